@@ -0,0 +1,1587 @@
+/**
+ * @file mds_bridged.c
+ * @brief Multi-device MDS gateway daemon
+ *
+ * Forwards diagnostic chunks from any number of MDS devices to the Memfault
+ * cloud. Unlike mds_gateway, which polls a single device and uploads inline,
+ * the daemon splits the work into a pipeline:
+ *
+ * - The main thread runs one device manager per configured VID/PID filter
+ *   and sleeps in poll() until a hotplug event, a signal or the next metrics
+ *   write is due.
+ * - Each attached device gets a reader thread that moves stream packets into
+ *   the spool and acknowledges them to the device (stream resume).
+ * - The spool is a directory with one file per chunk, so data received but
+ *   not yet uploaded survives a daemon restart or a network outage. When it
+ *   reaches spool_max_mb, readers stop reading and devices with flow control
+ *   wait for credits instead of dropping data.
+ * - Uploader threads take chunks from the spool in order per device (chunks
+ *   of one device are never uploaded concurrently) and retry failed uploads
+ *   with exponential backoff. A chunks_scheduler picks the next device by
+ *   weighted round robin, so a device uploading a coredump cannot starve the
+ *   others, and enforces the optional per-device and global rate limits.
+ *   Heartbeats, traces and reboot events get a larger share than coredumps.
+ * - Optionally (dedup_messages), a chunks_dedup stage in front of the spool
+ *   drops messages a device streams again after a reset, remembering recent
+ *   message hashes per device in "<state_dir>/dedup.db". Chunks it holds as
+ *   possible duplicates are acknowledged only once spooled or dropped.
+ *
+ * Signals:
+ *   SIGINT, SIGTERM  Shut down (the spool is kept for the next start)
+ *   SIGHUP           Reload the configuration file
+ *
+ * Usage:
+ *   ./mds_bridged -c <config file>
+ *
+ * See mds_bridged.conf for the configuration format.
+ */
+
+#include "mds_bridge/mds_protocol.h"
+#include "mds_bridge/mds_device_manager.h"
+#include "mds_bridge/chunks_uploader.h"
+#include "mds_bridge/chunks_scheduler.h"
+#include "mds_bridge/chunks_dedup.h"
+#include "mds_bridge/memfault_hid.h"
+#include "mds_bridge/mds_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <poll.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define MAX_DEVICE_FILTERS      16
+#define MAX_UPLOAD_THREADS      8
+#define MAX_PATH_LEN            512
+
+#define READ_TIMEOUT_MS         200     /* Reader wake-up interval (stop checks) */
+#define RESUME_SYNC_INTERVAL_MS 1000    /* Resume offset persistence interval */
+#define RETRY_MIN_MS            1000    /* First upload retry delay */
+#define RETRY_MAX_MS            60000   /* Upload retry delay cap */
+#define SHUTDOWN_DEADLINE_MS    2000    /* Per-device drain budget on detach/exit */
+
+/* ============================================================================
+ * Configuration
+ * ========================================================================== */
+
+typedef struct {
+    uint16_t vendor_id;
+    uint16_t product_id;
+    uint16_t usage_page;
+} device_filter_t;
+
+typedef struct {
+    device_filter_t filters[MAX_DEVICE_FILTERS];
+    size_t filter_count;
+    char spool_dir[MAX_PATH_LEN];
+    char state_dir[MAX_PATH_LEN];
+    char metrics_file[MAX_PATH_LEN];    /* Empty: log a summary instead */
+    int metrics_interval_s;
+    int upload_threads;
+    long upload_timeout_ms;
+    uint64_t spool_max_bytes;
+    uint64_t upload_rate;               /* Bytes per second, all devices (0: unlimited) */
+    uint64_t device_upload_rate;        /* Bytes per second, each device (0: unlimited) */
+    size_t dedup_messages;              /* Remembered messages per device (0: no dedup) */
+    uint32_t dedup_max_age_s;
+    mds_log_level_t log_level;
+    bool dry_run;
+} bridged_config_t;
+
+static bridged_config_t g_config;
+static pthread_mutex_t g_config_lock = PTHREAD_MUTEX_INITIALIZER;  /* Fields read by uploaders */
+
+static volatile sig_atomic_t g_stop = 0;
+static volatile sig_atomic_t g_reload = 0;
+
+static void signal_handler(int signum) {
+    if (signum == SIGHUP) {
+        g_reload = 1;
+    } else {
+        g_stop = 1;
+    }
+}
+
+/* ============================================================================
+ * Logging
+ * ========================================================================== */
+
+static void log_msg(mds_log_level_t level, const char *fmt, ...) {
+    if (level == MDS_LOG_OFF || level > mds_log_get_level()) {
+        return;
+    }
+
+    char message[512];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(message, sizeof(message), fmt, args);
+    va_end(args);
+
+    char timestamp[32];
+    time_t now = time(NULL);
+    struct tm tm_info;
+    localtime_r(&now, &tm_info);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &tm_info);
+
+    fprintf(stderr, "%s %s: %s\n", timestamp, mds_log_level_name(level), message);
+}
+
+/* Library diagnostics go through the same sink */
+static void library_log_handler(mds_log_level_t level, mds_log_subsystem_t subsystem,
+                                const char *message, void *user_data) {
+    (void)user_data;
+    log_msg(level, "%s: %s", mds_log_subsystem_name(subsystem), message);
+}
+
+/* ============================================================================
+ * Configuration File
+ * ========================================================================== */
+
+static void config_set_defaults(bridged_config_t *config) {
+    memset(config, 0, sizeof(*config));
+    snprintf(config->spool_dir, sizeof(config->spool_dir), "/var/spool/mds_bridged");
+    snprintf(config->state_dir, sizeof(config->state_dir), "/var/lib/mds_bridged");
+    config->metrics_interval_s = 15;
+    config->upload_threads = 2;
+    config->upload_timeout_ms = 30000;
+    config->spool_max_bytes = 64ull * 1024 * 1024;
+    config->dedup_max_age_s = 3600;
+    config->log_level = MDS_LOG_INFO;
+    config->dry_run = false;
+}
+
+static char *trim(char *s) {
+    while (*s == ' ' || *s == '\t') {
+        s++;
+    }
+
+    size_t len = strlen(s);
+    while (len > 0 && (s[len - 1] == ' ' || s[len - 1] == '\t' ||
+                       s[len - 1] == '\r' || s[len - 1] == '\n')) {
+        s[--len] = '\0';
+    }
+    return s;
+}
+
+static bool parse_long(const char *value, long min, long max, long *out) {
+    char *end;
+    errno = 0;
+    long v = strtol(value, &end, 10);
+    if (errno != 0 || end == value || *end != '\0' || v < min || v > max) {
+        return false;
+    }
+    *out = v;
+    return true;
+}
+
+static bool parse_path(const char *value, char *out, size_t len) {
+    size_t value_len = strlen(value);
+    if (value_len >= len) {
+        return false;
+    }
+    memcpy(out, value, value_len + 1);
+    return true;
+}
+
+static bool config_set(bridged_config_t *config, const char *key, const char *value) {
+    long v;
+
+    if (strcmp(key, "device") == 0) {
+        unsigned int vid, pid, usage_page = 0;
+        int n = sscanf(value, "%x:%x:%x", &vid, &pid, &usage_page);
+        if (n < 2 || vid > 0xFFFF || pid > 0xFFFF || usage_page > 0xFFFF ||
+            config->filter_count >= MAX_DEVICE_FILTERS) {
+            return false;
+        }
+        device_filter_t *filter = &config->filters[config->filter_count++];
+        filter->vendor_id = (uint16_t)vid;
+        filter->product_id = (uint16_t)pid;
+        filter->usage_page = (uint16_t)usage_page;
+        return true;
+    } else if (strcmp(key, "spool_dir") == 0) {
+        return parse_path(value, config->spool_dir, sizeof(config->spool_dir));
+    } else if (strcmp(key, "state_dir") == 0) {
+        return parse_path(value, config->state_dir, sizeof(config->state_dir));
+    } else if (strcmp(key, "metrics_file") == 0) {
+        return parse_path(value, config->metrics_file, sizeof(config->metrics_file));
+    } else if (strcmp(key, "metrics_interval") == 0) {
+        if (!parse_long(value, 1, 3600, &v)) {
+            return false;
+        }
+        config->metrics_interval_s = (int)v;
+        return true;
+    } else if (strcmp(key, "upload_threads") == 0) {
+        if (!parse_long(value, 1, MAX_UPLOAD_THREADS, &v)) {
+            return false;
+        }
+        config->upload_threads = (int)v;
+        return true;
+    } else if (strcmp(key, "upload_timeout_ms") == 0) {
+        return parse_long(value, 100, 600000, &config->upload_timeout_ms);
+    } else if (strcmp(key, "spool_max_mb") == 0) {
+        if (!parse_long(value, 1, 1024 * 1024, &v)) {
+            return false;
+        }
+        config->spool_max_bytes = (uint64_t)v * 1024 * 1024;
+        return true;
+    } else if (strcmp(key, "upload_rate_kb") == 0) {
+        if (!parse_long(value, 0, 1024 * 1024, &v)) {
+            return false;
+        }
+        config->upload_rate = (uint64_t)v * 1024;
+        return true;
+    } else if (strcmp(key, "device_upload_rate_kb") == 0) {
+        if (!parse_long(value, 0, 1024 * 1024, &v)) {
+            return false;
+        }
+        config->device_upload_rate = (uint64_t)v * 1024;
+        return true;
+    } else if (strcmp(key, "dedup_messages") == 0) {
+        if (!parse_long(value, 0, 4096, &v)) {
+            return false;
+        }
+        config->dedup_messages = (size_t)v;
+        return true;
+    } else if (strcmp(key, "dedup_max_age") == 0) {
+        if (!parse_long(value, 0, 30L * 24 * 3600, &v)) {
+            return false;
+        }
+        config->dedup_max_age_s = (uint32_t)v;
+        return true;
+    } else if (strcmp(key, "log_level") == 0) {
+        for (int level = MDS_LOG_OFF; level <= MDS_LOG_DEBUG; level++) {
+            if (strcmp(value, mds_log_level_name((mds_log_level_t)level)) == 0) {
+                config->log_level = (mds_log_level_t)level;
+                return true;
+            }
+        }
+        return false;
+    } else if (strcmp(key, "dry_run") == 0) {
+        if (strcmp(value, "true") == 0 || strcmp(value, "yes") == 0 || strcmp(value, "1") == 0) {
+            config->dry_run = true;
+        } else if (strcmp(value, "false") == 0 || strcmp(value, "no") == 0 ||
+                   strcmp(value, "0") == 0) {
+            config->dry_run = false;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    return false;
+}
+
+/* Parse "key = value" lines ('#' starts a comment); 0 on success */
+static int config_load(const char *path, bridged_config_t *config) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        log_msg(MDS_LOG_ERROR, "Cannot open %s: %s", path, strerror(errno));
+        return -errno;
+    }
+
+    config_set_defaults(config);
+
+    char line[1024];
+    int lineno = 0;
+    int ret = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        lineno++;
+
+        char *comment = strchr(line, '#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+
+        char *key = trim(line);
+        if (*key == '\0') {
+            continue;
+        }
+
+        char *eq = strchr(key, '=');
+        if (eq == NULL) {
+            log_msg(MDS_LOG_ERROR, "%s:%d: expected 'key = value'", path, lineno);
+            ret = -EINVAL;
+            break;
+        }
+        *eq = '\0';
+        key = trim(key);
+        char *value = trim(eq + 1);
+
+        if (!config_set(config, key, value)) {
+            log_msg(MDS_LOG_ERROR, "%s:%d: invalid setting '%s = %s'", path, lineno, key, value);
+            ret = -EINVAL;
+            break;
+        }
+    }
+    fclose(f);
+
+    if (ret == 0 && config->filter_count == 0) {
+        log_msg(MDS_LOG_ERROR, "%s: no 'device' configured", path);
+        ret = -EINVAL;
+    }
+    return ret;
+}
+
+/* ============================================================================
+ * Metrics
+ * ========================================================================== */
+
+typedef struct {
+    uint64_t devices_attached;
+    uint64_t packets_received;
+    uint64_t bytes_received;
+    uint64_t chunks_spooled;
+    uint64_t spool_errors;
+    uint64_t chunks_uploaded;
+    uint64_t bytes_uploaded;
+    uint64_t upload_failures;
+    uint64_t chunks_discarded;
+    uint64_t reloads;
+    uint64_t dedup_save_errors;
+    uint64_t class_chunks_uploaded[MDS_CHUNK_CLASS_COUNT];
+    uint64_t class_bytes_uploaded[MDS_CHUNK_CLASS_COUNT];
+} bridged_metrics_t;
+
+static bridged_metrics_t g_metrics;
+
+#define METRIC_ADD(name, n) __atomic_fetch_add(&g_metrics.name, (uint64_t)(n), __ATOMIC_RELAXED)
+#define METRIC_GET(name) __atomic_load_n(&g_metrics.name, __ATOMIC_RELAXED)
+
+/* ============================================================================
+ * Spool
+ *
+ * File format ("<spool_dir>/<id as 16 hex digits>.chunk"):
+ * Byte 0-3:  Magic "MDSC"
+ * Byte 4:    Format version (1)
+ * Byte 5-7:  Device identifier, URI and authorization lengths
+ * Byte 8-9:  Chunk data length (little-endian)
+ * Byte 10:   Chunk class (mds_chunk_class_t; not present in version 1)
+ * Byte 11-:  Device identifier, URI, authorization, chunk data
+ * ========================================================================== */
+
+#define SPOOL_MAGIC         "MDSC"
+#define SPOOL_VERSION       2
+#define SPOOL_HEADER_LEN    11
+#define SPOOL_V1_HEADER_LEN 10
+
+typedef struct {
+    char device_id[MDS_MAX_DEVICE_ID_LEN];
+    char uri[MDS_MAX_URI_LEN];
+    char auth[MDS_MAX_AUTH_LEN];
+    uint8_t data[MDS_MAX_STREAM_DATA_LEN];
+    size_t data_len;
+    mds_chunk_class_t chunk_class;
+} spool_record_t;
+
+typedef struct {
+    uint64_t id;
+    char device_id[MDS_MAX_DEVICE_ID_LEN];  /* Uploads are ordered per device */
+    size_t data_len;                    /* Chunk size (charged to the rate limits) */
+    size_t size;                        /* File size */
+    mds_chunk_class_t chunk_class;
+} spool_entry_t;
+
+typedef struct {
+    char dir[MAX_PATH_LEN];
+    pthread_mutex_t lock;
+    pthread_cond_t changed;             /* Entries added/completed, limit or stop changed */
+    chunks_scheduler_t *scheduler;      /* Queued entries, per device */
+    size_t count;                       /* Queued and in-flight chunks */
+    uint64_t bytes;                     /* Queued and in-flight bytes */
+    uint64_t max_bytes;
+    uint64_t next_id;
+    bool stopping;
+} spool_t;
+
+static spool_t g_spool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static void spool_path(const spool_t *spool, uint64_t id, const char *suffix,
+                       char *path, size_t len) {
+    snprintf(path, len, "%s/%016llx%s", spool->dir, (unsigned long long)id, suffix);
+}
+
+/* Deadline for pthread_cond_timedwait() on spool->changed */
+static void timespec_after_ms(struct timespec *ts, int ms) {
+#ifdef __APPLE__
+    clock_gettime(CLOCK_REALTIME, ts);  /* No pthread_condattr_setclock() */
+#else
+    clock_gettime(CLOCK_MONOTONIC, ts);
+#endif
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+/* Read and validate a spooled chunk */
+static int spool_read(const spool_t *spool, uint64_t id, spool_record_t *record) {
+    char path[MAX_PATH_LEN + 32];
+    spool_path(spool, id, ".chunk", path, sizeof(path));
+
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return -errno;
+    }
+
+    uint8_t header[SPOOL_HEADER_LEN];
+    int ret = -EINVAL;
+    if (fread(header, 1, SPOOL_V1_HEADER_LEN, f) == SPOOL_V1_HEADER_LEN &&
+        memcmp(header, SPOOL_MAGIC, 4) == 0 &&
+        (header[4] == 1 || (header[4] == SPOOL_VERSION &&
+                            fread(&header[SPOOL_V1_HEADER_LEN], 1, 1, f) == 1))) {
+        record->chunk_class = MDS_CHUNK_CLASS_UNKNOWN;
+        if (header[4] == SPOOL_VERSION && header[10] < MDS_CHUNK_CLASS_COUNT) {
+            record->chunk_class = (mds_chunk_class_t)header[10];
+        }
+
+        size_t id_len = header[5];
+        size_t uri_len = header[6];
+        size_t auth_len = header[7];
+        size_t data_len = (size_t)header[8] | ((size_t)header[9] << 8);
+
+        if (id_len < sizeof(record->device_id) && uri_len < sizeof(record->uri) &&
+            auth_len < sizeof(record->auth) && data_len <= sizeof(record->data) &&
+            fread(record->device_id, 1, id_len, f) == id_len &&
+            fread(record->uri, 1, uri_len, f) == uri_len &&
+            fread(record->auth, 1, auth_len, f) == auth_len &&
+            fread(record->data, 1, data_len, f) == data_len) {
+            record->device_id[id_len] = '\0';
+            record->uri[uri_len] = '\0';
+            record->auth[auth_len] = '\0';
+            record->data_len = data_len;
+            ret = 0;
+        }
+    }
+
+    fclose(f);
+    return ret;
+}
+
+/* Write a chunk durably (temp file, fsync, rename); returns the file size */
+static int spool_write(const spool_t *spool, uint64_t id, const spool_record_t *record,
+                       size_t *size) {
+    size_t id_len = strlen(record->device_id);
+    size_t uri_len = strlen(record->uri);
+    size_t auth_len = strlen(record->auth);
+
+    uint8_t header[SPOOL_HEADER_LEN];
+    memcpy(header, SPOOL_MAGIC, 4);
+    header[4] = SPOOL_VERSION;
+    header[5] = (uint8_t)id_len;
+    header[6] = (uint8_t)uri_len;
+    header[7] = (uint8_t)auth_len;
+    header[8] = (uint8_t)(record->data_len & 0xFF);
+    header[9] = (uint8_t)(record->data_len >> 8);
+    header[10] = (uint8_t)record->chunk_class;
+
+    char tmp_path[MAX_PATH_LEN + 32];
+    char path[MAX_PATH_LEN + 32];
+    spool_path(spool, id, ".tmp", tmp_path, sizeof(tmp_path));
+    spool_path(spool, id, ".chunk", path, sizeof(path));
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0640);
+    if (fd < 0) {
+        return -errno;
+    }
+
+    FILE *f = fdopen(fd, "wb");
+    if (f == NULL) {
+        int err = -errno;
+        close(fd);
+        unlink(tmp_path);
+        return err;
+    }
+
+    bool ok = fwrite(header, 1, sizeof(header), f) == sizeof(header) &&
+              fwrite(record->device_id, 1, id_len, f) == id_len &&
+              fwrite(record->uri, 1, uri_len, f) == uri_len &&
+              fwrite(record->auth, 1, auth_len, f) == auth_len &&
+              fwrite(record->data, 1, record->data_len, f) == record->data_len &&
+              fflush(f) == 0 && fsync(fd) == 0;
+    int err = ok ? 0 : -errno;
+    if (fclose(f) != 0 && ok) {
+        ok = false;
+        err = -errno;
+    }
+
+    if (!ok || rename(tmp_path, path) != 0) {
+        if (ok) {
+            err = -errno;
+        }
+        unlink(tmp_path);
+        return err != 0 ? err : -EIO;
+    }
+
+    *size = sizeof(header) + id_len + uri_len + auth_len + record->data_len;
+    return 0;
+}
+
+static int spool_enqueue_locked(spool_t *spool, spool_entry_t *entry) {
+    int ret = chunks_scheduler_enqueue(spool->scheduler, entry->device_id,
+                                       chunks_scheduler_priority(entry->chunk_class),
+                                       entry->data_len, entry);
+    if (ret == 0) {
+        spool->count++;
+        spool->bytes += entry->size;
+    }
+    return ret;
+}
+
+static int compare_entries(const void *a, const void *b) {
+    const spool_entry_t *ea = *(spool_entry_t *const *)a;
+    const spool_entry_t *eb = *(spool_entry_t *const *)b;
+    return ea->id < eb->id ? -1 : (ea->id > eb->id ? 1 : 0);
+}
+
+/* Pick up chunks left by a previous run (oldest first) */
+static int spool_open(spool_t *spool, const char *dir, uint64_t max_bytes) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+#ifndef __APPLE__
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+#endif
+    pthread_cond_init(&spool->changed, &attr);
+    pthread_condattr_destroy(&attr);
+
+    snprintf(spool->dir, sizeof(spool->dir), "%s", dir);
+    spool->max_bytes = max_bytes;
+
+    spool->scheduler = chunks_scheduler_create(NULL);
+    if (spool->scheduler == NULL) {
+        return -ENOMEM;
+    }
+
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        int err = -errno;
+        chunks_scheduler_destroy(spool->scheduler, NULL);
+        spool->scheduler = NULL;
+        return err;
+    }
+
+    spool_entry_t **entries = NULL;
+    size_t count = 0, capacity = 0;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        char *end;
+        unsigned long long id = strtoull(de->d_name, &end, 16);
+        if (end == de->d_name) {
+            continue;
+        }
+
+        if (strcmp(end, ".tmp") == 0) {
+            char path[MAX_PATH_LEN + 32];
+            spool_path(spool, id, ".tmp", path, sizeof(path));
+            unlink(path);  /* Interrupted write, never acknowledged */
+            continue;
+        }
+        if (strcmp(end, ".chunk") != 0) {
+            continue;
+        }
+
+        spool_record_t record;
+        if (spool_read(spool, id, &record) < 0) {
+            char path[MAX_PATH_LEN + 32];
+            spool_path(spool, id, ".chunk", path, sizeof(path));
+            log_msg(MDS_LOG_WARN, "Discarding unreadable spool file %s", path);
+            unlink(path);
+            METRIC_ADD(chunks_discarded, 1);
+            continue;
+        }
+
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            spool_entry_t **grown = realloc(entries, capacity * sizeof(*entries));
+            if (grown == NULL) {
+                break;
+            }
+            entries = grown;
+        }
+
+        spool_entry_t *entry = calloc(1, sizeof(*entry));
+        if (entry == NULL) {
+            break;
+        }
+        entry->id = id;
+        snprintf(entry->device_id, sizeof(entry->device_id), "%s", record.device_id);
+        entry->data_len = record.data_len;
+        entry->chunk_class = record.chunk_class;
+        entry->size = SPOOL_HEADER_LEN + strlen(record.device_id) + strlen(record.uri) +
+                      strlen(record.auth) + record.data_len;
+        entries[count++] = entry;
+    }
+    closedir(d);
+
+    if (count > 0) {
+        qsort(entries, count, sizeof(*entries), compare_entries);
+    }
+    size_t queued = 0;
+    for (size_t i = 0; i < count; i++) {
+        spool->next_id = entries[i]->id + 1;
+        if (spool_enqueue_locked(spool, entries[i]) < 0) {
+            free(entries[i]);  /* Stays on disk for the next start */
+            continue;
+        }
+        queued++;
+    }
+    free(entries);
+
+    return (int)queued;
+}
+
+/* Wait until the spool has room; false on timeout or shutdown */
+static bool spool_wait_space(spool_t *spool, int timeout_ms) {
+    struct timespec deadline;
+    timespec_after_ms(&deadline, timeout_ms);
+
+    pthread_mutex_lock(&spool->lock);
+    while (!spool->stopping && spool->bytes >= spool->max_bytes) {
+        if (pthread_cond_timedwait(&spool->changed, &spool->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    bool has_space = !spool->stopping && spool->bytes < spool->max_bytes;
+    pthread_mutex_unlock(&spool->lock);
+    return has_space;
+}
+
+static int spool_append(spool_t *spool, const spool_record_t *record) {
+    spool_entry_t *entry = calloc(1, sizeof(*entry));
+    if (entry == NULL) {
+        return -ENOMEM;
+    }
+
+    pthread_mutex_lock(&spool->lock);
+    entry->id = spool->next_id++;
+    pthread_mutex_unlock(&spool->lock);
+
+    int ret = spool_write(spool, entry->id, record, &entry->size);
+    if (ret < 0) {
+        free(entry);
+        return ret;
+    }
+    snprintf(entry->device_id, sizeof(entry->device_id), "%s", record->device_id);
+    entry->data_len = record->data_len;
+    entry->chunk_class = record->chunk_class;
+
+    pthread_mutex_lock(&spool->lock);
+    ret = spool_enqueue_locked(spool, entry);
+    pthread_cond_broadcast(&spool->changed);
+    pthread_mutex_unlock(&spool->lock);
+
+    if (ret < 0) {
+        char path[MAX_PATH_LEN + 32];
+        spool_path(spool, entry->id, ".chunk", path, sizeof(path));
+        unlink(path);
+        free(entry);
+    }
+    return ret;
+}
+
+/*
+ * Take the next chunk chosen by the scheduler (the oldest chunk of a device
+ * no other uploader is working on); NULL on shutdown
+ */
+static spool_entry_t *spool_take(spool_t *spool) {
+    pthread_mutex_lock(&spool->lock);
+    for (;;) {
+        if (spool->stopping) {
+            pthread_mutex_unlock(&spool->lock);
+            return NULL;
+        }
+
+        void *entry = NULL;
+        int wait_ms = 0;
+        int ret = chunks_scheduler_dequeue(spool->scheduler, &entry, &wait_ms);
+        if (ret == 0) {
+            pthread_mutex_unlock(&spool->lock);
+            return (spool_entry_t *)entry;
+        }
+
+        if (ret == -EAGAIN) {
+            /* Rate limited: wake up when the tokens are back */
+            struct timespec deadline;
+            timespec_after_ms(&deadline, wait_ms);
+            pthread_cond_timedwait(&spool->changed, &spool->lock, &deadline);
+        } else {
+            pthread_cond_wait(&spool->changed, &spool->lock);
+        }
+    }
+}
+
+/* Finish a taken chunk: delete it, or put it back at the front for a retry */
+static void spool_complete(spool_t *spool, spool_entry_t *entry, bool done) {
+    if (done) {
+        char path[MAX_PATH_LEN + 32];
+        spool_path(spool, entry->id, ".chunk", path, sizeof(path));
+        unlink(path);
+    }
+
+    pthread_mutex_lock(&spool->lock);
+    chunks_scheduler_complete(spool->scheduler, entry, !done);
+    if (done) {
+        spool->count--;
+        spool->bytes -= entry->size;
+        free(entry);
+    }
+    pthread_cond_broadcast(&spool->changed);
+    pthread_mutex_unlock(&spool->lock);
+}
+
+/* Sleep for a retry backoff; false if the spool is shutting down */
+static bool spool_sleep(spool_t *spool, int ms) {
+    struct timespec deadline;
+    timespec_after_ms(&deadline, ms);
+
+    pthread_mutex_lock(&spool->lock);
+    int rc = 0;
+    while (!spool->stopping && rc != ETIMEDOUT) {
+        rc = pthread_cond_timedwait(&spool->changed, &spool->lock, &deadline);
+    }
+    bool running = !spool->stopping;
+    pthread_mutex_unlock(&spool->lock);
+    return running;
+}
+
+/* Apply the spool size and upload rate limits */
+static void spool_set_limits(spool_t *spool, const bridged_config_t *config) {
+    chunks_scheduler_config_t sched_config;
+    chunks_scheduler_default_config(&sched_config);
+    sched_config.global_limit.rate_bytes_per_sec = config->upload_rate;
+    sched_config.device_limit.rate_bytes_per_sec = config->device_upload_rate;
+
+    pthread_mutex_lock(&spool->lock);
+    spool->max_bytes = config->spool_max_bytes;
+    chunks_scheduler_set_config(spool->scheduler, &sched_config);
+    pthread_cond_broadcast(&spool->changed);
+    pthread_mutex_unlock(&spool->lock);
+}
+
+static void spool_stop(spool_t *spool) {
+    pthread_mutex_lock(&spool->lock);
+    spool->stopping = true;
+    pthread_cond_broadcast(&spool->changed);
+    pthread_mutex_unlock(&spool->lock);
+}
+
+/* Free the in-memory index (files stay on disk for the next run) */
+static void spool_close(spool_t *spool) {
+    chunks_scheduler_destroy(spool->scheduler, free);
+    spool->scheduler = NULL;
+}
+
+/* ============================================================================
+ * Uploader Threads
+ * ========================================================================== */
+
+typedef struct {
+    pthread_t thread;
+    chunks_uploader_t *uploader;
+} upload_worker_t;
+
+static upload_worker_t g_workers[MAX_UPLOAD_THREADS];
+static int g_worker_count = 0;
+
+static void *upload_thread(void *arg) {
+    upload_worker_t *worker = (upload_worker_t *)arg;
+    int retry_ms = 0;
+    spool_entry_t *entry;
+    spool_record_t record;
+
+    while ((entry = spool_take(&g_spool)) != NULL) {
+        if (spool_read(&g_spool, entry->id, &record) < 0) {
+            log_msg(MDS_LOG_WARN, "Discarding unreadable spooled chunk %016llx",
+                    (unsigned long long)entry->id);
+            METRIC_ADD(chunks_discarded, 1);
+            spool_complete(&g_spool, entry, true);
+            continue;
+        }
+
+        pthread_mutex_lock(&g_config_lock);
+        bool dry_run = g_config.dry_run;
+        long timeout_ms = g_config.upload_timeout_ms;
+        pthread_mutex_unlock(&g_config_lock);
+
+        int ret = 0;
+        if (dry_run) {
+            log_msg(MDS_LOG_INFO, "[dry run] %s: %zu byte %s chunk to %s",
+                    record.device_id, record.data_len,
+                    mds_chunk_class_name(record.chunk_class), record.uri);
+        } else {
+            chunks_uploader_set_timeout(worker->uploader, timeout_ms);
+            ret = chunks_uploader_callback(record.uri, record.auth, record.data,
+                                           record.data_len, worker->uploader);
+        }
+
+        if (ret == 0) {
+            METRIC_ADD(chunks_uploaded, 1);
+            METRIC_ADD(bytes_uploaded, record.data_len);
+            METRIC_ADD(class_chunks_uploaded[record.chunk_class], 1);
+            METRIC_ADD(class_bytes_uploaded[record.chunk_class], record.data_len);
+            spool_complete(&g_spool, entry, true);
+            retry_ms = 0;
+            continue;
+        }
+
+        /* Keep the chunk (and everything after it from this device) spooled */
+        METRIC_ADD(upload_failures, 1);
+        spool_complete(&g_spool, entry, false);
+        retry_ms = retry_ms == 0 ? RETRY_MIN_MS :
+                   (retry_ms * 2 > RETRY_MAX_MS ? RETRY_MAX_MS : retry_ms * 2);
+        log_msg(MDS_LOG_WARN, "Upload for %s failed (%d), retrying in %d ms",
+                record.device_id, ret, retry_ms);
+        if (!spool_sleep(&g_spool, retry_ms)) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+/* ============================================================================
+ * Devices
+ * ========================================================================== */
+
+typedef struct device {
+    struct device *next;
+    mds_session_t *session;
+    char path[MAX_PATH_LEN];
+    mds_device_config_t config;
+    pthread_t thread;
+    int running;                        /* Atomic: reader keeps going */
+
+    /* Stream resume state, owned by the reader thread */
+    char resume_path[MAX_PATH_LEN + 64];  /* Empty: device cannot resume */
+    uint32_t resume_saved;
+
+    /* Metrics snapshot, guarded by g_devices_lock */
+    mds_session_stats_t stats;
+    uint64_t bytes_received;
+} device_t;
+
+static device_t *g_devices = NULL;
+static pthread_mutex_t g_devices_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static mds_device_manager_t *g_managers[MAX_DEVICE_FILTERS];
+static size_t g_manager_count = 0;
+
+static chunks_dedup_t *g_dedup = NULL;     /* NULL: deduplication disabled */
+
+static void sleep_ms(int ms) {
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+static int64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Worker threads leave signal handling to the main thread (so poll() wakes up) */
+static int start_thread(pthread_t *thread, void *(*fn)(void *), void *arg) {
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int ret = pthread_create(thread, NULL, fn, arg);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return -ret;
+}
+
+/* Resume state file: "<state_dir>/<device id>.resume" (file-name safe) */
+static void resume_state_path(const char *state_dir, const char *device_id,
+                              char *path, size_t len) {
+    int n = snprintf(path, len, "%s/", state_dir);
+    if (n < 0 || (size_t)n >= len) {
+        path[0] = '\0';
+        return;
+    }
+
+    size_t pos = (size_t)n;
+    for (const char *c = device_id; *c != '\0' && pos + 8 < len; c++) {
+        bool safe = (*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') ||
+                    (*c >= '0' && *c <= '9') || *c == '-' || *c == '_' || *c == '.';
+        path[pos++] = safe ? *c : '_';
+    }
+    snprintf(&path[pos], len - pos, ".resume");
+}
+
+static uint32_t resume_state_load(const char *path) {
+    unsigned long offset = 0;
+    FILE *f = fopen(path, "r");
+    if (f != NULL) {
+        if (fscanf(f, "%lu", &offset) != 1) {
+            offset = 0;
+        }
+        fclose(f);
+    }
+    return (uint32_t)offset;
+}
+
+static void resume_state_sync(device_t *dev) {
+    uint32_t offset;
+    if (dev->resume_path[0] == '\0' ||
+        mds_stream_get_resume_offset(dev->session, &offset) != 0 ||
+        offset == dev->resume_saved) {
+        return;
+    }
+
+    char tmp_path[sizeof(dev->resume_path) + 8];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", dev->resume_path);
+
+    FILE *f = fopen(tmp_path, "w");
+    bool ok = f != NULL && fprintf(f, "%lu\n", (unsigned long)offset) > 0;
+    if (f != NULL) {
+        ok = (fclose(f) == 0) && ok;
+    }
+    if (!ok || rename(tmp_path, dev->resume_path) != 0) {
+        unlink(tmp_path);
+        log_msg(MDS_LOG_WARN, "Failed to save resume offset for %s", dev->config.device_identifier);
+        return;
+    }
+    dev->resume_saved = offset;
+}
+
+/* Destination of a device's chunks: the spool, via the deduplicator if enabled */
+typedef struct {
+    device_t *dev;
+    spool_record_t *record;             /* Device, URI, authorization and class set */
+    bool retry;                         /* Retry spool errors while the reader runs */
+    bool ack;                           /* Acknowledge stream data once it is safe */
+    size_t unacked;                     /* Bytes received but not yet acknowledged */
+    int ret;                            /* First spool error */
+} spool_sink_t;
+
+static void spool_sink_forward(const char *device_id, const uint8_t *chunk, size_t len,
+                               void *user_data) {
+    spool_sink_t *sink = (spool_sink_t *)user_data;
+    (void)device_id;
+    if (sink->ret < 0) {
+        return;  /* Not acknowledged - the device resends from here */
+    }
+
+    if (chunk != sink->record->data) {
+        memcpy(sink->record->data, chunk, len);
+    }
+    sink->record->data_len = len;
+
+    int ret;
+    while ((ret = spool_append(&g_spool, sink->record)) < 0) {
+        METRIC_ADD(spool_errors, 1);
+        if (!sink->retry || !__atomic_load_n(&sink->dev->running, __ATOMIC_ACQUIRE)) {
+            sink->ret = ret;
+            return;
+        }
+        log_msg(MDS_LOG_ERROR, "Cannot spool chunk from %s: %s",
+                sink->record->device_id, strerror(-ret));
+        sleep_ms(1000);
+    }
+    METRIC_ADD(chunks_spooled, 1);
+
+    /* Forwarded chunks keep their stream order and length */
+    if (sink->ack) {
+        mds_stream_ack(sink->dev->session, len);
+        sink->unacked -= len;
+    }
+}
+
+/* Spool the chunk in sink->record; 0 once it is on disk, dropped as a
+ * duplicate or held by the deduplicator */
+static int spool_sink_write(spool_sink_t *sink) {
+    sink->ret = 0;
+    if (sink->ack) {
+        sink->unacked += sink->record->data_len;
+    }
+    if (g_dedup == NULL) {
+        spool_sink_forward(sink->record->device_id, sink->record->data,
+                           sink->record->data_len, sink);
+        return sink->ret;
+    }
+
+    chunks_dedup_process(g_dedup, sink->record->device_id, sink->record->data,
+                         sink->record->data_len, spool_sink_forward, sink);
+
+    /* What was neither forwarded nor is still held was dropped: acknowledge it */
+    size_t held = 0;
+    if (sink->ret == 0 && sink->ack &&
+        chunks_dedup_get_held_bytes(g_dedup, sink->record->device_id, &held) == 0 &&
+        sink->unacked > held) {
+        mds_stream_ack(sink->dev->session, sink->unacked - held);
+        sink->unacked = held;
+    }
+    return sink->ret;
+}
+
+static void *reader_thread(void *arg) {
+    device_t *dev = (device_t *)arg;
+    spool_record_t record;
+    spool_sink_t sink = { .dev = dev, .record = &record, .retry = true, .ack = true };
+    int64_t last_sync_ms = monotonic_ms();
+    int error_count = 0;
+
+    snprintf(record.device_id, sizeof(record.device_id), "%s", dev->config.device_identifier);
+    snprintf(record.uri, sizeof(record.uri), "%s", dev->config.data_uri);
+    snprintf(record.auth, sizeof(record.auth), "%s", dev->config.authorization);
+
+    while (__atomic_load_n(&dev->running, __ATOMIC_ACQUIRE)) {
+        /* A full spool stops reading; flow-controlled devices then wait for credit */
+        if (!spool_wait_space(&g_spool, READ_TIMEOUT_MS)) {
+            continue;
+        }
+
+        mds_stream_packet_t packet;
+        int ret = mds_stream_read_packet(dev->session, &packet, READ_TIMEOUT_MS);
+
+        if (ret == 0) {
+            error_count = 0;
+            METRIC_ADD(packets_received, 1);
+            METRIC_ADD(bytes_received, packet.data_len);
+
+            if (packet.data_len > 0) {
+                memcpy(record.data, packet.data, packet.data_len);
+                record.data_len = packet.data_len;
+                record.chunk_class = packet.chunk_class;
+
+                /* Acknowledged as it reaches the disk or is dropped as a
+                 * duplicate; held chunks wait (see chunks_dedup.h) */
+                if (spool_sink_write(&sink) < 0) {
+                    break;  /* Not acknowledged - the device resends it */
+                }
+            }
+
+            pthread_mutex_lock(&g_devices_lock);
+            mds_get_session_stats(dev->session, &dev->stats);
+            dev->bytes_received += packet.data_len;
+            pthread_mutex_unlock(&g_devices_lock);
+        } else if (ret != -ETIMEDOUT && ret != MEMFAULT_HID_ERROR_TIMEOUT) {
+            /* Usually a device going away - the manager detaches it shortly */
+            if (error_count++ == 0) {
+                log_msg(MDS_LOG_WARN, "Stream read from %s failed (%d)", dev->path, ret);
+            }
+            sleep_ms(100);
+        }
+
+        int64_t now = monotonic_ms();
+        if (now - last_sync_ms >= RESUME_SYNC_INTERVAL_MS) {
+            resume_state_sync(dev);
+            last_sync_ms = now;
+        }
+    }
+
+    resume_state_sync(dev);
+    return NULL;
+}
+
+/* Upload callback used while draining a device: spool instead of uploading */
+static int spool_chunk_callback(const char *uri, const char *auth_header,
+                                const uint8_t *chunk_data, size_t chunk_len,
+                                const mds_chunk_info_t *info, void *user_data) {
+    device_t *dev = (device_t *)user_data;
+    spool_record_t record;
+    spool_sink_t sink = { .dev = dev, .record = &record, .retry = false };
+
+    snprintf(record.device_id, sizeof(record.device_id), "%s", dev->config.device_identifier);
+    snprintf(record.uri, sizeof(record.uri), "%s", uri);
+    snprintf(record.auth, sizeof(record.auth), "%s", auth_header);
+    memcpy(record.data, chunk_data, chunk_len);
+    record.data_len = chunk_len;
+    record.chunk_class = info->chunk_class;
+
+    int ret = spool_sink_write(&sink);
+    if (ret < 0) {
+        return ret;
+    }
+    METRIC_ADD(packets_received, 1);
+    METRIC_ADD(bytes_received, chunk_len);
+    return 0;  /* Acknowledged by the session for stream resume */
+}
+
+/* Remembered message hashes: "<state_dir>/dedup.db" */
+static void dedup_save(void) {
+    if (g_dedup == NULL) {
+        return;
+    }
+
+    char path[MAX_PATH_LEN + 16];
+    snprintf(path, sizeof(path), "%s/dedup.db", g_config.state_dir);
+    int ret = chunks_dedup_save(g_dedup, path);
+    if (ret < 0) {
+        METRIC_ADD(dedup_save_errors, 1);
+        log_msg(MDS_LOG_WARN, "Cannot save %s: %s", path, strerror(-ret));
+    }
+}
+
+static int dedup_open(const bridged_config_t *config) {
+    chunks_dedup_config_t dedup_config;
+    chunks_dedup_default_config(&dedup_config);
+    dedup_config.max_messages = config->dedup_messages;
+    dedup_config.max_age_sec = config->dedup_max_age_s;
+
+    g_dedup = chunks_dedup_create(&dedup_config);
+    if (g_dedup == NULL) {
+        return -ENOMEM;
+    }
+
+    char path[MAX_PATH_LEN + 16];
+    snprintf(path, sizeof(path), "%s/dedup.db", config->state_dir);
+    int ret = chunks_dedup_load(g_dedup, path);
+    if (ret > 0) {
+        log_msg(MDS_LOG_INFO, "Loaded %d message hashes from %s", ret, path);
+    } else if (ret < 0 && ret != -ENOENT) {
+        log_msg(MDS_LOG_WARN, "Ignoring %s: %s", path, strerror(-ret));
+    }
+    return 0;
+}
+
+/* Configure a new device and start its reader */
+static void device_attach(const char *path, mds_session_t *session) {
+    device_t *dev = calloc(1, sizeof(*dev));
+    if (dev == NULL) {
+        log_msg(MDS_LOG_ERROR, "Out of memory attaching %s", path);
+        return;
+    }
+    dev->session = session;
+    snprintf(dev->path, sizeof(dev->path), "%s", path);
+
+    int ret = mds_read_device_config(session, &dev->config);
+    if (ret != 0) {
+        log_msg(MDS_LOG_ERROR, "Cannot read MDS configuration from %s (%d)", path, ret);
+        free(dev);
+        return;
+    }
+
+    /* Use every negotiated stream extension the device offers */
+    mds_stream_set_flow_control(session, MDS_CREDIT_DEFAULT_WINDOW);
+    mds_stream_set_large_reports(session, true);
+
+    resume_state_path(g_config.state_dir, dev->config.device_identifier,
+                      dev->resume_path, sizeof(dev->resume_path));
+    dev->resume_saved = resume_state_load(dev->resume_path);
+    if (mds_stream_set_resume_offset(session, dev->resume_saved) != 0) {
+        dev->resume_path[0] = '\0';
+    }
+
+    mds_reset_session_stats(session);
+    ret = mds_stream_enable(session);
+    if (ret != 0) {
+        log_msg(MDS_LOG_ERROR, "Cannot enable streaming on %s (%d)", path, ret);
+        free(dev);
+        return;
+    }
+
+    __atomic_store_n(&dev->running, 1, __ATOMIC_RELEASE);
+    ret = start_thread(&dev->thread, reader_thread, dev);
+    if (ret != 0) {
+        log_msg(MDS_LOG_ERROR, "Cannot start reader for %s (%d)", path, ret);
+        mds_stream_disable(session);
+        free(dev);
+        return;
+    }
+
+    pthread_mutex_lock(&g_devices_lock);
+    dev->next = g_devices;
+    g_devices = dev;
+    pthread_mutex_unlock(&g_devices_lock);
+
+    METRIC_ADD(devices_attached, 1);
+    log_msg(MDS_LOG_INFO, "Device %s attached (%s, features 0x%08X%s)",
+            dev->config.device_identifier, path, dev->config.supported_features,
+            dev->resume_path[0] ? ", resuming" : "");
+}
+
+/* Stop the reader before the manager destroys the session */
+static void device_detach(mds_session_t *session) {
+    pthread_mutex_lock(&g_devices_lock);
+    device_t **link = &g_devices;
+    while (*link != NULL && (*link)->session != session) {
+        link = &(*link)->next;
+    }
+    device_t *dev = *link;
+    if (dev != NULL) {
+        *link = dev->next;
+    }
+    pthread_mutex_unlock(&g_devices_lock);
+
+    if (dev == NULL) {
+        return;  /* Never set up */
+    }
+
+    __atomic_store_n(&dev->running, 0, __ATOMIC_RELEASE);
+    pthread_join(dev->thread, NULL);
+
+    /* Spool what the device already sent (fails fast if the device is gone) */
+    mds_shutdown_report_t report;
+    mds_set_upload_callback_ex(session, spool_chunk_callback, dev);
+    mds_session_shutdown(session, &dev->config, SHUTDOWN_DEADLINE_MS, &report);
+    resume_state_sync(dev);
+
+    /* Possible duplicates held in memory go to the spool (a resumed stream
+     * may continue the message) */
+    if (g_dedup != NULL) {
+        spool_record_t record;
+        spool_sink_t sink = { .dev = dev, .record = &record, .retry = false };
+        snprintf(record.device_id, sizeof(record.device_id), "%s", dev->config.device_identifier);
+        snprintf(record.uri, sizeof(record.uri), "%s", dev->config.data_uri);
+        snprintf(record.auth, sizeof(record.auth), "%s", dev->config.authorization);
+        record.chunk_class = MDS_CHUNK_CLASS_UNKNOWN;
+        chunks_dedup_flush(g_dedup, record.device_id, spool_sink_forward, &sink);
+    }
+    if (report.packets_drained > 0) {
+        log_msg(MDS_LOG_INFO, "Drained %u packets from %s (%u dropped)",
+                report.packets_drained, dev->config.device_identifier, report.packets_dropped);
+    }
+
+    log_msg(MDS_LOG_INFO, "Device %s detached (%s, %llu packets, %llu lost)",
+            dev->config.device_identifier, dev->path,
+            (unsigned long long)dev->stats.packets_received,
+            (unsigned long long)dev->stats.lost_packets);
+    free(dev);
+}
+
+static void device_event_callback(mds_device_manager_t *manager,
+                                  mds_device_event_t event,
+                                  const char *path,
+                                  mds_session_t *session,
+                                  void *user_data) {
+    (void)manager;
+    (void)user_data;
+
+    if (event == MDS_DEVICE_EVENT_ATTACHED) {
+        device_attach(path, session);
+    } else {
+        device_detach(session);
+    }
+}
+
+static void managers_start(const bridged_config_t *config) {
+    for (size_t i = 0; i < config->filter_count; i++) {
+        const device_filter_t *filter = &config->filters[i];
+        mds_device_manager_config_t manager_config = {
+            .vendor_id = filter->vendor_id,
+            .product_id = filter->product_id,
+            .usage_page = filter->usage_page,
+            .callback = device_event_callback,
+            .user_data = NULL,
+        };
+
+        mds_device_manager_t *manager = NULL;
+        int ret = mds_device_manager_create(&manager_config, &manager);
+        if (ret != 0) {
+            log_msg(MDS_LOG_ERROR, "Cannot watch devices %04X:%04X (%d)",
+                    filter->vendor_id, filter->product_id, ret);
+            continue;
+        }
+        g_managers[g_manager_count++] = manager;
+    }
+}
+
+static void managers_stop(void) {
+    for (size_t i = 0; i < g_manager_count; i++) {
+        mds_device_manager_destroy(g_managers[i]);  /* Detaches every device */
+    }
+    g_manager_count = 0;
+}
+
+/* ============================================================================
+ * Metrics Output
+ * ========================================================================== */
+
+static void write_counter(FILE *f, const char *name, const char *type, uint64_t value) {
+    fprintf(f, "# TYPE mds_bridged_%s %s\nmds_bridged_%s %llu\n",
+            name, type, name, (unsigned long long)value);
+}
+
+/* Prometheus text format, replaced atomically (node_exporter textfile collector) */
+static void metrics_write(const char *metrics_file) {
+    pthread_mutex_lock(&g_spool.lock);
+    size_t spool_count = g_spool.count;
+    uint64_t spool_bytes = g_spool.bytes;
+    pthread_mutex_unlock(&g_spool.lock);
+
+    chunks_scheduler_stats_t sched_stats;
+    memset(&sched_stats, 0, sizeof(sched_stats));
+    chunks_scheduler_get_stats(g_spool.scheduler, &sched_stats);
+
+    chunks_dedup_stats_t dedup_stats;
+    memset(&dedup_stats, 0, sizeof(dedup_stats));
+    if (g_dedup != NULL) {
+        chunks_dedup_get_stats(g_dedup, &dedup_stats);
+    }
+
+    pthread_mutex_lock(&g_devices_lock);
+    size_t device_count = 0;
+    for (device_t *dev = g_devices; dev != NULL; dev = dev->next) {
+        device_count++;
+    }
+    pthread_mutex_unlock(&g_devices_lock);
+
+    if (metrics_file[0] == '\0') {
+        log_msg(MDS_LOG_INFO, "devices=%zu packets=%llu spooled=%llu duplicates=%llu "
+                "uploaded=%llu failures=%llu throttled=%llu spool=%zu chunks/%llu bytes",
+                device_count, (unsigned long long)METRIC_GET(packets_received),
+                (unsigned long long)METRIC_GET(chunks_spooled),
+                (unsigned long long)dedup_stats.duplicate_chunks,
+                (unsigned long long)METRIC_GET(chunks_uploaded),
+                (unsigned long long)METRIC_GET(upload_failures),
+                (unsigned long long)sched_stats.throttled, spool_count, (unsigned long long)spool_bytes);
+        return;
+    }
+
+    char tmp_path[MAX_PATH_LEN + 8];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", metrics_file);
+    FILE *f = fopen(tmp_path, "w");
+    if (f == NULL) {
+        log_msg(MDS_LOG_WARN, "Cannot write metrics to %s: %s", tmp_path, strerror(errno));
+        return;
+    }
+
+    write_counter(f, "devices", "gauge", device_count);
+    write_counter(f, "devices_attached_total", "counter", METRIC_GET(devices_attached));
+    write_counter(f, "packets_received_total", "counter", METRIC_GET(packets_received));
+    write_counter(f, "bytes_received_total", "counter", METRIC_GET(bytes_received));
+    write_counter(f, "chunks_spooled_total", "counter", METRIC_GET(chunks_spooled));
+    write_counter(f, "spool_errors_total", "counter", METRIC_GET(spool_errors));
+    write_counter(f, "chunks_uploaded_total", "counter", METRIC_GET(chunks_uploaded));
+    write_counter(f, "bytes_uploaded_total", "counter", METRIC_GET(bytes_uploaded));
+    write_counter(f, "upload_failures_total", "counter", METRIC_GET(upload_failures));
+    write_counter(f, "chunks_discarded_total", "counter", METRIC_GET(chunks_discarded));
+    write_counter(f, "reloads_total", "counter", METRIC_GET(reloads));
+    write_counter(f, "spool_chunks", "gauge", spool_count);
+    write_counter(f, "spool_bytes", "gauge", spool_bytes);
+    write_counter(f, "upload_throttled_total", "counter", sched_stats.throttled);
+    write_counter(f, "upload_backlog_devices", "gauge", sched_stats.active_devices);
+    write_counter(f, "duplicate_messages_total", "counter", dedup_stats.duplicate_messages);
+    write_counter(f, "duplicate_chunks_total", "counter", dedup_stats.duplicate_chunks);
+    write_counter(f, "duplicate_bytes_total", "counter", dedup_stats.duplicate_bytes);
+    write_counter(f, "dedup_held_bytes", "gauge", dedup_stats.held_bytes);
+    write_counter(f, "dedup_save_errors_total", "counter", METRIC_GET(dedup_save_errors));
+
+    /* Uploads by kind of data */
+    fprintf(f, "# TYPE mds_bridged_class_chunks_uploaded_total counter\n");
+    fprintf(f, "# TYPE mds_bridged_class_bytes_uploaded_total counter\n");
+    for (int c = 0; c < MDS_CHUNK_CLASS_COUNT; c++) {
+        const char *name = mds_chunk_class_name((mds_chunk_class_t)c);
+        fprintf(f, "mds_bridged_class_chunks_uploaded_total{class=\"%s\"} %llu\n",
+                name, (unsigned long long)METRIC_GET(class_chunks_uploaded[c]));
+        fprintf(f, "mds_bridged_class_bytes_uploaded_total{class=\"%s\"} %llu\n",
+                name, (unsigned long long)METRIC_GET(class_bytes_uploaded[c]));
+    }
+
+    /* Per-device stream health */
+    fprintf(f, "# TYPE mds_bridged_device_packets_received_total counter\n");
+    fprintf(f, "# TYPE mds_bridged_device_lost_packets_total counter\n");
+    pthread_mutex_lock(&g_devices_lock);
+    for (device_t *dev = g_devices; dev != NULL; dev = dev->next) {
+        fprintf(f, "mds_bridged_device_packets_received_total{device=\"%s\"} %llu\n",
+                dev->config.device_identifier, (unsigned long long)dev->stats.packets_received);
+        fprintf(f, "mds_bridged_device_lost_packets_total{device=\"%s\"} %llu\n",
+                dev->config.device_identifier, (unsigned long long)dev->stats.lost_packets);
+    }
+    pthread_mutex_unlock(&g_devices_lock);
+
+    if (fclose(f) != 0 || rename(tmp_path, metrics_file) != 0) {
+        log_msg(MDS_LOG_WARN, "Cannot write metrics to %s: %s", metrics_file, strerror(errno));
+        unlink(tmp_path);
+    }
+}
+
+/* ============================================================================
+ * Main Loop
+ * ========================================================================== */
+
+static void reload_config(const char *config_path) {
+    bridged_config_t next;
+    if (config_load(config_path, &next) != 0) {
+        log_msg(MDS_LOG_ERROR, "Reload failed, keeping the current configuration");
+        return;
+    }
+
+    /* The spool, state files, worker pool and deduplicator are set up once */
+    if (strcmp(next.spool_dir, g_config.spool_dir) != 0 ||
+        strcmp(next.state_dir, g_config.state_dir) != 0 ||
+        next.upload_threads != g_config.upload_threads ||
+        next.dedup_messages != g_config.dedup_messages ||
+        next.dedup_max_age_s != g_config.dedup_max_age_s) {
+        log_msg(MDS_LOG_WARN, "spool_dir, state_dir, upload_threads and dedup_* changes "
+                "need a restart");
+        memcpy(next.spool_dir, g_config.spool_dir, sizeof(next.spool_dir));
+        memcpy(next.state_dir, g_config.state_dir, sizeof(next.state_dir));
+        next.upload_threads = g_config.upload_threads;
+        next.dedup_messages = g_config.dedup_messages;
+        next.dedup_max_age_s = g_config.dedup_max_age_s;
+    }
+
+    bool filters_changed = next.filter_count != g_config.filter_count ||
+                           memcmp(next.filters, g_config.filters,
+                                  next.filter_count * sizeof(next.filters[0])) != 0;
+
+    pthread_mutex_lock(&g_config_lock);
+    g_config = next;
+    pthread_mutex_unlock(&g_config_lock);
+
+    mds_log_set_level(next.log_level);
+    spool_set_limits(&g_spool, &next);
+
+    if (filters_changed) {
+        log_msg(MDS_LOG_INFO, "Device filters changed, reattaching devices");
+        managers_stop();
+        managers_start(&g_config);
+    }
+
+    METRIC_ADD(reloads, 1);
+    log_msg(MDS_LOG_INFO, "Configuration reloaded");
+}
+
+static int ensure_dir(const char *dir) {
+    if (mkdir(dir, 0750) != 0 && errno != EEXIST) {
+        log_msg(MDS_LOG_ERROR, "Cannot create %s: %s", dir, strerror(errno));
+        return -errno;
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s -c <config file>\n", prog);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Signals:\n");
+    fprintf(stderr, "  SIGHUP           Reload the configuration file\n");
+    fprintf(stderr, "  SIGINT, SIGTERM  Shut down (spooled chunks are kept)\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *config_path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:h")) != -1) {
+        if (opt == 'c') {
+            config_path = optarg;
+        } else {
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (config_path == NULL) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (config_load(config_path, &g_config) != 0) {
+        return 1;
+    }
+    mds_log_set_handler(library_log_handler, NULL);
+    mds_log_set_level(g_config.log_level);
+
+    if (ensure_dir(g_config.spool_dir) != 0 || ensure_dir(g_config.state_dir) != 0) {
+        return 1;
+    }
+
+    int spooled = spool_open(&g_spool, g_config.spool_dir, g_config.spool_max_bytes);
+    if (spooled < 0) {
+        log_msg(MDS_LOG_ERROR, "Cannot open spool %s: %s", g_config.spool_dir, strerror(-spooled));
+        return 1;
+    }
+    spool_set_limits(&g_spool, &g_config);
+    if (spooled > 0) {
+        log_msg(MDS_LOG_INFO, "%d chunks pending in spool from a previous run", spooled);
+    }
+    if (g_config.dedup_messages > 0 && dedup_open(&g_config) != 0) {
+        log_msg(MDS_LOG_ERROR, "Cannot set up deduplication");
+        spool_close(&g_spool);
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = signal_handler;  /* No SA_RESTART: poll() returns on signals */
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    for (int i = 0; i < g_config.upload_threads; i++) {
+        upload_worker_t *worker = &g_workers[g_worker_count];
+        worker->uploader = chunks_uploader_create();
+        if (worker->uploader == NULL || start_thread(&worker->thread, upload_thread, worker) != 0) {
+            log_msg(MDS_LOG_ERROR, "Cannot start uploader %d", i);
+            chunks_uploader_destroy(worker->uploader);
+            break;
+        }
+        g_worker_count++;
+    }
+    if (g_worker_count == 0) {
+        chunks_dedup_destroy(g_dedup);
+        spool_close(&g_spool);
+        return 1;
+    }
+
+    managers_start(&g_config);
+    log_msg(MDS_LOG_INFO, "mds_bridged running (%zu device filters, %d uploaders%s)",
+            g_config.filter_count, g_worker_count, g_config.dry_run ? ", dry run" : "");
+
+    int64_t next_metrics_ms = monotonic_ms() + (int64_t)g_config.metrics_interval_s * 1000;
+    while (!g_stop) {
+        if (g_reload) {
+            g_reload = 0;
+            reload_config(config_path);
+        }
+
+        /* Sleep until a hotplug event, a signal or the next metrics write */
+        struct pollfd fds[MAX_DEVICE_FILTERS];
+        for (size_t i = 0; i < g_manager_count; i++) {
+            fds[i].fd = mds_device_manager_get_fd(g_managers[i]);
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+        }
+
+        int64_t now = monotonic_ms();
+        int timeout_ms = next_metrics_ms > now ? (int)(next_metrics_ms - now) : 0;
+        if (timeout_ms > 1000) {
+            timeout_ms = 1000;  /* Managers without hotplug rescan about once a second */
+        }
+        poll(fds, g_manager_count, timeout_ms);
+
+        for (size_t i = 0; i < g_manager_count; i++) {
+            if (fds[i].fd < 0 || (fds[i].revents & POLLIN)) {
+                mds_device_manager_process(g_managers[i], 0);
+            }
+        }
+
+        now = monotonic_ms();
+        if (now >= next_metrics_ms) {
+            metrics_write(g_config.metrics_file);
+            dedup_save();
+            next_metrics_ms = now + (int64_t)g_config.metrics_interval_s * 1000;
+        }
+    }
+
+    log_msg(MDS_LOG_INFO, "Shutting down");
+
+    /* Readers first (they acknowledge only spooled data), then uploaders */
+    managers_stop();
+    spool_stop(&g_spool);
+    for (int i = 0; i < g_worker_count; i++) {
+        pthread_join(g_workers[i].thread, NULL);
+        chunks_uploader_destroy(g_workers[i].uploader);
+    }
+
+    metrics_write(g_config.metrics_file);
+    dedup_save();
+    chunks_dedup_destroy(g_dedup);
+    spool_close(&g_spool);
+    return 0;
+}
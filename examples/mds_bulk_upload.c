@@ -0,0 +1,378 @@
+/**
+ * @file mds_bulk_upload.c
+ * @brief Upload chunks stored by a chunks_file_sink in bulk
+ *
+ * Companion to mds_gateway --offline: walks the device directories of a
+ * file sink, reads every indexed (closed) segment and uploads its chunks
+ * with chunks_uploader_upload_batch(), many chunks per HTTP request.
+ *
+ * - Segments are uploaded in index order; a segment is deleted once all of
+ *   its chunks were accepted.
+ * - After every accepted batch, the number of chunks done is written to
+ *   "<segment>.progress", so an interrupted upload resumes where it stopped
+ *   instead of sending chunks twice.
+ * - The first failed batch stops the upload (chunks must reach the cloud in
+ *   order); run the tool again to retry.
+ *
+ * Do not run it on a directory a gateway is still writing to.
+ *
+ * Usage:
+ *   ./mds_bulk_upload [-b chunks] [-B KiB] [-t seconds] [-n] [-v] <directory>
+ *
+ * Exit status: 0 when everything was uploaded, 1 otherwise.
+ */
+
+#include "mds_bridge/chunks_uploader.h"
+#include "mds_bridge/chunks_file_sink.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define DEFAULT_BATCH_CHUNKS  100
+#define DEFAULT_BATCH_KIB     512
+#define DEFAULT_TIMEOUT_SEC   60
+#define PATH_LEN              1024
+#define PROGRESS_PATH_LEN     (PATH_LEN + sizeof(".progress"))
+
+typedef struct {
+    size_t max_chunks;
+    size_t max_bytes;
+    bool dry_run;
+    bool verbose;
+} bulk_options_t;
+
+/* One segment being uploaded */
+typedef struct {
+    const bulk_options_t *options;
+    chunks_uploader_t *uploader;
+    char progress_path[PROGRESS_PATH_LEN];
+
+    uint64_t skip;                      /* Chunks already uploaded */
+    uint64_t done;                      /* Chunks read so far, including skipped */
+
+    /* Current batch: chunk data back to back in data */
+    char uri[MDS_MAX_URI_LEN];
+    char auth[MDS_MAX_AUTH_LEN];
+    uint8_t *data;
+    size_t data_len;
+    const uint8_t **chunks;
+    size_t *lens;
+    size_t count;
+
+    uint64_t uploaded_chunks;
+    uint64_t uploaded_bytes;
+} bulk_segment_t;
+
+/* ============================================================================
+ * Progress Files
+ * ========================================================================== */
+
+static uint64_t progress_read(const char *path) {
+    unsigned long long done = 0;
+    FILE *f = fopen(path, "r");
+    if (f != NULL) {
+        if (fscanf(f, "%llu", &done) != 1) {
+            done = 0;
+        }
+        fclose(f);
+    }
+    return done;
+}
+
+/* Replace the progress file atomically */
+static int progress_write(const char *path, uint64_t done) {
+    char tmp_path[PROGRESS_PATH_LEN + sizeof(".tmp")];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *f = fopen(tmp_path, "w");
+    if (f == NULL) {
+        return -errno;
+    }
+    int ok = fprintf(f, "%llu\n", (unsigned long long)done) > 0;
+    ok = fflush(f) == 0 && ok;
+    ok = fsync(fileno(f)) == 0 && ok;
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp_path, path) != 0) {
+        int err = errno ? errno : EIO;
+        unlink(tmp_path);
+        return -err;
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Uploading
+ * ========================================================================== */
+
+static int batch_send(bulk_segment_t *segment) {
+    if (segment->count == 0) {
+        return 0;
+    }
+
+    if (segment->options->dry_run) {
+        printf("  [DRY RUN] %zu chunks, %zu bytes to %s\n",
+               segment->count, segment->data_len, segment->uri);
+    } else {
+        int ret = chunks_uploader_upload_batch(segment->uploader, segment->uri, segment->auth,
+                                               segment->chunks, segment->lens, segment->count);
+        if (ret != 0) {
+            return ret;
+        }
+
+        ret = progress_write(segment->progress_path, segment->done);
+        if (ret < 0) {
+            fprintf(stderr, "Cannot write %s: %s\n", segment->progress_path, strerror(-ret));
+            return ret;
+        }
+        if (segment->options->verbose) {
+            printf("  Uploaded %zu chunks (%zu bytes)\n", segment->count, segment->data_len);
+        }
+    }
+
+    segment->uploaded_chunks += segment->count;
+    segment->uploaded_bytes += segment->data_len;
+    segment->count = 0;
+    segment->data_len = 0;
+    return 0;
+}
+
+static int batch_add(const chunks_file_segment_info_t *info, const uint8_t *chunk, size_t len,
+                     mds_chunk_class_t chunk_class, void *user_data) {
+    bulk_segment_t *segment = (bulk_segment_t *)user_data;
+    (void)chunk_class;
+
+    if (segment->done < segment->skip) {
+        segment->done++;
+        return 0;
+    }
+
+    if (segment->count == segment->options->max_chunks ||
+        (segment->count > 0 && segment->data_len + len > segment->options->max_bytes)) {
+        int ret = batch_send(segment);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    snprintf(segment->uri, sizeof(segment->uri), "%s", info->uri);
+    snprintf(segment->auth, sizeof(segment->auth), "%s", info->auth);
+    uint8_t *dest = &segment->data[segment->data_len];
+    memcpy(dest, chunk, len);
+    segment->chunks[segment->count] = dest;
+    segment->lens[segment->count] = len;
+    segment->count++;
+    segment->data_len += len;
+    segment->done++;
+    return 0;
+}
+
+/* dir/name into path; -ENAMETOOLONG if it does not fit */
+static int path_join(char *path, size_t size, const char *dir, const char *name) {
+    int len = snprintf(path, size, "%s/%s", dir, name);
+    if (len < 0 || (size_t)len >= size) {
+        fprintf(stderr, "%s/%s: path too long\n", dir, name);
+        return -ENAMETOOLONG;
+    }
+    return 0;
+}
+
+static int segment_upload(bulk_segment_t *segment, const char *device_dir, const char *name) {
+    char path[PATH_LEN];
+    if (path_join(path, sizeof(path), device_dir, name) < 0) {
+        return -ENAMETOOLONG;
+    }
+    snprintf(segment->progress_path, sizeof(segment->progress_path), "%s.progress", path);
+
+    segment->skip = progress_read(segment->progress_path);
+    segment->done = 0;
+    segment->count = 0;
+    segment->data_len = 0;
+
+    int ret = chunks_file_segment_read(path, batch_add, segment);
+    if (ret >= 0) {
+        ret = batch_send(segment);
+    }
+    if (ret < 0) {
+        fprintf(stderr, "%s: upload stopped after %llu chunks: %s\n", path,
+                (unsigned long long)(segment->done - segment->count), strerror(-ret));
+        return ret;
+    }
+
+    if (segment->skip > 0) {
+        printf("  %s: resumed after %llu chunks\n", name, (unsigned long long)segment->skip);
+    }
+    if (!segment->options->dry_run) {
+        unlink(path);
+        unlink(segment->progress_path);
+    }
+    return 0;
+}
+
+/* Upload the indexed segments of one device; returns 0 when all were uploaded */
+static int device_upload(bulk_segment_t *segment, const char *device_dir) {
+    char index_path[PATH_LEN];
+    int ret = path_join(index_path, sizeof(index_path), device_dir, "index");
+    if (ret < 0) {
+        return ret;
+    }
+
+    FILE *index = fopen(index_path, "r");
+    if (index == NULL) {
+        return errno == ENOENT ? 0 : -errno;
+    }
+
+    char line[256];
+    while (ret == 0 && fgets(line, sizeof(line), index) != NULL) {
+        char name[64];
+        char path[PATH_LEN];
+        struct stat st;
+        if (sscanf(line, "%63s", name) != 1) {
+            continue;
+        }
+        ret = path_join(path, sizeof(path), device_dir, name);
+        if (ret < 0) {
+            break;
+        }
+        if (stat(path, &st) != 0) {
+            continue;  /* Uploaded earlier */
+        }
+        ret = segment_upload(segment, device_dir, name);
+    }
+    fclose(index);
+
+    if (ret == 0 && !segment->options->dry_run) {
+        /* Every listed segment is gone (segments still open when the data
+         * was copied are indexed by the sink's next start) */
+        unlink(index_path);
+    }
+    return ret;
+}
+
+/* ============================================================================
+ * Main
+ * ========================================================================== */
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] <directory>\n", prog);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Uploads the chunks stored by mds_gateway --offline.\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -b <chunks>   Chunks per request (default %d)\n", DEFAULT_BATCH_CHUNKS);
+    fprintf(stderr, "  -B <KiB>      Chunk data per request (default %d)\n", DEFAULT_BATCH_KIB);
+    fprintf(stderr, "  -t <seconds>  Request timeout (default %d)\n", DEFAULT_TIMEOUT_SEC);
+    fprintf(stderr, "  -n            Dry run: read segments, upload and delete nothing\n");
+    fprintf(stderr, "  -v            Print every request\n");
+}
+
+int main(int argc, char *argv[]) {
+    bulk_options_t options = {
+        .max_chunks = DEFAULT_BATCH_CHUNKS,
+        .max_bytes = (size_t)DEFAULT_BATCH_KIB * 1024,
+        .dry_run = false,
+        .verbose = false,
+    };
+    long timeout_sec = DEFAULT_TIMEOUT_SEC;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:B:t:nvh")) != -1) {
+        switch (opt) {
+            case 'b': options.max_chunks = (size_t)strtoul(optarg, NULL, 10); break;
+            case 'B': options.max_bytes = (size_t)strtoul(optarg, NULL, 10) * 1024; break;
+            case 't': timeout_sec = strtol(optarg, NULL, 10); break;
+            case 'n': options.dry_run = true; break;
+            case 'v': options.verbose = true; break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind != argc - 1 || options.max_chunks == 0 || options.max_bytes == 0 ||
+        timeout_sec <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *directory = argv[optind];
+
+    bulk_segment_t segment;
+    memset(&segment, 0, sizeof(segment));
+    segment.options = &options;
+    segment.data = malloc(options.max_bytes + MDS_MAX_STREAM_DATA_LEN);
+    segment.chunks = calloc(options.max_chunks, sizeof(*segment.chunks));
+    segment.lens = calloc(options.max_chunks, sizeof(*segment.lens));
+    if (!options.dry_run) {
+        segment.uploader = chunks_uploader_create();
+    }
+    if (segment.data == NULL || segment.chunks == NULL || segment.lens == NULL ||
+        (!options.dry_run && segment.uploader == NULL)) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    if (segment.uploader) {
+        chunks_uploader_set_timeout(segment.uploader, timeout_sec * 1000);
+    }
+
+    DIR *dir = opendir(directory);
+    if (dir == NULL) {
+        fprintf(stderr, "Cannot open %s: %s\n", directory, strerror(errno));
+        return 1;
+    }
+
+    int failed = 0;
+    int devices = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        char device_dir[PATH_LEN];
+        struct stat st;
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        if (path_join(device_dir, sizeof(device_dir), directory, entry->d_name) < 0) {
+            failed++;
+            continue;
+        }
+        if (stat(device_dir, &st) != 0 || !S_ISDIR(st.st_mode)) {
+            continue;
+        }
+
+        uint64_t chunks_before = segment.uploaded_chunks;
+        uint64_t bytes_before = segment.uploaded_bytes;
+        int ret = device_upload(&segment, device_dir);
+        if (segment.uploaded_chunks > chunks_before || ret != 0) {
+            printf("%s: %llu chunks, %llu bytes%s\n", entry->d_name,
+                   (unsigned long long)(segment.uploaded_chunks - chunks_before),
+                   (unsigned long long)(segment.uploaded_bytes - bytes_before),
+                   ret != 0 ? " (incomplete)" : "");
+        }
+        devices++;
+        failed += ret != 0;
+    }
+    closedir(dir);
+
+    printf("\n--- Bulk Upload ---\n");
+    printf("Devices:           %d (%d incomplete)\n", devices, failed);
+    printf("%s%llu\n", options.dry_run ? "Chunks found:      " : "Chunks uploaded:   ",
+           (unsigned long long)segment.uploaded_chunks);
+    printf("%s%llu\n", options.dry_run ? "Bytes found:       " : "Bytes uploaded:    ",
+           (unsigned long long)segment.uploaded_bytes);
+    if (segment.uploader) {
+        chunks_upload_stats_t stats;
+        chunks_uploader_get_stats(segment.uploader, &stats);
+        printf("HTTP failures:     %zu\n", stats.upload_failures);
+        chunks_uploader_destroy(segment.uploader);
+    }
+    printf("-------------------\n");
+
+    free(segment.data);
+    free(segment.chunks);
+    free(segment.lens);
+    return failed == 0 ? 0 : 1;
+}
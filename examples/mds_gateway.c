@@ -9,16 +9,20 @@
  * 4. Receive and upload chunks to Memfault cloud
  *
  * Usage:
- *   ./mds_gateway <vid> <pid> [--dry-run]
+ *   ./mds_gateway <vid> <pid> [--dry-run | --offline <dir>]
  *
  * Examples:
  *   ./mds_gateway 2fe3 0007              # Upload to Memfault cloud
  *   ./mds_gateway 2fe3 0007 --dry-run    # Print chunks without uploading
+ *   ./mds_gateway 2fe3 0007 --offline /var/lib/mds/chunks
+ *                                        # Store chunks for mds_bulk_upload
  */
 
 #include "mds_bridge/mds_protocol.h"
+#include "mds_bridge/mds_arena.h"
 #include "mds_bridge/chunks_uploader.h"
 #include "mds_bridge/memfault_hid.h"
+#include "mds_bridge/mds_log.h"
 #include "mds_bridge/platform_compat.h"
 
 #include <stdio.h>
@@ -29,6 +33,7 @@
 
 #ifndef _WIN32
 #include <unistd.h>  /* For usleep */
+#include "mds_bridge/chunks_file_sink.h"
 #endif
 
 static volatile sig_atomic_t keep_running = 1;
@@ -38,6 +43,25 @@ static void signal_handler(int signum) {
     keep_running = 0;
 }
 
+/* Sequence anomaly callback - reports dropped/duplicated packets */
+static void sequence_callback(mds_session_t *session,
+                              const mds_sequence_event_t *event,
+                              void *user_data) {
+    (void)user_data;
+    mds_session_stats_t stats;
+    mds_get_session_stats(session, &stats);
+
+    if (event->type == MDS_SEQUENCE_EVENT_GAP) {
+        fprintf(stderr, "*** SEQUENCE GAP: expected %u, got %u (missed %u packets, total lost: %llu) ***\n",
+                event->expected, event->received, event->missing,
+                (unsigned long long)stats.lost_packets);
+    } else {
+        fprintf(stderr, "*** %s: expected %u, got %u ***\n",
+                event->type == MDS_SEQUENCE_EVENT_DUPLICATE ? "DUPLICATE" : "OUT-OF-ORDER",
+                event->expected, event->received);
+    }
+}
+
 /* Dry-run callback - prints chunks without uploading */
 static int dry_run_callback(const char *uri,
                              const char *auth_header,
@@ -63,6 +87,25 @@ static int dry_run_callback(const char *uri,
     return 0;
 }
 
+#ifndef _WIN32
+/* Offline mode - stores chunks under the device identifier for mds_bulk_upload */
+typedef struct {
+    chunks_file_sink_t *sink;
+    const char *device_id;
+} offline_store_t;
+
+static int offline_callback(const char *uri,
+                            const char *auth_header,
+                            const uint8_t *chunk_data,
+                            size_t chunk_len,
+                            const mds_chunk_info_t *info,
+                            void *user_data) {
+    offline_store_t *store = (offline_store_t *)user_data;
+    return chunks_file_sink_write(store->sink, store->device_id, uri, auth_header,
+                                  chunk_data, chunk_len, info->chunk_class);
+}
+#endif
+
 int main(int argc, char *argv[]) {
     int ret;
     unsigned int vid, pid;
@@ -71,15 +114,24 @@ int main(int argc, char *argv[]) {
     chunks_uploader_t *uploader = NULL;
     bool dry_run = false;
     int dry_run_chunk_count = 0;
+#ifndef _WIN32
+    const char *offline_dir = NULL;
+    chunks_file_sink_t *offline_sink = NULL;
+    mds_io_t *offline_io = NULL;
+    offline_store_t offline_store;
+#endif
 
     /* Parse arguments */
     if (argc < 3) {
-        fprintf(stderr, "Usage: %s <vid> <pid> [--dry-run]\n", argv[0]);
+        fprintf(stderr, "Usage: %s <vid> <pid> [--dry-run | --offline <dir>]\n", argv[0]);
         fprintf(stderr, "\n");
         fprintf(stderr, "Arguments:\n");
         fprintf(stderr, "  vid        Vendor ID (hex, e.g., 2fe3)\n");
         fprintf(stderr, "  pid        Product ID (hex, e.g., 0007)\n");
         fprintf(stderr, "  --dry-run  Print chunks without uploading to Memfault cloud\n");
+#ifndef _WIN32
+        fprintf(stderr, "  --offline  Store chunks in <dir> for a later mds_bulk_upload\n");
+#endif
         fprintf(stderr, "\n");
         fprintf(stderr, "Examples:\n");
         fprintf(stderr, "  %s 2fe3 0007            # Upload to Memfault cloud\n", argv[0]);
@@ -98,6 +150,12 @@ int main(int argc, char *argv[]) {
         dry_run = true;
         printf("DRY RUN mode - chunks will be printed but NOT uploaded\n\n");
     }
+#ifndef _WIN32
+    else if (argc >= 5 && strcmp(argv[3], "--offline") == 0) {
+        offline_dir = argv[4];
+        printf("OFFLINE mode - chunks will be stored in %s\n\n", offline_dir);
+    }
+#endif
 
     /* Set up signal handler for graceful shutdown */
     signal(SIGINT, signal_handler);
@@ -140,6 +198,32 @@ int main(int argc, char *argv[]) {
             goto cleanup;
         }
         printf("Dry-run callback configured\n\n");
+#ifndef _WIN32
+    } else if (offline_dir != NULL) {
+        printf("Setting up offline storage...\n");
+
+        /* Segment writes run on the I/O engine, not between HID reads */
+        chunks_file_sink_config_t sink_config;
+        chunks_file_sink_default_config(&sink_config);
+        offline_io = mds_io_create(NULL);
+        sink_config.io = offline_io;
+        offline_sink = chunks_file_sink_create(offline_dir, &sink_config);
+        if (offline_sink == NULL) {
+            fprintf(stderr, "Cannot use %s for offline storage\n", offline_dir);
+            goto cleanup;
+        }
+
+        /* Also used for the chunks drained at shutdown */
+        offline_store.sink = offline_sink;
+        offline_store.device_id = config.device_identifier;
+        ret = mds_set_upload_callback_ex(session, offline_callback, &offline_store);
+        if (ret != 0) {
+            fprintf(stderr, "Failed to set upload callback\n");
+            goto cleanup;
+        }
+        printf("Offline storage configured (%s I/O)\n\n",
+               offline_io ? mds_io_backend_name(mds_io_get_backend(offline_io)) : "synchronous");
+#endif
     } else {
         printf("Setting up HTTP uploader (libcurl)...\n");
         uploader = chunks_uploader_create();
@@ -173,6 +257,21 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    /* Start sequence accounting from the first live packet */
+    mds_reset_session_stats(session);
+    mds_set_sequence_callback(session, sequence_callback, NULL);
+
+    /* Let the device pace itself to our reads when it supports flow control */
+    if (mds_stream_set_flow_control(session, MDS_CREDIT_DEFAULT_WINDOW) == 0) {
+        printf("Credit-based flow control enabled (window %d)\n", MDS_CREDIT_DEFAULT_WINDOW);
+    }
+
+    /* Fewer, larger reports when the device supports them */
+    if (mds_stream_set_large_reports(session, true) == 0) {
+        printf("Large-report stream mode enabled (up to %d bytes per packet)\n",
+               MDS_MAX_STREAM_DATA_LEN);
+    }
+
     /* Enable streaming */
     printf("Enabling diagnostic data streaming...\n");
     ret = mds_stream_enable(session);
@@ -193,69 +292,85 @@ int main(int argc, char *argv[]) {
      * device sends packets faster than our HTTP roundtrip, HID packets
      * accumulate in the kernel buffer and can be dropped.
      *
-     * Solution: Read all available packets first (non-blocking), buffer them,
-     * then upload the batch. This ensures we drain the HID buffer quickly.
+     * Solution: Block until the first packet of a burst arrives, then read
+     * everything else that is already queued (non-blocking), buffer it, and
+     * upload the batch. This drains the HID buffer quickly, and the first
+     * packet is handled as soon as USB delivers it. IDLE_WAIT_MS only bounds
+     * how long an idle gateway takes to notice Ctrl+C on platforms where
+     * signals do not interrupt HID reads.
+     *
+     * Chunk data of a burst is copied into an arena that is reset after the
+     * upload, so buffering costs one memcpy of the payload per packet and no
+     * heap allocation once the arena has grown to the largest burst.
      */
     #define CHUNK_BUFFER_SIZE 128
+    #define BURST_ARENA_SIZE  (16 * 1024)
+    #define IDLE_WAIT_MS      1000
+    #define MAX_READ_ERRORS   5
+    #define SHUTDOWN_DEADLINE_MS 5000
     typedef struct {
-        uint8_t data[MDS_MAX_CHUNK_DATA_LEN];
+        uint8_t *data;                  /* In burst_arena */
         size_t len;
+        mds_chunk_class_t chunk_class;
     } buffered_chunk_t;
 
-    buffered_chunk_t *chunk_buffer = malloc(CHUNK_BUFFER_SIZE * sizeof(buffered_chunk_t));
-    if (chunk_buffer == NULL) {
+    buffered_chunk_t chunk_buffer[CHUNK_BUFFER_SIZE];
+    mds_arena_t *burst_arena = mds_arena_create(BURST_ARENA_SIZE);
+    if (burst_arena == NULL) {
         fprintf(stderr, "Failed to allocate chunk buffer\n");
         goto cleanup;
     }
 
     int chunk_count = 0;
-    int error_count = 0;
-    uint8_t expected_seq = 0;  /* Track expected sequence for gap detection */
-    bool first_packet = true;
-    int dropped_packets = 0;
+    int error_count = 0;  /* Consecutive read errors */
+
+    /* Queue library log messages; they are written between read bursts */
+    mds_log_set_deferred(true);
 
     while (keep_running) {
-        /* Phase 1: Drain all available HID packets into buffer (short timeout) */
+        /* Phase 1: Wait for a packet, then drain everything already queued */
         size_t buffered_count = 0;
         while (buffered_count < CHUNK_BUFFER_SIZE) {
             mds_stream_packet_t packet;
-            /* Use short timeout (10ms) to quickly drain buffer */
-            ret = mds_stream_read_packet(session, &packet, 10);
+            ret = mds_stream_read_packet(session, &packet,
+                                         buffered_count == 0 ? IDLE_WAIT_MS : 0);
 
             if (ret == 0) {
-                /* Check for sequence gaps (dropped packets) */
-                if (first_packet) {
-                    expected_seq = packet.sequence;
-                    first_packet = false;
+                error_count = 0;
+
+                /* Sequence gaps are accounted by the session (see sequence_callback) */
+                if (chunk_count == 0 && buffered_count == 0) {
                     printf("First packet received, sequence=%u\n", packet.sequence);
-                } else if (packet.sequence != expected_seq) {
-                    /* Calculate how many packets we missed */
-                    int gap = (packet.sequence - expected_seq) & 0x1F;
-                    if (gap > 16) gap -= 32;  /* Handle wrap-around */
-                    if (gap > 0) {
-                        dropped_packets += gap;
-                        fprintf(stderr, "*** SEQUENCE GAP: expected %u, got %u (missed %d packets, total dropped: %d) ***\n",
-                                expected_seq, packet.sequence, gap, dropped_packets);
-                    } else if (gap < 0) {
-                        fprintf(stderr, "*** DUPLICATE/OUT-OF-ORDER: expected %u, got %u ***\n",
-                                expected_seq, packet.sequence);
-                    }
                 }
-                expected_seq = (packet.sequence + 1) & 0x1F;
 
                 /* Buffer this chunk */
+                uint8_t *data = mds_arena_alloc(burst_arena, packet.data_len);
+                if (data == NULL) {
+                    fprintf(stderr, "Out of memory, dropping chunk (sequence=%u)\n",
+                            packet.sequence);
+                    continue;
+                }
+                memcpy(data, packet.data, packet.data_len);
+                chunk_buffer[buffered_count].data = data;
                 chunk_buffer[buffered_count].len = packet.data_len;
-                memcpy(chunk_buffer[buffered_count].data, packet.data, packet.data_len);
+                chunk_buffer[buffered_count].chunk_class = packet.chunk_class;
                 buffered_count++;
             } else if (ret == -ETIMEDOUT || ret == MEMFAULT_HID_ERROR_TIMEOUT) {
                 /* No more packets available */
+                error_count = 0;
                 break;
             } else {
-                /* Other error */
+                /* Read error (or a signal interrupted the wait) */
+                error_count++;
                 break;
             }
         }
 
+        if (error_count >= MAX_READ_ERRORS) {
+            fprintf(stderr, "Device stopped responding (error %d)\n", ret);
+            break;
+        }
+
         /* Phase 2: Upload buffered chunks */
         if (buffered_count > 0) {
             if (buffered_count > 1) {
@@ -270,6 +385,19 @@ int main(int argc, char *argv[]) {
                     dry_run_callback(config.data_uri, config.authorization,
                                      chunk_buffer[i].data, chunk_buffer[i].len,
                                      &dry_run_chunk_count);
+#ifndef _WIN32
+                } else if (offline_sink) {
+                    /* Buffered by the sink, written in large appends */
+                    mds_chunk_info_t info = { 0 };
+                    info.chunk_class = chunk_buffer[i].chunk_class;
+                    ret = offline_callback(config.data_uri, config.authorization,
+                                           chunk_buffer[i].data, chunk_buffer[i].len,
+                                           &info, &offline_store);
+                    if (ret != 0) {
+                        fprintf(stderr, "Storing chunk #%d failed: %s\n", chunk_count,
+                                strerror(-ret));
+                    }
+#endif
                 } else {
                     /* Upload via HTTP */
                     ret = chunks_uploader_callback(config.data_uri, config.authorization,
@@ -281,33 +409,82 @@ int main(int argc, char *argv[]) {
                 }
             }
 
-            if (!dry_run && buffered_count > 0) {
+            if (uploader && buffered_count > 0) {
                 chunks_upload_stats_t stats;
                 chunks_uploader_get_stats(uploader, &stats);
                 printf("Processed %zu chunks (total: %d), uploaded: %zu chunks, %zu bytes\n",
                        buffered_count, chunk_count, stats.chunks_uploaded, stats.bytes_uploaded);
             }
-        } else {
-            /* No packets available - wait a bit before next poll */
-            /* Use platform_sleep if available, otherwise just continue */
+
+            mds_arena_reset(burst_arena);
+        } else if (error_count > 0 && keep_running) {
+            /* Don't spin on a failing device */
             #ifdef _WIN32
             Sleep(100);
             #else
             usleep(100000);  /* 100ms */
             #endif
         }
+
+#ifndef _WIN32
+        if (offline_sink && buffered_count == 0) {
+            /* Idle: write what is buffered */
+            chunks_file_sink_flush(offline_sink);
+        }
+#endif
+
+        mds_log_flush();
     }
 
-    free(chunk_buffer);
+    mds_log_set_deferred(false);
+
+    {
+        mds_arena_stats_t arena_stats;
+        mds_arena_get_stats(burst_arena, &arena_stats);
+        printf("Largest burst: %zu bytes buffered (%zu byte arena, %llu grows)\n",
+               arena_stats.high_water, arena_stats.capacity,
+               (unsigned long long)arena_stats.grows);
+    }
+    mds_arena_destroy(burst_arena);
 
     printf("\nShutting down...\n");
 
-    /* Disable streaming */
-    printf("Disabling streaming...\n");
-    mds_stream_disable(session);
+    /* Stop streaming and upload whatever the device already sent */
+    printf("Draining stream (up to %d ms)...\n", SHUTDOWN_DEADLINE_MS);
+    if (uploader) {
+        chunks_uploader_set_timeout(uploader, SHUTDOWN_DEADLINE_MS);
+    }
+    {
+        mds_shutdown_report_t report;
+        mds_session_shutdown(session, &config, SHUTDOWN_DEADLINE_MS, &report);
+        printf("Drained %u packets: %u uploaded, %u dropped (%llu bytes)%s\n",
+               report.packets_drained, report.packets_uploaded, report.packets_dropped,
+               (unsigned long long)report.bytes_dropped,
+               report.deadline_expired ? " - deadline expired" : "");
+    }
 
 cleanup:
     /* Print final statistics */
+    if (session) {
+        mds_session_stats_t seq_stats;
+        mds_get_session_stats(session, &seq_stats);
+        printf("\n--- Stream Statistics ---\n");
+        printf("Packets received:  %llu\n", (unsigned long long)seq_stats.packets_received);
+        printf("Sequence gaps:     %llu\n", (unsigned long long)seq_stats.gaps);
+        printf("Packets lost:      %llu\n", (unsigned long long)seq_stats.lost_packets);
+        printf("Duplicates:        %llu\n", (unsigned long long)seq_stats.duplicates);
+        printf("Out of order:      %llu\n", (unsigned long long)seq_stats.reorders);
+        for (int c = 0; c < MDS_CHUNK_CLASS_COUNT; c++) {
+            if (seq_stats.class_packets[c] > 0) {
+                printf("  %-16s %llu packets, %llu bytes\n",
+                       mds_chunk_class_name((mds_chunk_class_t)c),
+                       (unsigned long long)seq_stats.class_packets[c],
+                       (unsigned long long)seq_stats.class_bytes[c]);
+            }
+        }
+        printf("-------------------------\n");
+    }
+
     if (dry_run) {
         printf("\n--- Dry Run Statistics ---\n");
         printf("Chunks processed: %d\n", dry_run_chunk_count);
@@ -325,6 +502,20 @@ cleanup:
 
         chunks_uploader_destroy(uploader);
     }
+#ifndef _WIN32
+    if (offline_sink) {
+        chunks_file_sink_stats_t sink_stats;
+        chunks_file_sink_get_stats(offline_sink, &sink_stats);
+        chunks_file_sink_destroy(offline_sink);  /* Writes buffers, closes segments */
+        printf("\n--- Offline Storage ---\n");
+        printf("Chunks stored:     %llu\n", (unsigned long long)sink_stats.chunks_written);
+        printf("Bytes stored:      %llu\n", (unsigned long long)sink_stats.bytes_written);
+        printf("Write errors:      %llu\n", (unsigned long long)sink_stats.write_errors);
+        printf("Directory:         %s\n", offline_dir);
+        printf("-----------------------\n\n");
+    }
+    mds_io_destroy(offline_io);
+#endif
 
     /* Cleanup */
     if (session) {
@@ -6,13 +6,17 @@
  * - Colorized output for better visibility
  * - Large status messages
  * - Clear progress indicators
- * - Auto-reconnect on device disconnect (fault/reset)
+ * - Auto-reconnect on device disconnect (fault/reset), driven by hotplug
+ *   events where available (Linux udev) and by polling elsewhere
+ * - Stream resume: the acknowledged stream offset is saved per device, so
+ *   after a reboot the device only sends data that was not forwarded yet
  *
  * Usage:
- *   ./mds_gateway_demo <vid> <pid>
+ *   ./mds_gateway_demo <vid> <pid> [--state-dir <dir>]
  */
 
 #include "mds_bridge/mds_protocol.h"
+#include "mds_bridge/mds_device_manager.h"
 #include "mds_bridge/chunks_uploader.h"
 #include "mds_bridge/memfault_hid.h"
 #include "mds_bridge/platform_compat.h"
@@ -45,6 +49,9 @@
 
 static volatile sig_atomic_t keep_running = 1;
 
+/* Device handed to us by the hotplug device manager */
+static mds_session_t *g_attached_session = NULL;
+
 static void signal_handler(int signum) {
     (void)signum;
     keep_running = 0;
@@ -100,6 +107,108 @@ static void get_timestamp(char *buf, size_t len) {
     strftime(buf, len, "%H:%M:%S", tm_info);
 }
 
+/* Hotplug callback - adopt the first attached device, forget it on detach */
+static void device_event_callback(mds_device_manager_t *manager,
+                                  mds_device_event_t event,
+                                  const char *path,
+                                  mds_session_t *session,
+                                  void *user_data) {
+    (void)manager;
+    (void)user_data;
+
+    char timestamp[32];
+    get_timestamp(timestamp, sizeof(timestamp));
+
+    if (event == MDS_DEVICE_EVENT_ATTACHED) {
+        printf("  %s[%s] 🔌 Device attached: %s%s\n", COLOR_GREEN, timestamp, path, COLOR_RESET);
+        if (g_attached_session == NULL) {
+            g_attached_session = session;
+        }
+    } else if (session == g_attached_session) {
+        printf("  %s[%s] 🔌 Device detached: %s%s\n", COLOR_YELLOW, timestamp, path, COLOR_RESET);
+        g_attached_session = NULL;  /* Manager destroys the session after we return */
+    }
+}
+
+/* Drop a session after a setup failure (the device manager owns its sessions) */
+static void release_session(mds_device_manager_t *manager, mds_session_t *session) {
+    if (manager == NULL) {
+        mds_session_destroy(session);
+    }
+}
+
+/* ============================================================================
+ * Resume State (one file per device: "<state-dir>/mds-resume-<device id>")
+ * ========================================================================== */
+
+static void resume_state_path(const char *state_dir, const char *device_id,
+                              char *path, size_t len) {
+    int n = snprintf(path, len, "%s/mds-resume-", state_dir);
+    if (n < 0 || (size_t)n >= len) {
+        path[0] = '\0';
+        return;
+    }
+
+    /* Keep the device identifier file-name safe */
+    size_t pos = (size_t)n;
+    for (const char *c = device_id; *c != '\0' && pos + 1 < len; c++) {
+        bool safe = (*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') ||
+                    (*c >= '0' && *c <= '9') || *c == '-' || *c == '_' || *c == '.';
+        path[pos++] = safe ? *c : '_';
+    }
+    path[pos] = '\0';
+}
+
+/* Load the saved offset (0 if the device has never been seen) */
+static uint32_t resume_state_load(const char *path) {
+    unsigned long offset = 0;
+    FILE *f = fopen(path, "r");
+    if (f != NULL) {
+        if (fscanf(f, "%lu", &offset) != 1) {
+            offset = 0;
+        }
+        fclose(f);
+    }
+    return (uint32_t)offset;
+}
+
+/* Save the offset, replacing the previous file only once the new one is written */
+static bool resume_state_save(const char *path, uint32_t offset) {
+    char tmp_path[1024];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *f = fopen(tmp_path, "w");
+    if (f == NULL) {
+        return false;
+    }
+    bool ok = fprintf(f, "%lu\n", (unsigned long)offset) > 0;
+    ok = (fclose(f) == 0) && ok;
+
+#ifdef _WIN32
+    remove(path);  /* rename() does not replace existing files on Windows */
+#endif
+    if (!ok || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return false;
+    }
+    return true;
+}
+
+/* Persist the acknowledged offset if it moved */
+static void resume_state_sync(mds_session_t *session, const char *path, uint32_t *saved) {
+    uint32_t offset;
+    if (path[0] == '\0' || mds_stream_get_resume_offset(session, &offset) != 0 ||
+        offset == *saved) {
+        return;
+    }
+
+    if (resume_state_save(path, offset)) {
+        *saved = offset;
+    } else {
+        print_warning("Failed to save stream resume offset");
+    }
+}
+
 /* Upload callback with visual feedback */
 static int demo_upload_callback(const char *uri,
                                  const char *auth_header,
@@ -138,16 +247,21 @@ int main(int argc, char *argv[]) {
     mds_session_t *session = NULL;
     mds_device_config_t config;
     chunks_uploader_t *uploader = NULL;
+    mds_device_manager_t *manager = NULL;
     int total_packet_count = 0;
     int connection_count = 0;
+    const char *state_dir = ".";
+    char resume_path[1024] = "";
+    uint32_t resume_saved = 0;
 
     /* Parse arguments */
-    if (argc < 3) {
-        fprintf(stderr, "Usage: %s <vid> <pid>\n", argv[0]);
+    if (argc < 3 || (argc > 3 && (argc != 5 || strcmp(argv[3], "--state-dir") != 0))) {
+        fprintf(stderr, "Usage: %s <vid> <pid> [--state-dir <dir>]\n", argv[0]);
         fprintf(stderr, "\n");
         fprintf(stderr, "Arguments:\n");
         fprintf(stderr, "  vid        Vendor ID (hex, e.g., 2fe3)\n");
         fprintf(stderr, "  pid        Product ID (hex)\n");
+        fprintf(stderr, "  --state-dir  Directory for stream resume offsets (default: .)\n");
         fprintf(stderr, "\n");
         fprintf(stderr, "Example:\n");
         fprintf(stderr, "  %s 2fe3 0007\n", argv[0]);
@@ -160,6 +274,10 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    if (argc == 5) {
+        state_dir = argv[4];
+    }
+
     /* Set up signal handler for graceful shutdown */
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
@@ -187,6 +305,18 @@ int main(int argc, char *argv[]) {
     /* Disable verbose curl output for cleaner demo */
     chunks_uploader_set_verbose(uploader, false);
 
+    /* Hotplug monitoring - reconnect as soon as the device is announced */
+    mds_device_manager_config_t manager_config = {
+        .vendor_id = (uint16_t)vid,
+        .product_id = (uint16_t)pid,
+        .callback = device_event_callback,
+        .user_data = NULL,
+    };
+    if (mds_device_manager_create(&manager_config, &manager) != 0) {
+        manager = NULL;
+        print_info("Hotplug monitoring unavailable - polling for device");
+    }
+
     /*
      * Outer reconnection loop - handles device disconnect/reconnect
      * This allows the demo to continue after device faults/resets
@@ -205,39 +335,55 @@ int main(int argc, char *argv[]) {
         print_header("DEVICE CONNECTION");
         printf("  Target Device: %s%04X:%04X%s\n", COLOR_WHITE, vid, pid, COLOR_RESET);
 
-        /* Polling loop - wait for device to appear */
-        int connect_attempts = 0;
-        while (keep_running) {
-            connect_attempts++;
-
-            if (connect_attempts == 1) {
-                printf("  Connecting...\n");
-            } else if (connect_attempts % 10 == 0) {
-                char timestamp[32];
-                get_timestamp(timestamp, sizeof(timestamp));
-                printf("  %s[%s] Still waiting for device... (attempt %d)%s\n",
-                       COLOR_YELLOW, timestamp, connect_attempts, COLOR_RESET);
+        if (manager) {
+            /* Hotplug - block until udev announces a matching device */
+            int wait_seconds = 0;
+            printf("  Waiting for device (hotplug)...\n");
+            while (keep_running && g_attached_session == NULL) {
+                mds_device_manager_process(manager, 1000);
+                if (g_attached_session == NULL && ++wait_seconds % 10 == 0) {
+                    char timestamp[32];
+                    get_timestamp(timestamp, sizeof(timestamp));
+                    printf("  %s[%s] Still waiting for device... (%ds)%s\n",
+                           COLOR_YELLOW, timestamp, wait_seconds, COLOR_RESET);
+                }
             }
+            session = g_attached_session;
+        } else {
+            /* Polling loop - wait for device to appear */
+            int connect_attempts = 0;
+            while (keep_running) {
+                connect_attempts++;
+
+                if (connect_attempts == 1) {
+                    printf("  Connecting...\n");
+                } else if (connect_attempts % 10 == 0) {
+                    char timestamp[32];
+                    get_timestamp(timestamp, sizeof(timestamp));
+                    printf("  %s[%s] Still waiting for device... (attempt %d)%s\n",
+                           COLOR_YELLOW, timestamp, connect_attempts, COLOR_RESET);
+                }
 
-            ret = mds_session_create_hid(vid, pid, NULL, &session);
-            if (ret == 0) {
-                break;  /* Connected! */
-            }
+                ret = mds_session_create_hid(vid, pid, NULL, &session);
+                if (ret == 0) {
+                    break;  /* Connected! */
+                }
 
-            /* First attempt failure - show troubleshooting on initial connect only */
-            if (connect_attempts == 1 && connection_count == 1) {
-                print_warning("Device not found - waiting for connection...");
-                printf("\n");
-                print_info("Troubleshooting:");
-                printf("  1. Check device is plugged in\n");
-                printf("  2. Verify VID/PID are correct\n");
-                printf("  3. Try running with sudo\n");
-                printf("  4. Check 'lsusb' output\n");
-                printf("\n");
-            }
+                /* First attempt failure - show troubleshooting on initial connect only */
+                if (connect_attempts == 1 && connection_count == 1) {
+                    print_warning("Device not found - waiting for connection...");
+                    printf("\n");
+                    print_info("Troubleshooting:");
+                    printf("  1. Check device is plugged in\n");
+                    printf("  2. Verify VID/PID are correct\n");
+                    printf("  3. Try running with sudo\n");
+                    printf("  4. Check 'lsusb' output\n");
+                    printf("\n");
+                }
 
-            /* Wait before retry */
-            demo_sleep_ms(500);
+                /* Wait before retry */
+                demo_sleep_ms(500);
+            }
         }
 
         if (!keep_running) {
@@ -252,7 +398,7 @@ int main(int argc, char *argv[]) {
         ret = mds_read_device_config(session, &config);
         if (ret != 0) {
             print_error("Failed to read device configuration");
-            mds_session_destroy(session);
+            release_session(manager, session);
             session = NULL;
             print_warning("Will retry connection...");
             demo_sleep_ms(1000);
@@ -269,7 +415,7 @@ int main(int argc, char *argv[]) {
         ret = mds_set_upload_callback(session, demo_upload_callback, uploader);
         if (ret != 0) {
             print_error("Failed to set upload callback");
-            mds_session_destroy(session);
+            release_session(manager, session);
             session = NULL;
             continue;
         }
@@ -277,12 +423,22 @@ int main(int argc, char *argv[]) {
         print_success("Upload callback registered");
         printf("  Target: %s%s%s\n", COLOR_WHITE, config.data_uri, COLOR_RESET);
 
+        /* Skip data that was forwarded before the device rebooted */
+        resume_state_path(state_dir, config.device_identifier, resume_path, sizeof(resume_path));
+        resume_saved = resume_state_load(resume_path);
+        if (mds_stream_set_resume_offset(session, resume_saved) == 0) {
+            printf("  Resuming stream at offset %s%lu%s\n",
+                   COLOR_WHITE, (unsigned long)resume_saved, COLOR_RESET);
+        } else {
+            resume_path[0] = '\0';  /* Device cannot resume - nothing to persist */
+        }
+
         /* Enable streaming */
         print_header("STREAM CONTROL");
         ret = mds_stream_enable(session);
         if (ret != 0) {
             print_error("Failed to enable streaming");
-            mds_session_destroy(session);
+            release_session(manager, session);
             session = NULL;
             continue;
         }
@@ -309,6 +465,22 @@ int main(int argc, char *argv[]) {
             /* Process one packet with 1 second timeout */
             ret = mds_process_stream(session, &config, 1000, NULL);
 
+            /* Pick up hotplug events - a detach means the session is gone */
+            if (manager) {
+                mds_device_manager_process(manager, 0);
+                if (g_attached_session != session) {
+                    session = NULL;
+                    print_status_box("📴 DEVICE DISCONNECTED", COLOR_YELLOW);
+                    printf("\n");
+                    printf("  %sSession packets:%s  %d\n", COLOR_CYAN, COLOR_RESET, packet_count);
+                    printf("  %sTotal packets:%s    %d\n", COLOR_CYAN, COLOR_RESET, total_packet_count);
+                    printf("\n");
+                    print_info("Device may have reset after fault - waiting to reconnect...");
+                    device_disconnected = true;
+                    break;
+                }
+            }
+
             if (ret == 0) {
                 packet_count++;
                 total_packet_count++;
@@ -320,6 +492,8 @@ int main(int argc, char *argv[]) {
                 printf("%s[%s] 📦 Packet #%d received (session: %d, total: %d)%s\n",
                        COLOR_CYAN, timestamp, packet_count, packet_count, total_packet_count, COLOR_RESET);
 
+                resume_state_sync(session, resume_path, &resume_saved);
+
             } else if (ret == -ETIMEDOUT || ret == MEMFAULT_HID_ERROR_TIMEOUT) {
                 /* Timeout is normal - show heartbeat every 10 seconds */
                 time_t now = time(NULL);
@@ -355,7 +529,11 @@ int main(int argc, char *argv[]) {
                 }
 
                 /* Small delay between error retries */
-                demo_sleep_ms(100);
+                if (manager) {
+                    mds_device_manager_process(manager, 100);
+                } else {
+                    demo_sleep_ms(100);
+                }
             }
         }
 
@@ -363,12 +541,12 @@ int main(int argc, char *argv[]) {
         if (session) {
             /* Try to disable streaming gracefully (may fail if disconnected) */
             mds_stream_disable(session);
-            mds_session_destroy(session);
+            release_session(manager, session);
             session = NULL;
         }
 
-        /* Wait a bit before trying to reconnect */
-        if (keep_running && device_disconnected) {
+        /* Wait a bit before trying to reconnect (hotplug tells us when it's back) */
+        if (keep_running && device_disconnected && manager == NULL) {
             printf("\n");
             print_info("Waiting for device to reboot...");
             demo_sleep_ms(2000);  /* Give device time to reboot */
@@ -383,10 +561,13 @@ int main(int argc, char *argv[]) {
     if (session) {
         print_info("Disabling streaming...");
         mds_stream_disable(session);
-        mds_session_destroy(session);
+        release_session(manager, session);
         print_success("Streaming disabled");
     }
 
+    /* Destroys any sessions still attached */
+    mds_device_manager_destroy(manager);
+
     /* Print final statistics */
     if (uploader) {
         print_header("FINAL STATISTICS");
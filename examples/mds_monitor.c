@@ -142,25 +142,37 @@ static char* select_device_interactive(void) {
     return path;
 }
 
+/**
+ * Enumeration visitor: keep the first match and stop
+ */
+static bool take_first_device(const memfault_hid_device_ref_t *device, void *user_data) {
+    char **path = (char **)user_data;
+
+    printf("Found device: %ls %ls\n",
+           memfault_hid_device_ref_manufacturer(device),
+           memfault_hid_device_ref_product(device));
+
+    *path = strdup(device->path);
+    return false;
+}
+
 /**
  * Find device by VID/PID
  */
 static char* find_device_by_vid_pid(uint16_t vid, uint16_t pid) {
-    memfault_hid_device_info_t *devices = NULL;
-    size_t num_devices = 0;
-    int ret = memfault_hid_enumerate(vid, pid, &devices, &num_devices);
-
-    if (ret != MEMFAULT_HID_SUCCESS || num_devices == 0) {
+    memfault_hid_enum_filter_t filter = {
+        .vendor_id = vid,
+        .product_id = pid,
+        .interface_number = -1,
+    };
+    char *path = NULL;
+    int ret = memfault_hid_enumerate_visit(&filter, take_first_device, &path);
+
+    if (ret <= 0 || path == NULL) {
         fprintf(stderr, "Error: No device found with VID:0x%04X PID:0x%04X\n", vid, pid);
         return NULL;
     }
 
-    printf("Found device: %ls %ls\n",
-           devices[0].manufacturer, devices[0].product);
-
-    char *path = strdup(devices[0].path);
-    memfault_hid_free_device_list(devices);
-
     return path;
 }
 
@@ -22,10 +22,10 @@ def get_library_path() -> str:
     system = platform.system()
     if system == 'Darwin':
         lib_name = 'libmds_bridge.dylib'
-        lib_name_versioned = 'libmds_bridge.2.dylib'
+        lib_name_versioned = 'libmds_bridge.3.dylib'
     elif system == 'Linux':
         lib_name = 'libmds_bridge.so'
-        lib_name_versioned = 'libmds_bridge.so.2'
+        lib_name_versioned = 'libmds_bridge.so.3'
     elif system == 'Windows':
         lib_name = 'mds_bridge.dll'
         lib_name_versioned = None
@@ -93,10 +93,15 @@ class MDS_STREAM_MODE:
 MDS_MAX_DEVICE_ID_LEN = 64
 MDS_MAX_URI_LEN = 128
 MDS_MAX_AUTH_LEN = 128
-MDS_MAX_CHUNK_DATA_LEN = 63
+MDS_MAX_CHUNK_DATA_LEN = 61
+MDS_MAX_STREAM_DATA_LEN = 1020
 MDS_SEQUENCE_MASK = 0x1F
 MDS_SEQUENCE_MAX = 31
 
+# Chunk classes (mds_chunk_class_t)
+MDS_CHUNK_CLASS_NAMES = ['unknown', 'heartbeat', 'trace', 'reboot', 'log', 'coredump', 'cdr']
+MDS_CHUNK_CLASS_COUNT = len(MDS_CHUNK_CLASS_NAMES)
+
 # Struct definitions
 class mds_device_config_t(ctypes.Structure):
     """MDS device configuration"""
@@ -111,8 +116,33 @@ class mds_stream_packet_t(ctypes.Structure):
     """MDS stream data packet"""
     _fields_ = [
         ('sequence', ctypes.c_uint8),
-        ('data', ctypes.c_uint8 * MDS_MAX_CHUNK_DATA_LEN),
+        ('data', ctypes.c_uint8 * MDS_MAX_STREAM_DATA_LEN),
         ('data_len', ctypes.c_size_t),
+        ('rx_monotonic_ns', ctypes.c_uint64),
+        ('rx_realtime_ns', ctypes.c_uint64),
+        ('chunk_class', ctypes.c_int),
+    ]
+
+class mds_rx_timestamp_t(ctypes.Structure):
+    """Receive timestamp reported by a backend"""
+    _fields_ = [
+        ('monotonic_ns', ctypes.c_uint64),
+        ('realtime_ns', ctypes.c_uint64),
+    ]
+
+class mds_session_stats_t(ctypes.Structure):
+    """Per-session stream statistics"""
+    _fields_ = [
+        ('packets_received', ctypes.c_uint64),
+        ('gaps', ctypes.c_uint64),
+        ('lost_packets', ctypes.c_uint64),
+        ('duplicates', ctypes.c_uint64),
+        ('reorders', ctypes.c_uint64),
+        ('nacks_sent', ctypes.c_uint64),
+        ('recovered', ctypes.c_uint64),
+        ('credit_grants', ctypes.c_uint64),
+        ('class_packets', ctypes.c_uint64 * MDS_CHUNK_CLASS_COUNT),
+        ('class_bytes', ctypes.c_uint64 * MDS_CHUNK_CLASS_COUNT),
     ]
 
 # Backend callback function types
@@ -138,12 +168,28 @@ BACKEND_DESTROY_FN = ctypes.CFUNCTYPE(
     ctypes.c_void_p  # impl_data
 )
 
+BACKEND_GET_RX_TIMESTAMP_FN = ctypes.CFUNCTYPE(
+    ctypes.c_int,  # return type
+    ctypes.c_void_p,  # impl_data
+    ctypes.POINTER(mds_rx_timestamp_t)  # ts
+)
+
+BACKEND_READ_DIRECT_FN = ctypes.CFUNCTYPE(
+    ctypes.c_int,  # return type
+    ctypes.c_void_p,  # impl_data
+    ctypes.c_uint8,  # report_id
+    ctypes.POINTER(ctypes.POINTER(ctypes.c_uint8)),  # data
+    ctypes.c_int  # timeout_ms
+)
+
 class mds_backend_ops_t(ctypes.Structure):
     """Backend operations vtable"""
     _fields_ = [
         ('read', BACKEND_READ_FN),
         ('write', BACKEND_WRITE_FN),
         ('destroy', BACKEND_DESTROY_FN),
+        ('get_rx_timestamp', BACKEND_GET_RX_TIMESTAMP_FN),  # optional, may be left NULL
+        ('read_direct', BACKEND_READ_DIRECT_FN),  # optional, may be left NULL
     ]
 
 class mds_backend_t(ctypes.Structure):
@@ -214,6 +260,16 @@ lib.mds_stream_read_packet.argtypes = [
 ]
 lib.mds_stream_read_packet.restype = ctypes.c_int
 
+# Sequence accounting
+lib.mds_get_session_stats.argtypes = [
+    ctypes.c_void_p,  # session
+    ctypes.POINTER(mds_session_stats_t)  # stats
+]
+lib.mds_get_session_stats.restype = ctypes.c_int
+
+lib.mds_reset_session_stats.argtypes = [ctypes.c_void_p]  # session
+lib.mds_reset_session_stats.restype = ctypes.c_int
+
 # High-level stream processing - blocking I/O (reads from device)
 lib.mds_process_stream.argtypes = [
     ctypes.c_void_p,  # session
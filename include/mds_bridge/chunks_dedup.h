@@ -0,0 +1,263 @@
+/**
+ * @file chunks_dedup.h
+ * @brief Deduplication of Memfault messages streamed more than once
+ *
+ * A device that resets (or reconnects) before its last chunks were confirmed
+ * often streams the same messages again. The deduplicator sits between the
+ * stream reader and the upload path and drops messages whose content was
+ * already forwarded:
+ *
+ * - Chunks are followed through the chunk transport headers, and each
+ *   message is hashed (64-bit FNV-1a) as it is reassembled. Only the hash is
+ *   kept, so the comparison does not depend on how the device chunked the
+ *   message (the MTU may differ after a reset).
+ * - Each device has a bounded, most-recently-used list of message hashes,
+ *   optionally expiring after a maximum age and persisted across restarts
+ *   with chunks_dedup_save() / chunks_dedup_load().
+ * - Chunks are forwarded as soon as they arrive unless the message may be a
+ *   duplicate: once the first 64 bytes match a known message, its chunks are
+ *   held until the message ends. A complete duplicate is dropped; a message
+ *   that turns out to differ is forwarded in order. Held data per device is
+ *   capped; a message exceeding the cap is forwarded without deduplication.
+ * - A message interrupted by the start of a new one is dropped while held
+ *   (the Memfault cloud discards an incomplete message anyway).
+ *
+ * Messages with identical content are indistinguishable. Events without a
+ * capture timestamp that legitimately repeat (e.g. the same reboot reason in
+ * a reboot loop) are dropped within the window, so keep max_age_sec short if
+ * such repeats matter.
+ *
+ * Held chunks live only in memory. Call chunks_dedup_flush() when a device's
+ * stream stops (e.g. on detach) so they reach the upload path.
+ *
+ * Calls for the same device must not run concurrently (one reader per
+ * device); different devices may be processed from different threads. The
+ * forward callback runs without internal locks held.
+ *
+ * Usage:
+ * @code
+ * static void forward(const char *device_id, const uint8_t *chunk, size_t len,
+ *                     void *user_data) {
+ *     queue_for_upload(device_id, chunk, len);
+ * }
+ *
+ * chunks_dedup_t *dedup = chunks_dedup_create(NULL);
+ * chunks_dedup_load(dedup, "/var/lib/gateway/dedup.db");
+ *
+ * // For every stream packet
+ * chunks_dedup_process(dedup, device_id, packet.data, packet.data_len, forward, NULL);
+ *
+ * // Shutdown
+ * chunks_dedup_flush(dedup, NULL, forward, NULL);
+ * chunks_dedup_save(dedup, "/var/lib/gateway/dedup.db");
+ * chunks_dedup_destroy(dedup);
+ * @endcode
+ */
+
+#ifndef MDS_BRIDGE_CHUNKS_DEDUP_H
+#define MDS_BRIDGE_CHUNKS_DEDUP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Opaque handle to a deduplicator
+ */
+typedef struct chunks_dedup chunks_dedup_t;
+
+/**
+ * @brief Deduplicator configuration
+ */
+typedef struct {
+    /** Message hashes remembered per device (>= 1) */
+    size_t max_messages;
+
+    /** Devices tracked; the least recently active idle device is forgotten
+     *  first. While all of them hold chunks, other devices pass through
+     *  without deduplication. */
+    size_t max_devices;
+
+    /** Bytes of possibly duplicate chunks held per device */
+    size_t max_held_bytes;
+
+    /** Forget messages seen longer ago than this (0 = never) */
+    uint32_t max_age_sec;
+} chunks_dedup_config_t;
+
+/**
+ * @brief Deduplicator statistics
+ */
+typedef struct {
+    /** Devices tracked */
+    size_t devices;
+
+    /** Message hashes remembered, all devices */
+    size_t entries;
+
+    /** Bytes of chunks currently held */
+    size_t held_bytes;
+
+    /** Complete messages seen */
+    uint64_t messages;
+
+    /** Messages dropped as duplicates */
+    uint64_t duplicate_messages;
+
+    /** Chunks dropped as duplicates */
+    uint64_t duplicate_chunks;
+
+    /** Bytes dropped as duplicates */
+    uint64_t duplicate_bytes;
+
+    /** Held chunks dropped because their message was interrupted */
+    uint64_t abandoned_chunks;
+
+    /** Messages forwarded unchecked because they exceeded max_held_bytes */
+    uint64_t overflows;
+} chunks_dedup_stats_t;
+
+/**
+ * @brief Callback receiving chunks that are not duplicates
+ *
+ * @param device_id Device the chunk belongs to
+ * @param chunk Chunk data (valid for the duration of the call)
+ * @param len Chunk length
+ * @param user_data User context pointer
+ */
+typedef void (*chunks_dedup_forward_t)(const char *device_id,
+                                       const uint8_t *chunk,
+                                       size_t len,
+                                       void *user_data);
+
+/**
+ * @brief Fill a configuration with defaults
+ *
+ * 64 messages per device, 1024 devices, 64 KiB held per device and a one
+ * hour window.
+ *
+ * @param config Configuration to fill
+ */
+void chunks_dedup_default_config(chunks_dedup_config_t *config);
+
+/**
+ * @brief Create a deduplicator
+ *
+ * @param config Configuration (NULL for defaults)
+ *
+ * @return Deduplicator handle, or NULL on failure
+ */
+chunks_dedup_t *chunks_dedup_create(const chunks_dedup_config_t *config);
+
+/**
+ * @brief Destroy a deduplicator
+ *
+ * Held chunks are discarded; call chunks_dedup_flush() first to keep them.
+ *
+ * @param dedup Deduplicator handle
+ */
+void chunks_dedup_destroy(chunks_dedup_t *dedup);
+
+/**
+ * @brief Process a chunk received from a device
+ *
+ * Calls forward for each chunk to pass on, in stream order: possibly chunks
+ * held earlier, then this chunk. Nothing is forwarded while the chunk is
+ * held or when it completes a duplicate message. If memory for holding a
+ * chunk runs out, the message is forwarded without deduplication.
+ *
+ * @param dedup Deduplicator handle
+ * @param device_id Device the chunk was received from
+ * @param chunk Chunk data (one stream packet payload)
+ * @param len Chunk length
+ * @param forward Callback for chunks to pass on
+ * @param user_data User context pointer passed to forward
+ *
+ * @return Number of chunks forwarded (>= 0), -EINVAL on invalid parameters
+ */
+int chunks_dedup_process(chunks_dedup_t *dedup,
+                         const char *device_id,
+                         const uint8_t *chunk,
+                         size_t len,
+                         chunks_dedup_forward_t forward,
+                         void *user_data);
+
+/**
+ * @brief Forward held chunks of unfinished messages
+ *
+ * The rest of each flushed message is forwarded as it arrives (a resumed
+ * stream may continue it) and is not deduplicated.
+ *
+ * @param dedup Deduplicator handle
+ * @param device_id Device to flush (NULL for all devices)
+ * @param forward Callback for the held chunks
+ * @param user_data User context pointer passed to forward
+ *
+ * @return Number of chunks forwarded (>= 0), -EINVAL on invalid parameters
+ */
+int chunks_dedup_flush(chunks_dedup_t *dedup,
+                       const char *device_id,
+                       chunks_dedup_forward_t forward,
+                       void *user_data);
+
+/**
+ * @brief Save the remembered message hashes to a file
+ *
+ * The file is written to a temporary name and renamed into place.
+ *
+ * @param dedup Deduplicator handle
+ * @param path File path
+ *
+ * @return 0 on success, negative errno on failure
+ */
+int chunks_dedup_save(chunks_dedup_t *dedup, const char *path);
+
+/**
+ * @brief Load message hashes saved by chunks_dedup_save()
+ *
+ * Replaces the remembered hashes of every device in the file. Expired
+ * entries and entries beyond max_messages are skipped.
+ *
+ * @param dedup Deduplicator handle
+ * @param path File path
+ *
+ * @return Number of entries loaded (>= 0), -ENOENT if the file does not
+ *         exist, -EINVAL if it is not a valid file, other negative errno on
+ *         failure
+ */
+int chunks_dedup_load(chunks_dedup_t *dedup, const char *path);
+
+/**
+ * @brief Get the bytes of chunks held for one device
+ *
+ * Every chunk passed to chunks_dedup_process() is either forwarded, dropped
+ * or still held. A caller acknowledging stream data only once it is safe can
+ * therefore acknowledge everything it fed in except these bytes.
+ *
+ * @param dedup Deduplicator handle
+ * @param device_id Device to query (an unknown device holds nothing)
+ * @param held_bytes Pointer to receive the held byte count
+ *
+ * @return 0 on success, -EINVAL on invalid parameters
+ */
+int chunks_dedup_get_held_bytes(chunks_dedup_t *dedup, const char *device_id,
+                                size_t *held_bytes);
+
+/**
+ * @brief Get deduplicator statistics
+ *
+ * @param dedup Deduplicator handle
+ * @param stats Pointer to receive statistics
+ *
+ * @return 0 on success, -EINVAL on invalid parameters
+ */
+int chunks_dedup_get_stats(chunks_dedup_t *dedup, chunks_dedup_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MDS_BRIDGE_CHUNKS_DEDUP_H */
@@ -0,0 +1,301 @@
+/**
+ * @file chunks_file_sink.h
+ * @brief Offline storage of Memfault chunks in rotating per-device files
+ *
+ * For gateways without network access: instead of uploading chunks over
+ * HTTP, the file sink appends them to segment files that are carried off
+ * site and uploaded later in bulk (see examples/mds_bulk_upload.c).
+ *
+ * Layout under the sink directory:
+ * @code
+ * <directory>/<device id>/00000001.seg[.gz]   Closed segments
+ * <directory>/<device id>/00000002.seg[.gz]   Segment being written
+ * <directory>/<device id>/index               One line per closed segment
+ * @endcode
+ *
+ * - A segment starts with a header carrying the data URI and authorization
+ *   of its chunks, followed by the chunks in stream order. Segments are
+ *   closed (rotated) when they reach max_segment_bytes or
+ *   max_segment_age_sec, when the URI or authorization changes, and on
+ *   chunks_file_sink_rotate(). Only closed segments appear in the index, so
+ *   a bulk upload never picks up a segment that is still being written.
+ * - Each index line is "<segment file> <chunks> <chunk bytes>".
+ * - Chunks are collected in a per-device buffer and written with a single
+ *   write() to a file opened with O_APPEND when the buffer fills, when
+ *   flush_interval_ms has passed since the oldest buffered chunk, or on
+ *   chunks_file_sink_flush(). With compression, every write is one gzip
+ *   member (readers such as zcat and gzread() concatenate members).
+ * - Segments left open by a crash are indexed when the device is next
+ *   written to; a truncated tail is ignored when reading.
+ *
+ * Buffered chunks are lost if the process crashes before they are written;
+ * set sync for an fsync() after every write. With an I/O engine (io), writes
+ * and fsyncs run on the engine instead of the calling thread, and a failed
+ * write is reported by the next call that writes or closes the segment. The sink is safe to use from
+ * several threads (one lock per device). Only one sink may write to a
+ * directory at a time. POSIX only.
+ *
+ * Usage:
+ * @code
+ * chunks_file_sink_t *sink = chunks_file_sink_create("/var/lib/gateway/chunks", NULL);
+ * mds_set_upload_callback_ex(session, chunks_file_sink_callback, sink);
+ * ...
+ * chunks_file_sink_destroy(sink);  // Writes buffered chunks, closes segments
+ * @endcode
+ */
+
+#ifndef MDS_BRIDGE_CHUNKS_FILE_SINK_H
+#define MDS_BRIDGE_CHUNKS_FILE_SINK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "mds_protocol.h"
+#include "mds_sink.h"
+#include "mds_io.h"
+
+/**
+ * @brief Opaque handle to a file sink
+ */
+typedef struct chunks_file_sink chunks_file_sink_t;
+
+/**
+ * @brief File sink configuration
+ */
+typedef struct {
+    /** Write buffer per device in bytes (>= 4096) */
+    size_t buffer_bytes;
+
+    /** Rotate segments after this many bytes of chunk data */
+    uint64_t max_segment_bytes;
+
+    /** Rotate segments after this many seconds (0 = no age limit) */
+    uint32_t max_segment_age_sec;
+
+    /** Write buffered chunks at most this long after they arrive (0 = buffer until full) */
+    uint32_t flush_interval_ms;
+
+    /** gzip-compress segments (see chunks_file_sink_compression_supported()) */
+    bool compress;
+
+    /** fsync() segment files after every write */
+    bool sync;
+
+    /** Engine for segment writes and fsyncs (NULL: write on the calling thread).
+     *  Must outlive the sink. */
+    mds_io_t *io;
+} chunks_file_sink_config_t;
+
+/**
+ * @brief File sink statistics
+ */
+typedef struct {
+    /** Chunks accepted */
+    uint64_t chunks_written;
+
+    /** Chunk bytes accepted */
+    uint64_t bytes_written;
+
+    /** Bytes written to segment files (after compression) */
+    uint64_t file_bytes;
+
+    /** write() calls on segment files */
+    uint64_t writes;
+
+    /** Segments closed and added to an index */
+    uint64_t segments_closed;
+
+    /** Failed writes (chunks in the failed buffer are lost) */
+    uint64_t write_errors;
+
+    /** Segments currently open */
+    size_t open_segments;
+} chunks_file_sink_stats_t;
+
+/**
+ * @brief Segment header information passed to chunks_file_segment_read() callbacks
+ */
+typedef struct {
+    /** Data URI of the chunks */
+    char uri[MDS_MAX_URI_LEN];
+
+    /** Authorization header of the chunks ("HeaderName:HeaderValue") */
+    char auth[MDS_MAX_AUTH_LEN];
+} chunks_file_segment_info_t;
+
+/**
+ * @brief Callback receiving the chunks of a segment
+ *
+ * @param segment Segment header information
+ * @param chunk Chunk data (valid for the duration of the call)
+ * @param len Chunk length
+ * @param chunk_class Kind of data the chunk belongs to
+ * @param user_data User context pointer
+ *
+ * @return 0 to continue, negative error code to stop reading
+ */
+typedef int (*chunks_file_record_callback_t)(const chunks_file_segment_info_t *segment,
+                                             const uint8_t *chunk,
+                                             size_t len,
+                                             mds_chunk_class_t chunk_class,
+                                             void *user_data);
+
+/**
+ * @brief Fill a configuration with defaults
+ *
+ * 64 KiB buffers, 4 MiB segments rotated at least hourly, a one second
+ * flush interval, no compression, no fsync and synchronous writes.
+ *
+ * @param config Configuration to fill
+ */
+void chunks_file_sink_default_config(chunks_file_sink_config_t *config);
+
+/**
+ * @brief Check whether gzip compression is available (built with zlib)
+ *
+ * @return true if compressed segments can be written and read
+ */
+bool chunks_file_sink_compression_supported(void);
+
+/**
+ * @brief Create a file sink
+ *
+ * @param directory Directory for the device subdirectories (created if missing)
+ * @param config Configuration (NULL for defaults)
+ *
+ * @return Sink handle, or NULL on failure (invalid configuration, directory
+ *         not usable, or compression requested without zlib support)
+ */
+chunks_file_sink_t *chunks_file_sink_create(const char *directory,
+                                            const chunks_file_sink_config_t *config);
+
+/**
+ * @brief Destroy a file sink
+ *
+ * Writes buffered chunks and closes all open segments.
+ *
+ * @param sink Sink handle
+ */
+void chunks_file_sink_destroy(chunks_file_sink_t *sink);
+
+/**
+ * @brief Store a chunk
+ *
+ * @param sink Sink handle
+ * @param device_id Device the chunk belongs to (names its subdirectory)
+ * @param uri Data URI for the later upload
+ * @param auth_header Authorization header for the later upload
+ * @param chunk Chunk data
+ * @param len Chunk length (at most MDS_MAX_STREAM_DATA_LEN)
+ * @param chunk_class Kind of data the chunk belongs to
+ *
+ * @return 0 on success, -EINVAL on invalid parameters, negative errno if
+ *         the device directory or a segment cannot be written
+ */
+int chunks_file_sink_write(chunks_file_sink_t *sink,
+                           const char *device_id,
+                           const char *uri,
+                           const char *auth_header,
+                           const uint8_t *chunk,
+                           size_t len,
+                           mds_chunk_class_t chunk_class);
+
+/**
+ * @brief Extended upload callback for use with mds_set_upload_callback_ex()
+ *
+ * Stores the chunk with chunks_file_sink_write(). The device is identified
+ * by the last path component of the URI (the Memfault chunks URI ends with
+ * the device serial).
+ *
+ * @param uri Data URI
+ * @param auth_header Authorization header
+ * @param chunk_data Chunk data
+ * @param chunk_len Chunk length
+ * @param info Chunk metadata
+ * @param user_data Must be a chunks_file_sink_t* instance
+ *
+ * @return 0 on success, negative error code on failure
+ */
+int chunks_file_sink_callback(const char *uri,
+                              const char *auth_header,
+                              const uint8_t *chunk_data,
+                              size_t chunk_len,
+                              const mds_chunk_info_t *info,
+                              void *user_data);
+
+/**
+ * @brief Sink write callback for use as mds_sink_config_t::write
+ *
+ * Stores every chunk like chunks_file_sink_callback(). Well suited to an
+ * async sink, so that segment writes never delay the stream.
+ *
+ * @param chunks Chunks in stream order
+ * @param count Number of chunks
+ * @param user_data Must be a chunks_file_sink_t* instance
+ *
+ * @return 0 on success, the first error if a chunk could not be stored
+ */
+int chunks_file_sink_batch_callback(const mds_sink_chunk_t *chunks, size_t count,
+                                    void *user_data);
+
+/**
+ * @brief Write all buffered chunks
+ *
+ * Also closes segments that reached max_segment_age_sec. Call periodically
+ * when chunks arrive rarely, since buffers are otherwise only written when
+ * the next chunk of the device arrives.
+ *
+ * @param sink Sink handle
+ *
+ * @return 0 on success, negative errno if a write failed
+ */
+int chunks_file_sink_flush(chunks_file_sink_t *sink);
+
+/**
+ * @brief Close all open segments so they can be uploaded
+ *
+ * @param sink Sink handle
+ *
+ * @return 0 on success, negative errno if a write failed
+ */
+int chunks_file_sink_rotate(chunks_file_sink_t *sink);
+
+/**
+ * @brief Get file sink statistics
+ *
+ * @param sink Sink handle
+ * @param stats Pointer to receive statistics
+ *
+ * @return 0 on success, -EINVAL on invalid parameters
+ */
+int chunks_file_sink_get_stats(chunks_file_sink_t *sink, chunks_file_sink_stats_t *stats);
+
+/**
+ * @brief Read the chunks of a segment file
+ *
+ * Compressed segments need zlib support. A truncated last record (e.g.
+ * after a crash) ends the segment.
+ *
+ * @param path Segment file path
+ * @param callback Called for every chunk in order
+ * @param user_data User context pointer passed to callback
+ *
+ * @return Number of chunks read (>= 0), -EINVAL if the file is not a
+ *         segment, -ENOTSUP for compressed segments without zlib, the
+ *         callback's error if it stopped reading, other negative errno on
+ *         failure
+ */
+int chunks_file_segment_read(const char *path,
+                             chunks_file_record_callback_t callback,
+                             void *user_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MDS_BRIDGE_CHUNKS_FILE_SINK_H */
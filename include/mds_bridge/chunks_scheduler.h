@@ -0,0 +1,252 @@
+/**
+ * @file chunks_scheduler.h
+ * @brief Fair, rate-limited scheduling of chunk uploads across devices
+ *
+ * When several devices share one uplink, a device streaming a large coredump
+ * can keep the uploader busy for minutes while heartbeats and reboot events
+ * from every other device wait behind it. The scheduler sits between the
+ * producers (stream readers) and the uploader threads and decides which
+ * device's chunk is uploaded next:
+ *
+ * - Chunks are queued per device and always leave a device's queue in order,
+ *   with at most one chunk per device in flight (the Memfault cloud
+ *   reassembles messages that span several chunks).
+ * - Devices are served by deficit round robin. Each visit grants a device
+ *   quantum * weight bytes of credit, where the weight comes from the
+ *   priority class of the chunk at the head of its queue, so a device with
+ *   a pending heartbeat gets a larger share of the link than one trickling
+ *   out coredump data.
+ * - A per-device token bucket caps the rate of any single device, and a
+ *   global token bucket caps the total rate for metered links. A chunk may
+ *   leave when the bucket is not in debt, so chunks larger than the burst
+ *   size are never stuck; the debt delays the following chunks instead.
+ *
+ * The scheduler has no threads of its own and is safe to use from several
+ * threads. It never blocks: when every queued chunk is held back by a rate
+ * limit, chunks_scheduler_dequeue() reports how long to wait.
+ *
+ * Usage:
+ * @code
+ * chunks_scheduler_config_t config;
+ * chunks_scheduler_default_config(&config);
+ * config.global_limit.rate_bytes_per_sec = 16 * 1024;
+ * chunks_scheduler_t *scheduler = chunks_scheduler_create(&config);
+ *
+ * // Producer (info from the extended upload callback)
+ * chunks_scheduler_enqueue(scheduler, device_id,
+ *                          chunks_scheduler_priority(info->chunk_class), len, chunk);
+ *
+ * // Uploader thread
+ * void *chunk;
+ * int wait_ms;
+ * if (chunks_scheduler_dequeue(scheduler, &chunk, &wait_ms) == 0) {
+ *     bool ok = upload(chunk) == 0;
+ *     chunks_scheduler_complete(scheduler, chunk, !ok);  // Requeue on failure
+ * }
+ * @endcode
+ */
+
+#ifndef MDS_BRIDGE_CHUNKS_SCHEDULER_H
+#define MDS_BRIDGE_CHUNKS_SCHEDULER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "mds_protocol.h"
+
+/**
+ * @brief Opaque handle to a chunk scheduler
+ */
+typedef struct chunks_scheduler chunks_scheduler_t;
+
+/**
+ * @brief Priority classes (lower value = more urgent)
+ */
+typedef enum {
+    /** Time-sensitive events (heartbeats, reboots) */
+    CHUNKS_PRIORITY_HIGH = 0,
+
+    /** Default class */
+    CHUNKS_PRIORITY_NORMAL = 1,
+
+    /** Large transfers that may trickle (coredumps) */
+    CHUNKS_PRIORITY_BULK = 2,
+
+    /** Number of priority classes */
+    CHUNKS_PRIORITY_COUNT
+} chunks_priority_t;
+
+/**
+ * @brief Token bucket parameters
+ */
+typedef struct {
+    /** Sustained rate in bytes per second (0 = unlimited) */
+    uint64_t rate_bytes_per_sec;
+
+    /** Bucket size in bytes (0 = one second worth of rate) */
+    uint64_t burst_bytes;
+} chunks_rate_limit_t;
+
+/**
+ * @brief Scheduler configuration
+ */
+typedef struct {
+    /** Cap on the total upload rate of all devices */
+    chunks_rate_limit_t global_limit;
+
+    /** Cap on the upload rate of each device */
+    chunks_rate_limit_t device_limit;
+
+    /** Credit in bytes granted per round robin visit (before weighting) */
+    size_t quantum;
+
+    /** Share of each priority class, indexed by chunks_priority_t (>= 1) */
+    unsigned int weights[CHUNKS_PRIORITY_COUNT];
+} chunks_scheduler_config_t;
+
+/**
+ * @brief Scheduler statistics
+ */
+typedef struct {
+    /** Devices with queued or in-flight chunks */
+    size_t active_devices;
+
+    /** Chunks waiting in device queues */
+    size_t queued;
+
+    /** Chunks handed out and not yet completed */
+    size_t in_flight;
+
+    /** Chunks handed out, per priority class */
+    uint64_t dispatched[CHUNKS_PRIORITY_COUNT];
+
+    /** Bytes handed out, per priority class */
+    uint64_t bytes_dispatched[CHUNKS_PRIORITY_COUNT];
+
+    /** Dequeue attempts held back by a rate limit */
+    uint64_t throttled;
+} chunks_scheduler_stats_t;
+
+/**
+ * @brief Fill a configuration with defaults
+ *
+ * No rate limits, 1024-byte quantum and weights 8/4/1 for the high, normal
+ * and bulk classes.
+ *
+ * @param config Configuration to fill
+ */
+void chunks_scheduler_default_config(chunks_scheduler_config_t *config);
+
+/**
+ * @brief Get the priority class for a kind of chunk
+ *
+ * Heartbeats, traces and reboots are HIGH, coredumps and custom data
+ * recordings BULK, everything else NORMAL.
+ *
+ * @param chunk_class Chunk class (see mds_chunk_classify())
+ *
+ * @return Priority class
+ */
+chunks_priority_t chunks_scheduler_priority(mds_chunk_class_t chunk_class);
+
+/**
+ * @brief Create a scheduler
+ *
+ * @param config Configuration (NULL for defaults)
+ *
+ * @return Scheduler handle, or NULL on failure
+ */
+chunks_scheduler_t *chunks_scheduler_create(const chunks_scheduler_config_t *config);
+
+/**
+ * @brief Destroy a scheduler
+ *
+ * Queued and in-flight chunks are owned by the caller; release is called
+ * for each chunk still queued so the caller can free it.
+ *
+ * @param scheduler Scheduler handle
+ * @param release Called for every queued chunk (may be NULL)
+ */
+void chunks_scheduler_destroy(chunks_scheduler_t *scheduler, void (*release)(void *chunk));
+
+/**
+ * @brief Replace the configuration
+ *
+ * Takes effect for the next dequeue. Token buckets keep their current fill
+ * level, clamped to the new burst size.
+ *
+ * @param scheduler Scheduler handle
+ * @param config New configuration
+ *
+ * @return 0 on success, -EINVAL on invalid parameters
+ */
+int chunks_scheduler_set_config(chunks_scheduler_t *scheduler,
+                                const chunks_scheduler_config_t *config);
+
+/**
+ * @brief Queue a chunk for upload
+ *
+ * @param scheduler Scheduler handle
+ * @param device_id Device the chunk belongs to (chunks of a device leave in order)
+ * @param priority Priority class of the chunk
+ * @param size Bytes the chunk costs against the rate limits
+ * @param chunk Caller-owned chunk handle returned by chunks_scheduler_dequeue()
+ *
+ * @return 0 on success, -EINVAL on invalid parameters, -ENOMEM on allocation failure
+ */
+int chunks_scheduler_enqueue(chunks_scheduler_t *scheduler,
+                             const char *device_id,
+                             chunks_priority_t priority,
+                             size_t size,
+                             void *chunk);
+
+/**
+ * @brief Take the next chunk to upload
+ *
+ * The chunk stays charged to its device until chunks_scheduler_complete()
+ * is called; until then no other chunk of that device is handed out.
+ *
+ * @param scheduler Scheduler handle
+ * @param chunk Receives the chunk handle
+ * @param wait_ms Receives the time until a rate-limited chunk becomes
+ *                eligible when -EAGAIN is returned (may be NULL)
+ *
+ * @return 0 on success, -EAGAIN if every queued chunk is rate limited,
+ *         -ENOENT if no chunk is eligible (queues empty or devices busy),
+ *         -EINVAL on invalid parameters
+ */
+int chunks_scheduler_dequeue(chunks_scheduler_t *scheduler, void **chunk, int *wait_ms);
+
+/**
+ * @brief Finish a chunk returned by chunks_scheduler_dequeue()
+ *
+ * @param scheduler Scheduler handle
+ * @param chunk Chunk handle
+ * @param requeue true to put the chunk back at the front of its device queue
+ *                (e.g. after a failed upload); its bytes are refunded to the
+ *                rate limits
+ *
+ * @return 0 on success, -EINVAL if the chunk is not in flight
+ */
+int chunks_scheduler_complete(chunks_scheduler_t *scheduler, void *chunk, bool requeue);
+
+/**
+ * @brief Get scheduler statistics
+ *
+ * @param scheduler Scheduler handle
+ * @param stats Pointer to receive statistics
+ *
+ * @return 0 on success, -EINVAL on invalid parameters
+ */
+int chunks_scheduler_get_stats(chunks_scheduler_t *scheduler, chunks_scheduler_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MDS_BRIDGE_CHUNKS_SCHEDULER_H */
@@ -22,6 +22,8 @@ extern "C" {
 #include <stddef.h>
 #include <stdbool.h>
 
+#include "mds_sink.h"
+
 /**
  * @brief Opaque handle to an HTTP uploader
  */
@@ -87,6 +89,47 @@ int chunks_uploader_callback(const char *uri,
                               size_t chunk_len,
                               void *user_data);
 
+/**
+ * @brief Upload several chunks of one device in a single request
+ *
+ * Sends the chunks as one multipart/mixed POST (one part per chunk, in
+ * order), which the Memfault chunks endpoint accepts in place of one request
+ * per chunk. Meant for bulk uploads of stored data; a single chunk is sent
+ * as a plain chunk upload.
+ *
+ * @param uploader Uploader handle
+ * @param uri Data URI to POST to
+ * @param auth_header Authorization header (format: "HeaderName:HeaderValue")
+ * @param chunks Chunk data, in stream order
+ * @param lens Length of each chunk
+ * @param count Number of chunks
+ *
+ * @return 0 on success (all chunks accepted), negative error code on failure
+ */
+int chunks_uploader_upload_batch(chunks_uploader_t *uploader,
+                                 const char *uri,
+                                 const char *auth_header,
+                                 const uint8_t *const chunks[],
+                                 const size_t lens[],
+                                 size_t count);
+
+/**
+ * @brief Sink write callback for use as mds_sink_config_t::write
+ *
+ * Uploads the chunks with chunks_uploader_upload_batch(), one request per
+ * run of chunks with the same URI and authorization. With an async sink
+ * the chunks of a batch share one HTTP request. An uploader is not
+ * thread-safe: give every sink its own.
+ *
+ * @param chunks Chunks in stream order
+ * @param count Number of chunks
+ * @param user_data Must be a chunks_uploader_t* instance
+ *
+ * @return 0 on success (all chunks accepted), negative error code on failure
+ */
+int chunks_uploader_batch_callback(const mds_sink_chunk_t *chunks, size_t count,
+                                   void *user_data);
+
 /**
  * @brief Get upload statistics
  *
@@ -0,0 +1,187 @@
+/**
+ * @file mds_arena.h
+ * @brief Arena (bump) allocator for per-session and per-batch memory
+ *
+ * An arena hands out memory by advancing an offset in a block, and gives all
+ * of it back at once. Long-running gateways use arenas for memory that has a
+ * common lifetime, so steady-state processing does not call malloc()/free()
+ * and the heap does not fragment:
+ * - Scratch memory of one batch or request: allocate while processing, then
+ *   mds_arena_reset() (constant time) before the next one.
+ * - Objects living as long as their owner (e.g. a session and its tables):
+ *   allocate from the owner's arena and mds_arena_destroy() it with the owner.
+ *
+ * When a block is full, another one is added (twice the size of the last, or
+ * larger for a big allocation). Blocks are kept across resets, so once the
+ * arena has grown to the largest batch it sees, allocation never reaches
+ * the heap again; mds_arena_trim() returns the extra blocks after a one-off
+ * spike. Allocations are aligned for any object type and cannot be freed
+ * individually (see mds_arena_mark() for nested scratch use).
+ *
+ * An arena is not thread-safe; give every thread its own.
+ *
+ * Usage:
+ * @code
+ * mds_arena_t *scratch = mds_arena_create(16 * 1024);
+ * while (running) {
+ *     char *header = mds_arena_printf(scratch, "%s: %s", name, value);
+ *     uint8_t *body = mds_arena_alloc(scratch, body_len);
+ *     ...
+ *     mds_arena_reset(scratch);  // Everything above is released
+ * }
+ * mds_arena_destroy(scratch);
+ * @endcode
+ */
+
+#ifndef MDS_BRIDGE_MDS_ARENA_H
+#define MDS_BRIDGE_MDS_ARENA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Opaque handle to an arena
+ */
+typedef struct mds_arena mds_arena_t;
+
+/**
+ * @brief Position in an arena (see mds_arena_mark())
+ */
+typedef struct {
+    void *block;
+    size_t offset;
+    size_t used;
+} mds_arena_mark_t;
+
+/**
+ * @brief Arena statistics
+ */
+typedef struct {
+    /** Bytes in all blocks */
+    size_t capacity;
+
+    /** Bytes allocated since the last reset */
+    size_t used;
+
+    /** Most bytes allocated between two resets */
+    size_t high_water;
+
+    /** Blocks held */
+    size_t blocks;
+
+    /** Blocks added after creation (heap allocations) */
+    uint64_t grows;
+
+    /** Resets */
+    uint64_t resets;
+} mds_arena_stats_t;
+
+/**
+ * @brief Create an arena
+ *
+ * The arena and its first block are one heap allocation.
+ *
+ * @param block_size Size of the first block in bytes (0 for 4 KiB)
+ *
+ * @return Arena handle, or NULL if out of memory
+ */
+mds_arena_t *mds_arena_create(size_t block_size);
+
+/**
+ * @brief Destroy an arena and everything allocated from it
+ *
+ * @param arena Arena handle
+ */
+void mds_arena_destroy(mds_arena_t *arena);
+
+/**
+ * @brief Allocate memory
+ *
+ * @param arena Arena handle
+ * @param size Bytes to allocate
+ *
+ * @return Memory aligned for any object type (uninitialized), or NULL if
+ *         out of memory or arena is NULL
+ */
+void *mds_arena_alloc(mds_arena_t *arena, size_t size);
+
+/**
+ * @brief Allocate zeroed memory for an array
+ *
+ * @param arena Arena handle
+ * @param count Number of elements
+ * @param size Size of an element
+ *
+ * @return Zeroed memory, or NULL if out of memory or on overflow
+ */
+void *mds_arena_calloc(mds_arena_t *arena, size_t count, size_t size);
+
+/**
+ * @brief Format a string into arena memory
+ *
+ * @param arena Arena handle
+ * @param fmt printf-style format string
+ *
+ * @return Formatted string, or NULL if out of memory
+ */
+char *mds_arena_printf(mds_arena_t *arena, const char *fmt, ...)
+#if defined(__GNUC__) || defined(__clang__)
+    __attribute__((format(printf, 2, 3)))
+#endif
+    ;
+
+/**
+ * @brief Remember the current position
+ *
+ * mds_arena_rewind() to the mark releases everything allocated after it,
+ * e.g. scratch memory of one item within a batch.
+ *
+ * @param arena Arena handle
+ *
+ * @return Position
+ */
+mds_arena_mark_t mds_arena_mark(const mds_arena_t *arena);
+
+/**
+ * @brief Release everything allocated after a mark
+ *
+ * @param arena Arena handle
+ * @param mark Position from mds_arena_mark() (no reset in between)
+ */
+void mds_arena_rewind(mds_arena_t *arena, mds_arena_mark_t mark);
+
+/**
+ * @brief Release everything allocated from an arena
+ *
+ * Constant time; blocks are kept for reuse.
+ *
+ * @param arena Arena handle
+ */
+void mds_arena_reset(mds_arena_t *arena);
+
+/**
+ * @brief Reset an arena and free all blocks but the first
+ *
+ * @param arena Arena handle
+ */
+void mds_arena_trim(mds_arena_t *arena);
+
+/**
+ * @brief Get arena statistics
+ *
+ * @param arena Arena handle
+ * @param stats Pointer to receive statistics
+ *
+ * @return 0 on success, -EINVAL on invalid parameters
+ */
+int mds_arena_get_stats(const mds_arena_t *arena, mds_arena_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MDS_BRIDGE_MDS_ARENA_H */
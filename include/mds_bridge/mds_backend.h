@@ -3,7 +3,9 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <assert.h>
+#include <errno.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -21,6 +23,9 @@ extern "C" {
  * - write(): Write a report to the device (handles feature SET operations)
  * - destroy(): Clean up backend resources
  *
+ * Optional operations (leave NULL if unsupported):
+ * - get_rx_timestamp(): Receive time of the last input report
+ *
  * The report_id parameter determines the type of operation:
  * - For HID: report_id maps to HID report IDs (feature vs input determined by context)
  * - For Serial: report_id used as protocol framing byte
@@ -32,6 +37,14 @@ extern "C" {
  */
 typedef struct mds_backend mds_backend_t;
 
+/**
+ * Receive timestamps of an input report
+ */
+typedef struct {
+    uint64_t monotonic_ns;          /**< CLOCK_MONOTONIC when the report was read */
+    uint64_t realtime_ns;           /**< CLOCK_REALTIME when the report was read */
+} mds_rx_timestamp_t;
+
 /**
  * Backend operation vtable
  *
@@ -69,6 +82,36 @@ typedef struct {
      * @param impl_data Backend-specific state to clean up
      */
     void (*destroy)(void *impl_data);
+
+    /**
+     * Get the receive timestamps of the last input report read (optional)
+     *
+     * Transports should capture the timestamps as close to the read system
+     * call as possible. If NULL, the protocol layer timestamps the report
+     * when read() returns.
+     *
+     * @param impl_data Backend-specific state
+     * @param ts Pointer to receive timestamps
+     * @return 0 on success, negative on error
+     */
+    int (*get_rx_timestamp)(void *impl_data, mds_rx_timestamp_t *ts);
+
+    /**
+     * Read an input report without copying it (optional)
+     *
+     * Like read(), but the transport reads the report into a buffer of its
+     * own and hands out a pointer to it, saving a copy per stream packet.
+     * If NULL, or if it returns -ENOTSUP for report_id, read() is used.
+     *
+     * @param impl_data Backend-specific state
+     * @param report_id Report ID to read
+     * @param data Pointer to receive the report data (excluding Report ID),
+     *             valid until the next read or destroy
+     * @param timeout_ms Timeout in milliseconds (-1 for blocking)
+     * @return Number of bytes read on success, negative on error
+     */
+    int (*read_direct)(void *impl_data, uint8_t report_id, const uint8_t **data,
+                       int timeout_ms);
 } mds_backend_ops_t;
 
 /**
@@ -115,6 +158,44 @@ static inline int mds_backend_write(mds_backend_t *backend, uint8_t report_id,
     return backend->ops->write(backend->impl_data, report_id, buffer, length);
 }
 
+/**
+ * Get the receive timestamps of the last input report read
+ *
+ * @param backend Backend instance
+ * @param ts Pointer to receive timestamps
+ * @return 0 on success, -ENOTSUP if the backend does not provide timestamps,
+ *         other negative error code on failure
+ */
+static inline int mds_backend_get_rx_timestamp(mds_backend_t *backend,
+                                                mds_rx_timestamp_t *ts) {
+    assert(backend != NULL && "backend cannot be NULL");
+    assert(backend->ops != NULL && "backend->ops cannot be NULL");
+    if (backend->ops->get_rx_timestamp == NULL) {
+        return -ENOTSUP;
+    }
+    return backend->ops->get_rx_timestamp(backend->impl_data, ts);
+}
+
+/**
+ * Read a report into a buffer owned by the backend
+ *
+ * @param backend Backend instance
+ * @param report_id Report ID to read
+ * @param data Pointer to receive the report data, valid until the next read
+ * @param timeout_ms Timeout in milliseconds (-1 for blocking)
+ * @return Number of bytes read on success, -ENOTSUP if the backend cannot
+ *         read report_id this way, other negative error code on failure
+ */
+static inline int mds_backend_read_direct(mds_backend_t *backend, uint8_t report_id,
+                                          const uint8_t **data, int timeout_ms) {
+    assert(backend != NULL && "backend cannot be NULL");
+    assert(backend->ops != NULL && "backend->ops cannot be NULL");
+    if (backend->ops->read_direct == NULL) {
+        return -ENOTSUP;
+    }
+    return backend->ops->read_direct(backend->impl_data, report_id, data, timeout_ms);
+}
+
 /**
  * Destroy backend and free resources
  *
@@ -126,6 +207,106 @@ static inline void mds_backend_destroy(mds_backend_t *backend) {
     }
 }
 
+/* ============================================================================
+ * Backend Decorators
+ * ========================================================================== */
+
+/**
+ * Backend decorator operation vtable
+ *
+ * A decorator wraps an inner backend to add cross-cutting behaviour such as
+ * tracing, metrics, fault injection or rate limiting without touching the
+ * backend implementation. Each operation receives the inner backend and is
+ * responsible for forwarding the call (typically via mds_backend_read() or
+ * mds_backend_write()).
+ *
+ * Any operation may be NULL:
+ * - read/write: the call is forwarded to the inner backend unchanged
+ * - destroy: nothing is done with the decorator context on teardown
+ *
+ * Receive timestamps are always taken from the inner backend. Decorated
+ * backends never read directly (read_direct), so every read passes through
+ * the decorator.
+ */
+typedef struct {
+    /**
+     * Read a report through the decorator
+     *
+     * @param ctx Decorator context
+     * @param inner Wrapped backend to forward to
+     * @param report_id Report ID to read
+     * @param buffer Output buffer for report data
+     * @param length Maximum bytes to read
+     * @param timeout_ms Timeout in milliseconds (-1 for blocking)
+     * @return Number of bytes read on success, negative on error
+     */
+    int (*read)(void *ctx, mds_backend_t *inner, uint8_t report_id,
+                uint8_t *buffer, size_t length, int timeout_ms);
+
+    /**
+     * Write a report through the decorator
+     *
+     * @param ctx Decorator context
+     * @param inner Wrapped backend to forward to
+     * @param report_id Report ID to write
+     * @param buffer Report data to write
+     * @param length Number of bytes to write
+     * @return Number of bytes written on success, negative on error
+     */
+    int (*write)(void *ctx, mds_backend_t *inner, uint8_t report_id,
+                 const uint8_t *buffer, size_t length);
+
+    /**
+     * Release the decorator context
+     *
+     * Called before the inner backend is destroyed.
+     *
+     * @param ctx Decorator context
+     */
+    void (*destroy)(void *ctx);
+} mds_backend_decorator_ops_t;
+
+/**
+ * Wrap a backend with a decorator
+ *
+ * The returned backend takes ownership of the inner backend: destroying it
+ * calls the decorator's destroy() and then destroys the inner backend.
+ * Decorators can be stacked by decorating an already decorated backend; the
+ * most recently applied decorator sees each call first.
+ *
+ * Backends without decorators are called directly, so undecorated sessions
+ * pay no indirection cost.
+ *
+ * @param inner Backend to wrap (ownership is transferred on success)
+ * @param ops Decorator vtable (must outlive the returned backend)
+ * @param ctx Decorator context passed to every operation
+ * @param backend Pointer to receive the decorated backend
+ * @return 0 on success, negative error code otherwise
+ */
+int mds_backend_decorate(mds_backend_t *inner,
+                         const mds_backend_decorator_ops_t *ops,
+                         void *ctx,
+                         mds_backend_t **backend);
+
+/**
+ * Remove the outermost decorator from a backend
+ *
+ * Calls the decorator's destroy(), frees the wrapper and returns the inner
+ * backend to the caller (ownership is transferred back).
+ *
+ * @param backend Decorated backend
+ * @return Inner backend, or NULL if backend is not a decorator
+ */
+mds_backend_t *mds_backend_undecorate(mds_backend_t *backend);
+
+/**
+ * Check whether a backend is a decorator created by mds_backend_decorate()
+ *
+ * @param backend Backend instance
+ * @return true if the backend wraps another backend
+ */
+bool mds_backend_is_decorated(const mds_backend_t *backend);
+
 #ifdef __cplusplus
 }
 #endif
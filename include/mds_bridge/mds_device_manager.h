@@ -0,0 +1,215 @@
+/**
+ * @file mds_device_manager.h
+ * @brief Hotplug-driven MDS device manager
+ *
+ * The device manager discovers every HID interface matching a VID/PID (and
+ * optionally usage page) filter, opens an MDS session per device and keeps
+ * the set up to date: a session is created when a device appears and
+ * destroyed when it goes away, and the application is notified through a
+ * callback. One manager can therefore serve a whole USB hub tree of
+ * identical devices without hardcoding serial numbers.
+ *
+ * On Linux, hotplug notifications come from the kernel/udev uevent netlink
+ * socket (hidraw subsystem), so a rebooting device is picked up as soon as
+ * udev announces it instead of by periodically retrying to open it. Session
+ * paths are hidraw device nodes ("/dev/hidrawN"), which matches the hidapi
+ * hidraw backend. On other platforms (or when the netlink socket cannot be
+ * opened) the manager rescans with memfault_hid_enumerate() from
+ * mds_device_manager_process() instead.
+ *
+ * The manager is driven by the caller: either call
+ * mds_device_manager_process() from your loop, or poll() the descriptor from
+ * mds_device_manager_get_fd() and call mds_device_manager_process() with a
+ * zero timeout when it becomes readable.
+ *
+ * Usage:
+ * @code
+ * static void on_device(mds_device_manager_t *mgr, mds_device_event_t event,
+ *                       const char *path, mds_session_t *session, void *ctx) {
+ *     if (event == MDS_DEVICE_EVENT_ATTACHED) {
+ *         // Read config, register upload callback, enable streaming...
+ *     } else {
+ *         // Stop using session - it is destroyed after this callback returns
+ *     }
+ * }
+ *
+ * mds_device_manager_config_t cfg = {
+ *     .vendor_id = 0x2fe3, .product_id = 0x0007,
+ *     .callback = on_device, .user_data = NULL,
+ * };
+ * mds_device_manager_t *mgr;
+ * mds_device_manager_create(&cfg, &mgr);
+ * while (running) {
+ *     mds_device_manager_process(mgr, 1000);
+ * }
+ * mds_device_manager_destroy(mgr);
+ * @endcode
+ */
+
+#ifndef MDS_BRIDGE_MDS_DEVICE_MANAGER_H
+#define MDS_BRIDGE_MDS_DEVICE_MANAGER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "mds_protocol.h"
+
+/**
+ * @brief Opaque handle to a device manager
+ */
+typedef struct mds_device_manager mds_device_manager_t;
+
+/**
+ * @brief Device lifecycle events
+ */
+typedef enum {
+    /** A matching device appeared and a session was created for it */
+    MDS_DEVICE_EVENT_ATTACHED = 0,
+
+    /** A managed device disappeared; its session is destroyed after the callback */
+    MDS_DEVICE_EVENT_DETACHED = 1,
+} mds_device_event_t;
+
+/**
+ * @brief Device event callback
+ *
+ * Invoked from mds_device_manager_process() (or mds_device_manager_create()
+ * for devices already present).
+ *
+ * @param manager Device manager
+ * @param event Event type
+ * @param path Device path
+ * @param session Session for the device (owned by the manager)
+ * @param user_data User-provided context pointer
+ */
+typedef void (*mds_device_event_callback_t)(mds_device_manager_t *manager,
+                                             mds_device_event_t event,
+                                             const char *path,
+                                             mds_session_t *session,
+                                             void *user_data);
+
+/**
+ * @brief Device manager configuration
+ */
+typedef struct {
+    /** USB Vendor ID to match (0x0000 matches any vendor) */
+    uint16_t vendor_id;
+
+    /** USB Product ID to match (0x0000 matches any product) */
+    uint16_t product_id;
+
+    /** HID usage page of the MDS interface (0x0000 matches any usage page) */
+    uint16_t usage_page;
+
+    /** Event callback (required) */
+    mds_device_event_callback_t callback;
+
+    /** User context pointer passed to the callback */
+    void *user_data;
+} mds_device_manager_config_t;
+
+/**
+ * @brief Create a device manager
+ *
+ * Starts listening for hotplug events and attaches every matching device that
+ * is already connected (the callback fires for each of them before this
+ * returns).
+ *
+ * @param config Manager configuration
+ * @param manager Pointer to receive manager handle
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int mds_device_manager_create(const mds_device_manager_config_t *config,
+                              mds_device_manager_t **manager);
+
+/**
+ * @brief Destroy a device manager
+ *
+ * Fires MDS_DEVICE_EVENT_DETACHED for every managed device, destroys their
+ * sessions and stops hotplug monitoring.
+ *
+ * May be called from another thread while mds_device_manager_process() waits:
+ * the wait ends at once (process returns 0) and the manager is freed after
+ * process has returned. Do not call it from the device callback.
+ *
+ * @param manager Manager handle
+ */
+void mds_device_manager_destroy(mds_device_manager_t *manager);
+
+/**
+ * @brief Get the hotplug monitor file descriptor
+ *
+ * The descriptor becomes readable when hotplug events are pending. Use it to
+ * integrate the manager into an existing poll()/select() loop.
+ *
+ * @param manager Manager handle
+ *
+ * @return File descriptor, or negative error code
+ *         -ENOTSUP if hotplug monitoring is not available (use rescans)
+ */
+int mds_device_manager_get_fd(mds_device_manager_t *manager);
+
+/**
+ * @brief Rescan for devices
+ *
+ * Enumerates matching devices, attaches new ones and detaches managed
+ * devices that are no longer present. Hotplug-capable platforms do this
+ * automatically; call it explicitly to force a resync.
+ *
+ * @param manager Manager handle
+ *
+ * @return Number of callbacks fired, negative error code otherwise
+ */
+int mds_device_manager_scan(mds_device_manager_t *manager);
+
+/**
+ * @brief Wait for and handle hotplug events
+ *
+ * Waits up to timeout_ms for hotplug events, then handles all pending
+ * events, creating/destroying sessions and firing the callback. Without
+ * hotplug support this waits for timeout_ms and then rescans.
+ *
+ * @param manager Manager handle
+ * @param timeout_ms Timeout in milliseconds (0 = non-blocking, -1 = infinite)
+ *
+ * @return Number of callbacks fired (0 on timeout), negative error code otherwise
+ */
+int mds_device_manager_process(mds_device_manager_t *manager, int timeout_ms);
+
+/**
+ * @brief Get number of managed devices
+ *
+ * @param manager Manager handle
+ *
+ * @return Number of devices with an active session
+ */
+size_t mds_device_manager_count(mds_device_manager_t *manager);
+
+/**
+ * @brief Get a managed device by index
+ *
+ * Indices are stable only until the next call that can attach or detach
+ * devices (process, scan, destroy).
+ *
+ * @param manager Manager handle
+ * @param index Device index (0 to mds_device_manager_count() - 1)
+ * @param path Pointer to receive device path (may be NULL)
+ * @param session Pointer to receive session (may be NULL)
+ *
+ * @return 0 on success, -ENOENT if index is out of range
+ */
+int mds_device_manager_get(mds_device_manager_t *manager,
+                           size_t index,
+                           const char **path,
+                           mds_session_t **session);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MDS_BRIDGE_MDS_DEVICE_MANAGER_H */
@@ -0,0 +1,239 @@
+/**
+ * @file mds_io.h
+ * @brief Asynchronous file I/O engine for persistence features
+ *
+ * Moves file writes and fsyncs off the calling thread so that slow storage
+ * (e.g. eMMC during garbage collection) does not stall device reads. One
+ * engine can be shared by every component that writes files; pass it to
+ * chunks_file_sink_config_t::io, for example.
+ *
+ * Backends:
+ * - io_uring (Linux 5.6+, when built with <linux/io_uring.h>): requests are
+ *   queued as submission queue entries and handed to the kernel with one
+ *   io_uring_enter() per batch; a completion thread reaps results.
+ * - Thread pool (everywhere else, or when io_uring is unavailable at run
+ *   time, e.g. blocked by a seccomp policy): worker threads run write() and
+ *   fsync().
+ *
+ * Requests:
+ * - mds_io_write() and mds_io_fsync() queue a request and return at once.
+ *   Queued requests are submitted when batch_size of them have accumulated,
+ *   or on mds_io_submit() / mds_io_drain().
+ * - Requests on the same file descriptor run one at a time in the order they
+ *   were queued, so an fsync covers the writes queued before it on that
+ *   descriptor. Requests on different descriptors may run concurrently.
+ * - Writes are completed in full (short writes are continued).
+ * - With io_uring, requests on one descriptor that are submitted together
+ *   are linked in the kernel: if one fails, the rest complete with
+ *   -ECANCELED (a short write is not a failure). The thread pool runs them
+ *   regardless.
+ * - Completion callbacks run on an engine thread without engine locks held.
+ *   They may queue further requests but should not block.
+ *
+ * The engine does not own file descriptors or buffers: keep both valid until
+ * the request's callback has run. POSIX only.
+ *
+ * Usage:
+ * @code
+ * mds_io_t *io = mds_io_create(NULL);
+ * mds_io_write(io, fd, buf, len, -1, write_done, ctx);   // Append
+ * mds_io_fsync(io, fd, true, sync_done, ctx);
+ * mds_io_submit(io);
+ * ...
+ * mds_io_destroy(io);  // Waits for queued requests
+ * @endcode
+ */
+
+#ifndef MDS_BRIDGE_MDS_IO_H
+#define MDS_BRIDGE_MDS_IO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * @brief Opaque handle to an I/O engine
+ */
+typedef struct mds_io mds_io_t;
+
+/**
+ * @brief I/O engine backends
+ */
+typedef enum {
+    /** io_uring if available, otherwise the thread pool */
+    MDS_IO_BACKEND_AUTO = 0,
+
+    /** io_uring only (creation fails if it is unavailable) */
+    MDS_IO_BACKEND_IO_URING = 1,
+
+    /** Worker threads running blocking system calls */
+    MDS_IO_BACKEND_THREADS = 2,
+} mds_io_backend_t;
+
+/**
+ * @brief I/O engine configuration
+ */
+typedef struct {
+    /** Backend to use */
+    mds_io_backend_t backend;
+
+    /** Requests handed to the kernel at a time (io_uring queue size, >= 1) */
+    unsigned int queue_depth;
+
+    /** Worker threads of the thread pool backend (>= 1) */
+    unsigned int threads;
+
+    /** Submit queued requests once this many have accumulated (>= 1) */
+    unsigned int batch_size;
+} mds_io_config_t;
+
+/**
+ * @brief I/O engine statistics
+ */
+typedef struct {
+    /** Requests queued */
+    uint64_t requests;
+
+    /** Requests that failed */
+    uint64_t failures;
+
+    /** Bytes written */
+    uint64_t bytes_written;
+
+    /** Submissions (io_uring_enter() calls, or hand-overs to the workers) */
+    uint64_t submissions;
+
+    /** Longest time from queuing to completion in microseconds */
+    uint64_t max_latency_us;
+
+    /** Requests queued or running */
+    size_t pending;
+} mds_io_stats_t;
+
+/**
+ * @brief Callback invoked when a request completes
+ *
+ * @param result Bytes written for writes, 0 for fsyncs, or a negative errno
+ * @param user_data User context pointer passed with the request
+ */
+typedef void (*mds_io_callback_t)(int result, void *user_data);
+
+/**
+ * @brief Fill a configuration with defaults
+ *
+ * Automatic backend selection, a queue depth of 64, two worker threads and
+ * batches of 16 requests.
+ *
+ * @param config Configuration to fill
+ */
+void mds_io_default_config(mds_io_config_t *config);
+
+/**
+ * @brief Create an I/O engine
+ *
+ * @param config Configuration (NULL for defaults)
+ *
+ * @return Engine handle, or NULL on failure (invalid configuration, io_uring
+ *         requested but unavailable, or out of resources)
+ */
+mds_io_t *mds_io_create(const mds_io_config_t *config);
+
+/**
+ * @brief Destroy an I/O engine
+ *
+ * Submits queued requests and waits for all of them to complete.
+ *
+ * @param io Engine handle
+ */
+void mds_io_destroy(mds_io_t *io);
+
+/**
+ * @brief Get the backend an engine uses
+ *
+ * @param io Engine handle
+ *
+ * @return MDS_IO_BACKEND_IO_URING or MDS_IO_BACKEND_THREADS
+ */
+mds_io_backend_t mds_io_get_backend(mds_io_t *io);
+
+/**
+ * @brief Get the name of a backend
+ *
+ * @param backend Backend
+ *
+ * @return "auto", "io_uring" or "threads"
+ */
+const char *mds_io_backend_name(mds_io_backend_t backend);
+
+/**
+ * @brief Queue a write
+ *
+ * @param io Engine handle
+ * @param fd File descriptor
+ * @param buf Data (must stay valid until the callback has run)
+ * @param len Data length (> 0)
+ * @param offset File offset, or -1 to write at the current position (use
+ *               with files opened with O_APPEND)
+ * @param callback Completion callback (may be NULL)
+ * @param user_data User context pointer passed to callback
+ *
+ * @return 0 if queued, -EINVAL on invalid parameters, -ENOMEM
+ */
+int mds_io_write(mds_io_t *io, int fd, const void *buf, size_t len, int64_t offset,
+                 mds_io_callback_t callback, void *user_data);
+
+/**
+ * @brief Queue an fsync
+ *
+ * Runs after the writes queued earlier on the same descriptor.
+ *
+ * @param io Engine handle
+ * @param fd File descriptor
+ * @param datasync true for fdatasync() semantics
+ * @param callback Completion callback (may be NULL)
+ * @param user_data User context pointer passed to callback
+ *
+ * @return 0 if queued, -EINVAL on invalid parameters, -ENOMEM
+ */
+int mds_io_fsync(mds_io_t *io, int fd, bool datasync,
+                 mds_io_callback_t callback, void *user_data);
+
+/**
+ * @brief Submit queued requests without waiting for a full batch
+ *
+ * @param io Engine handle
+ *
+ * @return 0 on success, -EINVAL on invalid parameters
+ */
+int mds_io_submit(mds_io_t *io);
+
+/**
+ * @brief Submit queued requests and wait until all requests have completed
+ *
+ * Must not be called from a completion callback.
+ *
+ * @param io Engine handle
+ *
+ * @return 0 on success, -EINVAL on invalid parameters
+ */
+int mds_io_drain(mds_io_t *io);
+
+/**
+ * @brief Get I/O engine statistics
+ *
+ * @param io Engine handle
+ * @param stats Pointer to receive statistics
+ *
+ * @return 0 on success, -EINVAL on invalid parameters
+ */
+int mds_io_get_stats(mds_io_t *io, mds_io_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MDS_BRIDGE_MDS_IO_H */
@@ -0,0 +1,206 @@
+/**
+ * @file mds_log.h
+ * @brief Pluggable, rate-limited logging for the MDS bridge library
+ *
+ * All library diagnostics (malformed packets, sequence errors, HID queue
+ * overflows, upload failures) go through a single logging hook instead of
+ * being written to stderr directly. Each message carries a level and the
+ * subsystem that produced it.
+ *
+ * Logging is designed to stay off the packet hot path:
+ * - Messages above the configured level are discarded before formatting.
+ * - Each subsystem is rate limited (default 20 messages per second); excess
+ *   messages are counted and summarized once the next window starts.
+ * - In deferred mode, messages are stored in a lock-free ring buffer and the
+ *   handler only runs from mds_log_flush(), so log I/O happens on a thread of
+ *   the application's choosing. When the ring is full, messages are dropped
+ *   (and counted) rather than blocking the caller.
+ *
+ * By default, messages of level MDS_LOG_WARN and above are written to stderr
+ * immediately.
+ *
+ * Usage:
+ * @code
+ * static void my_log(mds_log_level_t level, mds_log_subsystem_t subsystem,
+ *                    const char *message, void *user_data) {
+ *     syslog(LOG_WARNING, "%s: %s", mds_log_subsystem_name(subsystem), message);
+ * }
+ *
+ * mds_log_set_handler(my_log, NULL);
+ * mds_log_set_deferred(true);
+ *
+ * // From a housekeeping thread or the main loop
+ * while (running) {
+ *     mds_log_flush();
+ *     sleep(1);
+ * }
+ * @endcode
+ */
+
+#ifndef MDS_BRIDGE_MDS_LOG_H
+#define MDS_BRIDGE_MDS_LOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Maximum length of a formatted log message (longer messages are truncated) */
+#define MDS_LOG_MAX_MESSAGE_LEN 160
+
+/**
+ * @brief Log levels
+ */
+typedef enum {
+    /** Logging disabled (threshold only) */
+    MDS_LOG_OFF = 0,
+
+    /** Operation failed */
+    MDS_LOG_ERROR = 1,
+
+    /** Unexpected device or network behavior, operation continues */
+    MDS_LOG_WARN = 2,
+
+    /** Informational messages */
+    MDS_LOG_INFO = 3,
+
+    /** Debug output */
+    MDS_LOG_DEBUG = 4,
+} mds_log_level_t;
+
+/**
+ * @brief Subsystems that produce log messages
+ */
+typedef enum {
+    /** MDS protocol (packet parsing, sequence accounting) */
+    MDS_LOG_PROTOCOL = 0,
+
+    /** HID transport (memfault_hid) */
+    MDS_LOG_HID = 1,
+
+    /** Chunk uploader */
+    MDS_LOG_UPLOAD = 2,
+
+    /** Number of subsystems */
+    MDS_LOG_SUBSYSTEM_COUNT
+} mds_log_subsystem_t;
+
+/**
+ * @brief Log handler
+ *
+ * In immediate mode the handler runs on the thread that logged the message
+ * and may be called concurrently from several threads. In deferred mode it
+ * only runs from mds_log_flush().
+ *
+ * @param level Message level
+ * @param subsystem Subsystem that produced the message
+ * @param message Formatted message (no trailing newline)
+ * @param user_data User-provided context pointer
+ */
+typedef void (*mds_log_handler_t)(mds_log_level_t level,
+                                  mds_log_subsystem_t subsystem,
+                                  const char *message,
+                                  void *user_data);
+
+/**
+ * @brief Logging statistics
+ */
+typedef struct {
+    /** Messages discarded by the rate limiter */
+    uint64_t suppressed;
+
+    /** Messages dropped because the deferred ring was full */
+    uint64_t dropped;
+} mds_log_stats_t;
+
+/**
+ * @brief Set the log handler
+ *
+ * Safe to call while other threads log: each message goes to either the
+ * old or the new handler, always with that handler's own user_data.
+ *
+ * @param handler Handler function (NULL restores the default stderr handler)
+ * @param user_data User context pointer passed to the handler
+ */
+void mds_log_set_handler(mds_log_handler_t handler, void *user_data);
+
+/**
+ * @brief Set the log level threshold
+ *
+ * Messages with a level above the threshold are discarded without being
+ * formatted. Default: MDS_LOG_WARN.
+ *
+ * @param level Most verbose level to log (MDS_LOG_OFF disables logging)
+ */
+void mds_log_set_level(mds_log_level_t level);
+
+/**
+ * @brief Get the log level threshold
+ *
+ * @return Current threshold
+ */
+mds_log_level_t mds_log_get_level(void);
+
+/**
+ * @brief Set the per-subsystem rate limit
+ *
+ * Each subsystem may log at most max_per_second messages per one-second
+ * window. Default: 20. Messages already logged in the current window do
+ * not count against the new limit.
+ *
+ * @param max_per_second Messages per second per subsystem (0 = unlimited)
+ */
+void mds_log_set_rate_limit(unsigned int max_per_second);
+
+/**
+ * @brief Enable or disable deferred delivery
+ *
+ * When enabled, messages are queued in a lock-free ring buffer and delivered
+ * by mds_log_flush(). Disabling delivers any queued messages first.
+ *
+ * @param deferred true to queue messages, false to deliver them immediately
+ */
+void mds_log_set_deferred(bool deferred);
+
+/**
+ * @brief Deliver queued messages to the handler
+ *
+ * Safe to call from any thread; concurrent calls are serialized.
+ *
+ * @return Number of messages delivered
+ */
+size_t mds_log_flush(void);
+
+/**
+ * @brief Get logging statistics
+ *
+ * @param stats Pointer to receive statistics
+ */
+void mds_log_get_stats(mds_log_stats_t *stats);
+
+/**
+ * @brief Get the name of a log level ("error", "warn", ...)
+ *
+ * @param level Log level
+ *
+ * @return Static string
+ */
+const char *mds_log_level_name(mds_log_level_t level);
+
+/**
+ * @brief Get the name of a subsystem ("protocol", "hid", "upload")
+ *
+ * @param subsystem Subsystem
+ *
+ * @return Static string
+ */
+const char *mds_log_subsystem_name(mds_log_subsystem_t subsystem);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MDS_BRIDGE_MDS_LOG_H */
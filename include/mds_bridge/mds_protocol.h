@@ -14,6 +14,7 @@
  * - Feature reports provide device information and configuration
  * - Control reports enable/disable data streaming
  * - Stream reports deliver diagnostic chunk data
+ * - Optional extensions are negotiated through the supported features bitmask
  */
 
 #ifndef MDS_BRIDGE_MDS_PROTOCOL_H
@@ -35,7 +36,7 @@ extern "C" {
  * Report ID Definitions
  * ========================================================================== */
 
-/** Feature Report: Supported features bitmask (currently 0x00) */
+/** Feature Report: Supported features bitmask (MDS_FEATURE_* flags) */
 #define MDS_REPORT_ID_SUPPORTED_FEATURES    0x01
 
 /** Feature Report: Device identifier string */
@@ -53,6 +54,81 @@ extern "C" {
 /** Input Report: Stream data packets (chunk data) */
 #define MDS_REPORT_ID_STREAM_DATA           0x06
 
+/** Stream retransmit request (NACK), written like Stream Control (MDS_FEATURE_STREAM_RETRANSMIT) */
+#define MDS_REPORT_ID_STREAM_NACK           0x07
+
+/** Feature Report: Stream resume offset (MDS_FEATURE_STREAM_RESUME) */
+#define MDS_REPORT_ID_STREAM_RESUME         0x08
+
+/* ============================================================================
+ * Supported Features
+ * ========================================================================== */
+
+/**
+ * Device keeps a retransmit window of its most recent stream packets and
+ * resends them on request.
+ *
+ * NACK report (MDS_REPORT_ID_STREAM_NACK) format:
+ * Byte 0: First missing sequence number (bits 0-4)
+ * Byte 1: Number of consecutive missing packets (1-MDS_RETRANSMIT_WINDOW)
+ *
+ * The device resends the requested packets unchanged (same sequence numbers)
+ * ahead of new data. Packets that already left its window are not resent.
+ */
+#define MDS_FEATURE_STREAM_RETRANSMIT       (1u << 0)
+
+/** Minimum retransmit window (packets) of a device with MDS_FEATURE_STREAM_RETRANSMIT */
+#define MDS_RETRANSMIT_WINDOW               8
+
+/** Default time to wait for retransmitted packets before giving up */
+#define MDS_RETRANSMIT_DEFAULT_TIMEOUT_MS   200
+
+/**
+ * Device supports credit-based flow control.
+ *
+ * With flow control on, the Stream Control report carries a second byte:
+ * Byte 0: MDS_STREAM_MODE_ENABLED
+ * Byte 1: Credit - number of packets the device may send from now on (1-255)
+ *
+ * Each grant replaces the previous credit (it is not added to it), so a
+ * repeated grant is harmless. The device decrements the credit for every
+ * stream packet and stops sending at zero until the next grant.
+ */
+#define MDS_FEATURE_STREAM_CREDITS          (1u << 1)
+
+/** Default credit window (packets the gateway can absorb) */
+#define MDS_CREDIT_DEFAULT_WINDOW           16
+
+/** Interval at which an idle stream re-sends its credit grant */
+#define MDS_CREDIT_REGRANT_INTERVAL_MS      1000
+
+/**
+ * Device can send stream data in reports larger than 64 bytes (up to 1024
+ * bytes, e.g. high-speed interrupt endpoints).
+ *
+ * Enabled with MDS_STREAM_MODE_LARGE_REPORTS in the Stream Control mode byte.
+ * Large-report packet format:
+ * Byte 0: Sequence counter (bits 0-4) + reserved (bits 5-7)
+ * Bytes 1-2: Payload length (little-endian, 0-MDS_MAX_STREAM_DATA_LEN)
+ * Bytes 3-: Chunk data payload
+ */
+#define MDS_FEATURE_STREAM_LARGE_REPORTS    (1u << 2)
+
+/**
+ * Device keeps unacknowledged chunk data across reboots and can resume its
+ * stream from a byte offset.
+ *
+ * The offset counts chunk data bytes (packet payloads) since the device
+ * started its stream, modulo 2^32. Resume report (MDS_REPORT_ID_STREAM_RESUME)
+ * format, written before Stream Control enables streaming:
+ * Bytes 0-3: Offset of the first byte the host has not acknowledged (little-endian)
+ *
+ * The device discards data before the offset and starts the stream there.
+ * Reading the report returns the offset the device actually resumes from
+ * (the same format), which differs if the requested data no longer exists.
+ */
+#define MDS_FEATURE_STREAM_RESUME           (1u << 3)
+
 /* ============================================================================
  * Constants
  * ========================================================================== */
@@ -69,6 +145,9 @@ extern "C" {
 /** Maximum chunk data per packet (after sequence and length bytes) */
 #define MDS_MAX_CHUNK_DATA_LEN              61
 
+/** Maximum chunk data per packet in large-report mode (1024-byte report) */
+#define MDS_MAX_STREAM_DATA_LEN             1020
+
 /* ============================================================================
  * Stream Control Modes
  * ========================================================================== */
@@ -79,6 +158,9 @@ extern "C" {
 /** Stream control mode: Streaming enabled */
 #define MDS_STREAM_MODE_ENABLED             0x01
 
+/** Stream control mode flag: Send large-report packets (MDS_FEATURE_STREAM_LARGE_REPORTS) */
+#define MDS_STREAM_MODE_LARGE_REPORTS       0x02
+
 /* ============================================================================
  * Stream Data Packet Format
  * ========================================================================== */
@@ -89,6 +171,105 @@ extern "C" {
 /** Sequence counter max value (wraps at 31) */
 #define MDS_SEQUENCE_MAX                    31
 
+/* ============================================================================
+ * Chunk Classification
+ *
+ * Stream packets carry Memfault chunks: pieces of messages produced by the
+ * firmware SDK's data packetizer. The first chunk of a message names the
+ * message type (coredump, event, log, custom data recording) and, for
+ * events, the start of the CBOR-encoded event, which tells heartbeats,
+ * traces and reboots apart. Later chunks of the message get the same class.
+ *
+ * Chunk header (byte 0): bit 7 = continuation of a message, bit 6 = more
+ * chunks follow. The first chunk of a multi-chunk message carries the total
+ * message length as a varint, continuations carry their offset as a varint.
+ * ========================================================================== */
+
+/**
+ * @brief Kind of data a chunk belongs to
+ */
+typedef enum {
+    /** Not (yet) recognized, e.g. a stream picked up mid-message */
+    MDS_CHUNK_CLASS_UNKNOWN = 0,
+
+    /** Heartbeat event (periodic metrics) */
+    MDS_CHUNK_CLASS_HEARTBEAT = 1,
+
+    /** Trace event */
+    MDS_CHUNK_CLASS_TRACE = 2,
+
+    /** Reboot event (trace carrying a reboot reason) */
+    MDS_CHUNK_CLASS_REBOOT = 3,
+
+    /** Logs (log messages and log events) */
+    MDS_CHUNK_CLASS_LOG = 4,
+
+    /** Coredump */
+    MDS_CHUNK_CLASS_COREDUMP = 5,
+
+    /** Custom data recording */
+    MDS_CHUNK_CLASS_CDR = 6,
+
+    /** Number of classes */
+    MDS_CHUNK_CLASS_COUNT
+} mds_chunk_class_t;
+
+/** Message bytes a classifier looks at before giving up */
+#define MDS_CHUNK_CLASSIFY_PREFIX_LEN       64
+
+/**
+ * @brief Chunk classifier state (one per stream)
+ *
+ * Chunks must be classified in stream order. Every session has one built
+ * in; use a separate classifier for chunks obtained another way (e.g. read
+ * back from storage).
+ */
+typedef struct {
+    /** Class of the message in progress */
+    mds_chunk_class_t chunk_class;
+
+    /** The class is not decided yet and more message bytes are needed */
+    bool pending;
+
+    /** Leading message bytes collected so far */
+    uint8_t prefix[MDS_CHUNK_CLASSIFY_PREFIX_LEN];
+
+    /** Number of valid bytes in prefix */
+    size_t prefix_len;
+} mds_chunk_classifier_t;
+
+/**
+ * @brief Reset a classifier (e.g. when a stream restarts)
+ *
+ * @param classifier Classifier to reset
+ */
+void mds_chunk_classifier_reset(mds_chunk_classifier_t *classifier);
+
+/**
+ * @brief Classify the next chunk of a stream
+ *
+ * A message whose type cannot be decided from its first chunk (because the
+ * chunk is very small) is reported as MDS_CHUNK_CLASS_UNKNOWN until a later
+ * chunk completes the picture.
+ *
+ * @param classifier Classifier state
+ * @param chunk Chunk data
+ * @param chunk_len Length of chunk data
+ *
+ * @return Class of the message the chunk belongs to
+ */
+mds_chunk_class_t mds_chunk_classify(mds_chunk_classifier_t *classifier,
+                                     const uint8_t *chunk, size_t chunk_len);
+
+/**
+ * @brief Get the name of a chunk class ("heartbeat", "coredump", ...)
+ *
+ * @param chunk_class Chunk class
+ *
+ * @return Static string
+ */
+const char *mds_chunk_class_name(mds_chunk_class_t chunk_class);
+
 /* ============================================================================
  * Data Structures
  * ========================================================================== */
@@ -100,7 +281,7 @@ extern "C" {
  * used for diagnostic data upload.
  */
 typedef struct {
-    /** Supported features bitmask (currently always 0x00) */
+    /** Supported features bitmask (MDS_FEATURE_* flags) */
     uint32_t supported_features;
 
     /** Device identifier (null-terminated string) */
@@ -118,18 +299,30 @@ typedef struct {
  *
  * Packet format for diagnostic chunk data.
  * Byte 0: Sequence counter (bits 0-4) + reserved (bits 5-7)
- * Byte 1: Payload length (1-62, number of valid data bytes)
+ * Byte 1: Payload length (1-61, number of valid data bytes)
  * Bytes 2-63: Chunk data payload (only first `length` bytes valid)
+ *
+ * In large-report mode the length is 16 bits wide and the payload can hold
+ * up to MDS_MAX_STREAM_DATA_LEN bytes (see MDS_FEATURE_STREAM_LARGE_REPORTS).
  */
 typedef struct {
     /** Sequence counter (0-31, wraps around) */
     uint8_t sequence;
 
-    /** Chunk data payload */
-    uint8_t data[MDS_MAX_CHUNK_DATA_LEN];
+    /** Chunk data payload (MDS_MAX_CHUNK_DATA_LEN bytes unless large reports are enabled) */
+    uint8_t data[MDS_MAX_STREAM_DATA_LEN];
 
     /** Length of valid data in the data array */
     size_t data_len;
+
+    /** Receive time (CLOCK_MONOTONIC, ns), taken as close to the read as possible */
+    uint64_t rx_monotonic_ns;
+
+    /** Receive time (CLOCK_REALTIME, ns since the Unix epoch) */
+    uint64_t rx_realtime_ns;
+
+    /** Kind of data the chunk belongs to (set when read through a session) */
+    mds_chunk_class_t chunk_class;
 } mds_stream_packet_t;
 
 /**
@@ -160,6 +353,45 @@ typedef int (*mds_chunk_upload_callback_t)(const char *uri,
                                             size_t chunk_len,
                                             void *user_data);
 
+/**
+ * @brief Per-chunk metadata passed to the extended upload callback
+ */
+typedef struct {
+    /** Sequence counter of the packet carrying the chunk */
+    uint8_t sequence;
+
+    /** Receive time of the packet (CLOCK_MONOTONIC, ns) */
+    uint64_t rx_monotonic_ns;
+
+    /** Receive time of the packet (CLOCK_REALTIME, ns since the Unix epoch) */
+    uint64_t rx_realtime_ns;
+
+    /** Kind of data the chunk belongs to */
+    mds_chunk_class_t chunk_class;
+} mds_chunk_info_t;
+
+/**
+ * @brief Extended upload callback with per-chunk metadata
+ *
+ * Same contract as mds_chunk_upload_callback_t, plus packet metadata such as
+ * receive timestamps (e.g. for device-to-cloud latency measurements).
+ *
+ * @param uri Data URI to upload to (from device config)
+ * @param auth_header Authorization header (format: "HeaderName:HeaderValue")
+ * @param chunk_data Chunk data bytes to upload
+ * @param chunk_len Length of chunk data
+ * @param info Chunk metadata
+ * @param user_data User-provided context pointer
+ *
+ * @return 0 on success, negative error code on failure
+ */
+typedef int (*mds_chunk_upload_callback_ex_t)(const char *uri,
+                                               const char *auth_header,
+                                               const uint8_t *chunk_data,
+                                               size_t chunk_len,
+                                               const mds_chunk_info_t *info,
+                                               void *user_data);
+
 /* ============================================================================
  * MDS Session Management
  * ========================================================================== */
@@ -240,6 +472,49 @@ int mds_session_create_hid_path(const char *path,
  */
 void mds_session_destroy(mds_session_t *session);
 
+/**
+ * @brief Install a backend decorator on a session
+ *
+ * Wraps the session's current backend with the given decorator (see
+ * mds_backend_decorate()). Decorators pushed later see each call first.
+ * Sessions without decorators call their transport backend directly.
+ *
+ * @param session MDS session handle (must have a backend)
+ * @param ops Decorator vtable (must outlive the decorator)
+ * @param ctx Decorator context passed to every operation
+ *
+ * @return 0 on success, negative error code otherwise
+ *
+ * Example:
+ * @code
+ * static int trace_read(void *ctx, mds_backend_t *inner, uint8_t report_id,
+ *                       uint8_t *buf, size_t len, int timeout_ms) {
+ *     int ret = mds_backend_read(inner, report_id, buf, len, timeout_ms);
+ *     printf("read 0x%02X -> %d\n", report_id, ret);
+ *     return ret;
+ * }
+ * static const mds_backend_decorator_ops_t trace_ops = { .read = trace_read };
+ *
+ * mds_session_push_decorator(session, &trace_ops, NULL);
+ * @endcode
+ */
+int mds_session_push_decorator(mds_session_t *session,
+                                const mds_backend_decorator_ops_t *ops,
+                                void *ctx);
+
+/**
+ * @brief Remove the most recently installed backend decorator
+ *
+ * The decorator's destroy() is invoked and the session continues with the
+ * backend the decorator was wrapping.
+ *
+ * @param session MDS session handle
+ *
+ * @return 0 on success, -ENOENT if no decorator is installed,
+ *         negative error code otherwise
+ */
+int mds_session_pop_decorator(mds_session_t *session);
+
 /* ============================================================================
  * Device Configuration
  * ========================================================================== */
@@ -360,10 +635,11 @@ int mds_stream_read_packet(mds_session_t *session,
  * @brief Process a stream packet from a byte buffer
  *
  * Processes a stream packet from a buffer (event-driven I/O):
- * 1. Parses the stream packet from the buffer
+ * 1. Parses the stream packet from the buffer (receive timestamps are taken
+ *    on entry, so call this as soon as the report arrives)
  * 2. Validates the sequence number (logs warning if invalid)
  * 3. Updates sequence tracking
- * 4. Triggers upload callback if registered (with mds_set_upload_callback)
+ * 4. Hands the chunk to the sinks (mds_set_upload_callback(), mds_session_add_sink())
  * 5. Optionally returns parsed packet to caller
  *
  * This is the primary function for event-driven/non-blocking I/O patterns.
@@ -411,6 +687,9 @@ int mds_process_stream_from_bytes(mds_session_t *session,
  * This enables automatic chunk forwarding to the Memfault cloud when using
  * mds_process_stream() or mds_process_stream_from_bytes().
  *
+ * The callback is attached as a required inline sink (see mds_sink.h), so
+ * further sinks can run next to it; it takes one of the MDS_MAX_SINKS slots.
+ *
  * @param session MDS session handle
  * @param callback Upload callback function (NULL to disable)
  * @param user_data User context pointer passed to callback
@@ -421,6 +700,23 @@ int mds_set_upload_callback(mds_session_t *session,
                              mds_chunk_upload_callback_t callback,
                              void *user_data);
 
+/**
+ * @brief Set extended chunk upload callback
+ *
+ * Like mds_set_upload_callback(), but the callback also receives per-chunk
+ * metadata (sequence and receive timestamps). Replaces any callback set
+ * with mds_set_upload_callback() and vice versa.
+ *
+ * @param session MDS session handle
+ * @param callback Upload callback function (NULL to disable)
+ * @param user_data User context pointer passed to callback
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int mds_set_upload_callback_ex(mds_session_t *session,
+                                mds_chunk_upload_callback_ex_t callback,
+                                void *user_data);
+
 /**
  * @brief Process a stream packet by reading from the device
  *
@@ -428,7 +724,7 @@ int mds_set_upload_callback(mds_session_t *session,
  * 1. Reads packet from device (blocking with timeout)
  * 2. Validates the sequence number (logs warning if invalid)
  * 3. Updates sequence tracking
- * 4. Triggers upload callback if registered (with mds_set_upload_callback)
+ * 4. Hands the chunk to the sinks (mds_set_upload_callback(), mds_session_add_sink())
  * 5. Optionally returns parsed packet to caller
  *
  * This is the primary function for blocking I/O patterns. Call this in a loop
@@ -462,6 +758,325 @@ int mds_process_stream(mds_session_t *session,
                        int timeout_ms,
                        mds_stream_packet_t *packet);
 
+/* ============================================================================
+ * Sequence Accounting
+ * ========================================================================== */
+
+/**
+ * @brief Sequence anomaly types
+ *
+ * The 5-bit sequence counter is classified by its distance from the expected
+ * value: 1-15 ahead is a gap (the skipped packets are counted as lost), the
+ * previous sequence again is a duplicate, and anything else is an earlier
+ * packet arriving late (a reorder).
+ */
+typedef enum {
+    /** One or more packets were skipped */
+    MDS_SEQUENCE_EVENT_GAP = 0,
+
+    /** The previous packet was received again */
+    MDS_SEQUENCE_EVENT_DUPLICATE = 1,
+
+    /** An older packet arrived after a newer one */
+    MDS_SEQUENCE_EVENT_REORDER = 2,
+} mds_sequence_event_type_t;
+
+/**
+ * @brief Sequence anomaly details
+ */
+typedef struct {
+    /** Anomaly type */
+    mds_sequence_event_type_t type;
+
+    /** Sequence number that was expected next */
+    uint8_t expected;
+
+    /** Sequence number that was received */
+    uint8_t received;
+
+    /** Number of packets skipped (MDS_SEQUENCE_EVENT_GAP only, 0 otherwise) */
+    uint8_t missing;
+} mds_sequence_event_t;
+
+/**
+ * @brief Sequence anomaly callback
+ *
+ * Invoked synchronously from the packet read/processing call that detected
+ * the anomaly.
+ *
+ * @param session MDS session handle
+ * @param event Anomaly details
+ * @param user_data User-provided context pointer
+ */
+typedef void (*mds_sequence_callback_t)(mds_session_t *session,
+                                        const mds_sequence_event_t *event,
+                                        void *user_data);
+
+/**
+ * @brief Per-session stream statistics
+ */
+typedef struct {
+    /** Stream packets received (including duplicates and late packets) */
+    uint64_t packets_received;
+
+    /** Number of gap events */
+    uint64_t gaps;
+
+    /**
+     * Estimated packets lost. Packets skipped by a gap count as lost until
+     * they arrive late (reorder); gaps of 16 or more packets alias with the
+     * 5-bit counter and are undercounted.
+     */
+    uint64_t lost_packets;
+
+    /** Duplicate packets */
+    uint64_t duplicates;
+
+    /** Packets that arrived out of order */
+    uint64_t reorders;
+
+    /** Retransmit requests sent (see mds_stream_set_retransmit()) */
+    uint64_t nacks_sent;
+
+    /** Missing packets that arrived in time after a retransmit request */
+    uint64_t recovered;
+
+    /** Credit grants sent (see mds_stream_set_flow_control()) */
+    uint64_t credit_grants;
+
+    /** Packets received per chunk class, indexed by mds_chunk_class_t */
+    uint64_t class_packets[MDS_CHUNK_CLASS_COUNT];
+
+    /** Chunk data bytes received per chunk class, indexed by mds_chunk_class_t */
+    uint64_t class_bytes[MDS_CHUNK_CLASS_COUNT];
+} mds_session_stats_t;
+
+/**
+ * @brief Get stream statistics
+ *
+ * Counters are updated by mds_stream_read_packet(), mds_process_stream() and
+ * mds_process_stream_from_bytes().
+ *
+ * @param session MDS session handle
+ * @param stats Pointer to receive statistics
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int mds_get_session_stats(mds_session_t *session, mds_session_stats_t *stats);
+
+/**
+ * @brief Reset stream statistics
+ *
+ * Clears all counters and restarts sequence tracking, so the next packet is
+ * accepted as the start of the stream (e.g. after flushing stale data).
+ *
+ * @param session MDS session handle
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int mds_reset_session_stats(mds_session_t *session);
+
+/**
+ * @brief Set sequence anomaly callback
+ *
+ * @param session MDS session handle
+ * @param callback Callback function (NULL to disable)
+ * @param user_data User context pointer passed to callback
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int mds_set_sequence_callback(mds_session_t *session,
+                              mds_sequence_callback_t callback,
+                              void *user_data);
+
+/* ============================================================================
+ * Loss Recovery
+ * ========================================================================== */
+
+/**
+ * @brief Enable or disable retransmission of missed packets
+ *
+ * Requires a device that advertises MDS_FEATURE_STREAM_RETRANSMIT. When
+ * enabled, mds_process_stream() and mds_process_stream_from_bytes() answer a
+ * sequence gap of up to MDS_RETRANSMIT_WINDOW packets with a NACK report and
+ * hold back the packets after the gap, so chunks still reach the upload
+ * callback in order. If the missing packets do not arrive within timeout_ms,
+ * they are given up as lost and the held packets are uploaded. Loss therefore
+ * costs at most timeout_ms of delay instead of a corrupted chunk.
+ *
+ * mds_stream_read_packet() returns packets as received and is not affected.
+ * Disable only after streaming stops; packets still held are discarded.
+ *
+ * @param session MDS session handle
+ * @param enable true to enable, false to disable
+ * @param timeout_ms Time to wait for retransmissions (<= 0 for MDS_RETRANSMIT_DEFAULT_TIMEOUT_MS)
+ *
+ * @return 0 on success, negative error code otherwise
+ *         -ENOTSUP if the device does not support retransmission
+ */
+int mds_stream_set_retransmit(mds_session_t *session, bool enable, int timeout_ms);
+
+/* ============================================================================
+ * Flow Control
+ * ========================================================================== */
+
+/**
+ * @brief Enable or disable credit-based flow control
+ *
+ * Requires a device that advertises MDS_FEATURE_STREAM_CREDITS. Call before
+ * mds_stream_enable(), which then grants the first credits. The session
+ * grants new credits as packets are consumed through mds_stream_read_packet(),
+ * mds_process_stream() or mds_process_stream_from_bytes(): once half of the
+ * last grant has been used, the credit is topped up to the window minus the
+ * packets still held for reordering. A gateway that stops reading (e.g.
+ * while uploads back up) therefore stops the device instead of overflowing
+ * the kernel HID buffer. While the stream is idle, the grant is repeated
+ * every MDS_CREDIT_REGRANT_INTERVAL_MS in case it was lost.
+ *
+ * @param session MDS session handle
+ * @param window Packets the gateway can absorb (1-255, 0 disables flow control)
+ *
+ * @return 0 on success, negative error code otherwise
+ *         -ENOTSUP if the device does not support flow control
+ */
+int mds_stream_set_flow_control(mds_session_t *session, unsigned int window);
+
+/* ============================================================================
+ * Large Reports
+ * ========================================================================== */
+
+/**
+ * @brief Enable or disable large-report stream mode
+ *
+ * Requires a device that advertises MDS_FEATURE_STREAM_LARGE_REPORTS. Call
+ * before mds_stream_enable(), which then asks the device for large-report
+ * packets. Each packet can carry up to MDS_MAX_STREAM_DATA_LEN bytes instead
+ * of MDS_MAX_CHUNK_DATA_LEN, cutting the number of interrupt transfers (and
+ * header overhead) for large chunks such as coredumps.
+ *
+ * mds_process_stream_from_bytes() parses buffers in the same mode.
+ *
+ * @param session MDS session handle
+ * @param enable true to enable, false to use 64-byte reports
+ *
+ * @return 0 on success, negative error code otherwise
+ *         -ENOTSUP if the device does not support large reports
+ */
+int mds_stream_set_large_reports(mds_session_t *session, bool enable);
+
+/* ============================================================================
+ * Stream Resume
+ * ========================================================================== */
+
+/**
+ * @brief Resume the stream from an acknowledged offset
+ *
+ * Requires a device that advertises MDS_FEATURE_STREAM_RESUME. Call before
+ * mds_stream_enable(), which then tells the device where to resume, so data
+ * that was already forwarded before a reboot or reconnect is not sent again.
+ * Pass the offset saved from mds_stream_get_resume_offset() in the previous
+ * session for the same device (0 if there is none).
+ *
+ * @param session MDS session handle
+ * @param offset First chunk data byte not yet acknowledged
+ *
+ * @return 0 on success, negative error code otherwise
+ *         -ENOTSUP if the device does not support resume
+ */
+int mds_stream_set_resume_offset(mds_session_t *session, uint32_t offset);
+
+/**
+ * @brief Get the acknowledged stream offset
+ *
+ * The offset advances by the payload length of every packet the upload
+ * callback accepts (mds_process_stream(), mds_process_stream_from_bytes())
+ * and of every packet acknowledged with mds_stream_ack(). Persist it per
+ * device and hand it back with mds_stream_set_resume_offset().
+ *
+ * The offset stops advancing if the host can no longer tell which data was
+ * forwarded: after an upload failure or a sequence gap, duplicate or reorder
+ * that retransmission did not resolve. The next mds_stream_enable() resumes
+ * from there, so the device resends the uncertain data instead of it being
+ * lost.
+ *
+ * @param session MDS session handle
+ * @param offset Pointer to receive the offset
+ *
+ * @return 0 on success, negative error code otherwise
+ *         -ENOTSUP if resume is not enabled on this session
+ */
+int mds_stream_get_resume_offset(mds_session_t *session, uint32_t *offset);
+
+/**
+ * @brief Acknowledge forwarded stream data
+ *
+ * For applications that read packets with mds_stream_read_packet() and
+ * upload them themselves. Acknowledge each packet's payload length, in
+ * stream order, once it has been forwarded.
+ *
+ * @param session MDS session handle
+ * @param length Number of chunk data bytes forwarded
+ *
+ * @return 0 on success, negative error code otherwise
+ *         -ENOTSUP if resume is not enabled on this session
+ */
+int mds_stream_ack(mds_session_t *session, size_t length);
+
+/* ============================================================================
+ * Shutdown
+ * ========================================================================== */
+
+/**
+ * @brief Outcome of mds_session_shutdown()
+ */
+typedef struct {
+    /** Packets read from the device after streaming was disabled */
+    uint32_t packets_drained;
+
+    /** Drained or held packets accepted by the upload callback */
+    uint32_t packets_uploaded;
+
+    /** Packets that were received but not uploaded (upload failed or no callback) */
+    uint32_t packets_dropped;
+
+    /** Chunk data bytes in dropped packets */
+    uint64_t bytes_dropped;
+
+    /** The deadline expired before the device went quiet */
+    bool deadline_expired;
+} mds_shutdown_report_t;
+
+/**
+ * @brief Stop streaming without losing data already sent by the device
+ *
+ * Use before mds_session_destroy() (which only disables streaming) when
+ * stopping a gateway, e.g. for a rolling restart:
+ * 1. Disables streaming, so the device stops sending new data
+ * 2. Uploads packets held back for reordering (see mds_stream_set_retransmit())
+ * 3. Drains reports already in flight (in the kernel or HID queues) and hands
+ *    them to the upload callback, until the device has been quiet for a short
+ *    while or the deadline expires
+ *
+ * Uploads run synchronously in the upload callback; bound their duration
+ * (e.g. with chunks_uploader_set_timeout()) to keep within the deadline. To
+ * spool data to disk instead of uploading it during shutdown, register a
+ * callback that writes the chunks before calling this function. Data the
+ * device had not sent yet is not lost on devices with stream resume: it was
+ * never acknowledged.
+ *
+ * @param session MDS session handle
+ * @param config Device configuration (URI and auth for the upload callback)
+ * @param deadline_ms Time budget for draining (<= 0 to only disable and flush held packets)
+ * @param report Optional pointer to receive the outcome (NULL to skip)
+ *
+ * @return 0 if everything received was uploaded, negative error code otherwise
+ *         -ETIMEDOUT if the deadline expired while the device was still sending
+ *         -EIO if packets were dropped
+ */
+int mds_session_shutdown(mds_session_t *session,
+                         const mds_device_config_t *config,
+                         int deadline_ms,
+                         mds_shutdown_report_t *report);
 
 #ifdef __cplusplus
 }
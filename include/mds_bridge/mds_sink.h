@@ -0,0 +1,294 @@
+/**
+ * @file mds_sink.h
+ * @brief Chunk sinks: several consumers of one session's stream
+ *
+ * A sink receives the chunks a session processes (mds_process_stream() and
+ * mds_process_stream_from_bytes()). Any number of sinks, up to
+ * MDS_MAX_SINKS, can be attached to a session, so one stream can be uploaded,
+ * archived and fed to local analytics at the same time without a
+ * hand-written multiplexer.
+ *
+ * Every sink has its own settings:
+ * - Mode. Inline sinks are called on the thread processing the stream, one
+ *   chunk per call, before the next packet is read. Async sinks have their
+ *   own thread and a bounded queue; a slow async sink delays neither the
+ *   stream nor the other sinks.
+ * - Filtering by chunk class (class_mask) and/or a filter callback, both
+ *   evaluated on the stream thread before anything is queued.
+ * - Batching (async sinks): the write callback receives up to max_batch
+ *   chunks (max_batch_bytes of data) at a time, and waits up to max_delay_ms
+ *   for a batch to fill.
+ * - Queue depth and overflow policy (async sinks): when the queue is full,
+ *   the stream thread either waits for room (backpressure on the device) or
+ *   the chunk is dropped for this sink and counted.
+ *
+ * Chunks are not copied for inline sinks: they see the session's parsed
+ * packet. For async sinks each packet is copied once, however many async
+ * sinks take it, into a reference-counted buffer that is recycled for a
+ * later packet when the last of them has written it.
+ *
+ * Acknowledgement: a packet counts as uploaded (and the stream resume offset
+ * advances) when every inline sink with required set has written it. Async
+ * sinks and inline sinks without required never fail a packet; their write
+ * failures only show in their statistics. Each sink sees chunks in stream
+ * order, and its write callback is never called concurrently with itself.
+ *
+ * mds_set_upload_callback() and mds_set_upload_callback_ex() attach a
+ * required inline sink for the given callback, so existing code keeps its
+ * behaviour and can add further sinks next to it.
+ *
+ * Add and remove sinks from the thread that processes the stream (or while
+ * it is not processing).
+ *
+ * Usage:
+ * @code
+ * mds_sink_config_t upload;
+ * mds_sink_default_config(&upload);
+ * upload.name = "upload";
+ * upload.write = chunks_uploader_batch_callback;
+ * upload.user_data = uploader;
+ * mds_session_add_sink(session, &upload, NULL);
+ *
+ * mds_sink_config_t archive;
+ * mds_sink_default_config(&archive);
+ * archive.name = "archive";
+ * archive.mode = MDS_SINK_ASYNC;
+ * archive.required = false;
+ * archive.class_mask = MDS_SINK_CLASS(MDS_CHUNK_CLASS_COREDUMP);
+ * archive.write = chunks_file_sink_batch_callback;
+ * archive.user_data = file_sink;
+ * mds_session_add_sink(session, &archive, NULL);
+ *
+ * while (running) {
+ *     mds_process_stream(session, &config, 1000, NULL);  // Feeds both sinks
+ * }
+ * @endcode
+ */
+
+#ifndef MDS_BRIDGE_MDS_SINK_H
+#define MDS_BRIDGE_MDS_SINK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "mds_protocol.h"
+
+/** Maximum number of sinks per session (including an upload callback) */
+#define MDS_MAX_SINKS               8
+
+/** Bit of a chunk class in mds_sink_config_t::class_mask */
+#define MDS_SINK_CLASS(chunk_class) (1u << (chunk_class))
+
+/** Every chunk class */
+#define MDS_SINK_CLASS_ALL          ((1u << MDS_CHUNK_CLASS_COUNT) - 1)
+
+/**
+ * @brief Opaque handle to a sink attached to a session
+ */
+typedef struct mds_sink mds_sink_t;
+
+/**
+ * @brief Sink threading modes
+ */
+typedef enum {
+    /** Called on the thread processing the stream */
+    MDS_SINK_INLINE = 0,
+
+    /** Called on a thread of the sink, fed through a queue */
+    MDS_SINK_ASYNC = 1,
+} mds_sink_mode_t;
+
+/**
+ * @brief Chunk passed to sinks
+ *
+ * All pointers are valid for the duration of the call only.
+ */
+typedef struct {
+    /** Data URI (from the device configuration) */
+    const char *uri;
+
+    /** Authorization header (format: "HeaderName:HeaderValue") */
+    const char *auth_header;
+
+    /** Chunk data */
+    const uint8_t *data;
+
+    /** Chunk length */
+    size_t len;
+
+    /** Chunk metadata */
+    mds_chunk_info_t info;
+} mds_sink_chunk_t;
+
+/**
+ * @brief Callback writing chunks to a sink
+ *
+ * @param chunks Chunks in stream order (always one for inline sinks)
+ * @param count Number of chunks
+ * @param user_data User context pointer from the sink configuration
+ *
+ * @return 0 on success, negative error code if the chunks were not written
+ */
+typedef int (*mds_sink_write_t)(const mds_sink_chunk_t *chunks, size_t count, void *user_data);
+
+/**
+ * @brief Callback deciding whether a sink takes a chunk
+ *
+ * Called on the thread processing the stream; must not block.
+ *
+ * @param chunk Chunk
+ * @param user_data User context pointer from the sink configuration
+ *
+ * @return true to pass the chunk to the sink
+ */
+typedef bool (*mds_sink_filter_t)(const mds_sink_chunk_t *chunk, void *user_data);
+
+/**
+ * @brief Sink configuration
+ */
+typedef struct {
+    /** Name for log messages (may be NULL) */
+    const char *name;
+
+    /** Threading mode */
+    mds_sink_mode_t mode;
+
+    /** Chunk classes to take (MDS_SINK_CLASS() bits) */
+    uint32_t class_mask;
+
+    /** Additional filter (NULL: take every chunk of the selected classes) */
+    mds_sink_filter_t filter;
+
+    /** Write callback (required) */
+    mds_sink_write_t write;
+
+    /** User context pointer passed to the callbacks */
+    void *user_data;
+
+    /** Inline sinks: a write failure fails the packet (see file description) */
+    bool required;
+
+    /** Async sinks: chunks queued at most (>= 1) */
+    size_t queue_depth;
+
+    /** Async sinks: drop chunks when the queue is full instead of waiting for room */
+    bool drop_when_full;
+
+    /** Async sinks: chunks per write call at most (>= 1) */
+    size_t max_batch;
+
+    /** Async sinks: chunk bytes per write call at most (0 = no limit; a
+     *  larger chunk is written on its own) */
+    size_t max_batch_bytes;
+
+    /** Async sinks: wait this long for a batch to fill (0 = write what is queued) */
+    uint32_t max_delay_ms;
+} mds_sink_config_t;
+
+/**
+ * @brief Sink statistics
+ */
+typedef struct {
+    /** Chunks taken (written inline or queued) */
+    uint64_t chunks_accepted;
+
+    /** Chunks skipped by class_mask or the filter */
+    uint64_t chunks_filtered;
+
+    /** Chunks dropped because the queue was full (or out of memory) */
+    uint64_t chunks_dropped;
+
+    /** Chunks written successfully */
+    uint64_t chunks_written;
+
+    /** Chunks in failed write calls */
+    uint64_t chunks_failed;
+
+    /** Write callback calls */
+    uint64_t writes;
+
+    /** Chunks currently queued */
+    size_t queued;
+
+    /** Most chunks queued at once */
+    size_t max_queued;
+} mds_sink_stats_t;
+
+/**
+ * @brief Fill a configuration with defaults
+ *
+ * A required inline sink taking every chunk class. For async mode: a queue
+ * of 256 chunks that waits for room when full, and batches of up to 16
+ * chunks written as soon as they are queued.
+ *
+ * @param config Configuration to fill
+ */
+void mds_sink_default_config(mds_sink_config_t *config);
+
+/**
+ * @brief Attach a sink to a session
+ *
+ * Sinks receive chunks in the order they were attached.
+ *
+ * @param session MDS session handle
+ * @param config Sink configuration (copied; name is copied too)
+ * @param sink Pointer to receive the sink handle (may be NULL)
+ *
+ * @return 0 on success, -EINVAL on invalid parameters, -ENOSPC if the
+ *         session has MDS_MAX_SINKS sinks, -ENOMEM, or a negative errno if
+ *         the sink thread cannot be started
+ */
+int mds_session_add_sink(mds_session_t *session,
+                         const mds_sink_config_t *config,
+                         mds_sink_t **sink);
+
+/**
+ * @brief Detach a sink from a session
+ *
+ * Writes the chunks an async sink still has queued, then stops its thread.
+ * The handle is invalid afterwards. Sinks still attached are removed the
+ * same way by mds_session_destroy().
+ *
+ * @param session MDS session handle
+ * @param sink Sink handle
+ *
+ * @return 0 on success, -EINVAL on invalid parameters, -ENOENT if the sink
+ *         is not attached to the session
+ */
+int mds_session_remove_sink(mds_session_t *session, mds_sink_t *sink);
+
+/**
+ * @brief Wait until an async sink has written everything queued
+ *
+ * Returns at once for inline sinks. Also ends a max_delay_ms wait, so a
+ * partial batch is written immediately.
+ *
+ * @param sink Sink handle
+ * @param timeout_ms Longest wait in milliseconds (< 0 = no limit)
+ *
+ * @return 0 on success, -EINVAL on invalid parameters, -ETIMEDOUT
+ */
+int mds_sink_flush(mds_sink_t *sink, int timeout_ms);
+
+/**
+ * @brief Get sink statistics
+ *
+ * May be called from any thread.
+ *
+ * @param sink Sink handle
+ * @param stats Pointer to receive statistics
+ *
+ * @return 0 on success, -EINVAL on invalid parameters
+ */
+int mds_sink_get_stats(mds_sink_t *sink, mds_sink_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MDS_BRIDGE_MDS_SINK_H */
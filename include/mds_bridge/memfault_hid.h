@@ -54,6 +54,48 @@ typedef struct {
     int interface_number;            /* USB interface number */
 } memfault_hid_device_info_t;
 
+/**
+ * @brief Enumeration filter for memfault_hid_enumerate_visit()
+ *
+ * All predicates are evaluated against hidapi's list before anything is
+ * copied or reported to the visitor.
+ */
+typedef struct {
+    uint16_t vendor_id;              /* USB Vendor ID (0x0000 matches any) */
+    uint16_t product_id;             /* USB Product ID (0x0000 matches any) */
+    uint16_t usage_page;             /* HID usage page (0x0000 matches any) */
+    int interface_number;            /* USB interface number (-1 matches any) */
+    const wchar_t *serial_prefix;    /* Serial number prefix (NULL matches any) */
+} memfault_hid_enum_filter_t;
+
+/**
+ * @brief Compact device reference passed to enumeration visitors
+ *
+ * Only valid for the duration of the visitor call. Strings are not copied;
+ * fetch them on demand with memfault_hid_device_ref_serial() and friends.
+ */
+typedef struct {
+    const char *path;                /* Platform-specific device path */
+    uint16_t vendor_id;              /* USB Vendor ID */
+    uint16_t product_id;             /* USB Product ID */
+    uint16_t release_number;         /* Device release number */
+    uint16_t usage_page;             /* HID usage page */
+    uint16_t usage;                  /* HID usage */
+    int interface_number;            /* USB interface number */
+    const void *handle;              /* Internal - backing enumeration entry */
+} memfault_hid_device_ref_t;
+
+/**
+ * @brief Enumeration visitor callback
+ *
+ * @param device Matching device (valid only during the call)
+ * @param user_data User-provided context pointer
+ *
+ * @return true to continue enumerating, false to stop
+ */
+typedef bool (*memfault_hid_enum_visitor_t)(const memfault_hid_device_ref_t *device,
+                                            void *user_data);
+
 /* ============================================================================
  * Library Initialization
  * ========================================================================== */
@@ -62,10 +104,12 @@ typedef struct {
  * @brief Initialize the HID library
  *
  * This function must be called before device enumeration or opening devices.
- * It is safe to call multiple times (idempotent).
+ * Initialization is reference counted and thread-safe: every successful
+ * call must be balanced by a call to memfault_hid_exit(), and the underlying
+ * HID library is initialized only once.
  *
- * Note: When using the high-level MDS API (mds_session_create_hid()), this
- * is called automatically by the backend.
+ * Note: When using the high-level MDS API (mds_session_create_hid()), the
+ * backend takes (and releases on destroy) its own reference.
  *
  * @return MEMFAULT_HID_SUCCESS on success, error code otherwise
  */
@@ -74,7 +118,9 @@ int memfault_hid_init(void);
 /**
  * @brief Cleanup and shutdown the HID library
  *
- * This function should be called when done using the library.
+ * Releases one reference taken by memfault_hid_init(). The underlying HID
+ * library is shut down when the last reference is released. Calling this
+ * without a matching memfault_hid_init() is a no-op.
  *
  * @return MEMFAULT_HID_SUCCESS on success, error code otherwise
  */
@@ -102,6 +148,52 @@ int memfault_hid_enumerate(uint16_t vendor_id,
                            memfault_hid_device_info_t **devices,
                            size_t *num_devices);
 
+/**
+ * @brief Visit every HID device matching a filter
+ *
+ * Streams hidapi's device list through the filter and calls the visitor for
+ * each match, without allocating per-device records. Prefer this over
+ * memfault_hid_enumerate() for periodic rescans or when only paths are needed.
+ *
+ * @param filter Filter predicates (NULL matches every device)
+ * @param visitor Callback invoked for each matching device
+ * @param user_data User context pointer passed to the visitor
+ *
+ * @return Number of devices visited (>= 0), error code otherwise
+ *
+ * @note memfault_hid_init() must be called before calling this function
+ */
+int memfault_hid_enumerate_visit(const memfault_hid_enum_filter_t *filter,
+                                 memfault_hid_enum_visitor_t visitor,
+                                 void *user_data);
+
+/**
+ * @brief Get the serial number of a visited device
+ *
+ * @param device Device reference from an enumeration visitor
+ *
+ * @return Serial number (wide string, never NULL), valid during the visitor call
+ */
+const wchar_t *memfault_hid_device_ref_serial(const memfault_hid_device_ref_t *device);
+
+/**
+ * @brief Get the manufacturer string of a visited device
+ *
+ * @param device Device reference from an enumeration visitor
+ *
+ * @return Manufacturer (wide string, never NULL), valid during the visitor call
+ */
+const wchar_t *memfault_hid_device_ref_manufacturer(const memfault_hid_device_ref_t *device);
+
+/**
+ * @brief Get the product string of a visited device
+ *
+ * @param device Device reference from an enumeration visitor
+ *
+ * @return Product (wide string, never NULL), valid during the visitor call
+ */
+const wchar_t *memfault_hid_device_ref_product(const memfault_hid_device_ref_t *device);
+
 /**
  * @brief Free device list returned by memfault_hid_enumerate()
  *
@@ -19,14 +19,27 @@
     /* clock_gettime replacement for Windows */
     #ifndef CLOCK_MONOTONIC
         #define CLOCK_MONOTONIC 0
+        #define CLOCK_REALTIME 1
 
         /* Windows SDK 10.0.17063+ defines struct timespec in time.h
          * We only need to provide clock_gettime implementation */
         static inline int clock_gettime(int clk_id, struct timespec *ts) {
-            (void)clk_id;
-            ULONGLONG ms = GetTickCount64();
-            ts->tv_sec = (long)(ms / 1000);
-            ts->tv_nsec = (long)((ms % 1000) * 1000000);
+            if (clk_id == CLOCK_REALTIME) {
+                /* FILETIME counts 100 ns intervals since 1601-01-01 */
+                FILETIME ft;
+                GetSystemTimePreciseAsFileTime(&ft);
+                ULONGLONG t = ((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+                t -= 116444736000000000ULL;
+                ts->tv_sec = (long)(t / 10000000ULL);
+                ts->tv_nsec = (long)((t % 10000000ULL) * 100);
+                return 0;
+            }
+
+            LARGE_INTEGER freq, count;
+            QueryPerformanceFrequency(&freq);
+            QueryPerformanceCounter(&count);
+            ts->tv_sec = (long)(count.QuadPart / freq.QuadPart);
+            ts->tv_nsec = (long)((count.QuadPart % freq.QuadPart) * 1000000000LL / freq.QuadPart);
             return 0;
         }
     #endif
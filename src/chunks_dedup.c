@@ -0,0 +1,771 @@
+/**
+ * @file chunks_dedup.c
+ * @brief Content-hash deduplication of Memfault messages
+ *
+ * Data structures:
+ * - Every device seen has a dedup_device_t holding its remembered messages
+ *   (an array ordered most recently seen first) and the state of the message
+ *   currently streaming.
+ * - A remembered message is its length, the hash of its first
+ *   PREFIX_LEN bytes and the hash of all of it. The prefix hash is the FNV
+ *   state after PREFIX_LEN bytes, so both come out of a single pass.
+ *
+ * Message states:
+ * - PROBING: the prefix is still incomplete; chunks are held.
+ * - HOLDING: the prefix matches a remembered message; chunks are held until
+ *   the message ends and the full hash decides.
+ * - PASSING: not a duplicate (or too large to hold); chunks are forwarded
+ *   and the message is remembered when it ends.
+ * - UNTRACKED: the start of the message was missed or flushed; chunks are
+ *   forwarded and nothing is remembered.
+ *
+ * All state is guarded by a single mutex. Chunks to forward are detached
+ * from the device under the lock and handed to the callback after it is
+ * released.
+ */
+
+#include "mds_bridge/chunks_dedup.h"
+#include "mds_bridge/mds_protocol.h"
+#include "mds_thread.h"
+#include "mds_time.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+
+#define DEFAULT_MAX_MESSAGES    64
+#define DEFAULT_MAX_DEVICES     1024
+#define DEFAULT_MAX_HELD_BYTES  (64 * 1024)
+#define DEFAULT_MAX_AGE_SEC     3600
+
+#define PREFIX_LEN              64
+
+#define CHUNK_HDR_CONTINUATION  0x80
+#define CHUNK_HDR_MORE_DATA     0x40
+
+#define FNV_OFFSET_BASIS        0xcbf29ce484222325ull
+#define FNV_PRIME               0x100000001b3ull
+
+/*
+ * Persistence file format:
+ * Byte 0-3:  Magic "MDSD"
+ * Byte 4:    Format version (1)
+ * Then per device:
+ *   Device identifier length (1 byte), device identifier,
+ *   entry count (2 bytes), entries of ENTRY_RECORD_LEN bytes:
+ *   length (4), prefix hash (8), hash (8), last seen in Unix seconds (8)
+ * All integers are little-endian.
+ */
+#define FILE_MAGIC              "MDSD"
+#define FILE_VERSION            1
+#define ENTRY_RECORD_LEN        28
+
+typedef enum {
+    MSG_IDLE,
+    MSG_PROBING,
+    MSG_HOLDING,
+    MSG_PASSING,
+    MSG_UNTRACKED,
+} msg_state_t;
+
+/* Remembered message */
+typedef struct {
+    uint32_t length;
+    uint64_t prefix_hash;
+    uint64_t hash;
+    int64_t seen;                       /* Unix seconds */
+} dedup_entry_t;
+
+/* Held chunk */
+typedef struct held_chunk {
+    struct held_chunk *next;
+    size_t len;
+    uint8_t data[];
+} held_chunk_t;
+
+/* Per-device state */
+typedef struct dedup_device {
+    struct dedup_device *next;
+    char id[MDS_MAX_DEVICE_ID_LEN];
+    dedup_entry_t *entries;             /* Most recently seen first */
+    size_t entry_count;
+    int64_t active;                     /* Last chunk, Unix seconds */
+
+    /* Message currently streaming */
+    msg_state_t state;
+    uint64_t hash;
+    uint64_t prefix_hash;
+    uint32_t length;
+    held_chunk_t *held;
+    held_chunk_t *held_tail;
+    size_t held_count;
+    size_t held_bytes;
+} dedup_device_t;
+
+struct chunks_dedup {
+    mds_mutex_t lock;
+    chunks_dedup_config_t config;
+    dedup_device_t *devices;
+    size_t device_count;
+    chunks_dedup_stats_t stats;
+};
+
+static int64_t now_sec(void) {
+    return (int64_t)(mds_time_realtime_ns() / 1000000000ull);
+}
+
+/* ============================================================================
+ * Message Hashing
+ * ========================================================================== */
+
+static uint64_t fnv1a(uint64_t hash, const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/* Add message bytes, capturing the prefix hash on the way */
+static void message_consume(dedup_device_t *device, const uint8_t *data, size_t len) {
+    if (device->length < PREFIX_LEN) {
+        size_t head = PREFIX_LEN - device->length;
+        if (head > len) {
+            head = len;
+        }
+        device->hash = fnv1a(device->hash, data, head);
+        device->length += (uint32_t)head;
+        if (device->length == PREFIX_LEN) {
+            device->prefix_hash = device->hash;
+        }
+        data += head;
+        len -= head;
+    }
+
+    device->hash = fnv1a(device->hash, data, len);
+    device->length += (uint32_t)len;
+}
+
+/* Read a varint; returns the number of bytes, or 0 if it is incomplete */
+static size_t varint_read(const uint8_t *data, size_t len, uint32_t *value) {
+    uint32_t result = 0;
+    for (size_t i = 0; i < len && i < 5; i++) {
+        result |= (uint32_t)(data[i] & 0x7F) << (7 * i);
+        if (!(data[i] & 0x80)) {
+            *value = result;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Remembered Messages
+ * ========================================================================== */
+
+static bool entry_expired(const chunks_dedup_t *dedup, const dedup_entry_t *entry, int64_t now) {
+    return dedup->config.max_age_sec != 0 && now - entry->seen > (int64_t)dedup->config.max_age_sec;
+}
+
+/* Drop expired entries (they are at the end of the list) */
+static void entries_expire(chunks_dedup_t *dedup, dedup_device_t *device, int64_t now) {
+    while (device->entry_count > 0 &&
+           entry_expired(dedup, &device->entries[device->entry_count - 1], now)) {
+        device->entry_count--;
+    }
+}
+
+static bool entries_match_prefix(const dedup_device_t *device, uint64_t prefix_hash) {
+    for (size_t i = 0; i < device->entry_count; i++) {
+        if (device->entries[i].length >= PREFIX_LEN &&
+            device->entries[i].prefix_hash == prefix_hash) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static dedup_entry_t *entries_find(dedup_device_t *device, uint32_t length, uint64_t hash) {
+    for (size_t i = 0; i < device->entry_count; i++) {
+        if (device->entries[i].length == length && device->entries[i].hash == hash) {
+            return &device->entries[i];
+        }
+    }
+    return NULL;
+}
+
+/* Move an entry (or, with NULL, a new one) to the front and stamp it */
+static void entries_touch(chunks_dedup_t *dedup, dedup_device_t *device,
+                          dedup_entry_t *entry, int64_t now) {
+    size_t index;
+    dedup_entry_t value;
+
+    if (entry != NULL) {
+        index = (size_t)(entry - device->entries);
+        value = *entry;
+    } else {
+        if (device->entry_count < dedup->config.max_messages) {
+            device->entry_count++;
+        }
+        index = device->entry_count - 1;  /* Evicts the least recently seen when full */
+        value.length = device->length;
+        value.prefix_hash = device->length >= PREFIX_LEN ? device->prefix_hash : device->hash;
+        value.hash = device->hash;
+    }
+
+    memmove(&device->entries[1], &device->entries[0], index * sizeof(device->entries[0]));
+    value.seen = now;
+    device->entries[0] = value;
+}
+
+/* ============================================================================
+ * Devices
+ * ========================================================================== */
+
+static void held_free(held_chunk_t *held) {
+    while (held != NULL) {
+        held_chunk_t *next = held->next;
+        free(held);
+        held = next;
+    }
+}
+
+/* Detach the held chunks (to forward or free) */
+static held_chunk_t *held_take(dedup_device_t *device) {
+    held_chunk_t *held = device->held;
+    device->held = NULL;
+    device->held_tail = NULL;
+    device->held_count = 0;
+    device->held_bytes = 0;
+    return held;
+}
+
+static bool held_append(dedup_device_t *device, const uint8_t *chunk, size_t len) {
+    held_chunk_t *held = malloc(sizeof(*held) + len);
+    if (held == NULL) {
+        return false;
+    }
+    held->next = NULL;
+    held->len = len;
+    memcpy(held->data, chunk, len);
+
+    if (device->held_tail) {
+        device->held_tail->next = held;
+    } else {
+        device->held = held;
+    }
+    device->held_tail = held;
+    device->held_count++;
+    device->held_bytes += len;
+    return true;
+}
+
+static void device_free(dedup_device_t *device) {
+    held_free(device->held);
+    free(device->entries);
+    free(device);
+}
+
+/* Forget the least recently active device without held chunks.
+ * Returns false if every device holds chunks. */
+static bool devices_evict(chunks_dedup_t *dedup) {
+    dedup_device_t **victim = NULL;
+    for (dedup_device_t **link = &dedup->devices; *link != NULL; link = &(*link)->next) {
+        if ((*link)->held == NULL && (victim == NULL || (*link)->active < (*victim)->active)) {
+            victim = link;
+        }
+    }
+
+    if (victim == NULL) {
+        return false;
+    }
+
+    dedup_device_t *device = *victim;
+    *victim = device->next;
+    dedup->device_count--;
+    device_free(device);
+    return true;
+}
+
+static dedup_device_t *device_find(chunks_dedup_t *dedup, const char *device_id) {
+    for (dedup_device_t *device = dedup->devices; device != NULL; device = device->next) {
+        if (strcmp(device->id, device_id) == 0) {
+            return device;
+        }
+    }
+    return NULL;
+}
+
+static dedup_device_t *device_get(chunks_dedup_t *dedup, const char *device_id) {
+    dedup_device_t *device = device_find(dedup, device_id);
+    if (device != NULL) {
+        return device;
+    }
+
+    if (strlen(device_id) >= sizeof(device->id)) {
+        return NULL;
+    }
+    if (dedup->device_count >= dedup->config.max_devices && !devices_evict(dedup)) {
+        return NULL;  /* Full of devices with held chunks */
+    }
+
+    device = calloc(1, sizeof(*device));
+    if (device == NULL) {
+        return NULL;
+    }
+    device->entries = calloc(dedup->config.max_messages, sizeof(device->entries[0]));
+    if (device->entries == NULL) {
+        free(device);
+        return NULL;
+    }
+    snprintf(device->id, sizeof(device->id), "%s", device_id);
+    device->state = MSG_IDLE;
+
+    device->next = dedup->devices;
+    dedup->devices = device;
+    dedup->device_count++;
+    return device;
+}
+
+/* ============================================================================
+ * Message State Machine
+ * ========================================================================== */
+
+/* Outcome of one chunk: chunks to forward (held ones first) and whether the
+ * chunk itself follows them */
+typedef struct {
+    held_chunk_t *release;
+    bool forward_chunk;
+} dedup_action_t;
+
+static void message_begin(dedup_device_t *device) {
+    device->state = MSG_PROBING;
+    device->hash = FNV_OFFSET_BASIS;
+    device->prefix_hash = 0;
+    device->length = 0;
+}
+
+/* Stop holding: forward what was held, then this chunk */
+static void message_pass(dedup_device_t *device, msg_state_t state, dedup_action_t *action) {
+    action->release = held_take(device);
+    action->forward_chunk = true;
+    device->state = state;
+}
+
+static void message_step(chunks_dedup_t *dedup, dedup_device_t *device,
+                         const uint8_t *chunk, size_t len, int64_t now,
+                         dedup_action_t *action) {
+    uint8_t header = chunk[0];
+    bool more = (header & CHUNK_HDR_MORE_DATA) != 0;
+    size_t pos = 1;
+    uint32_t varint = 0;
+
+    action->release = NULL;
+    action->forward_chunk = true;
+
+    if (header & CHUNK_HDR_CONTINUATION) {
+        size_t n = varint_read(chunk + pos, len - pos, &varint);
+        if (device->state == MSG_IDLE || device->state == MSG_UNTRACKED ||
+            n == 0 || varint != device->length) {
+            /* Missed part of the message - pass the rest on unchecked */
+            message_pass(device, more ? MSG_UNTRACKED : MSG_IDLE, action);
+            return;
+        }
+        pos += n;
+    } else {
+        if (device->state == MSG_PROBING || device->state == MSG_HOLDING) {
+            /* Interrupted before it was forwarded; the cloud would discard it */
+            dedup->stats.abandoned_chunks += device->held_count;
+            held_free(held_take(device));
+        }
+        message_begin(device);
+        if (more) {
+            size_t n = varint_read(chunk + pos, len - pos, &varint);
+            if (n == 0) {
+                device->state = MSG_UNTRACKED;
+                return;
+            }
+            pos += n;
+        }
+    }
+
+    message_consume(device, chunk + pos, len - pos);
+
+    if (!more) {
+        dedup->stats.messages++;
+        if (device->state == MSG_PROBING || device->state == MSG_HOLDING) {
+            dedup_entry_t *entry = entries_find(device, device->length, device->hash);
+            if (entry != NULL) {
+                dedup->stats.duplicate_messages++;
+                dedup->stats.duplicate_chunks += device->held_count + 1;
+                dedup->stats.duplicate_bytes += device->held_bytes + len;
+                held_free(held_take(device));
+                action->forward_chunk = false;
+                entries_touch(dedup, device, entry, now);
+                device->state = MSG_IDLE;
+                return;
+            }
+            message_pass(device, MSG_IDLE, action);
+        }
+        if (device->state != MSG_UNTRACKED) {
+            entries_touch(dedup, device, entries_find(device, device->length, device->hash), now);
+        }
+        device->state = MSG_IDLE;
+        return;
+    }
+
+    if (device->state == MSG_PROBING && device->length >= PREFIX_LEN) {
+        if (!entries_match_prefix(device, device->prefix_hash)) {
+            message_pass(device, MSG_PASSING, action);
+            return;
+        }
+        device->state = MSG_HOLDING;
+    }
+
+    if (device->state == MSG_PROBING || device->state == MSG_HOLDING) {
+        if (device->held_bytes + len > dedup->config.max_held_bytes) {
+            dedup->stats.overflows++;
+            message_pass(device, MSG_PASSING, action);
+        } else if (!held_append(device, chunk, len)) {
+            message_pass(device, MSG_PASSING, action);  /* Out of memory: do not lose data */
+        } else {
+            action->forward_chunk = false;
+        }
+    }
+}
+
+/* Hand detached chunks to the callback (outside the lock) and free them */
+static int release_chunks(const char *device_id, held_chunk_t *held,
+                          chunks_dedup_forward_t forward, void *user_data) {
+    int count = 0;
+    while (held != NULL) {
+        held_chunk_t *next = held->next;
+        forward(device_id, held->data, held->len, user_data);
+        free(held);
+        held = next;
+        count++;
+    }
+    return count;
+}
+
+/* ============================================================================
+ * Public API
+ * ========================================================================== */
+
+void chunks_dedup_default_config(chunks_dedup_config_t *config) {
+    if (config == NULL) {
+        return;
+    }
+
+    memset(config, 0, sizeof(*config));
+    config->max_messages = DEFAULT_MAX_MESSAGES;
+    config->max_devices = DEFAULT_MAX_DEVICES;
+    config->max_held_bytes = DEFAULT_MAX_HELD_BYTES;
+    config->max_age_sec = DEFAULT_MAX_AGE_SEC;
+}
+
+chunks_dedup_t *chunks_dedup_create(const chunks_dedup_config_t *config) {
+    chunks_dedup_config_t defaults;
+    if (config == NULL) {
+        chunks_dedup_default_config(&defaults);
+        config = &defaults;
+    }
+    if (config->max_messages == 0 || config->max_messages > UINT16_MAX ||
+        config->max_devices == 0) {
+        return NULL;
+    }
+
+    chunks_dedup_t *dedup = calloc(1, sizeof(*dedup));
+    if (dedup == NULL) {
+        return NULL;
+    }
+
+    mds_mutex_init(&dedup->lock);
+    dedup->config = *config;
+    return dedup;
+}
+
+void chunks_dedup_destroy(chunks_dedup_t *dedup) {
+    if (dedup == NULL) {
+        return;
+    }
+
+    dedup_device_t *device = dedup->devices;
+    while (device != NULL) {
+        dedup_device_t *next = device->next;
+        device_free(device);
+        device = next;
+    }
+
+    mds_mutex_destroy(&dedup->lock);
+    free(dedup);
+}
+
+int chunks_dedup_process(chunks_dedup_t *dedup,
+                         const char *device_id,
+                         const uint8_t *chunk,
+                         size_t len,
+                         chunks_dedup_forward_t forward,
+                         void *user_data) {
+    if (dedup == NULL || device_id == NULL || chunk == NULL || len == 0 || forward == NULL) {
+        return -EINVAL;
+    }
+
+    dedup_action_t action = { NULL, true };
+    int64_t now = now_sec();
+
+    mds_mutex_lock(&dedup->lock);
+    dedup_device_t *device = device_get(dedup, device_id);
+    if (device != NULL) {
+        device->active = now;
+        entries_expire(dedup, device, now);
+        message_step(dedup, device, chunk, len, now, &action);
+    }
+    mds_mutex_unlock(&dedup->lock);
+
+    /* Untrackable devices (allocation failure, overlong ID, max_devices
+     * devices all holding chunks) pass through */
+    int count = release_chunks(device_id, action.release, forward, user_data);
+    if (action.forward_chunk) {
+        forward(device_id, chunk, len, user_data);
+        count++;
+    }
+    return count;
+}
+
+int chunks_dedup_flush(chunks_dedup_t *dedup,
+                       const char *device_id,
+                       chunks_dedup_forward_t forward,
+                       void *user_data) {
+    if (dedup == NULL || forward == NULL) {
+        return -EINVAL;
+    }
+
+    int count = 0;
+    for (;;) {
+        /* One device per pass, so the callback never runs under the lock */
+        char id[MDS_MAX_DEVICE_ID_LEN];
+        held_chunk_t *held = NULL;
+
+        mds_mutex_lock(&dedup->lock);
+        for (dedup_device_t *device = dedup->devices; device != NULL; device = device->next) {
+            if ((device->state == MSG_PROBING || device->state == MSG_HOLDING) &&
+                (device_id == NULL || strcmp(device->id, device_id) == 0)) {
+                snprintf(id, sizeof(id), "%s", device->id);
+                held = held_take(device);
+                device->state = MSG_UNTRACKED;
+                break;
+            }
+        }
+        mds_mutex_unlock(&dedup->lock);
+
+        if (held == NULL) {
+            return count;
+        }
+        count += release_chunks(id, held, forward, user_data);
+    }
+}
+
+/* ============================================================================
+ * Persistence
+ * ========================================================================== */
+
+static void put_le(uint8_t *p, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) {
+        p[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint64_t get_le(const uint8_t *p, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; i++) {
+        value |= (uint64_t)p[i] << (8 * i);
+    }
+    return value;
+}
+
+int chunks_dedup_save(chunks_dedup_t *dedup, const char *path) {
+    if (dedup == NULL || path == NULL) {
+        return -EINVAL;
+    }
+
+    size_t path_len = strlen(path);
+    char *tmp_path = malloc(path_len + 5);
+    if (tmp_path == NULL) {
+        return -ENOMEM;
+    }
+    snprintf(tmp_path, path_len + 5, "%s.tmp", path);
+
+    FILE *f = fopen(tmp_path, "wb");
+    if (f == NULL) {
+        int ret = -errno;
+        free(tmp_path);
+        return ret;
+    }
+
+    uint8_t header[5];
+    memcpy(header, FILE_MAGIC, 4);
+    header[4] = FILE_VERSION;
+    bool ok = fwrite(header, sizeof(header), 1, f) == 1;
+
+    int64_t now = now_sec();
+    mds_mutex_lock(&dedup->lock);
+    for (dedup_device_t *device = dedup->devices; ok && device != NULL; device = device->next) {
+        entries_expire(dedup, device, now);
+        if (device->entry_count == 0) {
+            continue;
+        }
+
+        uint8_t record[1 + MDS_MAX_DEVICE_ID_LEN + 2];
+        size_t id_len = strlen(device->id);
+        record[0] = (uint8_t)id_len;
+        memcpy(&record[1], device->id, id_len);
+        put_le(&record[1 + id_len], device->entry_count, 2);
+        ok = fwrite(record, 1 + id_len + 2, 1, f) == 1;
+
+        for (size_t i = 0; ok && i < device->entry_count; i++) {
+            const dedup_entry_t *entry = &device->entries[i];
+            uint8_t data[ENTRY_RECORD_LEN];
+            put_le(&data[0], entry->length, 4);
+            put_le(&data[4], entry->prefix_hash, 8);
+            put_le(&data[12], entry->hash, 8);
+            put_le(&data[20], (uint64_t)entry->seen, 8);
+            ok = fwrite(data, sizeof(data), 1, f) == 1;
+        }
+    }
+    mds_mutex_unlock(&dedup->lock);
+
+    int ret = 0;
+    if (!ok) {
+        ret = -EIO;
+    }
+    if (fclose(f) != 0 && ret == 0) {
+        ret = -errno;
+    }
+#ifdef _WIN32
+    if (ret == 0) {
+        remove(path);  /* rename() does not replace existing files on Windows */
+    }
+#endif
+    if (ret == 0 && rename(tmp_path, path) != 0) {
+        ret = -errno;
+    }
+    if (ret != 0) {
+        remove(tmp_path);
+    }
+    free(tmp_path);
+    return ret;
+}
+
+int chunks_dedup_load(chunks_dedup_t *dedup, const char *path) {
+    if (dedup == NULL || path == NULL) {
+        return -EINVAL;
+    }
+
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return -errno;
+    }
+
+    uint8_t header[5];
+    if (fread(header, sizeof(header), 1, f) != 1 ||
+        memcmp(header, FILE_MAGIC, 4) != 0 || header[4] != FILE_VERSION) {
+        fclose(f);
+        return -EINVAL;
+    }
+
+    int loaded = 0;
+    int ret = 0;
+    int64_t now = now_sec();
+
+    mds_mutex_lock(&dedup->lock);
+    for (;;) {
+        uint8_t id_len;
+        if (fread(&id_len, 1, 1, f) != 1) {
+            break;  /* End of file */
+        }
+
+        char id[MDS_MAX_DEVICE_ID_LEN];
+        uint8_t count_bytes[2];
+        if (id_len == 0 || id_len >= sizeof(id) ||
+            fread(id, id_len, 1, f) != 1 || fread(count_bytes, 2, 1, f) != 1) {
+            ret = -EINVAL;
+            break;
+        }
+        id[id_len] = '\0';
+
+        /* NULL if every tracked device holds chunks: skip its entries */
+        dedup_device_t *device = device_get(dedup, id);
+        if (device == NULL && dedup->device_count < dedup->config.max_devices) {
+            ret = -ENOMEM;
+            break;
+        }
+        if (device != NULL) {
+            device->entry_count = 0;
+            if (device->active < now) {
+                device->active = now;
+            }
+        }
+
+        size_t count = (size_t)get_le(count_bytes, 2);
+        for (size_t i = 0; i < count; i++) {
+            uint8_t data[ENTRY_RECORD_LEN];
+            if (fread(data, sizeof(data), 1, f) != 1) {
+                ret = -EINVAL;
+                break;
+            }
+
+            dedup_entry_t entry;
+            entry.length = (uint32_t)get_le(&data[0], 4);
+            entry.prefix_hash = get_le(&data[4], 8);
+            entry.hash = get_le(&data[12], 8);
+            entry.seen = (int64_t)get_le(&data[20], 8);
+
+            /* Saved most recently seen first: keep the head of the list */
+            if (device != NULL && device->entry_count < dedup->config.max_messages &&
+                !entry_expired(dedup, &entry, now)) {
+                device->entries[device->entry_count++] = entry;
+                loaded++;
+            }
+        }
+        if (ret != 0) {
+            break;
+        }
+    }
+    mds_mutex_unlock(&dedup->lock);
+
+    fclose(f);
+    return ret != 0 ? ret : loaded;
+}
+
+int chunks_dedup_get_held_bytes(chunks_dedup_t *dedup, const char *device_id,
+                                size_t *held_bytes) {
+    if (dedup == NULL || device_id == NULL || held_bytes == NULL) {
+        return -EINVAL;
+    }
+
+    mds_mutex_lock(&dedup->lock);
+    dedup_device_t *device = device_find(dedup, device_id);
+    *held_bytes = (device != NULL) ? device->held_bytes : 0;
+    mds_mutex_unlock(&dedup->lock);
+    return 0;
+}
+
+int chunks_dedup_get_stats(chunks_dedup_t *dedup, chunks_dedup_stats_t *stats) {
+    if (dedup == NULL || stats == NULL) {
+        return -EINVAL;
+    }
+
+    mds_mutex_lock(&dedup->lock);
+    *stats = dedup->stats;
+    stats->devices = dedup->device_count;
+    stats->entries = 0;
+    stats->held_bytes = 0;
+    for (dedup_device_t *device = dedup->devices; device != NULL; device = device->next) {
+        stats->entries += device->entry_count;
+        stats->held_bytes += device->held_bytes;
+    }
+    mds_mutex_unlock(&dedup->lock);
+    return 0;
+}
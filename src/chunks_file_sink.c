@@ -0,0 +1,1021 @@
+/**
+ * @file chunks_file_sink.c
+ * @brief Rotating per-device segment files for offline chunk storage
+ *
+ * Each device has a sink_device_t with its own lock, the open segment file
+ * and a write buffer. The sink lock only guards the device list and the
+ * statistics; devices are never removed before the sink is destroyed, so
+ * the list can be walked without holding it once the head has been read.
+ *
+ * Segment file format (before compression):
+ * Byte 0-3:  Magic "MDSF"
+ * Byte 4:    Format version (1)
+ * Byte 5-6:  URI and authorization lengths
+ * Byte 7:    Reserved (0)
+ * Byte 8-:   URI, authorization, then records:
+ *            chunk length (2 bytes, little-endian), chunk class (1 byte),
+ *            reserved (1 byte), chunk data
+ *
+ * Compressed segments are a sequence of gzip members, one per write.
+ *
+ * With an I/O engine, a full buffer is swapped with a spare and handed to
+ * the engine; the device lock is only held until the write is queued. At most
+ * one write (plus its fsync) per device is in flight, so the next write or a
+ * segment close waits for it, and its error is reported by that call.
+ */
+
+#include "mds_bridge/chunks_file_sink.h"
+#include "mds_log_internal.h"
+#include "mds_thread.h"
+#include "mds_time.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef MDS_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#define DEFAULT_BUFFER_BYTES        (64 * 1024)
+#define DEFAULT_MAX_SEGMENT_BYTES   (4ull * 1024 * 1024)
+#define DEFAULT_MAX_SEGMENT_AGE_SEC 3600
+#define DEFAULT_FLUSH_INTERVAL_MS   1000
+#define MIN_BUFFER_BYTES            4096
+
+#define SINK_PATH_LEN               512
+#define SEGMENT_NAME_LEN            32
+
+#define SEGMENT_MAGIC               "MDSF"
+#define SEGMENT_VERSION             1
+#define SEGMENT_HEADER_LEN          8
+#define RECORD_HEADER_LEN           4
+#define INDEX_NAME                  "index"
+
+struct chunks_file_sink;
+
+/* Per-device state */
+typedef struct sink_device {
+    struct sink_device *next;
+    struct chunks_file_sink *sink;
+    mds_mutex_t lock;
+    char id[MDS_MAX_DEVICE_ID_LEN];
+    char dir[SINK_PATH_LEN];
+    bool scanned;                       /* Leftover segments indexed */
+    uint64_t next_seq;
+
+    /* Open segment (fd < 0: none) */
+    int fd;
+    char segment[SEGMENT_NAME_LEN];
+    char uri[MDS_MAX_URI_LEN];
+    char auth[MDS_MAX_AUTH_LEN];
+    uint64_t segment_chunks;
+    uint64_t segment_bytes;
+    int64_t segment_opened_ms;
+
+    /* Data not yet written to the segment */
+    uint8_t *buffer;
+    size_t buffered;
+    int64_t pending_since_ms;           /* Oldest buffered chunk (0: none) */
+
+    /* Requests queued on the I/O engine */
+    mds_cond_t io_idle;
+    unsigned int io_pending;
+    int io_error;                       /* First failure not yet reported */
+    uint8_t *spare;                     /* Buffer swapped in while one is written */
+
+#ifdef MDS_HAVE_ZLIB
+    z_stream zstream;
+    bool zstream_ready;
+    uint8_t *zbuffer;
+    size_t zbuffer_len;
+    uint8_t *zspare;
+    size_t zspare_len;
+#endif
+} sink_device_t;
+
+struct chunks_file_sink {
+    mds_mutex_t lock;
+    char dir[SINK_PATH_LEN];
+    chunks_file_sink_config_t config;
+    sink_device_t *devices;
+    chunks_file_sink_stats_t stats;
+};
+
+/* ============================================================================
+ * File Helpers
+ * ========================================================================== */
+
+static int write_all(int fd, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int make_dir(const char *path) {
+    if (mkdir(path, 0750) != 0 && errno != EEXIST) {
+        return -errno;
+    }
+    return 0;
+}
+
+/* "<seq>.seg" or "<seq>.seg.gz" */
+static bool segment_name_parse(const char *name, uint64_t *seq) {
+    char *end;
+    if (name[0] < '0' || name[0] > '9' || strlen(name) >= SEGMENT_NAME_LEN) {
+        return false;
+    }
+    unsigned long long value = strtoull(name, &end, 10);
+    if (strcmp(end, ".seg") != 0 && strcmp(end, ".seg.gz") != 0) {
+        return false;
+    }
+    *seq = value;
+    return true;
+}
+
+/* ============================================================================
+ * Segment Reading
+ * ========================================================================== */
+
+typedef struct {
+#ifdef MDS_HAVE_ZLIB
+    gzFile gz;                          /* Also reads uncompressed files */
+#else
+    FILE *f;
+#endif
+} segment_reader_t;
+
+static int reader_open(segment_reader_t *reader, const char *path) {
+#ifdef MDS_HAVE_ZLIB
+    reader->gz = gzopen(path, "rb");
+    if (reader->gz == NULL) {
+        return errno ? -errno : -ENOMEM;
+    }
+    gzbuffer(reader->gz, 64 * 1024);
+#else
+    reader->f = fopen(path, "rb");
+    if (reader->f == NULL) {
+        return -errno;
+    }
+    int c = fgetc(reader->f);
+    if (c == 0x1F) {
+        fclose(reader->f);
+        return -ENOTSUP;  /* gzip magic: compressed segment */
+    }
+    rewind(reader->f);
+#endif
+    return 0;
+}
+
+/* Returns the number of bytes read; fewer than len at the end or on errors */
+static size_t reader_read(segment_reader_t *reader, void *buf, size_t len) {
+#ifdef MDS_HAVE_ZLIB
+    int n = gzread(reader->gz, buf, (unsigned int)len);
+    return n > 0 ? (size_t)n : 0;
+#else
+    return fread(buf, 1, len, reader->f);
+#endif
+}
+
+static void reader_close(segment_reader_t *reader) {
+#ifdef MDS_HAVE_ZLIB
+    gzclose(reader->gz);
+#else
+    fclose(reader->f);
+#endif
+}
+
+int chunks_file_segment_read(const char *path,
+                             chunks_file_record_callback_t callback,
+                             void *user_data) {
+    if (path == NULL || callback == NULL) {
+        return -EINVAL;
+    }
+
+    segment_reader_t reader;
+    int ret = reader_open(&reader, path);
+    if (ret < 0) {
+        return ret;
+    }
+
+    chunks_file_segment_info_t info;
+    uint8_t header[SEGMENT_HEADER_LEN];
+    size_t uri_len = 0, auth_len = 0;
+    bool valid = reader_read(&reader, header, sizeof(header)) == sizeof(header) &&
+                 memcmp(header, SEGMENT_MAGIC, 4) == 0 && header[4] == SEGMENT_VERSION;
+    if (valid) {
+        uri_len = header[5];
+        auth_len = header[6];
+        valid = uri_len < sizeof(info.uri) && auth_len < sizeof(info.auth) &&
+                reader_read(&reader, info.uri, uri_len) == uri_len &&
+                reader_read(&reader, info.auth, auth_len) == auth_len;
+    }
+    if (!valid) {
+        reader_close(&reader);
+        return -EINVAL;
+    }
+    info.uri[uri_len] = '\0';
+    info.auth[auth_len] = '\0';
+
+    int count = 0;
+    uint8_t chunk[MDS_MAX_STREAM_DATA_LEN];
+    for (;;) {
+        uint8_t record[RECORD_HEADER_LEN];
+        if (reader_read(&reader, record, sizeof(record)) != sizeof(record)) {
+            break;  /* End of segment (or truncated record) */
+        }
+
+        size_t len = (size_t)record[0] | ((size_t)record[1] << 8);
+        if (len > sizeof(chunk) || reader_read(&reader, chunk, len) != len) {
+            break;
+        }
+
+        mds_chunk_class_t chunk_class = record[2] < MDS_CHUNK_CLASS_COUNT ?
+                                        (mds_chunk_class_t)record[2] : MDS_CHUNK_CLASS_UNKNOWN;
+        ret = callback(&info, chunk, len, chunk_class, user_data);
+        if (ret < 0) {
+            reader_close(&reader);
+            return ret;
+        }
+        count++;
+    }
+
+    reader_close(&reader);
+    return count;
+}
+
+/* ============================================================================
+ * Segment Writing
+ * ========================================================================== */
+
+#ifdef MDS_HAVE_ZLIB
+/* Compress the buffer into one gzip member */
+static int device_compress(sink_device_t *device, const uint8_t **out, size_t *out_len) {
+    if (!device->zstream_ready) {
+        memset(&device->zstream, 0, sizeof(device->zstream));
+        if (deflateInit2(&device->zstream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                         15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return -ENOMEM;
+        }
+        device->zstream_ready = true;
+    } else {
+        deflateReset(&device->zstream);
+    }
+
+    size_t bound = deflateBound(&device->zstream, (uLong)device->buffered);
+    if (device->zbuffer_len < bound) {
+        uint8_t *zbuffer = realloc(device->zbuffer, bound);
+        if (zbuffer == NULL) {
+            return -ENOMEM;
+        }
+        device->zbuffer = zbuffer;
+        device->zbuffer_len = bound;
+    }
+
+    device->zstream.next_in = device->buffer;
+    device->zstream.avail_in = (uInt)device->buffered;
+    device->zstream.next_out = device->zbuffer;
+    device->zstream.avail_out = (uInt)bound;
+    if (deflate(&device->zstream, Z_FINISH) != Z_STREAM_END) {
+        return -EIO;
+    }
+
+    *out = device->zbuffer;
+    *out_len = bound - device->zstream.avail_out;
+    return 0;
+}
+#endif
+
+/* I/O engine completion of a segment write or fsync */
+static void device_io_done(int result, void *user_data) {
+    sink_device_t *device = (sink_device_t *)user_data;
+    chunks_file_sink_t *sink = device->sink;
+
+    mds_mutex_lock(&sink->lock);
+    if (result > 0) {
+        sink->stats.writes++;
+        sink->stats.file_bytes += (uint64_t)result;
+    } else if (result < 0) {
+        sink->stats.write_errors++;
+    }
+    mds_mutex_unlock(&sink->lock);
+
+    mds_mutex_lock(&device->lock);
+    if (result < 0 && device->io_error == 0) {
+        device->io_error = result;
+    }
+    if (--device->io_pending == 0) {
+        mds_cond_broadcast(&device->io_idle);
+    }
+    mds_mutex_unlock(&device->lock);
+}
+
+/* Wait for the device's queued requests; returns their first error */
+static int device_io_wait(sink_device_t *device) {
+    while (device->io_pending > 0) {
+        mds_cond_wait(&device->io_idle, &device->lock);
+    }
+    int ret = device->io_error;
+    device->io_error = 0;
+    return ret;
+}
+
+/* Hand out (the buffer or the compressed buffer) to the I/O engine */
+static int device_write_async(chunks_file_sink_t *sink, sink_device_t *device,
+                              const uint8_t *out, size_t out_len) {
+    mds_io_t *io = sink->config.io;
+
+    if (device->spare == NULL) {
+        device->spare = malloc(sink->config.buffer_bytes);
+        if (device->spare == NULL) {
+            return -ENOMEM;
+        }
+    }
+
+    /* The engine owns out until the write completes; keep filling the spare */
+    if (out == device->buffer) {
+        device->buffer = device->spare;
+        device->spare = (uint8_t *)out;
+    }
+#ifdef MDS_HAVE_ZLIB
+    else {
+        uint8_t *zbuffer = device->zbuffer;
+        size_t zbuffer_len = device->zbuffer_len;
+        device->zbuffer = device->zspare;
+        device->zbuffer_len = device->zspare_len;
+        device->zspare = zbuffer;
+        device->zspare_len = zbuffer_len;
+    }
+#endif
+
+    int ret = mds_io_write(io, device->fd, out, out_len, -1, device_io_done, device);
+    if (ret == 0) {
+        device->io_pending++;
+        if (sink->config.sync) {
+            ret = mds_io_fsync(io, device->fd, true, device_io_done, device);
+            device->io_pending += ret == 0 ? 1 : 0;
+        }
+        mds_io_submit(io);
+    }
+    return ret;
+}
+
+/* Write the buffer to the open segment */
+static int device_write_buffer(chunks_file_sink_t *sink, sink_device_t *device) {
+    int ret = 0;
+
+    if (sink->config.io) {
+        /* One write in flight per device; report its error here */
+        ret = device_io_wait(device);
+        if (ret < 0) {
+            device->buffered = 0;
+            device->pending_since_ms = 0;
+            return ret;
+        }
+    }
+    if (device->buffered == 0) {
+        return 0;
+    }
+
+    const uint8_t *out = device->buffer;
+    size_t out_len = device->buffered;
+
+#ifdef MDS_HAVE_ZLIB
+    if (sink->config.compress) {
+        ret = device_compress(device, &out, &out_len);
+    }
+#endif
+    if (ret == 0 && sink->config.io) {
+        ret = device_write_async(sink, device, out, out_len);
+        device->buffered = 0;
+        device->pending_since_ms = 0;
+        return ret;
+    }
+    if (ret == 0) {
+        ret = write_all(device->fd, out, out_len);
+    }
+    if (ret == 0 && sink->config.sync && fsync(device->fd) != 0) {
+        ret = -errno;
+    }
+
+    device->buffered = 0;
+    device->pending_since_ms = 0;
+
+    mds_mutex_lock(&sink->lock);
+    if (ret == 0) {
+        sink->stats.writes++;
+        sink->stats.file_bytes += out_len;
+    } else {
+        sink->stats.write_errors++;
+    }
+    mds_mutex_unlock(&sink->lock);
+
+    if (ret < 0) {
+        mds_log(MDS_LOG_ERROR, MDS_LOG_UPLOAD, "Cannot write %s/%s: %s",
+                device->dir, device->segment, strerror(-ret));
+    }
+    return ret;
+}
+
+static int index_append(chunks_file_sink_t *sink, sink_device_t *device, const char *line) {
+    char path[SINK_PATH_LEN + 16];
+    snprintf(path, sizeof(path), "%s/" INDEX_NAME, device->dir);
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0640);
+    if (fd < 0) {
+        return -errno;
+    }
+    int ret = write_all(fd, (const uint8_t *)line, strlen(line));
+    if (ret == 0 && sink->config.sync && fsync(fd) != 0) {
+        ret = -errno;
+    }
+    close(fd);
+    return ret;
+}
+
+/* Write what is buffered, close the segment and add it to the index */
+static int segment_close(chunks_file_sink_t *sink, sink_device_t *device) {
+    if (device->fd < 0) {
+        return 0;
+    }
+
+    int ret = device_write_buffer(sink, device);
+    if (sink->config.io) {
+        int io_ret = device_io_wait(device);
+        ret = ret < 0 ? ret : io_ret;
+    }
+    close(device->fd);
+    device->fd = -1;
+
+    if (device->segment_chunks == 0) {
+        /* Header only */
+        char path[SINK_PATH_LEN + SEGMENT_NAME_LEN];
+        snprintf(path, sizeof(path), "%s/%s", device->dir, device->segment);
+        unlink(path);
+    } else {
+        char line[SEGMENT_NAME_LEN + 48];
+        snprintf(line, sizeof(line), "%s %llu %llu\n", device->segment,
+                 (unsigned long long)device->segment_chunks,
+                 (unsigned long long)device->segment_bytes);
+        int index_ret = index_append(sink, device, line);
+        if (index_ret < 0) {
+            mds_log(MDS_LOG_ERROR, MDS_LOG_UPLOAD, "Cannot index %s/%s: %s",
+                    device->dir, device->segment, strerror(-index_ret));
+            ret = ret < 0 ? ret : index_ret;
+        }
+    }
+
+    mds_mutex_lock(&sink->lock);
+    sink->stats.open_segments--;
+    if (device->segment_chunks > 0) {
+        sink->stats.segments_closed++;
+    }
+    mds_mutex_unlock(&sink->lock);
+    return ret;
+}
+
+static int segment_open(chunks_file_sink_t *sink, sink_device_t *device,
+                        const char *uri, const char *auth_header) {
+    char path[SINK_PATH_LEN + SEGMENT_NAME_LEN];
+
+    for (;;) {
+        snprintf(device->segment, sizeof(device->segment), "%08llu.seg%s",
+                 (unsigned long long)device->next_seq++, sink->config.compress ? ".gz" : "");
+        snprintf(path, sizeof(path), "%s/%s", device->dir, device->segment);
+        device->fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_APPEND, 0640);
+        if (device->fd >= 0) {
+            break;
+        }
+        if (errno != EEXIST) {
+            return -errno;
+        }
+    }
+
+    size_t uri_len = strlen(uri);
+    size_t auth_len = strlen(auth_header);
+    uint8_t *header = device->buffer;
+    memcpy(header, SEGMENT_MAGIC, 4);
+    header[4] = SEGMENT_VERSION;
+    header[5] = (uint8_t)uri_len;
+    header[6] = (uint8_t)auth_len;
+    header[7] = 0;
+    memcpy(&header[SEGMENT_HEADER_LEN], uri, uri_len);
+    memcpy(&header[SEGMENT_HEADER_LEN + uri_len], auth_header, auth_len);
+    device->buffered = SEGMENT_HEADER_LEN + uri_len + auth_len;
+    device->pending_since_ms = 0;
+
+    snprintf(device->uri, sizeof(device->uri), "%s", uri);
+    snprintf(device->auth, sizeof(device->auth), "%s", auth_header);
+    device->segment_chunks = 0;
+    device->segment_bytes = 0;
+    device->segment_opened_ms = mds_time_monotonic_ms();
+
+    mds_mutex_lock(&sink->lock);
+    sink->stats.open_segments++;
+    mds_mutex_unlock(&sink->lock);
+    return 0;
+}
+
+static bool segment_expired(const chunks_file_sink_t *sink, const sink_device_t *device,
+                            int64_t now) {
+    return sink->config.max_segment_age_sec != 0 &&
+           now - device->segment_opened_ms >= (int64_t)sink->config.max_segment_age_sec * 1000;
+}
+
+/* ============================================================================
+ * Leftover Segments
+ * ========================================================================== */
+
+typedef struct {
+    uint64_t chunks;
+    uint64_t bytes;
+} segment_count_t;
+
+static int count_record(const chunks_file_segment_info_t *segment, const uint8_t *chunk,
+                        size_t len, mds_chunk_class_t chunk_class, void *user_data) {
+    segment_count_t *count = (segment_count_t *)user_data;
+    count->chunks++;
+    count->bytes += len;
+    (void)segment;
+    (void)chunk;
+    (void)chunk_class;
+    return 0;
+}
+
+/* Add a line to a growing string; false on allocation failure */
+static bool text_append(char **text, size_t *len, const char *line) {
+    size_t line_len = strlen(line);
+    char *grown = realloc(*text, *len + line_len + 1);
+    if (grown == NULL) {
+        return false;
+    }
+    memcpy(grown + *len, line, line_len + 1);
+    *text = grown;
+    *len += line_len;
+    return true;
+}
+
+static bool index_lists(const char *index, const char *name) {
+    size_t name_len = strlen(name);
+    for (const char *line = index; line != NULL && *line != '\0'; ) {
+        if (strncmp(line, name, name_len) == 0 && line[name_len] == ' ') {
+            return true;
+        }
+        line = strchr(line, '\n');
+        line = line ? line + 1 : NULL;
+    }
+    return false;
+}
+
+/*
+ * First use of a device directory in this sink: continue the segment
+ * numbering, index segments a crash left open, and drop index lines of
+ * segments that were uploaded and removed
+ */
+static int device_scan(sink_device_t *device) {
+    int ret = make_dir(device->dir);
+    if (ret < 0) {
+        return ret;
+    }
+
+    char path[SINK_PATH_LEN + SEGMENT_NAME_LEN];
+    char *old_index = NULL;
+    size_t old_len = 0;
+    snprintf(path, sizeof(path), "%s/" INDEX_NAME, device->dir);
+    FILE *f = fopen(path, "r");
+    if (f != NULL) {
+        char line[256];
+        while (fgets(line, sizeof(line), f) != NULL) {
+            if (!text_append(&old_index, &old_len, line)) {
+                fclose(f);
+                free(old_index);
+                return -ENOMEM;
+            }
+        }
+        fclose(f);
+    }
+
+    DIR *dir = opendir(device->dir);
+    if (dir == NULL) {
+        free(old_index);
+        return -errno;
+    }
+
+    char *new_index = NULL;
+    size_t new_len = 0;
+    bool changed = false;
+    uint64_t max_seq = 0;
+    struct dirent *entry;
+    ret = 0;
+
+    while ((entry = readdir(dir)) != NULL && ret == 0) {
+        uint64_t seq;
+        if (!segment_name_parse(entry->d_name, &seq)) {
+            continue;
+        }
+        if (seq > max_seq) {
+            max_seq = seq;
+        }
+        if (old_index != NULL && index_lists(old_index, entry->d_name)) {
+            continue;
+        }
+
+        /* Left open by a crash */
+        segment_count_t count = { 0, 0 };
+        snprintf(path, sizeof(path), "%s/%.31s", device->dir, entry->d_name);
+        int read_ret = chunks_file_segment_read(path, count_record, &count);
+        struct stat st;
+        if (read_ret == 0 || (stat(path, &st) == 0 && st.st_size == 0)) {
+            unlink(path);  /* Never got past the header */
+            continue;
+        }
+        if (read_ret < 0) {
+            mds_log(MDS_LOG_WARN, MDS_LOG_UPLOAD, "Cannot read %s: %s", path, strerror(-read_ret));
+            continue;
+        }
+
+        char line[SEGMENT_NAME_LEN + 48];
+        snprintf(line, sizeof(line), "%.*s %llu %llu\n", SEGMENT_NAME_LEN - 1, entry->d_name,
+                 (unsigned long long)count.chunks, (unsigned long long)count.bytes);
+        if (!text_append(&new_index, &new_len, line)) {
+            ret = -ENOMEM;
+        }
+        changed = true;
+        mds_log(MDS_LOG_WARN, MDS_LOG_UPLOAD, "Recovered %s/%s (%llu chunks)",
+                device->dir, entry->d_name, (unsigned long long)count.chunks);
+    }
+    closedir(dir);
+
+    /* Keep the lines of segments still present */
+    for (char *line = old_index; ret == 0 && line != NULL && *line != '\0'; ) {
+        char *next = strchr(line, '\n');
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+
+        char name[SEGMENT_NAME_LEN];
+        struct stat st;
+        if (sscanf(line, "%31s", name) == 1 &&
+            snprintf(path, sizeof(path), "%s/%s", device->dir, name) > 0 &&
+            stat(path, &st) == 0) {
+            if (!text_append(&new_index, &new_len, line) ||
+                !text_append(&new_index, &new_len, "\n")) {
+                ret = -ENOMEM;
+            }
+        } else {
+            changed = true;
+        }
+        line = next;
+    }
+    free(old_index);
+
+    if (ret == 0 && changed) {
+        char tmp_path[SINK_PATH_LEN + 16];
+        snprintf(tmp_path, sizeof(tmp_path), "%s/" INDEX_NAME ".tmp", device->dir);
+        snprintf(path, sizeof(path), "%s/" INDEX_NAME, device->dir);
+
+        int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0640);
+        ret = fd < 0 ? -errno : write_all(fd, (const uint8_t *)(new_index ? new_index : ""), new_len);
+        if (fd >= 0) {
+            if (ret == 0 && fsync(fd) != 0) {
+                ret = -errno;
+            }
+            close(fd);
+        }
+        if (ret == 0 && rename(tmp_path, path) != 0) {
+            ret = -errno;
+        }
+        if (ret != 0) {
+            unlink(tmp_path);
+        }
+    }
+    free(new_index);
+
+    device->next_seq = max_seq + 1;
+    return ret;
+}
+
+/* ============================================================================
+ * Devices
+ * ========================================================================== */
+
+static sink_device_t *device_get(chunks_file_sink_t *sink, const char *device_id) {
+    mds_mutex_lock(&sink->lock);
+    sink_device_t *device = sink->devices;
+    while (device != NULL && strcmp(device->id, device_id) != 0) {
+        device = device->next;
+    }
+
+    if (device == NULL) {
+        device = calloc(1, sizeof(*device));
+        uint8_t *buffer = malloc(sink->config.buffer_bytes);
+        if (device == NULL || buffer == NULL) {
+            free(device);
+            free(buffer);
+            mds_mutex_unlock(&sink->lock);
+            return NULL;
+        }
+
+        mds_mutex_init(&device->lock);
+        mds_cond_init(&device->io_idle);
+        device->sink = sink;
+        device->buffer = buffer;
+        device->fd = -1;
+        snprintf(device->id, sizeof(device->id), "%s", device_id);
+
+        /* Directory name: the device ID with unsafe characters replaced */
+        int n = snprintf(device->dir, sizeof(device->dir), "%s/", sink->dir);
+        size_t pos = (size_t)n;
+        for (const char *c = device_id; *c != '\0' && pos + 1 < sizeof(device->dir); c++) {
+            bool safe = (*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') ||
+                        (*c >= '0' && *c <= '9') || *c == '-' || *c == '_' || *c == '.';
+            bool leading_dot = pos == (size_t)n && *c == '.';
+            device->dir[pos++] = (safe && !leading_dot) ? *c : '_';
+        }
+        device->dir[pos] = '\0';
+
+        device->next = sink->devices;
+        sink->devices = device;
+    }
+    mds_mutex_unlock(&sink->lock);
+    return device;
+}
+
+static void device_free(sink_device_t *device) {
+#ifdef MDS_HAVE_ZLIB
+    if (device->zstream_ready) {
+        deflateEnd(&device->zstream);
+    }
+    free(device->zbuffer);
+    free(device->zspare);
+#endif
+    mds_cond_destroy(&device->io_idle);
+    mds_mutex_destroy(&device->lock);
+    free(device->buffer);
+    free(device->spare);
+    free(device);
+}
+
+static sink_device_t *devices_head(chunks_file_sink_t *sink) {
+    mds_mutex_lock(&sink->lock);
+    sink_device_t *head = sink->devices;
+    mds_mutex_unlock(&sink->lock);
+    return head;
+}
+
+/* ============================================================================
+ * Public API
+ * ========================================================================== */
+
+void chunks_file_sink_default_config(chunks_file_sink_config_t *config) {
+    if (config == NULL) {
+        return;
+    }
+
+    memset(config, 0, sizeof(*config));
+    config->buffer_bytes = DEFAULT_BUFFER_BYTES;
+    config->max_segment_bytes = DEFAULT_MAX_SEGMENT_BYTES;
+    config->max_segment_age_sec = DEFAULT_MAX_SEGMENT_AGE_SEC;
+    config->flush_interval_ms = DEFAULT_FLUSH_INTERVAL_MS;
+    config->compress = false;
+    config->sync = false;
+}
+
+bool chunks_file_sink_compression_supported(void) {
+#ifdef MDS_HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+chunks_file_sink_t *chunks_file_sink_create(const char *directory,
+                                            const chunks_file_sink_config_t *config) {
+    chunks_file_sink_config_t defaults;
+    if (config == NULL) {
+        chunks_file_sink_default_config(&defaults);
+        config = &defaults;
+    }
+    if (directory == NULL || strlen(directory) + MDS_MAX_DEVICE_ID_LEN + 2 > SINK_PATH_LEN ||
+        config->buffer_bytes < MIN_BUFFER_BYTES || config->max_segment_bytes == 0 ||
+        (config->compress && !chunks_file_sink_compression_supported())) {
+        return NULL;
+    }
+    if (make_dir(directory) != 0) {
+        return NULL;
+    }
+
+    chunks_file_sink_t *sink = calloc(1, sizeof(*sink));
+    if (sink == NULL) {
+        return NULL;
+    }
+
+    mds_mutex_init(&sink->lock);
+    snprintf(sink->dir, sizeof(sink->dir), "%s", directory);
+    sink->config = *config;
+    return sink;
+}
+
+void chunks_file_sink_destroy(chunks_file_sink_t *sink) {
+    if (sink == NULL) {
+        return;
+    }
+
+    chunks_file_sink_rotate(sink);
+
+    sink_device_t *device = sink->devices;
+    while (device != NULL) {
+        sink_device_t *next = device->next;
+        device_free(device);
+        device = next;
+    }
+
+    mds_mutex_destroy(&sink->lock);
+    free(sink);
+}
+
+int chunks_file_sink_write(chunks_file_sink_t *sink,
+                           const char *device_id,
+                           const char *uri,
+                           const char *auth_header,
+                           const uint8_t *chunk,
+                           size_t len,
+                           mds_chunk_class_t chunk_class) {
+    if (sink == NULL || device_id == NULL || device_id[0] == '\0' || uri == NULL ||
+        auth_header == NULL || chunk == NULL || len == 0 || len > MDS_MAX_STREAM_DATA_LEN ||
+        strlen(device_id) >= MDS_MAX_DEVICE_ID_LEN || strlen(uri) >= MDS_MAX_URI_LEN ||
+        strlen(auth_header) >= MDS_MAX_AUTH_LEN) {
+        return -EINVAL;
+    }
+
+    sink_device_t *device = device_get(sink, device_id);
+    if (device == NULL) {
+        return -ENOMEM;
+    }
+
+    int ret = 0;
+    int64_t now = mds_time_monotonic_ms();
+
+    mds_mutex_lock(&device->lock);
+    if (!device->scanned) {
+        ret = device_scan(device);
+        if (ret < 0) {
+            mds_mutex_unlock(&device->lock);
+            return ret;
+        }
+        device->scanned = true;
+    }
+
+    /* Rotate on size, age or a new destination */
+    if (device->fd >= 0 &&
+        ((device->segment_chunks > 0 &&
+          device->segment_bytes + len > sink->config.max_segment_bytes) ||
+         segment_expired(sink, device, now) ||
+         strcmp(device->uri, uri) != 0 || strcmp(device->auth, auth_header) != 0)) {
+        segment_close(sink, device);
+    }
+
+    if (device->fd < 0) {
+        ret = segment_open(sink, device, uri, auth_header);
+    }
+    if (ret == 0 && device->buffered + RECORD_HEADER_LEN + len > sink->config.buffer_bytes) {
+        ret = device_write_buffer(sink, device);
+    }
+    if (ret < 0) {
+        /* Do not append to a segment with a failed write */
+        segment_close(sink, device);
+        mds_mutex_unlock(&device->lock);
+        return ret;
+    }
+
+    uint8_t *record = &device->buffer[device->buffered];
+    record[0] = (uint8_t)(len & 0xFF);
+    record[1] = (uint8_t)(len >> 8);
+    record[2] = (uint8_t)chunk_class;
+    record[3] = 0;
+    memcpy(&record[RECORD_HEADER_LEN], chunk, len);
+    device->buffered += RECORD_HEADER_LEN + len;
+    device->segment_chunks++;
+    device->segment_bytes += len;
+    if (device->pending_since_ms == 0) {
+        device->pending_since_ms = now;
+    }
+
+    if (sink->config.flush_interval_ms != 0 &&
+        now - device->pending_since_ms >= (int64_t)sink->config.flush_interval_ms) {
+        ret = device_write_buffer(sink, device);
+        if (ret < 0) {
+            segment_close(sink, device);
+        }
+    }
+    mds_mutex_unlock(&device->lock);
+
+    mds_mutex_lock(&sink->lock);
+    sink->stats.chunks_written++;
+    sink->stats.bytes_written += len;
+    mds_mutex_unlock(&sink->lock);
+    return ret;
+}
+
+int chunks_file_sink_callback(const char *uri,
+                              const char *auth_header,
+                              const uint8_t *chunk_data,
+                              size_t chunk_len,
+                              const mds_chunk_info_t *info,
+                              void *user_data) {
+    if (uri == NULL || user_data == NULL) {
+        return -EINVAL;
+    }
+
+    /* The Memfault chunks URI ends with the device serial */
+    const char *device_id = strrchr(uri, '/');
+    device_id = (device_id != NULL && device_id[1] != '\0') ? device_id + 1 : "unknown";
+
+    return chunks_file_sink_write((chunks_file_sink_t *)user_data, device_id, uri, auth_header,
+                                  chunk_data, chunk_len,
+                                  info ? info->chunk_class : MDS_CHUNK_CLASS_UNKNOWN);
+}
+
+int chunks_file_sink_batch_callback(const mds_sink_chunk_t *chunks, size_t count,
+                                    void *user_data) {
+    if (chunks == NULL || user_data == NULL) {
+        return -EINVAL;
+    }
+
+    int result = 0;
+    for (size_t i = 0; i < count; i++) {
+        int ret = chunks_file_sink_callback(chunks[i].uri, chunks[i].auth_header,
+                                            chunks[i].data, chunks[i].len,
+                                            &chunks[i].info, user_data);
+        if (ret < 0 && result == 0) {
+            result = ret;
+        }
+    }
+    return result;
+}
+
+int chunks_file_sink_flush(chunks_file_sink_t *sink) {
+    if (sink == NULL) {
+        return -EINVAL;
+    }
+
+    int result = 0;
+    int64_t now = mds_time_monotonic_ms();
+    for (sink_device_t *device = devices_head(sink); device != NULL; device = device->next) {
+        mds_mutex_lock(&device->lock);
+        if (device->fd >= 0) {
+            int ret = device_write_buffer(sink, device);
+            if (ret < 0 || segment_expired(sink, device, now)) {
+                int close_ret = segment_close(sink, device);
+                ret = ret < 0 ? ret : close_ret;
+            }
+            if (ret < 0 && result == 0) {
+                result = ret;
+            }
+        }
+        mds_mutex_unlock(&device->lock);
+    }
+    return result;
+}
+
+int chunks_file_sink_rotate(chunks_file_sink_t *sink) {
+    if (sink == NULL) {
+        return -EINVAL;
+    }
+
+    int result = 0;
+    for (sink_device_t *device = devices_head(sink); device != NULL; device = device->next) {
+        mds_mutex_lock(&device->lock);
+        int ret = segment_close(sink, device);
+        if (ret < 0 && result == 0) {
+            result = ret;
+        }
+        mds_mutex_unlock(&device->lock);
+    }
+    return result;
+}
+
+int chunks_file_sink_get_stats(chunks_file_sink_t *sink, chunks_file_sink_stats_t *stats) {
+    if (sink == NULL || stats == NULL) {
+        return -EINVAL;
+    }
+
+    mds_mutex_lock(&sink->lock);
+    *stats = sink->stats;
+    mds_mutex_unlock(&sink->lock);
+    return 0;
+}
@@ -0,0 +1,537 @@
+/**
+ * @file chunks_scheduler.c
+ * @brief Deficit round robin chunk scheduler with token bucket rate limits
+ *
+ * Data structures:
+ * - Every device seen has a sched_device_t on the devices list holding its
+ *   FIFO of queued chunks, its round robin deficit and its token bucket.
+ * - Devices with queued chunks and nothing in flight are on the active list.
+ *   The head of the active list is the device whose turn it is. A device
+ *   leaves the list while one of its chunks is in flight and, on completion,
+ *   returns to the front if its remaining deficit covers the next chunk (its
+ *   turn continues) or to the back otherwise.
+ * - Token buckets count millibytes so rates below 1000 bytes per second
+ *   refill without rounding to zero. Buckets may go into debt by one chunk;
+ *   a bucket in debt holds back further chunks until it has refilled.
+ *
+ * All state is guarded by a single mutex; no call blocks.
+ */
+
+#include "mds_bridge/chunks_scheduler.h"
+#include "mds_thread.h"
+#include "mds_time.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define DEFAULT_QUANTUM         1024
+#define DEFAULT_WEIGHT_HIGH     8
+#define DEFAULT_WEIGHT_NORMAL   4
+#define DEFAULT_WEIGHT_BULK     1
+
+/* Token bucket */
+typedef struct {
+    int64_t tokens;                     /* Millibytes (negative = debt) */
+    int64_t updated_ms;                 /* Last refill */
+} token_bucket_t;
+
+/* Queued chunk */
+typedef struct sched_chunk {
+    struct sched_chunk *next;
+    void *chunk;
+    size_t size;
+    chunks_priority_t priority;
+} sched_chunk_t;
+
+/* Per-device state */
+typedef struct sched_device {
+    struct sched_device *next;          /* Devices list */
+    struct sched_device *next_active;   /* Active list */
+    char *id;
+    sched_chunk_t *head;
+    sched_chunk_t *tail;
+    sched_chunk_t *in_flight;
+    uint64_t deficit;                   /* Round robin credit in bytes */
+    token_bucket_t bucket;
+} sched_device_t;
+
+struct chunks_scheduler {
+    mds_mutex_t lock;
+    chunks_scheduler_config_t config;
+    sched_device_t *devices;
+    sched_device_t *active_head;
+    sched_device_t *active_tail;
+    size_t active_count;
+    token_bucket_t global;
+    chunks_scheduler_stats_t stats;
+};
+
+/* ============================================================================
+ * Token Buckets
+ * ========================================================================== */
+
+static int64_t bucket_capacity(const chunks_rate_limit_t *limit) {
+    uint64_t burst = limit->burst_bytes ? limit->burst_bytes : limit->rate_bytes_per_sec;
+    return (int64_t)burst * 1000;
+}
+
+static void bucket_init(token_bucket_t *bucket, const chunks_rate_limit_t *limit, int64_t now) {
+    bucket->tokens = bucket_capacity(limit);
+    bucket->updated_ms = now;
+}
+
+static void bucket_refill(token_bucket_t *bucket, const chunks_rate_limit_t *limit, int64_t now) {
+    if (now > bucket->updated_ms) {
+        bucket->tokens += (int64_t)limit->rate_bytes_per_sec * (now - bucket->updated_ms);
+        bucket->updated_ms = now;
+    }
+
+    int64_t capacity = bucket_capacity(limit);
+    if (bucket->tokens > capacity) {
+        bucket->tokens = capacity;
+    }
+}
+
+/* Milliseconds until the bucket is out of debt (0 = may send now) */
+static int bucket_wait_ms(const token_bucket_t *bucket, const chunks_rate_limit_t *limit) {
+    if (limit->rate_bytes_per_sec == 0 || bucket->tokens >= 0) {
+        return 0;
+    }
+
+    int64_t rate = (int64_t)limit->rate_bytes_per_sec;
+    int64_t wait = (-bucket->tokens + rate - 1) / rate;
+    return wait > 60000 ? 60000 : (int)wait;
+}
+
+/* Charge (or, with a negative size, refund) bytes against a bucket */
+static void bucket_charge(token_bucket_t *bucket, const chunks_rate_limit_t *limit,
+                          int64_t bytes) {
+    if (limit->rate_bytes_per_sec == 0) {
+        return;
+    }
+
+    bucket->tokens -= bytes * 1000;
+
+    int64_t capacity = bucket_capacity(limit);
+    if (bucket->tokens > capacity) {
+        bucket->tokens = capacity;
+    }
+}
+
+static bool bucket_full(const token_bucket_t *bucket, const chunks_rate_limit_t *limit) {
+    return limit->rate_bytes_per_sec == 0 || bucket->tokens >= bucket_capacity(limit);
+}
+
+/* ============================================================================
+ * Device Lists
+ * ========================================================================== */
+
+static void active_push_back(chunks_scheduler_t *scheduler, sched_device_t *device) {
+    device->next_active = NULL;
+    if (scheduler->active_tail) {
+        scheduler->active_tail->next_active = device;
+    } else {
+        scheduler->active_head = device;
+    }
+    scheduler->active_tail = device;
+    scheduler->active_count++;
+}
+
+static void active_push_front(chunks_scheduler_t *scheduler, sched_device_t *device) {
+    device->next_active = scheduler->active_head;
+    scheduler->active_head = device;
+    if (scheduler->active_tail == NULL) {
+        scheduler->active_tail = device;
+    }
+    scheduler->active_count++;
+}
+
+static sched_device_t *active_pop(chunks_scheduler_t *scheduler) {
+    sched_device_t *device = scheduler->active_head;
+    if (device != NULL) {
+        scheduler->active_head = device->next_active;
+        if (scheduler->active_head == NULL) {
+            scheduler->active_tail = NULL;
+        }
+        scheduler->active_count--;
+    }
+    return device;
+}
+
+static void device_free(sched_device_t *device) {
+    free(device->id);
+    free(device);
+}
+
+/* Drop idle devices whose buckets have refilled (nothing left to remember) */
+static void devices_prune(chunks_scheduler_t *scheduler, int64_t now) {
+    sched_device_t **link = &scheduler->devices;
+    while (*link != NULL) {
+        sched_device_t *device = *link;
+        if (device->head == NULL && device->in_flight == NULL) {
+            bucket_refill(&device->bucket, &scheduler->config.device_limit, now);
+            if (bucket_full(&device->bucket, &scheduler->config.device_limit)) {
+                *link = device->next;
+                device_free(device);
+                continue;
+            }
+        }
+        link = &device->next;
+    }
+}
+
+static sched_device_t *device_find(chunks_scheduler_t *scheduler, const char *device_id) {
+    for (sched_device_t *device = scheduler->devices; device != NULL; device = device->next) {
+        if (strcmp(device->id, device_id) == 0) {
+            return device;
+        }
+    }
+    return NULL;
+}
+
+static sched_device_t *device_create(chunks_scheduler_t *scheduler, const char *device_id,
+                                     int64_t now) {
+    sched_device_t *device = calloc(1, sizeof(sched_device_t));
+    if (device == NULL) {
+        return NULL;
+    }
+
+    size_t len = strlen(device_id) + 1;
+    device->id = malloc(len);
+    if (device->id == NULL) {
+        free(device);
+        return NULL;
+    }
+    memcpy(device->id, device_id, len);
+
+    bucket_init(&device->bucket, &scheduler->config.device_limit, now);
+    device->next = scheduler->devices;
+    scheduler->devices = device;
+    return device;
+}
+
+/* ============================================================================
+ * Public API
+ * ========================================================================== */
+
+void chunks_scheduler_default_config(chunks_scheduler_config_t *config) {
+    if (config == NULL) {
+        return;
+    }
+
+    memset(config, 0, sizeof(*config));
+    config->quantum = DEFAULT_QUANTUM;
+    config->weights[CHUNKS_PRIORITY_HIGH] = DEFAULT_WEIGHT_HIGH;
+    config->weights[CHUNKS_PRIORITY_NORMAL] = DEFAULT_WEIGHT_NORMAL;
+    config->weights[CHUNKS_PRIORITY_BULK] = DEFAULT_WEIGHT_BULK;
+}
+
+chunks_priority_t chunks_scheduler_priority(mds_chunk_class_t chunk_class) {
+    switch (chunk_class) {
+        case MDS_CHUNK_CLASS_HEARTBEAT:
+        case MDS_CHUNK_CLASS_TRACE:
+        case MDS_CHUNK_CLASS_REBOOT:
+            return CHUNKS_PRIORITY_HIGH;
+        case MDS_CHUNK_CLASS_COREDUMP:
+        case MDS_CHUNK_CLASS_CDR:
+            return CHUNKS_PRIORITY_BULK;
+        default:
+            return CHUNKS_PRIORITY_NORMAL;
+    }
+}
+
+static bool config_valid(const chunks_scheduler_config_t *config) {
+    if (config->quantum == 0) {
+        return false;
+    }
+    for (int i = 0; i < CHUNKS_PRIORITY_COUNT; i++) {
+        if (config->weights[i] == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+chunks_scheduler_t *chunks_scheduler_create(const chunks_scheduler_config_t *config) {
+    chunks_scheduler_config_t defaults;
+    if (config == NULL) {
+        chunks_scheduler_default_config(&defaults);
+        config = &defaults;
+    }
+
+    if (!config_valid(config)) {
+        return NULL;
+    }
+
+    chunks_scheduler_t *scheduler = calloc(1, sizeof(chunks_scheduler_t));
+    if (scheduler == NULL) {
+        return NULL;
+    }
+
+    mds_mutex_init(&scheduler->lock);
+    scheduler->config = *config;
+    bucket_init(&scheduler->global, &scheduler->config.global_limit, mds_time_monotonic_ms());
+    return scheduler;
+}
+
+void chunks_scheduler_destroy(chunks_scheduler_t *scheduler, void (*release)(void *chunk)) {
+    if (scheduler == NULL) {
+        return;
+    }
+
+    sched_device_t *device = scheduler->devices;
+    while (device != NULL) {
+        sched_device_t *next_device = device->next;
+
+        sched_chunk_t *entry = device->head;
+        while (entry != NULL) {
+            sched_chunk_t *next = entry->next;
+            if (release) {
+                release(entry->chunk);
+            }
+            free(entry);
+            entry = next;
+        }
+        free(device->in_flight);
+
+        device_free(device);
+        device = next_device;
+    }
+
+    mds_mutex_destroy(&scheduler->lock);
+    free(scheduler);
+}
+
+int chunks_scheduler_set_config(chunks_scheduler_t *scheduler,
+                                const chunks_scheduler_config_t *config) {
+    if (scheduler == NULL || config == NULL || !config_valid(config)) {
+        return -EINVAL;
+    }
+
+    mds_mutex_lock(&scheduler->lock);
+    int64_t now = mds_time_monotonic_ms();
+
+    /* Settle the buckets at the old rates, then clamp to the new burst sizes */
+    bucket_refill(&scheduler->global, &scheduler->config.global_limit, now);
+    for (sched_device_t *device = scheduler->devices; device != NULL; device = device->next) {
+        bucket_refill(&device->bucket, &scheduler->config.device_limit, now);
+    }
+
+    bool global_was_limited = scheduler->config.global_limit.rate_bytes_per_sec != 0;
+    bool device_was_limited = scheduler->config.device_limit.rate_bytes_per_sec != 0;
+    scheduler->config = *config;
+
+    if (!global_was_limited) {
+        bucket_init(&scheduler->global, &scheduler->config.global_limit, now);
+    }
+    bucket_refill(&scheduler->global, &scheduler->config.global_limit, now);
+    for (sched_device_t *device = scheduler->devices; device != NULL; device = device->next) {
+        if (!device_was_limited) {
+            bucket_init(&device->bucket, &scheduler->config.device_limit, now);
+        }
+        bucket_refill(&device->bucket, &scheduler->config.device_limit, now);
+    }
+
+    mds_mutex_unlock(&scheduler->lock);
+    return 0;
+}
+
+int chunks_scheduler_enqueue(chunks_scheduler_t *scheduler,
+                             const char *device_id,
+                             chunks_priority_t priority,
+                             size_t size,
+                             void *chunk) {
+    if (scheduler == NULL || device_id == NULL || chunk == NULL ||
+        (unsigned int)priority >= CHUNKS_PRIORITY_COUNT) {
+        return -EINVAL;
+    }
+
+    sched_chunk_t *entry = calloc(1, sizeof(sched_chunk_t));
+    if (entry == NULL) {
+        return -ENOMEM;
+    }
+    entry->chunk = chunk;
+    entry->size = size;
+    entry->priority = priority;
+
+    mds_mutex_lock(&scheduler->lock);
+
+    sched_device_t *device = device_find(scheduler, device_id);
+    if (device == NULL) {
+        int64_t now = mds_time_monotonic_ms();
+        devices_prune(scheduler, now);
+        device = device_create(scheduler, device_id, now);
+        if (device == NULL) {
+            mds_mutex_unlock(&scheduler->lock);
+            free(entry);
+            return -ENOMEM;
+        }
+    }
+
+    bool was_idle = device->head == NULL && device->in_flight == NULL;
+    if (device->tail) {
+        device->tail->next = entry;
+    } else {
+        device->head = entry;
+    }
+    device->tail = entry;
+    scheduler->stats.queued++;
+
+    if (was_idle) {
+        active_push_back(scheduler, device);
+    }
+
+    mds_mutex_unlock(&scheduler->lock);
+    return 0;
+}
+
+int chunks_scheduler_dequeue(chunks_scheduler_t *scheduler, void **chunk, int *wait_ms) {
+    if (scheduler == NULL || chunk == NULL) {
+        return -EINVAL;
+    }
+
+    mds_mutex_lock(&scheduler->lock);
+
+    if (scheduler->active_count == 0) {
+        mds_mutex_unlock(&scheduler->lock);
+        return -ENOENT;
+    }
+
+    const chunks_scheduler_config_t *config = &scheduler->config;
+    int64_t now = mds_time_monotonic_ms();
+
+    bucket_refill(&scheduler->global, &config->global_limit, now);
+    int wait = bucket_wait_ms(&scheduler->global, &config->global_limit);
+
+    while (wait == 0) {
+        size_t visits = scheduler->active_count;
+        bool short_of_credit = false;
+        int min_wait = 0;
+
+        for (size_t i = 0; i < visits; i++) {
+            sched_device_t *device = active_pop(scheduler);
+            sched_chunk_t *entry = device->head;
+
+            /* A new turn: grant credit weighted by the class of the next chunk */
+            if (device->deficit < entry->size) {
+                device->deficit += (uint64_t)config->quantum * config->weights[entry->priority];
+                if (device->deficit < entry->size) {
+                    active_push_back(scheduler, device);
+                    short_of_credit = true;
+                    continue;
+                }
+            }
+
+            bucket_refill(&device->bucket, &config->device_limit, now);
+            int device_wait = bucket_wait_ms(&device->bucket, &config->device_limit);
+            if (device_wait > 0) {
+                active_push_back(scheduler, device);
+                if (min_wait == 0 || device_wait < min_wait) {
+                    min_wait = device_wait;
+                }
+                continue;
+            }
+
+            device->head = entry->next;
+            if (device->head == NULL) {
+                device->tail = NULL;
+            }
+            entry->next = NULL;
+            device->in_flight = entry;
+            device->deficit -= entry->size;
+
+            bucket_charge(&device->bucket, &config->device_limit, (int64_t)entry->size);
+            bucket_charge(&scheduler->global, &config->global_limit, (int64_t)entry->size);
+
+            scheduler->stats.queued--;
+            scheduler->stats.in_flight++;
+            scheduler->stats.dispatched[entry->priority]++;
+            scheduler->stats.bytes_dispatched[entry->priority] += entry->size;
+
+            *chunk = entry->chunk;
+            mds_mutex_unlock(&scheduler->lock);
+            return 0;
+        }
+
+        /* Nobody was short of credit, so everything left is rate limited */
+        if (!short_of_credit) {
+            wait = min_wait;
+        }
+    }
+
+    scheduler->stats.throttled++;
+    mds_mutex_unlock(&scheduler->lock);
+
+    if (wait_ms) {
+        *wait_ms = wait;
+    }
+    return -EAGAIN;
+}
+
+int chunks_scheduler_complete(chunks_scheduler_t *scheduler, void *chunk, bool requeue) {
+    if (scheduler == NULL || chunk == NULL) {
+        return -EINVAL;
+    }
+
+    mds_mutex_lock(&scheduler->lock);
+
+    sched_device_t *device = scheduler->devices;
+    while (device != NULL && (device->in_flight == NULL || device->in_flight->chunk != chunk)) {
+        device = device->next;
+    }
+    if (device == NULL) {
+        mds_mutex_unlock(&scheduler->lock);
+        return -EINVAL;
+    }
+
+    sched_chunk_t *entry = device->in_flight;
+    device->in_flight = NULL;
+    scheduler->stats.in_flight--;
+
+    if (requeue) {
+        /* Nothing was delivered: give back the credit and the tokens */
+        int64_t now = mds_time_monotonic_ms();
+        bucket_refill(&device->bucket, &scheduler->config.device_limit, now);
+        bucket_refill(&scheduler->global, &scheduler->config.global_limit, now);
+        bucket_charge(&device->bucket, &scheduler->config.device_limit, -(int64_t)entry->size);
+        bucket_charge(&scheduler->global, &scheduler->config.global_limit, -(int64_t)entry->size);
+        device->deficit += entry->size;
+
+        entry->next = device->head;
+        device->head = entry;
+        if (device->tail == NULL) {
+            device->tail = entry;
+        }
+        scheduler->stats.queued++;
+    } else {
+        free(entry);
+    }
+
+    if (device->head == NULL) {
+        device->deficit = 0;
+    } else if (device->deficit >= device->head->size) {
+        active_push_front(scheduler, device);
+    } else {
+        active_push_back(scheduler, device);
+    }
+
+    mds_mutex_unlock(&scheduler->lock);
+    return 0;
+}
+
+int chunks_scheduler_get_stats(chunks_scheduler_t *scheduler, chunks_scheduler_stats_t *stats) {
+    if (scheduler == NULL || stats == NULL) {
+        return -EINVAL;
+    }
+
+    mds_mutex_lock(&scheduler->lock);
+    *stats = scheduler->stats;
+    stats->active_devices = 0;
+    for (sched_device_t *device = scheduler->devices; device != NULL; device = device->next) {
+        if (device->head != NULL || device->in_flight != NULL) {
+            stats->active_devices++;
+        }
+    }
+    mds_mutex_unlock(&scheduler->lock);
+    return 0;
+}
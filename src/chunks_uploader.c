@@ -4,20 +4,32 @@
  */
 
 #include "mds_bridge/chunks_uploader.h"
+#include "mds_bridge/mds_arena.h"
+#include "mds_log_internal.h"
 #include <curl/curl.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/* First block of the per-request scratch arena (one multipart batch fits after one growth) */
+#define SCRATCH_BLOCK_SIZE  (8 * 1024)
 
 /* Uploader structure */
 struct chunks_uploader {
     CURL *curl;
-    struct curl_slist *headers;
+    struct curl_slist *headers;         /* Request headers for header_auth and header_type */
+    char header_auth[MDS_MAX_AUTH_LEN];
+    char header_type[96];
+    mds_arena_t *scratch;               /* Per-request memory, reset after every request */
     chunks_upload_stats_t stats;
     long timeout_ms;
     bool verbose;
+    uint64_t boundary_seed;             /* Multipart boundary generator */
+    char boundary[32];                  /* Replaced only when a chunk contains it */
 };
 
 /* ============================================================================
@@ -37,9 +49,17 @@ chunks_uploader_t *chunks_uploader_create(void) {
         return NULL;
     }
 
+    uploader->scratch = mds_arena_create(SCRATCH_BLOCK_SIZE);
+    if (uploader->scratch == NULL) {
+        curl_easy_cleanup(uploader->curl);
+        free(uploader);
+        return NULL;
+    }
+
     /* Set default timeout (30 seconds) */
     uploader->timeout_ms = 30000;
     uploader->verbose = false;
+    uploader->boundary_seed = (uint64_t)(uintptr_t)uploader ^ (uint64_t)time(NULL);
 
     return uploader;
 }
@@ -57,23 +77,67 @@ void chunks_uploader_destroy(chunks_uploader_t *uploader) {
         curl_easy_cleanup(uploader->curl);
     }
 
+    mds_arena_destroy(uploader->scratch);
     free(uploader);
 }
 
 /* ============================================================================
- * Upload Callback
+ * HTTP POST
  * ========================================================================== */
 
-int chunks_uploader_callback(const char *uri,
-                              const char *auth_header,
-                              const uint8_t *chunk_data,
-                              size_t chunk_len,
-                              void *user_data) {
-    if (uri == NULL || auth_header == NULL || chunk_data == NULL || user_data == NULL) {
-        return -EINVAL;
+/*
+ * Request headers for an authorization header ("HeaderName:HeaderValue",
+ * colon at name_len) and content type. The list is kept and only rebuilt
+ * when either changes, so steady-state uploads allocate nothing here.
+ */
+static struct curl_slist *uploader_headers(chunks_uploader_t *uploader,
+                                           const char *auth_header,
+                                           size_t name_len,
+                                           const char *content_type) {
+    if (uploader->headers != NULL &&
+        strcmp(uploader->header_auth, auth_header) == 0 &&
+        strcmp(uploader->header_type, content_type) == 0) {
+        return uploader->headers;
     }
 
-    chunks_uploader_t *uploader = (chunks_uploader_t *)user_data;
+    curl_slist_free_all(uploader->headers);
+    uploader->headers = NULL;
+
+    /* "HeaderName: HeaderValue" */
+    char *full_header = mds_arena_printf(uploader->scratch, "%.*s: %s", (int)name_len,
+                                         auth_header, auth_header + name_len + 1);
+    if (full_header == NULL) {
+        return NULL;
+    }
+
+    const char *lines[] = { full_header, content_type,
+                            "User-Agent: mds-bridge/1.0 (Memfault MDS Gateway)" };
+    struct curl_slist *headers = NULL;
+    for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++) {
+        struct curl_slist *appended = curl_slist_append(headers, lines[i]);
+        if (appended == NULL) {
+            curl_slist_free_all(headers);
+            return NULL;
+        }
+        headers = appended;
+    }
+
+    /* Keys longer than the buffers are truncated and never match: no caching */
+    uploader->headers = headers;
+    snprintf(uploader->header_auth, sizeof(uploader->header_auth), "%s", auth_header);
+    snprintf(uploader->header_type, sizeof(uploader->header_type), "%s", content_type);
+    return headers;
+}
+
+/* POST a body to the chunks endpoint; counts chunk_count chunks on success */
+static int uploader_post_request(chunks_uploader_t *uploader,
+                                 const char *uri,
+                                 const char *auth_header,
+                                 const void *body,
+                                 size_t body_len,
+                                 const char *content_type,
+                                 size_t chunk_count,
+                                 size_t chunk_bytes) {
     CURLcode res;
 
     /* Reset curl for new request */
@@ -86,44 +150,24 @@ int chunks_uploader_callback(const char *uri,
     curl_easy_setopt(uploader->curl, CURLOPT_POST, 1L);
 
     /* Set POST data */
-    curl_easy_setopt(uploader->curl, CURLOPT_POSTFIELDS, chunk_data);
-    curl_easy_setopt(uploader->curl, CURLOPT_POSTFIELDSIZE, (long)chunk_len);
+    curl_easy_setopt(uploader->curl, CURLOPT_POSTFIELDS, body);
+    curl_easy_setopt(uploader->curl, CURLOPT_POSTFIELDSIZE, (long)body_len);
 
     /* Parse authorization header (format: "HeaderName:HeaderValue") */
     const char *colon = strchr(auth_header, ':');
     if (colon == NULL) {
-        fprintf(stderr, "Invalid authorization header format: %s\n", auth_header);
+        mds_log(MDS_LOG_ERROR, MDS_LOG_UPLOAD, "Invalid authorization header format: %s", auth_header);
         uploader->stats.upload_failures++;
         return -EINVAL;
     }
 
-    /* Extract header name and value */
-    size_t header_name_len = colon - auth_header;
-    char *header_name = malloc(header_name_len + 1);
-    if (header_name == NULL) {
-        uploader->stats.upload_failures++;
-        return -ENOMEM;
-    }
-    memcpy(header_name, auth_header, header_name_len);
-    header_name[header_name_len] = '\0';
-
-    const char *header_value = colon + 1;
-
-    /* Build full header string for curl */
-    size_t full_header_len = strlen(header_name) + 2 + strlen(header_value) + 1; /* name + ": " + value + \0 */
-    char *full_header = malloc(full_header_len);
-    if (full_header == NULL) {
-        free(header_name);
+    /* Set headers */
+    struct curl_slist *headers = uploader_headers(uploader, auth_header,
+                                                  (size_t)(colon - auth_header), content_type);
+    if (headers == NULL) {
         uploader->stats.upload_failures++;
         return -ENOMEM;
     }
-    snprintf(full_header, full_header_len, "%s: %s", header_name, header_value);
-
-    /* Set headers */
-    struct curl_slist *headers = NULL;
-    headers = curl_slist_append(headers, full_header);
-    headers = curl_slist_append(headers, "Content-Type: application/octet-stream");
-    headers = curl_slist_append(headers, "User-Agent: mds-bridge/1.0 (Memfault MDS Gateway)");
 
     curl_easy_setopt(uploader->curl, CURLOPT_HTTPHEADER, headers);
 
@@ -133,16 +177,6 @@ int chunks_uploader_callback(const char *uri,
     /* Set verbose if enabled */
     if (uploader->verbose) {
         curl_easy_setopt(uploader->curl, CURLOPT_VERBOSE, 1L);
-
-        /* Debug: show exactly what bytes we're uploading */
-        printf("[UPLOAD] %zu bytes: ", chunk_len);
-        for (size_t i = 0; i < chunk_len && i < 20; i++) {
-            printf("%02X ", chunk_data[i]);
-        }
-        if (chunk_len > 20) {
-            printf("...");
-        }
-        printf("\n");
     }
 
     /* Perform the request */
@@ -153,36 +187,200 @@ int chunks_uploader_callback(const char *uri,
     curl_easy_getinfo(uploader->curl, CURLINFO_RESPONSE_CODE, &http_code);
     uploader->stats.last_http_status = http_code;
 
-    /* Clean up headers */
-    curl_slist_free_all(headers);
-    free(full_header);
-    free(header_name);
-
     /* Check result */
     if (res != CURLE_OK) {
-        fprintf(stderr, "Upload failed: %s\n", curl_easy_strerror(res));
+        mds_log(MDS_LOG_ERROR, MDS_LOG_UPLOAD, "Upload failed: %s", curl_easy_strerror(res));
         uploader->stats.upload_failures++;
         return -EIO;
     }
 
     /* Check HTTP status */
     if (http_code < 200 || http_code >= 300) {
-        fprintf(stderr, "Upload failed with HTTP status %ld\n", http_code);
+        mds_log(MDS_LOG_ERROR, MDS_LOG_UPLOAD, "Upload failed with HTTP status %ld", http_code);
         uploader->stats.upload_failures++;
         return -EIO;
     }
 
     /* Success - update stats */
-    uploader->stats.chunks_uploaded++;
-    uploader->stats.bytes_uploaded += chunk_len;
+    uploader->stats.chunks_uploaded += chunk_count;
+    uploader->stats.bytes_uploaded += chunk_bytes;
 
     if (uploader->verbose) {
-        printf("Uploaded chunk: %zu bytes, HTTP %ld\n", chunk_len, http_code);
+        printf("Uploaded %zu chunk(s): %zu bytes, HTTP %ld\n", chunk_count, chunk_bytes, http_code);
     }
 
     return 0;
 }
 
+static int uploader_post(chunks_uploader_t *uploader,
+                         const char *uri,
+                         const char *auth_header,
+                         const void *body,
+                         size_t body_len,
+                         const char *content_type,
+                         size_t chunk_count,
+                         size_t chunk_bytes) {
+    int ret = uploader_post_request(uploader, uri, auth_header, body, body_len, content_type,
+                                    chunk_count, chunk_bytes);
+    mds_arena_reset(uploader->scratch);  /* Releases the body and header strings */
+    return ret;
+}
+
+/* ============================================================================
+ * Upload Callback
+ * ========================================================================== */
+
+int chunks_uploader_callback(const char *uri,
+                              const char *auth_header,
+                              const uint8_t *chunk_data,
+                              size_t chunk_len,
+                              void *user_data) {
+    if (uri == NULL || auth_header == NULL || chunk_data == NULL || user_data == NULL) {
+        return -EINVAL;
+    }
+
+    chunks_uploader_t *uploader = (chunks_uploader_t *)user_data;
+
+    if (uploader->verbose) {
+        /* Debug: show exactly what bytes we're uploading */
+        printf("[UPLOAD] %zu bytes: ", chunk_len);
+        for (size_t i = 0; i < chunk_len && i < 20; i++) {
+            printf("%02X ", chunk_data[i]);
+        }
+        if (chunk_len > 20) {
+            printf("...");
+        }
+        printf("\n");
+    }
+
+    return uploader_post(uploader, uri, auth_header, chunk_data, chunk_len,
+                         "Content-Type: application/octet-stream", 1, chunk_len);
+}
+
+/* ============================================================================
+ * Batch Upload
+ * ========================================================================== */
+
+/* Find a needle in binary data */
+static bool contains(const uint8_t *data, size_t len, const char *needle, size_t needle_len) {
+    for (size_t i = 0; i + needle_len <= len; i++) {
+        if (data[i] == (uint8_t)needle[0] && memcmp(&data[i], needle, needle_len) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int chunks_uploader_upload_batch(chunks_uploader_t *uploader,
+                                 const char *uri,
+                                 const char *auth_header,
+                                 const uint8_t *const chunks[],
+                                 const size_t lens[],
+                                 size_t count) {
+    if (uploader == NULL || uri == NULL || auth_header == NULL ||
+        chunks == NULL || lens == NULL || count == 0) {
+        return -EINVAL;
+    }
+    if (count == 1) {
+        return chunks_uploader_callback(uri, auth_header, chunks[0], lens[0], uploader);
+    }
+
+    /*
+     * A boundary that occurs in none of the chunks. The previous one is kept
+     * while it qualifies, so the Content-Type header (and the cached header
+     * list) stays the same from batch to batch.
+     */
+    const char *boundary = uploader->boundary;
+    size_t boundary_len = strlen(boundary);
+    bool unique = boundary_len > 0;
+    for (size_t i = 0; i < count && unique; i++) {
+        unique = !contains(chunks[i], lens[i], boundary, boundary_len);
+    }
+    while (!unique) {
+        uploader->boundary_seed = uploader->boundary_seed * 6364136223846793005ull +
+                                  1442695040888963407ull;
+        boundary_len = (size_t)snprintf(uploader->boundary, sizeof(uploader->boundary),
+                                        "mds-bridge-%016llx",
+                                        (unsigned long long)uploader->boundary_seed);
+        unique = true;
+        for (size_t i = 0; i < count && unique; i++) {
+            unique = !contains(chunks[i], lens[i], boundary, boundary_len);
+        }
+    }
+
+    /* "--B\r\nContent-Type: application/octet-stream\r\n\r\n<chunk>\r\n" per part,
+     * "--B--\r\n" at the end */
+    static const char part_header[] = "Content-Type: application/octet-stream\r\n\r\n";
+    size_t chunk_bytes = 0;
+    size_t body_len = 2 + boundary_len + 4;
+    for (size_t i = 0; i < count; i++) {
+        if (chunks[i] == NULL) {
+            return -EINVAL;
+        }
+        chunk_bytes += lens[i];
+        body_len += 2 + boundary_len + 2 + (sizeof(part_header) - 1) + lens[i] + 2;
+    }
+
+    uint8_t *body = mds_arena_alloc(uploader->scratch, body_len + 1);  /* sprintf() terminator */
+    if (body == NULL) {
+        uploader->stats.upload_failures++;
+        return -ENOMEM;
+    }
+
+    size_t pos = 0;
+    for (size_t i = 0; i < count; i++) {
+        pos += (size_t)sprintf((char *)&body[pos], "--%s\r\n%s", boundary, part_header);
+        memcpy(&body[pos], chunks[i], lens[i]);
+        pos += lens[i];
+        body[pos++] = '\r';
+        body[pos++] = '\n';
+    }
+    pos += (size_t)sprintf((char *)&body[pos], "--%s--\r\n", boundary);
+
+    char content_type[96];
+    snprintf(content_type, sizeof(content_type),
+             "Content-Type: multipart/mixed; boundary=%s", boundary);
+
+    return uploader_post(uploader, uri, auth_header, body, pos, content_type,
+                         count, chunk_bytes);
+}
+
+/* Chunks per multipart request from chunks_uploader_batch_callback() */
+#define SINK_BATCH_MAX 32
+
+int chunks_uploader_batch_callback(const mds_sink_chunk_t *chunks, size_t count,
+                                   void *user_data) {
+    if (chunks == NULL || user_data == NULL) {
+        return -EINVAL;
+    }
+
+    chunks_uploader_t *uploader = (chunks_uploader_t *)user_data;
+    const uint8_t *data[SINK_BATCH_MAX];
+    size_t lens[SINK_BATCH_MAX];
+    int result = 0;
+
+    size_t i = 0;
+    while (i < count) {
+        /* A run of chunks for the same destination */
+        size_t n = 0;
+        while (i + n < count && n < SINK_BATCH_MAX &&
+               strcmp(chunks[i + n].uri, chunks[i].uri) == 0 &&
+               strcmp(chunks[i + n].auth_header, chunks[i].auth_header) == 0) {
+            data[n] = chunks[i + n].data;
+            lens[n] = chunks[i + n].len;
+            n++;
+        }
+
+        int ret = chunks_uploader_upload_batch(uploader, chunks[i].uri, chunks[i].auth_header,
+                                               data, lens, n);
+        if (ret < 0 && result == 0) {
+            result = ret;
+        }
+        i += n;
+    }
+    return result;
+}
+
 /* ============================================================================
  * Statistics
  * ========================================================================== */
@@ -0,0 +1,226 @@
+/**
+ * @file mds_arena.c
+ * @brief Arena (bump) allocator
+ *
+ * Data structures:
+ * - Blocks form a singly linked list starting with the first block, which
+ *   is allocated together with the arena. Allocation advances the offset of
+ *   the current block; when it does not fit, the arena moves on to the next
+ *   block (left over from before the last reset) or inserts a new one.
+ * - Blocks after the current one are unused and have their offset reset
+ *   when the arena moves on to them, so a reset only rewinds to the first
+ *   block.
+ * - used counts bytes handed out (including alignment padding) since the
+ *   last reset; the unused tail of a block that was skipped is not counted.
+ */
+
+#include "mds_bridge/mds_arena.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define DEFAULT_BLOCK_SIZE  4096
+
+/* Alignment for any object type */
+#define ARENA_ALIGN         16
+
+typedef struct arena_block {
+    struct arena_block *next;
+    size_t size;
+    size_t offset;
+    uint8_t *data;                      /* ARENA_ALIGN-aligned */
+} arena_block_t;
+
+struct mds_arena {
+    arena_block_t *current;
+    arena_block_t first;
+    size_t used;
+    mds_arena_stats_t stats;
+};
+
+/* Bytes to reserve after a block header so its data can be aligned */
+#define BLOCK_HEADER        (sizeof(arena_block_t) + ARENA_ALIGN)
+
+static uint8_t *align_up(uint8_t *p) {
+    return (uint8_t *)(((uintptr_t)p + ARENA_ALIGN - 1) & ~(uintptr_t)(ARENA_ALIGN - 1));
+}
+
+/* Add a block able to hold size bytes after the current one */
+static arena_block_t *arena_grow(mds_arena_t *arena, size_t size) {
+    size_t block_size = arena->current->size * 2;
+    if (block_size < size) {
+        block_size = size;
+    }
+    if (block_size > SIZE_MAX - BLOCK_HEADER) {
+        return NULL;
+    }
+
+    arena_block_t *block = malloc(BLOCK_HEADER + block_size);
+    if (block == NULL) {
+        return NULL;
+    }
+    block->size = block_size;
+    block->offset = 0;
+    block->data = align_up((uint8_t *)(block + 1));
+    block->next = arena->current->next;
+    arena->current->next = block;
+
+    arena->stats.capacity += block_size;
+    arena->stats.blocks++;
+    arena->stats.grows++;
+    return block;
+}
+
+/* ============================================================================
+ * Public API
+ * ========================================================================== */
+
+mds_arena_t *mds_arena_create(size_t block_size) {
+    if (block_size == 0) {
+        block_size = DEFAULT_BLOCK_SIZE;
+    }
+    if (block_size > SIZE_MAX - sizeof(mds_arena_t) - 2 * ARENA_ALIGN) {
+        return NULL;
+    }
+    block_size = (block_size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    mds_arena_t *arena = malloc(sizeof(mds_arena_t) + ARENA_ALIGN + block_size);
+    if (arena == NULL) {
+        return NULL;
+    }
+
+    memset(arena, 0, sizeof(*arena));
+    arena->first.size = block_size;
+    arena->first.data = align_up((uint8_t *)(arena + 1));
+    arena->current = &arena->first;
+    arena->stats.capacity = block_size;
+    arena->stats.blocks = 1;
+    return arena;
+}
+
+void mds_arena_destroy(mds_arena_t *arena) {
+    if (arena == NULL) {
+        return;
+    }
+
+    mds_arena_trim(arena);
+    free(arena);
+}
+
+void *mds_arena_alloc(mds_arena_t *arena, size_t size) {
+    if (arena == NULL) {
+        return NULL;
+    }
+
+    /* Round up so the next allocation stays aligned */
+    if (size > SIZE_MAX - ARENA_ALIGN) {
+        return NULL;
+    }
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    arena_block_t *block = arena->current;
+    if (block->size - block->offset < size) {
+        block = block->next;
+        if (block == NULL || block->size < size) {
+            block = arena_grow(arena, size);
+            if (block == NULL) {
+                return NULL;
+            }
+        }
+        block->offset = 0;
+        arena->current = block;
+    }
+
+    void *p = block->data + block->offset;
+    block->offset += size;
+    arena->used += size;
+    if (arena->used > arena->stats.high_water) {
+        arena->stats.high_water = arena->used;
+    }
+    return p;
+}
+
+void *mds_arena_calloc(mds_arena_t *arena, size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) {
+        return NULL;
+    }
+
+    void *p = mds_arena_alloc(arena, count * size);
+    if (p != NULL) {
+        memset(p, 0, count * size);
+    }
+    return p;
+}
+
+char *mds_arena_printf(mds_arena_t *arena, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    if (len < 0) {
+        return NULL;
+    }
+
+    char *str = mds_arena_alloc(arena, (size_t)len + 1);
+    if (str != NULL) {
+        va_start(args, fmt);
+        vsnprintf(str, (size_t)len + 1, fmt, args);
+        va_end(args);
+    }
+    return str;
+}
+
+mds_arena_mark_t mds_arena_mark(const mds_arena_t *arena) {
+    mds_arena_mark_t mark = { arena->current, arena->current->offset, arena->used };
+    return mark;
+}
+
+void mds_arena_rewind(mds_arena_t *arena, mds_arena_mark_t mark) {
+    if (arena == NULL || mark.block == NULL) {
+        return;
+    }
+
+    arena->current = (arena_block_t *)mark.block;
+    arena->current->offset = mark.offset;
+    arena->used = mark.used;
+}
+
+void mds_arena_reset(mds_arena_t *arena) {
+    if (arena == NULL) {
+        return;
+    }
+
+    arena->current = &arena->first;
+    arena->first.offset = 0;
+    arena->used = 0;
+    arena->stats.resets++;
+}
+
+void mds_arena_trim(mds_arena_t *arena) {
+    if (arena == NULL) {
+        return;
+    }
+
+    arena_block_t *block = arena->first.next;
+    while (block != NULL) {
+        arena_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->first.next = NULL;
+    arena->stats.capacity = arena->first.size;
+    arena->stats.blocks = 1;
+    mds_arena_reset(arena);
+}
+
+int mds_arena_get_stats(const mds_arena_t *arena, mds_arena_stats_t *stats) {
+    if (arena == NULL || stats == NULL) {
+        return -EINVAL;
+    }
+
+    *stats = arena->stats;
+    stats->used = arena->used;
+    return 0;
+}
@@ -0,0 +1,118 @@
+/**
+ * @file mds_backend_decorator.c
+ * @brief Backend decorator chain for MDS backends
+ *
+ * A decorator is itself an mds_backend_t whose vtable forwards to a
+ * user-supplied mds_backend_decorator_ops_t, handing it the wrapped backend.
+ * Stacking decorators therefore builds a simple linked chain that ends at
+ * the transport backend (e.g. HID).
+ */
+
+#include "mds_bridge/mds_backend.h"
+#include <stdlib.h>
+#include <errno.h>
+
+/**
+ * Decorator backend internal state
+ */
+typedef struct {
+    mds_backend_t base;                        /**< Base backend structure */
+    mds_backend_t *inner;                      /**< Wrapped backend (owned) */
+    const mds_backend_decorator_ops_t *ops;    /**< Decorator vtable */
+    void *ctx;                                 /**< Decorator context */
+} mds_decorator_backend_t;
+
+static int decorator_backend_read(void *impl_data, uint8_t report_id,
+                                   uint8_t *buffer, size_t length, int timeout_ms) {
+    mds_decorator_backend_t *dec = (mds_decorator_backend_t *)impl_data;
+
+    if (dec->ops->read == NULL) {
+        return mds_backend_read(dec->inner, report_id, buffer, length, timeout_ms);
+    }
+
+    return dec->ops->read(dec->ctx, dec->inner, report_id, buffer, length, timeout_ms);
+}
+
+static int decorator_backend_write(void *impl_data, uint8_t report_id,
+                                    const uint8_t *buffer, size_t length) {
+    mds_decorator_backend_t *dec = (mds_decorator_backend_t *)impl_data;
+
+    if (dec->ops->write == NULL) {
+        return mds_backend_write(dec->inner, report_id, buffer, length);
+    }
+
+    return dec->ops->write(dec->ctx, dec->inner, report_id, buffer, length);
+}
+
+static int decorator_backend_get_rx_timestamp(void *impl_data, mds_rx_timestamp_t *ts) {
+    mds_decorator_backend_t *dec = (mds_decorator_backend_t *)impl_data;
+    return mds_backend_get_rx_timestamp(dec->inner, ts);
+}
+
+static void decorator_backend_destroy(void *impl_data) {
+    mds_decorator_backend_t *dec = (mds_decorator_backend_t *)impl_data;
+
+    if (dec == NULL) {
+        return;
+    }
+
+    if (dec->ops->destroy) {
+        dec->ops->destroy(dec->ctx);
+    }
+
+    mds_backend_destroy(dec->inner);
+    free(dec);
+}
+
+/**
+ * Decorator backend operations vtable
+ */
+static const mds_backend_ops_t decorator_backend_ops = {
+    .read = decorator_backend_read,
+    .write = decorator_backend_write,
+    .destroy = decorator_backend_destroy,
+    .get_rx_timestamp = decorator_backend_get_rx_timestamp,
+};
+
+int mds_backend_decorate(mds_backend_t *inner,
+                         const mds_backend_decorator_ops_t *ops,
+                         void *ctx,
+                         mds_backend_t **backend) {
+    if (inner == NULL || ops == NULL || backend == NULL) {
+        return -EINVAL;
+    }
+
+    mds_decorator_backend_t *dec = calloc(1, sizeof(mds_decorator_backend_t));
+    if (dec == NULL) {
+        return -ENOMEM;
+    }
+
+    dec->base.ops = &decorator_backend_ops;
+    dec->base.impl_data = dec;
+    dec->inner = inner;
+    dec->ops = ops;
+    dec->ctx = ctx;
+
+    *backend = &dec->base;
+    return 0;
+}
+
+bool mds_backend_is_decorated(const mds_backend_t *backend) {
+    return backend != NULL && backend->ops == &decorator_backend_ops;
+}
+
+mds_backend_t *mds_backend_undecorate(mds_backend_t *backend) {
+    if (!mds_backend_is_decorated(backend)) {
+        return NULL;
+    }
+
+    mds_decorator_backend_t *dec = (mds_decorator_backend_t *)backend->impl_data;
+    mds_backend_t *inner = dec->inner;
+
+    if (dec->ops->destroy) {
+        dec->ops->destroy(dec->ctx);
+    }
+
+    free(dec);
+    return inner;
+}
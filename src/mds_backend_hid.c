@@ -9,6 +9,10 @@
 #include "memfault_hid_internal.h"
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+
+/* The stream buffer, plus one feature read and one feature write in flight */
+#define HID_BACKEND_POOL_SIZE 3
 
 /**
  * HID backend internal state
@@ -16,6 +20,8 @@
 typedef struct {
     mds_backend_t base;               /**< Base backend structure */
     memfault_hid_device_t *device;    /**< HID device handle */
+    memfault_hid_buf_pool_t *pool;    /**< Stream and feature report buffers */
+    memfault_hid_report_buf_t *stream_buf; /**< Last stream report, read in place */
 } mds_hid_backend_t;
 
 /**
@@ -29,43 +35,109 @@ static int hid_backend_read(void *impl_data, uint8_t report_id,
                              uint8_t *buffer, size_t length, int timeout_ms) {
     mds_hid_backend_t *hid_backend = (mds_hid_backend_t *)impl_data;
 
-    /* Report 0x06 is an input report (stream data) */
+    /* Report 0x06 is an input report (stream data). Other input reports that
+     * arrive meanwhile stay queued for their own consumers. */
     if (report_id == 0x06) {
-        uint8_t read_report_id = 0;
-        int result = memfault_hid_read_report(hid_backend->device, &read_report_id,
-                                               buffer, length, timeout_ms);
+        return memfault_hid_read_report_id(hid_backend->device, report_id,
+                                            buffer, length, timeout_ms);
+    }
 
-        /* Verify we got the expected report ID */
-        if (result > 0 && read_report_id != report_id) {
-            return MEMFAULT_HID_ERROR_IO;
-        }
+    /* All other reports (0x01-0x05) are feature reports, read into a pooled
+     * buffer (Report ID in its headroom) and copied out */
+    memfault_hid_report_buf_t *buf = memfault_hid_buf_alloc(hid_backend->pool);
+    if (buf == NULL || length > buf->capacity) {
+        /* Pool in use by other threads, or let the copying path reject it */
+        memfault_hid_buf_free(buf);
+        return memfault_hid_get_feature_report(hid_backend->device, report_id,
+                                                buffer, length);
+    }
 
-        return result;
+    buf->length = length;
+    int result = memfault_hid_get_feature_report_buf(hid_backend->device, report_id, buf);
+    if (result > (int)length) {
+        result = (int)length;
+    }
+    if (result > 0) {
+        memcpy(buffer, buf->data, (size_t)result);
+    }
+    memfault_hid_buf_free(buf);
+    return result;
+}
+
+/**
+ * Direct read operation for HID backend
+ *
+ * Stream reports (0x06) are read by hidapi straight into a pooled buffer,
+ * with the Report ID in its headroom, and parsed from there. Feature
+ * reports go through hid_backend_read().
+ */
+static int hid_backend_read_direct(void *impl_data, uint8_t report_id,
+                                   const uint8_t **data, int timeout_ms) {
+    mds_hid_backend_t *hid_backend = (mds_hid_backend_t *)impl_data;
+
+    if (report_id != 0x06) {
+        return -ENOTSUP;
     }
 
-    /* All other reports (0x01-0x05) are feature reports */
-    return memfault_hid_get_feature_report(hid_backend->device, report_id,
-                                            buffer, length);
+    int result = memfault_hid_read_report_id_buf(hid_backend->device, report_id,
+                                                 hid_backend->stream_buf, timeout_ms);
+    if (result >= 0) {
+        *data = hid_backend->stream_buf->data;
+    }
+    return result;
 }
 
 /**
  * Write operation for HID backend
  *
- * Currently only used for stream control (report 0x05)
- * Uses SET_FEATURE for all writes.
+ * Used for stream control (report 0x05) and retransmit requests (report 0x07).
+ * Uses SET_FEATURE for all writes, staged in a pooled buffer so the Report
+ * ID goes in its headroom.
  */
 static int hid_backend_write(void *impl_data, uint8_t report_id,
                               const uint8_t *buffer, size_t length) {
     mds_hid_backend_t *hid_backend = (mds_hid_backend_t *)impl_data;
 
-    return memfault_hid_set_feature_report(hid_backend->device, report_id,
-                                            buffer, length);
+    memfault_hid_report_buf_t *buf = memfault_hid_buf_alloc(hid_backend->pool);
+    if (buf == NULL || length > buf->capacity) {
+        /* Pool in use by other threads, or let the copying path reject it */
+        memfault_hid_buf_free(buf);
+        return memfault_hid_set_feature_report(hid_backend->device, report_id,
+                                                buffer, length);
+    }
+
+    memcpy(buf->data, buffer, length);
+    buf->length = length;
+    buf->report_id = report_id;
+    int result = memfault_hid_set_feature_report_buf(hid_backend->device, buf);
+    memfault_hid_buf_free(buf);
+    return result;
+}
+
+/* Free the backend structure and its stream buffer */
+static void hid_backend_free(mds_hid_backend_t *hid_backend) {
+    memfault_hid_buf_free(hid_backend->stream_buf);
+    memfault_hid_buf_pool_destroy(hid_backend->pool);
+    free(hid_backend);
+}
+
+/**
+ * Receive timestamps for HID backend
+ *
+ * Taken by memfault_hid right after the input report read returned.
+ */
+static int hid_backend_get_rx_timestamp(void *impl_data, mds_rx_timestamp_t *ts) {
+    mds_hid_backend_t *hid_backend = (mds_hid_backend_t *)impl_data;
+
+    return memfault_hid_get_rx_timestamp(hid_backend->device, &ts->monotonic_ns,
+                                         &ts->realtime_ns);
 }
 
 /**
  * Destroy HID backend
  *
- * Closes the HID device and frees the backend structure.
+ * Closes the HID device, frees the backend structure and releases the
+ * library reference taken at creation.
  */
 static void hid_backend_destroy(void *impl_data) {
     mds_hid_backend_t *hid_backend = (mds_hid_backend_t *)impl_data;
@@ -74,7 +146,8 @@ static void hid_backend_destroy(void *impl_data) {
         if (hid_backend->device) {
             memfault_hid_close(hid_backend->device);
         }
-        free(hid_backend);
+        hid_backend_free(hid_backend);
+        memfault_hid_exit();
     }
 }
 
@@ -85,8 +158,28 @@ static const mds_backend_ops_t hid_backend_ops = {
     .read = hid_backend_read,
     .write = hid_backend_write,
     .destroy = hid_backend_destroy,
+    .get_rx_timestamp = hid_backend_get_rx_timestamp,
+    .read_direct = hid_backend_read_direct,
 };
 
+/* Allocate a backend with its stream buffer (device not opened yet) */
+static mds_hid_backend_t *hid_backend_alloc(void) {
+    mds_hid_backend_t *hid_backend = calloc(1, sizeof(mds_hid_backend_t));
+    if (!hid_backend) {
+        return NULL;
+    }
+
+    if (memfault_hid_buf_pool_create(HID_BACKEND_POOL_SIZE, &hid_backend->pool) < 0) {
+        free(hid_backend);
+        return NULL;
+    }
+    hid_backend->stream_buf = memfault_hid_buf_alloc(hid_backend->pool);
+
+    hid_backend->base.ops = &hid_backend_ops;
+    hid_backend->base.impl_data = hid_backend;
+    return hid_backend;
+}
+
 /**
  * Create HID backend from VID/PID
  *
@@ -104,27 +197,25 @@ int mds_backend_hid_create(uint16_t vendor_id, uint16_t product_id,
         return MEMFAULT_HID_ERROR_INVALID_PARAM;
     }
 
-    /* Initialize HID library if not already done */
+    /* Take a library reference (released in hid_backend_destroy) */
     int result = memfault_hid_init();
     if (result < 0) {
         return result;
     }
 
     /* Allocate backend structure */
-    mds_hid_backend_t *hid_backend = calloc(1, sizeof(mds_hid_backend_t));
+    mds_hid_backend_t *hid_backend = hid_backend_alloc();
     if (!hid_backend) {
+        memfault_hid_exit();
         return MEMFAULT_HID_ERROR_NO_MEM;
     }
 
-    /* Initialize base backend */
-    hid_backend->base.ops = &hid_backend_ops;
-    hid_backend->base.impl_data = hid_backend;
-
     /* Open HID device */
     result = memfault_hid_open(vendor_id, product_id, serial_number,
                                &hid_backend->device);
     if (result < 0) {
-        free(hid_backend);
+        hid_backend_free(hid_backend);
+        memfault_hid_exit();
         return result;
     }
 
@@ -145,26 +236,24 @@ int mds_backend_hid_create_path(const char *path, mds_backend_t **backend) {
         return MEMFAULT_HID_ERROR_INVALID_PARAM;
     }
 
-    /* Initialize HID library if not already done */
+    /* Take a library reference (released in hid_backend_destroy) */
     int result = memfault_hid_init();
     if (result < 0) {
         return result;
     }
 
     /* Allocate backend structure */
-    mds_hid_backend_t *hid_backend = calloc(1, sizeof(mds_hid_backend_t));
+    mds_hid_backend_t *hid_backend = hid_backend_alloc();
     if (!hid_backend) {
+        memfault_hid_exit();
         return MEMFAULT_HID_ERROR_NO_MEM;
     }
 
-    /* Initialize base backend */
-    hid_backend->base.ops = &hid_backend_ops;
-    hid_backend->base.impl_data = hid_backend;
-
     /* Open HID device by path */
     result = memfault_hid_open_path(path, &hid_backend->device);
     if (result < 0) {
-        free(hid_backend);
+        hid_backend_free(hid_backend);
+        memfault_hid_exit();
         return result;
     }
 
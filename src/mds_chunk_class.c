@@ -0,0 +1,357 @@
+/**
+ * @file mds_chunk_class.c
+ * @brief Classification of Memfault chunks by message type
+ *
+ * Only the start of each message is inspected: the chunk transport header
+ * and varint of every chunk, the packetizer message type, and for events the
+ * first CBOR map entries up to the event type (and, for traces, the start of
+ * the event info map). Message bytes are collected into a small prefix
+ * buffer until the class is decided, so a message split into tiny chunks is
+ * still classified once enough of it has arrived.
+ *
+ * Memfault SDK encodings relied on:
+ * - Packetizer message types: 1 coredump, 2 event, 3 log, 4 CDR
+ * - Event map keys: 2 = event type, 4 = event info
+ * - Event types: 1 heartbeat, 2 trace, 3 log error, 4 logs, 5 CDR
+ * - Trace info keys: 1 = reboot reason (reboot events),
+ *   6 = user reason (MEMFAULT_TRACE_EVENT)
+ */
+
+#include "mds_bridge/mds_protocol.h"
+#include <string.h>
+
+#define CHUNK_HDR_CONTINUATION      0x80
+#define CHUNK_HDR_MORE_DATA         0x40
+
+#define MSG_TYPE_MASK               0x7F
+#define MSG_TYPE_COREDUMP           1
+#define MSG_TYPE_EVENT              2
+#define MSG_TYPE_LOG                3
+#define MSG_TYPE_CDR                4
+
+#define EVENT_KEY_TYPE              2
+#define EVENT_KEY_INFO              4
+
+#define EVENT_TYPE_HEARTBEAT        1
+#define EVENT_TYPE_TRACE            2
+#define EVENT_TYPE_LOG_ERROR        3
+#define EVENT_TYPE_LOGS             4
+#define EVENT_TYPE_CDR              5
+
+#define TRACE_KEY_REASON            1
+#define TRACE_KEY_USER_REASON       6
+
+#define CBOR_MAX_DEPTH              4
+
+/* Parse outcome for the collected prefix */
+typedef enum {
+    PARSE_NEED_MORE,
+    PARSE_DONE,
+} parse_result_t;
+
+/* ============================================================================
+ * Minimal CBOR Reader
+ * ========================================================================== */
+
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    size_t pos;
+    bool truncated;                     /* Ran past the collected bytes */
+    bool malformed;
+} cbor_reader_t;
+
+/* Read an item head; returns false on truncation or unsupported encodings */
+static bool cbor_head(cbor_reader_t *r, uint8_t *major, uint64_t *value) {
+    if (r->pos >= r->len) {
+        r->truncated = true;
+        return false;
+    }
+
+    uint8_t initial = r->data[r->pos++];
+    uint8_t info = initial & 0x1F;
+    *major = initial >> 5;
+
+    size_t extra;
+    if (info < 24) {
+        *value = info;
+        return true;
+    } else if (info <= 27) {
+        extra = (size_t)1 << (info - 24);
+    } else {
+        r->malformed = true;  /* Indefinite lengths are not used by the SDK */
+        return false;
+    }
+
+    if (r->len - r->pos < extra) {
+        r->truncated = true;
+        return false;
+    }
+
+    *value = 0;
+    for (size_t i = 0; i < extra; i++) {
+        *value = (*value << 8) | r->data[r->pos++];
+    }
+    return true;
+}
+
+static bool cbor_skip(cbor_reader_t *r, int depth) {
+    uint8_t major;
+    uint64_t value;
+
+    if (depth > CBOR_MAX_DEPTH) {
+        r->malformed = true;
+        return false;
+    }
+    if (!cbor_head(r, &major, &value)) {
+        return false;
+    }
+
+    switch (major) {
+        case 2:  /* Byte string */
+        case 3:  /* Text string */
+            if (r->len - r->pos < value) {
+                r->truncated = true;
+                return false;
+            }
+            r->pos += (size_t)value;
+            return true;
+        case 4:  /* Array */
+        case 5:  /* Map */
+            if (major == 5) {
+                value *= 2;
+            }
+            for (uint64_t i = 0; i < value; i++) {
+                if (!cbor_skip(r, depth + 1)) {
+                    return false;
+                }
+            }
+            return true;
+        case 6:  /* Tag */
+            return cbor_skip(r, depth + 1);
+        default: /* Integers, simple values and floats carry no payload */
+            return true;
+    }
+}
+
+/* ============================================================================
+ * Message Parsing
+ * ========================================================================== */
+
+/* A trace with a reboot reason is a reboot event */
+static parse_result_t parse_trace_info(cbor_reader_t *r, mds_chunk_class_t *chunk_class) {
+    uint8_t major;
+    uint64_t count;
+
+    if (!cbor_head(r, &major, &count)) {
+        return PARSE_NEED_MORE;
+    }
+    if (major != 5) {
+        *chunk_class = MDS_CHUNK_CLASS_TRACE;
+        return PARSE_DONE;
+    }
+
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t key;
+        if (!cbor_head(r, &major, &key)) {
+            return PARSE_NEED_MORE;
+        }
+        if (major == 0 && key == TRACE_KEY_REASON) {
+            *chunk_class = MDS_CHUNK_CLASS_REBOOT;
+            return PARSE_DONE;
+        }
+        if (major == 0 && key == TRACE_KEY_USER_REASON) {
+            *chunk_class = MDS_CHUNK_CLASS_TRACE;
+            return PARSE_DONE;
+        }
+        if (!cbor_skip(r, 1)) {
+            return PARSE_NEED_MORE;
+        }
+    }
+
+    *chunk_class = MDS_CHUNK_CLASS_TRACE;
+    return PARSE_DONE;
+}
+
+static parse_result_t parse_event(cbor_reader_t *r, mds_chunk_class_t *chunk_class) {
+    uint8_t major;
+    uint64_t count;
+    uint64_t event_type = 0;
+
+    if (!cbor_head(r, &major, &count)) {
+        return PARSE_NEED_MORE;
+    }
+    if (major != 5) {
+        r->malformed = true;
+        return PARSE_DONE;
+    }
+
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t key;
+        if (!cbor_head(r, &major, &key)) {
+            return PARSE_NEED_MORE;
+        }
+
+        if (major == 0 && key == EVENT_KEY_TYPE) {
+            if (!cbor_head(r, &major, &event_type)) {
+                return PARSE_NEED_MORE;
+            }
+
+            switch (event_type) {
+                case EVENT_TYPE_HEARTBEAT:
+                    *chunk_class = MDS_CHUNK_CLASS_HEARTBEAT;
+                    return PARSE_DONE;
+                case EVENT_TYPE_LOG_ERROR:
+                case EVENT_TYPE_LOGS:
+                    *chunk_class = MDS_CHUNK_CLASS_LOG;
+                    return PARSE_DONE;
+                case EVENT_TYPE_CDR:
+                    *chunk_class = MDS_CHUNK_CLASS_CDR;
+                    return PARSE_DONE;
+                case EVENT_TYPE_TRACE:
+                    *chunk_class = MDS_CHUNK_CLASS_TRACE;  /* Until the info says reboot */
+                    continue;
+                default:
+                    *chunk_class = MDS_CHUNK_CLASS_UNKNOWN;
+                    return PARSE_DONE;
+            }
+        }
+
+        if (major == 0 && key == EVENT_KEY_INFO && event_type == EVENT_TYPE_TRACE) {
+            return parse_trace_info(r, chunk_class);
+        }
+
+        if (!cbor_skip(r, 1)) {
+            return PARSE_NEED_MORE;
+        }
+    }
+
+    return PARSE_DONE;
+}
+
+static parse_result_t parse_message(const uint8_t *msg, size_t len,
+                                    mds_chunk_class_t *chunk_class) {
+    if (len == 0) {
+        return PARSE_NEED_MORE;
+    }
+
+    switch (msg[0] & MSG_TYPE_MASK) {
+        case MSG_TYPE_COREDUMP:
+            *chunk_class = MDS_CHUNK_CLASS_COREDUMP;
+            return PARSE_DONE;
+        case MSG_TYPE_LOG:
+            *chunk_class = MDS_CHUNK_CLASS_LOG;
+            return PARSE_DONE;
+        case MSG_TYPE_CDR:
+            *chunk_class = MDS_CHUNK_CLASS_CDR;
+            return PARSE_DONE;
+        case MSG_TYPE_EVENT:
+            break;
+        default:
+            *chunk_class = MDS_CHUNK_CLASS_UNKNOWN;
+            return PARSE_DONE;
+    }
+
+    cbor_reader_t reader = { .data = msg + 1, .len = len - 1 };
+    *chunk_class = MDS_CHUNK_CLASS_UNKNOWN;
+    parse_result_t result = parse_event(&reader, chunk_class);
+    if (reader.malformed) {
+        *chunk_class = MDS_CHUNK_CLASS_UNKNOWN;
+        return PARSE_DONE;
+    }
+    return result;
+}
+
+/* ============================================================================
+ * Public API
+ * ========================================================================== */
+
+void mds_chunk_classifier_reset(mds_chunk_classifier_t *classifier) {
+    if (classifier == NULL) {
+        return;
+    }
+
+    memset(classifier, 0, sizeof(*classifier));
+    classifier->chunk_class = MDS_CHUNK_CLASS_UNKNOWN;
+}
+
+/* Skip a varint; returns the number of bytes, or 0 if it is incomplete */
+static size_t varint_skip(const uint8_t *data, size_t len, uint32_t *value) {
+    uint32_t result = 0;
+    for (size_t i = 0; i < len && i < 5; i++) {
+        result |= (uint32_t)(data[i] & 0x7F) << (7 * i);
+        if (!(data[i] & 0x80)) {
+            *value = result;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+mds_chunk_class_t mds_chunk_classify(mds_chunk_classifier_t *classifier,
+                                     const uint8_t *chunk, size_t chunk_len) {
+    if (classifier == NULL || chunk == NULL || chunk_len == 0) {
+        return MDS_CHUNK_CLASS_UNKNOWN;
+    }
+
+    uint8_t header = chunk[0];
+    size_t pos = 1;
+    uint32_t varint = 0;
+
+    if (header & CHUNK_HDR_CONTINUATION) {
+        size_t n = varint_skip(chunk + pos, chunk_len - pos, &varint);
+        if (!classifier->pending) {
+            return classifier->chunk_class;
+        }
+        if (n == 0 || varint != classifier->prefix_len) {
+            /* Missed part of the message - the class cannot be decided */
+            classifier->pending = false;
+            return classifier->chunk_class;
+        }
+        pos += n;
+    } else {
+        classifier->chunk_class = MDS_CHUNK_CLASS_UNKNOWN;
+        classifier->pending = true;
+        classifier->prefix_len = 0;
+        if (header & CHUNK_HDR_MORE_DATA) {
+            size_t n = varint_skip(chunk + pos, chunk_len - pos, &varint);
+            if (n == 0) {
+                classifier->pending = false;
+                return classifier->chunk_class;
+            }
+            pos += n;
+        }
+    }
+
+    size_t room = sizeof(classifier->prefix) - classifier->prefix_len;
+    size_t take = chunk_len - pos < room ? chunk_len - pos : room;
+    memcpy(classifier->prefix + classifier->prefix_len, chunk + pos, take);
+    classifier->prefix_len += take;
+
+    mds_chunk_class_t chunk_class = MDS_CHUNK_CLASS_UNKNOWN;
+    parse_result_t result = parse_message(classifier->prefix, classifier->prefix_len,
+                                          &chunk_class);
+
+    /* Settle for the best guess once the prefix is full or the message ended */
+    if (result == PARSE_DONE || classifier->prefix_len == sizeof(classifier->prefix) ||
+        !(header & CHUNK_HDR_MORE_DATA)) {
+        classifier->pending = false;
+        classifier->chunk_class = chunk_class;
+    } else if (chunk_class != MDS_CHUNK_CLASS_UNKNOWN) {
+        classifier->chunk_class = chunk_class;  /* E.g. a trace that may turn out a reboot */
+    }
+
+    return classifier->chunk_class;
+}
+
+const char *mds_chunk_class_name(mds_chunk_class_t chunk_class) {
+    switch (chunk_class) {
+        case MDS_CHUNK_CLASS_HEARTBEAT: return "heartbeat";
+        case MDS_CHUNK_CLASS_TRACE:     return "trace";
+        case MDS_CHUNK_CLASS_REBOOT:    return "reboot";
+        case MDS_CHUNK_CLASS_LOG:       return "log";
+        case MDS_CHUNK_CLASS_COREDUMP:  return "coredump";
+        case MDS_CHUNK_CLASS_CDR:       return "cdr";
+        default:                        return "unknown";
+    }
+}
@@ -0,0 +1,620 @@
+/**
+ * @file mds_device_manager.c
+ * @brief Hotplug-driven MDS device manager
+ *
+ * On Linux the manager listens on the NETLINK_KOBJECT_UEVENT socket for
+ * hidraw add/remove events. Both the kernel and the udev multicast groups
+ * are joined: kernel events arrive first, udev events arrive once rules
+ * (permissions, symlinks) have been applied. Attaching is idempotent per
+ * path, so whichever event first allows the device to be opened wins.
+ *
+ * Discovery itself goes through memfault_hid_enumerate_visit(), which is what
+ * applies the usage page filter and works on every platform. Hotplug events
+ * only trigger a rescan (add) or detach a tracked path (remove); platforms
+ * without hotplug support fall back to periodic rescans.
+ *
+ * mds_device_manager_destroy() may run on another thread while
+ * mds_device_manager_process() waits: it wakes the wait (an eventfd next to
+ * the netlink socket, a condition variable between rescans) and frees the
+ * manager once process() has returned.
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE  /* struct ucred */
+#endif
+
+#include "mds_bridge/mds_device_manager.h"
+#include "mds_bridge/memfault_hid.h"
+#include "mds_bridge/platform_compat.h"
+#include "mds_thread.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#endif
+
+/* Netlink multicast groups for uevents */
+#define UEVENT_GROUP_KERNEL     1
+#define UEVENT_GROUP_UDEV       2
+
+/* Maximum uevent message size */
+#define UEVENT_BUFFER_SIZE      8192
+
+/* Maximum device path length (matches memfault_hid_device_info_t.path) */
+#define DEVICE_PATH_MAX         256
+
+/* Managed device entry */
+typedef struct {
+    char path[DEVICE_PATH_MAX];
+    mds_session_t *session;
+    bool seen;                  /* Marked during a rescan */
+} managed_device_t;
+
+/* Device manager structure */
+struct mds_device_manager {
+    mds_device_manager_config_t config;
+    int monitor_fd;
+    int wake_fd;                /* eventfd written by destroy (with monitor_fd) */
+
+    mds_mutex_t lock;
+    mds_cond_t wake;            /* Signaled by destroy and when process() returns */
+    bool stopping;
+    bool busy;                  /* mds_device_manager_process() running */
+
+    managed_device_t *devices;
+    size_t num_devices;
+    size_t capacity;
+};
+
+/* ============================================================================
+ * Device Set
+ * ========================================================================== */
+
+static managed_device_t *find_device(mds_device_manager_t *manager, const char *path) {
+    for (size_t i = 0; i < manager->num_devices; i++) {
+        if (strcmp(manager->devices[i].path, path) == 0) {
+            return &manager->devices[i];
+        }
+    }
+    return NULL;
+}
+
+/* Open a session for path and add it to the set. Returns 1 if attached. */
+static int attach_device(mds_device_manager_t *manager, const char *path) {
+    if (find_device(manager, path) != NULL) {
+        return 0;  /* Already attached (e.g. kernel event followed by udev event) */
+    }
+
+    if (manager->num_devices == manager->capacity) {
+        size_t new_capacity = manager->capacity ? manager->capacity * 2 : 4;
+        managed_device_t *devices = realloc(manager->devices,
+                                            new_capacity * sizeof(managed_device_t));
+        if (devices == NULL) {
+            return -ENOMEM;
+        }
+        manager->devices = devices;
+        manager->capacity = new_capacity;
+    }
+
+    mds_session_t *session = NULL;
+    int ret = mds_session_create_hid_path(path, &session);
+    if (ret < 0) {
+        /* Device node may not be accessible yet - a later udev event retries */
+        return 0;
+    }
+
+    managed_device_t *dev = &manager->devices[manager->num_devices++];
+    memset(dev, 0, sizeof(*dev));
+    strncpy(dev->path, path, sizeof(dev->path) - 1);
+    dev->session = session;
+    dev->seen = true;
+
+    manager->config.callback(manager, MDS_DEVICE_EVENT_ATTACHED, dev->path,
+                             dev->session, manager->config.user_data);
+    return 1;
+}
+
+/* Fire the detach callback, destroy the session and remove it from the set */
+static int detach_device(mds_device_manager_t *manager, const char *path) {
+    managed_device_t *dev = find_device(manager, path);
+    if (dev == NULL) {
+        return 0;
+    }
+
+    manager->config.callback(manager, MDS_DEVICE_EVENT_DETACHED, dev->path,
+                             dev->session, manager->config.user_data);
+
+    mds_session_destroy(dev->session);
+
+    /* Keep the array dense */
+    size_t index = (size_t)(dev - manager->devices);
+    manager->num_devices--;
+    if (index != manager->num_devices) {
+        manager->devices[index] = manager->devices[manager->num_devices];
+    }
+    return 1;
+}
+
+static bool matches_filter(mds_device_manager_t *manager, uint16_t vid, uint16_t pid) {
+    return (manager->config.vendor_id == 0 || manager->config.vendor_id == vid) &&
+           (manager->config.product_id == 0 || manager->config.product_id == pid);
+}
+
+/* Rescan state passed through the enumeration visitor */
+typedef struct {
+    mds_device_manager_t *manager;
+    int fired;
+    int error;
+} scan_context_t;
+
+static bool scan_visit(const memfault_hid_device_ref_t *device, void *user_data) {
+    scan_context_t *scan = (scan_context_t *)user_data;
+
+    managed_device_t *dev = find_device(scan->manager, device->path);
+    if (dev != NULL) {
+        dev->seen = true;
+        return true;
+    }
+
+    int ret = attach_device(scan->manager, device->path);
+    if (ret < 0) {
+        scan->error = ret;
+        return false;
+    }
+    scan->fired += ret;
+    return true;
+}
+
+/*
+ * Enumerate matching HID interfaces and reconcile the managed set: attach
+ * every new path and detach managed paths that are no longer present.
+ * hidapi may list one path several times (one entry per top-level usage),
+ * the repeats find the already attached entry.
+ */
+static int scan_devices(mds_device_manager_t *manager) {
+    int ret = memfault_hid_init();
+    if (ret < 0) {
+        return ret;
+    }
+
+    for (size_t i = 0; i < manager->num_devices; i++) {
+        manager->devices[i].seen = false;
+    }
+
+    memfault_hid_enum_filter_t filter = {
+        .vendor_id = manager->config.vendor_id,
+        .product_id = manager->config.product_id,
+        .usage_page = manager->config.usage_page,
+        .interface_number = -1,
+    };
+    scan_context_t scan = { .manager = manager };
+
+    ret = memfault_hid_enumerate_visit(&filter, scan_visit, &scan);
+    memfault_hid_exit();
+    if (ret < 0) {
+        return ret;
+    }
+    if (scan.error < 0) {
+        return scan.error;
+    }
+
+    /* Detach devices that disappeared (only needed without hotplug events) */
+    for (size_t i = manager->num_devices; i > 0; i--) {
+        if (!manager->devices[i - 1].seen) {
+            scan.fired += detach_device(manager, manager->devices[i - 1].path);
+        }
+    }
+
+    return scan.fired;
+}
+
+#ifdef __linux__
+
+/* Header prepended by udevd to messages on the udev multicast group */
+typedef struct {
+    char prefix[8];                 /* "libudev" */
+    unsigned int magic;
+    unsigned int header_size;
+    unsigned int properties_off;
+    unsigned int properties_len;
+    unsigned int filter_subsystem_hash;
+    unsigned int filter_devtype_hash;
+    unsigned int filter_tag_bloom_hi;
+    unsigned int filter_tag_bloom_lo;
+} udev_netlink_header_t;
+
+/* Properties of a hidraw uevent we care about */
+typedef struct {
+    const char *action;
+    const char *subsystem;
+    const char *devname;
+    const char *devpath;
+} uevent_t;
+
+/* Read VID/PID of a hidraw device from its parent HID device in sysfs */
+static bool read_hid_id(const char *devpath, uint16_t *vendor_id, uint16_t *product_id) {
+    char path[512];
+    snprintf(path, sizeof(path), "/sys%s/device/uevent", devpath);
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return false;
+    }
+
+    char line[256];
+    bool found = false;
+    while (fgets(line, sizeof(line), f)) {
+        unsigned int bus, vid, pid;
+        if (sscanf(line, "HID_ID=%x:%x:%x", &bus, &vid, &pid) == 3) {
+            *vendor_id = (uint16_t)vid;
+            *product_id = (uint16_t)pid;
+            found = true;
+            break;
+        }
+    }
+
+    fclose(f);
+    return found;
+}
+
+/* Build "/dev/hidrawN" from a DEVNAME property (kernel events omit "/dev/") */
+static void devnode_path(const char *devname, char *path, size_t len) {
+    if (devname[0] == '/') {
+        snprintf(path, len, "%s", devname);
+    } else {
+        snprintf(path, len, "/dev/%s", devname);
+    }
+}
+
+/* Split a NUL-separated KEY=VALUE property block */
+static void parse_properties(const char *buf, size_t len, uevent_t *ev) {
+    size_t pos = 0;
+    while (pos < len) {
+        const char *prop = &buf[pos];
+        size_t prop_len = strnlen(prop, len - pos);
+
+        if (strncmp(prop, "ACTION=", 7) == 0) {
+            ev->action = prop + 7;
+        } else if (strncmp(prop, "SUBSYSTEM=", 10) == 0) {
+            ev->subsystem = prop + 10;
+        } else if (strncmp(prop, "DEVNAME=", 8) == 0) {
+            ev->devname = prop + 8;
+        } else if (strncmp(prop, "DEVPATH=", 8) == 0) {
+            ev->devpath = prop + 8;
+        }
+
+        pos += prop_len + 1;
+    }
+}
+
+static bool parse_uevent(char *buf, size_t len, uevent_t *ev) {
+    memset(ev, 0, sizeof(*ev));
+
+    /* Make sure the last property is terminated */
+    if (len == 0 || len >= UEVENT_BUFFER_SIZE) {
+        return false;
+    }
+    buf[len] = '\0';
+
+    if (len >= sizeof(udev_netlink_header_t) && strcmp(buf, "libudev") == 0) {
+        /* udev message: properties follow the header */
+        const udev_netlink_header_t *hdr = (const udev_netlink_header_t *)buf;
+        if (hdr->properties_off >= len ||
+            hdr->properties_len > len - hdr->properties_off) {
+            return false;
+        }
+        parse_properties(buf + hdr->properties_off, hdr->properties_len, ev);
+    } else {
+        /* Kernel message: "action@devpath\0KEY=VALUE\0..." */
+        size_t head_len = strnlen(buf, len);
+        if (strchr(buf, '@') == NULL || head_len >= len) {
+            return false;
+        }
+        parse_properties(buf + head_len + 1, len - head_len - 1, ev);
+    }
+
+    return ev->action && ev->subsystem && ev->devname && ev->devpath;
+}
+
+static int handle_uevent(mds_device_manager_t *manager, const uevent_t *ev) {
+    if (strcmp(ev->subsystem, "hidraw") != 0) {
+        return 0;
+    }
+
+    char path[DEVICE_PATH_MAX];
+    devnode_path(ev->devname, path, sizeof(path));
+
+    if (strcmp(ev->action, "remove") == 0) {
+        /* sysfs is already gone, match on the tracked path */
+        return detach_device(manager, path);
+    }
+
+    if (strcmp(ev->action, "add") == 0) {
+        /* Cheap VID/PID check from sysfs before paying for an enumeration */
+        uint16_t vid, pid;
+        if (!read_hid_id(ev->devpath, &vid, &pid) || !matches_filter(manager, vid, pid)) {
+            return 0;
+        }
+        return scan_devices(manager);
+    }
+
+    return 0;
+}
+
+/* Receive and dispatch all queued uevents */
+static int drain_uevents(mds_device_manager_t *manager) {
+    int fired = 0;
+    char buf[UEVENT_BUFFER_SIZE];
+
+    for (;;) {
+        struct sockaddr_nl addr;
+        struct iovec iov = { .iov_base = buf, .iov_len = sizeof(buf) - 1 };
+        char cred_msg[CMSG_SPACE(sizeof(struct ucred))];
+        struct msghdr msg = {
+            .msg_name = &addr,
+            .msg_namelen = sizeof(addr),
+            .msg_iov = &iov,
+            .msg_iovlen = 1,
+            .msg_control = cred_msg,
+            .msg_controllen = sizeof(cred_msg),
+        };
+
+        ssize_t len = recvmsg(manager->monitor_fd, &msg, 0);
+        if (len < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            if (errno == EINTR || errno == ENOBUFS) {
+                /* ENOBUFS: socket overran, keep going with what is queued */
+                continue;
+            }
+            return -errno;
+        }
+
+        /* Only trust the kernel (pid 0) and udevd running as root */
+        if (addr.nl_groups == 0) {
+            continue;
+        }
+        if (addr.nl_groups == UEVENT_GROUP_KERNEL && addr.nl_pid != 0) {
+            continue;
+        }
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        if (cmsg == NULL || cmsg->cmsg_type != SCM_CREDENTIALS) {
+            continue;
+        }
+        struct ucred cred;
+        memcpy(&cred, CMSG_DATA(cmsg), sizeof(cred));
+        if (cred.uid != 0) {
+            continue;
+        }
+
+        uevent_t ev;
+        if (!parse_uevent(buf, (size_t)len, &ev)) {
+            continue;
+        }
+
+        int ret = handle_uevent(manager, &ev);
+        if (ret > 0) {
+            fired += ret;
+        }
+    }
+
+    return fired;
+}
+
+static int open_monitor(void) {
+    int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                    NETLINK_KOBJECT_UEVENT);
+    if (fd < 0) {
+        return -errno;
+    }
+
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = UEVENT_GROUP_KERNEL | UEVENT_GROUP_UDEV;
+
+    int on = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_PASSCRED, &on, sizeof(on)) < 0 ||
+        bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        int err = -errno;
+        close(fd);
+        return err;
+    }
+
+    return fd;
+}
+
+#endif /* __linux__ */
+
+/* ============================================================================
+ * Device Manager API
+ * ========================================================================== */
+
+int mds_device_manager_create(const mds_device_manager_config_t *config,
+                              mds_device_manager_t **manager) {
+    if (config == NULL || config->callback == NULL || manager == NULL) {
+        return -EINVAL;
+    }
+
+    mds_device_manager_t *m = calloc(1, sizeof(mds_device_manager_t));
+    if (m == NULL) {
+        return -ENOMEM;
+    }
+
+    m->config = *config;
+    m->monitor_fd = -1;
+    m->wake_fd = -1;
+    mds_mutex_init(&m->lock);
+    mds_cond_init(&m->wake);
+
+#ifdef __linux__
+    /* Start monitoring before the initial scan so nothing slips through the gap.
+     * Without a monitor (e.g. netlink blocked) the manager falls back to rescans. */
+    int fd = open_monitor();
+    if (fd >= 0) {
+        m->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (m->wake_fd >= 0) {
+            m->monitor_fd = fd;
+        } else {
+            close(fd);
+        }
+    }
+#endif
+
+    int ret = scan_devices(m);
+    if (ret < 0) {
+        mds_device_manager_destroy(m);
+        return ret;
+    }
+
+    *manager = m;
+    return 0;
+}
+
+void mds_device_manager_destroy(mds_device_manager_t *manager) {
+    if (manager == NULL) {
+        return;
+    }
+
+    /* Wake a process() call that is waiting and let it return first */
+    mds_mutex_lock(&manager->lock);
+    manager->stopping = true;
+#ifdef __linux__
+    if (manager->wake_fd >= 0) {
+        uint64_t one = 1;
+        ssize_t n = write(manager->wake_fd, &one, sizeof(one));
+        (void)n;  /* Fails only if the wait is already woken */
+    }
+#endif
+    mds_cond_broadcast(&manager->wake);
+    while (manager->busy) {
+        mds_cond_wait(&manager->wake, &manager->lock);
+    }
+    mds_mutex_unlock(&manager->lock);
+
+    while (manager->num_devices > 0) {
+        detach_device(manager, manager->devices[manager->num_devices - 1].path);
+    }
+
+#ifdef __linux__
+    if (manager->monitor_fd >= 0) {
+        close(manager->monitor_fd);
+    }
+    if (manager->wake_fd >= 0) {
+        close(manager->wake_fd);
+    }
+#endif
+
+    mds_cond_destroy(&manager->wake);
+    mds_mutex_destroy(&manager->lock);
+    free(manager->devices);
+    free(manager);
+}
+
+int mds_device_manager_get_fd(mds_device_manager_t *manager) {
+    if (manager == NULL) {
+        return -EINVAL;
+    }
+
+    if (manager->monitor_fd < 0) {
+        return -ENOTSUP;
+    }
+
+    return manager->monitor_fd;
+}
+
+int mds_device_manager_scan(mds_device_manager_t *manager) {
+    if (manager == NULL) {
+        return -EINVAL;
+    }
+
+    return scan_devices(manager);
+}
+
+int mds_device_manager_process(mds_device_manager_t *manager, int timeout_ms) {
+    if (manager == NULL) {
+        return -EINVAL;
+    }
+
+    mds_mutex_lock(&manager->lock);
+    if (manager->stopping) {
+        mds_mutex_unlock(&manager->lock);
+        return 0;
+    }
+    manager->busy = true;
+
+    int ret;
+#ifdef __linux__
+    if (manager->monitor_fd >= 0) {
+        mds_mutex_unlock(&manager->lock);
+        struct pollfd pfds[2] = {
+            { .fd = manager->monitor_fd, .events = POLLIN },
+            { .fd = manager->wake_fd, .events = POLLIN },
+        };
+        ret = poll(pfds, 2, timeout_ms);
+        if (ret < 0) {
+            ret = (errno == EINTR) ? 0 : -errno;
+        } else if (ret > 0 && !(pfds[1].revents & POLLIN)) {
+            ret = drain_uevents(manager);
+        } else {
+            ret = 0;  /* Timeout or destroy */
+        }
+        mds_mutex_lock(&manager->lock);
+    } else
+#endif
+    {
+        /* No hotplug notifications - wait, then reconcile with a rescan */
+        if (timeout_ms != 0) {
+            mds_cond_timedwait(&manager->wake, &manager->lock, timeout_ms > 0 ? timeout_ms : 1000);
+        }
+        ret = 0;
+        if (!manager->stopping) {
+            mds_mutex_unlock(&manager->lock);
+            ret = scan_devices(manager);
+            mds_mutex_lock(&manager->lock);
+        }
+    }
+
+    manager->busy = false;
+    mds_cond_broadcast(&manager->wake);
+    mds_mutex_unlock(&manager->lock);
+    return ret;
+}
+
+size_t mds_device_manager_count(mds_device_manager_t *manager) {
+    if (manager == NULL) {
+        return 0;
+    }
+
+    return manager->num_devices;
+}
+
+int mds_device_manager_get(mds_device_manager_t *manager,
+                           size_t index,
+                           const char **path,
+                           mds_session_t **session) {
+    if (manager == NULL) {
+        return -EINVAL;
+    }
+
+    if (index >= manager->num_devices) {
+        return -ENOENT;
+    }
+
+    if (path) {
+        *path = manager->devices[index].path;
+    }
+    if (session) {
+        *session = manager->devices[index].session;
+    }
+    return 0;
+}
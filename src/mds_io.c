@@ -0,0 +1,847 @@
+/**
+ * @file mds_io.c
+ * @brief Asynchronous file I/O engine (io_uring or thread pool)
+ *
+ * Requests are staged by mds_io_write() / mds_io_fsync() and handed to the
+ * backend in batches:
+ *
+ * - Thread pool: each request goes to worker (fd % threads), so requests on
+ *   one descriptor run in order on one worker.
+ * - io_uring: requests wait in a list until their descriptor has no request
+ *   in flight and the ring has room, then become submission queue entries;
+ *   every dispatch ends with one io_uring_enter(). Requests on the same
+ *   descriptor dispatched together are linked (IOSQE_IO_LINK), so the kernel
+ *   runs them in order and a batch of appends to one file costs one call.
+ *   A short write breaks its chain: the kernel cancels the linked requests
+ *   behind it, so they go back to the waiting list (in queue order) and run
+ *   after the rest of the short write. The submission side is
+ *   only touched under the engine lock; the completion queue only by the
+ *   reaper thread. Each in-flight request owns a slot, and the slot number
+ *   (plus one) is the entry's user_data; 0 is the NOP that stops the reaper.
+ */
+
+#include "mds_bridge/mds_io.h"
+#include "mds_io_internal.h"
+#include "mds_log_internal.h"
+#include "mds_thread.h"
+#include "mds_time.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+
+#ifdef MDS_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#if !defined(__NR_io_uring_setup) || !defined(IORING_FEAT_RW_CUR_POS)
+#undef MDS_HAVE_IO_URING
+#endif
+#endif
+
+#define DEFAULT_QUEUE_DEPTH 64
+#define DEFAULT_THREADS     2
+#define DEFAULT_BATCH_SIZE  16
+#define MAX_QUEUE_DEPTH     4096
+#define MAX_THREADS         64
+
+typedef enum {
+    IO_OP_WRITE,
+    IO_OP_FSYNC,
+} io_op_t;
+
+typedef struct io_request {
+    struct io_request *next;
+    io_op_t op;
+    int fd;
+    const uint8_t *buf;
+    size_t len;
+    size_t done;
+    int64_t offset;
+    bool datasync;
+    mds_io_callback_t callback;
+    void *user_data;
+    uint64_t queued_ns;
+    uint64_t seq;                       /* Queue order */
+#ifdef MDS_HAVE_IO_URING
+    struct iovec iov[2];
+    unsigned int iov_count;
+    bool linked;                        /* The next entry is linked behind this one */
+    bool restart;                       /* Requeue if the kernel cancels it */
+#endif
+} io_request_t;
+
+typedef struct {
+    io_request_t *head;
+    io_request_t *tail;
+} io_queue_t;
+
+typedef struct {
+    mds_io_t *io;
+    mds_thread_t thread;
+    mds_cond_t cond;
+    io_queue_t queue;
+} io_worker_t;
+
+#ifdef MDS_HAVE_IO_URING
+typedef struct {
+    int fd;
+    unsigned int entries;
+    void *sq_ptr;
+    size_t sq_size;
+    void *cq_ptr;
+    size_t cq_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    mds_thread_t reaper;
+    io_request_t **inflight;            /* Slot -> request (NULL: free) */
+    unsigned int inflight_count;
+    io_queue_t waiting;                 /* Submitted, not yet in the ring */
+
+    /* Last entry per descriptor in the current dispatch (link targets) */
+    struct {
+        int fd;
+        struct io_uring_sqe *sqe;
+        io_request_t *req;
+    } *chains;
+    unsigned int chain_count;
+} io_ring_t;
+#endif
+
+struct mds_io {
+    mds_mutex_t lock;
+    mds_cond_t idle;
+    mds_io_config_t config;
+    mds_io_backend_t backend;
+
+    io_queue_t staged;                  /* Queued, not yet submitted */
+    unsigned int staged_count;
+    size_t pending;                     /* Queued or running */
+    uint64_t next_seq;
+    bool stopping;
+    mds_io_stats_t stats;
+
+    io_worker_t *workers;
+    unsigned int worker_count;
+#ifdef MDS_HAVE_IO_URING
+    io_ring_t ring;
+#endif
+};
+
+/* ============================================================================
+ * Common
+ * ========================================================================== */
+
+#ifdef MDS_IO_FAULT_INJECTION
+unsigned int mds_io_fault_short_writes;
+#endif
+
+static void queue_push(io_queue_t *queue, io_request_t *req) {
+    req->next = NULL;
+    if (queue->tail) {
+        queue->tail->next = req;
+    } else {
+        queue->head = req;
+    }
+    queue->tail = req;
+}
+
+static io_request_t *queue_pop(io_queue_t *queue) {
+    io_request_t *req = queue->head;
+    if (req) {
+        queue->head = req->next;
+        if (queue->head == NULL) {
+            queue->tail = NULL;
+        }
+    }
+    return req;
+}
+
+/* Run the callback and retire the request */
+static void request_complete(mds_io_t *io, io_request_t *req, int result) {
+    uint64_t latency_us = (mds_time_monotonic_ns() - req->queued_ns) / 1000;
+
+    if (req->callback) {
+        req->callback(result, req->user_data);
+    }
+
+    mds_mutex_lock(&io->lock);
+    if (result < 0) {
+        io->stats.failures++;
+    } else if (req->op == IO_OP_WRITE) {
+        io->stats.bytes_written += req->len;
+    }
+    if (latency_us > io->stats.max_latency_us) {
+        io->stats.max_latency_us = latency_us;
+    }
+    if (--io->pending == 0) {
+        mds_cond_broadcast(&io->idle);
+    }
+    mds_mutex_unlock(&io->lock);
+    free(req);
+}
+
+/* ============================================================================
+ * Thread Pool Backend
+ * ========================================================================== */
+
+static int request_run(io_request_t *req) {
+    if (req->op == IO_OP_FSYNC) {
+#ifdef __APPLE__
+        int ret = fsync(req->fd);
+#else
+        int ret = req->datasync ? fdatasync(req->fd) : fsync(req->fd);
+#endif
+        return ret == 0 ? 0 : -errno;
+    }
+
+    while (req->done < req->len) {
+        ssize_t n;
+        if (req->offset < 0) {
+            n = write(req->fd, req->buf + req->done, req->len - req->done);
+        } else {
+            n = pwrite(req->fd, req->buf + req->done, req->len - req->done,
+                       (off_t)(req->offset + (int64_t)req->done));
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        if (n == 0) {
+            return -EIO;
+        }
+        req->done += (size_t)n;
+    }
+    return (int)req->len;
+}
+
+static mds_thread_result_t MDS_THREAD_CALL worker_main(void *arg) {
+    io_worker_t *worker = (io_worker_t *)arg;
+    mds_io_t *io = worker->io;
+
+    for (;;) {
+        mds_mutex_lock(&io->lock);
+        io_request_t *req;
+        while ((req = queue_pop(&worker->queue)) == NULL && !io->stopping) {
+            mds_cond_wait(&worker->cond, &io->lock);
+        }
+        mds_mutex_unlock(&io->lock);
+
+        if (req == NULL) {
+            return 0;
+        }
+        request_complete(io, req, request_run(req));
+    }
+}
+
+static void threads_submit_locked(mds_io_t *io) {
+    io_request_t *req;
+    while ((req = queue_pop(&io->staged)) != NULL) {
+        io_worker_t *worker = &io->workers[(unsigned int)req->fd % io->worker_count];
+        queue_push(&worker->queue, req);
+        mds_cond_signal(&worker->cond);
+    }
+}
+
+static void threads_stop(mds_io_t *io) {
+    mds_mutex_lock(&io->lock);
+    io->stopping = true;
+    for (unsigned int i = 0; i < io->worker_count; i++) {
+        mds_cond_signal(&io->workers[i].cond);
+    }
+    mds_mutex_unlock(&io->lock);
+
+    for (unsigned int i = 0; i < io->worker_count; i++) {
+        mds_thread_join(io->workers[i].thread);
+        mds_cond_destroy(&io->workers[i].cond);
+    }
+    free(io->workers);
+    io->workers = NULL;
+    io->worker_count = 0;
+}
+
+static int threads_start(mds_io_t *io) {
+    io->workers = calloc(io->config.threads, sizeof(*io->workers));
+    if (io->workers == NULL) {
+        return -ENOMEM;
+    }
+
+    for (unsigned int i = 0; i < io->config.threads; i++) {
+        io_worker_t *worker = &io->workers[i];
+        worker->io = io;
+        mds_cond_init(&worker->cond);
+        int ret = mds_thread_create(&worker->thread, worker_main, worker);
+        if (ret < 0) {
+            mds_cond_destroy(&worker->cond);
+            threads_stop(io);
+            return ret;
+        }
+        io->worker_count++;
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * io_uring Backend
+ * ========================================================================== */
+
+#ifdef MDS_HAVE_IO_URING
+
+static int ring_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+                      unsigned int flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+/* Put a request (or the stop NOP) into the next submission queue entry */
+static struct io_uring_sqe *ring_prep(io_ring_t *ring, const io_request_t *req,
+                                      unsigned int slot) {
+    unsigned int tail = *ring->sq_tail;
+    unsigned int index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    if (req == NULL) {
+        sqe->opcode = IORING_OP_NOP;
+        sqe->user_data = 0;
+    } else if (req->op == IO_OP_WRITE) {
+        sqe->opcode = IORING_OP_WRITEV;
+        sqe->fd = req->fd;
+        sqe->addr = (uint64_t)(uintptr_t)req->iov;
+        sqe->len = req->iov_count;
+        sqe->off = req->offset < 0 ? (uint64_t)-1 : (uint64_t)(req->offset + (int64_t)req->done);
+        sqe->user_data = (uint64_t)slot + 1;
+    } else {
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fd = req->fd;
+        sqe->fsync_flags = req->datasync ? IORING_FSYNC_DATASYNC : 0;
+        sqe->user_data = (uint64_t)slot + 1;
+    }
+
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+}
+
+/* Hand entries the kernel has not consumed yet to the kernel */
+static void ring_submit_locked(mds_io_t *io) {
+    io_ring_t *ring = &io->ring;
+
+    for (;;) {
+        unsigned int unsubmitted = *ring->sq_tail -
+                                   __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+        if (unsubmitted == 0) {
+            return;
+        }
+
+        int ret = ring_enter(ring->fd, unsubmitted, 0, 0);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret < 0) {
+            /* Entries stay in the ring; the next dispatch retries */
+            mds_log(MDS_LOG_WARN, MDS_LOG_UPLOAD, "io_uring_enter failed: %s", strerror(errno));
+            return;
+        }
+        io->stats.submissions++;
+        if (ret == 0) {
+            return;
+        }
+    }
+}
+
+/* Point the iovec at the part of the write still to go */
+static void ring_set_iov(io_request_t *req) {
+    req->iov[0].iov_base = (void *)(uintptr_t)(req->buf + req->done);
+    req->iov[0].iov_len = req->len - req->done;
+    req->iov_count = 1;
+#ifdef MDS_IO_FAULT_INJECTION
+    if (req->op == IO_OP_WRITE && mds_io_fault_short_writes > 0 && req->iov[0].iov_len > 1) {
+        mds_io_fault_short_writes--;
+        req->iov[1].iov_base = (void *)(uintptr_t)16;
+        req->iov[1].iov_len = req->iov[0].iov_len - req->iov[0].iov_len / 2;
+        req->iov[0].iov_len /= 2;
+        req->iov_count = 2;
+    }
+#endif
+}
+
+/* Put a request the kernel cancelled back before later ones on its descriptor */
+static void ring_requeue(io_ring_t *ring, io_request_t *req) {
+    io_request_t *prev = NULL;
+    io_request_t *cur = ring->waiting.head;
+    while (cur != NULL && !(cur->fd == req->fd && cur->seq > req->seq)) {
+        prev = cur;
+        cur = cur->next;
+    }
+
+    req->linked = false;
+    req->restart = false;
+    req->next = cur;
+    if (prev) {
+        prev->next = req;
+    } else {
+        ring->waiting.head = req;
+    }
+    if (cur == NULL) {
+        ring->waiting.tail = req;
+    }
+}
+
+static bool ring_fd_busy(const io_ring_t *ring, int fd) {
+    for (unsigned int i = 0; i < ring->entries; i++) {
+        if (ring->inflight[i] != NULL && ring->inflight[i]->fd == fd) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Move waiting requests into the ring; one system call for all of them */
+static void ring_dispatch_locked(mds_io_t *io) {
+    io_ring_t *ring = &io->ring;
+    io_request_t *prev = NULL;
+    io_request_t *req = ring->waiting.head;
+    unsigned int slot = 0;
+
+    ring->chain_count = 0;
+    while (req != NULL && ring->inflight_count < ring->entries) {
+        io_request_t *next = req->next;
+
+        /* Link behind a request on the same descriptor from this dispatch,
+         * or wait for the one still in flight from an earlier dispatch */
+        unsigned int chain = 0;
+        while (chain < ring->chain_count && ring->chains[chain].fd != req->fd) {
+            chain++;
+        }
+        if (chain == ring->chain_count && ring_fd_busy(ring, req->fd)) {
+            prev = req;
+            req = next;
+            continue;
+        }
+
+        if (prev) {
+            prev->next = next;
+        } else {
+            ring->waiting.head = next;
+        }
+        if (ring->waiting.tail == req) {
+            ring->waiting.tail = prev;
+        }
+
+        while (ring->inflight[slot] != NULL) {
+            slot++;
+        }
+        ring->inflight[slot] = req;
+        ring->inflight_count++;
+        ring_set_iov(req);
+
+        struct io_uring_sqe *sqe = ring_prep(ring, req, slot);
+        if (chain < ring->chain_count) {
+            ring->chains[chain].sqe->flags |= IOSQE_IO_LINK;
+            ring->chains[chain].req->linked = true;
+        } else {
+            ring->chains[chain].fd = req->fd;
+            ring->chain_count++;
+        }
+        ring->chains[chain].sqe = sqe;
+        ring->chains[chain].req = req;
+        req = next;
+    }
+
+    ring_submit_locked(io);
+}
+
+static mds_thread_result_t MDS_THREAD_CALL reaper_main(void *arg) {
+    mds_io_t *io = (mds_io_t *)arg;
+    io_ring_t *ring = &io->ring;
+    bool stop = false;
+
+    while (!stop) {
+        if (ring_enter(ring->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+            mds_log(MDS_LOG_ERROR, MDS_LOG_UPLOAD, "io_uring wait failed: %s", strerror(errno));
+            usleep(10000);
+        }
+
+        unsigned int head = *ring->cq_head;
+        unsigned int tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            const struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            uint64_t user_data = cqe->user_data;
+            int res = cqe->res;
+            head++;
+            __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+            if (user_data == 0) {
+                stop = true;
+                continue;
+            }
+
+            unsigned int slot = (unsigned int)(user_data - 1);
+            mds_mutex_lock(&io->lock);
+            io_request_t *req = ring->inflight[slot];
+            if (req->op == IO_OP_WRITE && res > 0 && req->done + (size_t)res < req->len) {
+                /* Short write: continue in the same slot. If it headed a
+                 * link, the kernel cancels the rest of the chain; those
+                 * requests are requeued rather than failed. */
+                if (req->linked) {
+                    for (unsigned int i = 0; i < ring->entries; i++) {
+                        if (ring->inflight[i] != NULL && ring->inflight[i] != req &&
+                            ring->inflight[i]->fd == req->fd) {
+                            ring->inflight[i]->restart = true;
+                        }
+                    }
+                    req->linked = false;
+                }
+                req->done += (size_t)res;
+                ring_set_iov(req);
+                ring_prep(ring, req, slot);
+                ring_submit_locked(io);
+                mds_mutex_unlock(&io->lock);
+                continue;
+            }
+            ring->inflight[slot] = NULL;
+            ring->inflight_count--;
+            if (res == -ECANCELED && req->restart) {
+                ring_requeue(ring, req);
+                ring_dispatch_locked(io);
+                mds_mutex_unlock(&io->lock);
+                continue;
+            }
+            mds_mutex_unlock(&io->lock);
+
+            int result = res;
+            if (req->op == IO_OP_WRITE && res >= 0) {
+                result = res == 0 ? -EIO : (int)req->len;
+            }
+            request_complete(io, req, result);
+
+            mds_mutex_lock(&io->lock);
+            ring_dispatch_locked(io);
+            mds_mutex_unlock(&io->lock);
+        }
+    }
+    return 0;
+}
+
+static void ring_unmap(io_ring_t *ring) {
+    if (ring->sqes) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ptr && ring->cq_ptr != ring->sq_ptr) {
+        munmap(ring->cq_ptr, ring->cq_size);
+    }
+    if (ring->sq_ptr) {
+        munmap(ring->sq_ptr, ring->sq_size);
+    }
+    close(ring->fd);
+    free(ring->inflight);
+    free(ring->chains);
+}
+
+static int ring_start(mds_io_t *io) {
+    io_ring_t *ring = &io->ring;
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    ring->fd = (int)syscall(__NR_io_uring_setup, io->config.queue_depth, &params);
+    if (ring->fd < 0) {
+        return -errno;
+    }
+    if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+        close(ring->fd);
+        return -ENOTSUP;  /* Before Linux 5.6: no writes at the current position */
+    }
+
+    ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_size > ring->sq_size) {
+            ring->sq_size = ring->cq_size;
+        }
+        ring->cq_size = ring->sq_size;
+    }
+
+    ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        ring->sq_ptr = NULL;
+    } else if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    } else {
+        ring->cq_ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        ring->cq_ptr = ring->cq_ptr == MAP_FAILED ? NULL : ring->cq_ptr;
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    if (ring->cq_ptr) {
+        ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+        ring->sqes = ring->sqes == MAP_FAILED ? NULL : ring->sqes;
+    }
+    ring->entries = params.sq_entries;
+    ring->inflight = calloc(ring->entries, sizeof(*ring->inflight));
+    ring->chains = calloc(ring->entries, sizeof(*ring->chains));
+    if (ring->sqes == NULL || ring->inflight == NULL || ring->chains == NULL) {
+        ring_unmap(ring);
+        return -ENOMEM;
+    }
+
+    uint8_t *sq = (uint8_t *)ring->sq_ptr;
+    uint8_t *cq = (uint8_t *)ring->cq_ptr;
+    ring->sq_head = (unsigned int *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned int *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned int *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned int *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned int *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned int *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned int *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    int ret = mds_thread_create(&ring->reaper, reaper_main, io);
+    if (ret < 0) {
+        ring_unmap(ring);
+        return ret;
+    }
+    return 0;
+}
+
+static void ring_stop(mds_io_t *io) {
+    mds_mutex_lock(&io->lock);
+    io->stopping = true;
+    ring_prep(&io->ring, NULL, 0);
+    ring_submit_locked(io);
+    mds_mutex_unlock(&io->lock);
+
+    mds_thread_join(io->ring.reaper);
+    ring_unmap(&io->ring);
+}
+
+#endif /* MDS_HAVE_IO_URING */
+
+/* ============================================================================
+ * Public API
+ * ========================================================================== */
+
+static void submit_locked(mds_io_t *io) {
+    if (io->staged.head == NULL) {
+        return;
+    }
+
+#ifdef MDS_HAVE_IO_URING
+    if (io->backend == MDS_IO_BACKEND_IO_URING) {
+        io_ring_t *ring = &io->ring;
+        if (ring->waiting.tail) {
+            ring->waiting.tail->next = io->staged.head;
+        } else {
+            ring->waiting.head = io->staged.head;
+        }
+        ring->waiting.tail = io->staged.tail;
+        io->staged.head = io->staged.tail = NULL;
+        io->staged_count = 0;
+        ring_dispatch_locked(io);
+        return;
+    }
+#endif
+
+    threads_submit_locked(io);
+    io->staged_count = 0;
+    io->stats.submissions++;
+}
+
+static int request_queue(mds_io_t *io, io_request_t *req) {
+    req->queued_ns = mds_time_monotonic_ns();
+
+    mds_mutex_lock(&io->lock);
+    if (io->stopping) {
+        mds_mutex_unlock(&io->lock);
+        free(req);
+        return -EINVAL;
+    }
+    req->seq = io->next_seq++;
+    queue_push(&io->staged, req);
+    io->pending++;
+    io->stats.requests++;
+    if (++io->staged_count >= io->config.batch_size) {
+        submit_locked(io);
+    }
+    mds_mutex_unlock(&io->lock);
+    return 0;
+}
+
+void mds_io_default_config(mds_io_config_t *config) {
+    if (config == NULL) {
+        return;
+    }
+
+    memset(config, 0, sizeof(*config));
+    config->backend = MDS_IO_BACKEND_AUTO;
+    config->queue_depth = DEFAULT_QUEUE_DEPTH;
+    config->threads = DEFAULT_THREADS;
+    config->batch_size = DEFAULT_BATCH_SIZE;
+}
+
+mds_io_t *mds_io_create(const mds_io_config_t *config) {
+    mds_io_config_t defaults;
+    if (config == NULL) {
+        mds_io_default_config(&defaults);
+        config = &defaults;
+    }
+    if (config->queue_depth == 0 || config->queue_depth > MAX_QUEUE_DEPTH ||
+        config->threads == 0 || config->threads > MAX_THREADS || config->batch_size == 0 ||
+        config->backend > MDS_IO_BACKEND_THREADS) {
+        return NULL;
+    }
+
+    mds_io_t *io = calloc(1, sizeof(*io));
+    if (io == NULL) {
+        return NULL;
+    }
+    mds_mutex_init(&io->lock);
+    mds_cond_init(&io->idle);
+    io->config = *config;
+
+    int ret = -ENOTSUP;
+#ifdef MDS_HAVE_IO_URING
+    if (config->backend != MDS_IO_BACKEND_THREADS) {
+        ret = ring_start(io);
+        if (ret == 0) {
+            io->backend = MDS_IO_BACKEND_IO_URING;
+        } else if (config->backend == MDS_IO_BACKEND_AUTO) {
+            mds_log(MDS_LOG_INFO, MDS_LOG_UPLOAD, "io_uring unavailable (%s), using threads",
+                    strerror(-ret));
+        }
+    }
+#endif
+    if (ret != 0 && config->backend != MDS_IO_BACKEND_IO_URING) {
+        ret = threads_start(io);
+        io->backend = MDS_IO_BACKEND_THREADS;
+    }
+
+    if (ret != 0) {
+        mds_cond_destroy(&io->idle);
+        mds_mutex_destroy(&io->lock);
+        free(io);
+        return NULL;
+    }
+    return io;
+}
+
+void mds_io_destroy(mds_io_t *io) {
+    if (io == NULL) {
+        return;
+    }
+
+    mds_io_drain(io);
+#ifdef MDS_HAVE_IO_URING
+    if (io->backend == MDS_IO_BACKEND_IO_URING) {
+        ring_stop(io);
+    } else
+#endif
+    {
+        threads_stop(io);
+    }
+
+    mds_cond_destroy(&io->idle);
+    mds_mutex_destroy(&io->lock);
+    free(io);
+}
+
+mds_io_backend_t mds_io_get_backend(mds_io_t *io) {
+    return io ? io->backend : MDS_IO_BACKEND_AUTO;
+}
+
+const char *mds_io_backend_name(mds_io_backend_t backend) {
+    switch (backend) {
+        case MDS_IO_BACKEND_IO_URING: return "io_uring";
+        case MDS_IO_BACKEND_THREADS:  return "threads";
+        default:                      return "auto";
+    }
+}
+
+int mds_io_write(mds_io_t *io, int fd, const void *buf, size_t len, int64_t offset,
+                 mds_io_callback_t callback, void *user_data) {
+    if (io == NULL || fd < 0 || buf == NULL || len == 0 || len > INT_MAX) {
+        return -EINVAL;
+    }
+
+    io_request_t *req = calloc(1, sizeof(*req));
+    if (req == NULL) {
+        return -ENOMEM;
+    }
+    req->op = IO_OP_WRITE;
+    req->fd = fd;
+    req->buf = (const uint8_t *)buf;
+    req->len = len;
+    req->offset = offset < 0 ? -1 : offset;
+    req->callback = callback;
+    req->user_data = user_data;
+    return request_queue(io, req);
+}
+
+int mds_io_fsync(mds_io_t *io, int fd, bool datasync,
+                 mds_io_callback_t callback, void *user_data) {
+    if (io == NULL || fd < 0) {
+        return -EINVAL;
+    }
+
+    io_request_t *req = calloc(1, sizeof(*req));
+    if (req == NULL) {
+        return -ENOMEM;
+    }
+    req->op = IO_OP_FSYNC;
+    req->fd = fd;
+    req->datasync = datasync;
+    req->callback = callback;
+    req->user_data = user_data;
+    return request_queue(io, req);
+}
+
+int mds_io_submit(mds_io_t *io) {
+    if (io == NULL) {
+        return -EINVAL;
+    }
+
+    mds_mutex_lock(&io->lock);
+    submit_locked(io);
+    mds_mutex_unlock(&io->lock);
+    return 0;
+}
+
+int mds_io_drain(mds_io_t *io) {
+    if (io == NULL) {
+        return -EINVAL;
+    }
+
+    mds_mutex_lock(&io->lock);
+    submit_locked(io);
+    while (io->pending > 0) {
+        mds_cond_wait(&io->idle, &io->lock);
+    }
+    mds_mutex_unlock(&io->lock);
+    return 0;
+}
+
+int mds_io_get_stats(mds_io_t *io, mds_io_stats_t *stats) {
+    if (io == NULL || stats == NULL) {
+        return -EINVAL;
+    }
+
+    mds_mutex_lock(&io->lock);
+    *stats = io->stats;
+    stats->pending = io->pending;
+    mds_mutex_unlock(&io->lock);
+    return 0;
+}
@@ -0,0 +1,32 @@
+/**
+ * @file mds_io_internal.h
+ * @brief Fault injection hooks for the I/O engine tests
+ *
+ * This header is for internal use only and should not be installed as a public API.
+ */
+
+#ifndef MDS_IO_INTERNAL_H
+#define MDS_IO_INTERNAL_H
+
+#ifdef MDS_IO_FAULT_INJECTION
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Number of upcoming io_uring writes to cut short
+ *
+ * Each such write is submitted with its second half pointing at an unmapped
+ * address, so the kernel writes the first half and completes it short.
+ * Read and decremented under the engine lock; set it before queueing.
+ */
+extern unsigned int mds_io_fault_short_writes;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MDS_IO_FAULT_INJECTION */
+
+#endif /* MDS_IO_INTERNAL_H */
@@ -0,0 +1,296 @@
+/**
+ * @file mds_log.c
+ * @brief Pluggable, rate-limited logger
+ *
+ * Concurrency model:
+ * - Configuration (level, rate limit, deferred flag) lives in atomics, so the
+ *   level check on the hot path is a single load.
+ * - Rate limiting uses a fixed one-second window per subsystem. The thread
+ *   that observes a new window resets the counters (CAS on the window) and
+ *   reports how many messages were suppressed in the previous one.
+ * - The deferred ring is a bounded multi-producer queue with per-slot
+ *   sequence numbers: producers claim a slot with a CAS on the enqueue
+ *   position and publish it by bumping the slot sequence, so logging never
+ *   takes a lock. mds_log_flush() is the only consumer and is serialized by
+ *   g_flush_lock.
+ * - The handler and its user data are published together under
+ *   g_handler_lock; delivery copies the pair under it and calls the handler
+ *   outside, so a handler may log or replace itself.
+ */
+
+#include "mds_log_internal.h"
+#include "mds_thread.h"
+#include "mds_time.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#define LOG_RING_SIZE       128   /* Deferred messages (power of two) */
+#define DEFAULT_RATE_LIMIT  20    /* Messages per second per subsystem */
+
+/* Deferred ring slot */
+typedef struct {
+    mds_atomic_int_t sequence;          /* Slot state (see ring_push/ring_pop) */
+    mds_log_level_t level;
+    mds_log_subsystem_t subsystem;
+    char message[MDS_LOG_MAX_MESSAGE_LEN];
+} log_slot_t;
+
+/* Per-subsystem rate limiter */
+typedef struct {
+    mds_atomic_int_t window;            /* Current window (monotonic seconds) */
+    mds_atomic_int_t count;             /* Messages logged in the window */
+    mds_atomic_int_t suppressed;        /* Messages suppressed in the window */
+} rate_limit_t;
+
+static mds_atomic_int_t g_level = MDS_LOG_WARN;
+static mds_atomic_int_t g_rate_limit = DEFAULT_RATE_LIMIT;
+static mds_atomic_int_t g_deferred = 0;
+static mds_log_handler_t g_handler = NULL;         /* Guarded by g_handler_lock */
+static void *g_handler_user_data = NULL;            /* Guarded by g_handler_lock */
+static mds_mutex_t g_handler_lock = MDS_MUTEX_INITIALIZER;
+
+static rate_limit_t g_rate[MDS_LOG_SUBSYSTEM_COUNT];
+static mds_atomic_int_t g_total_suppressed = 0;
+static mds_atomic_int_t g_total_dropped = 0;
+
+static log_slot_t g_ring[LOG_RING_SIZE];
+static mds_atomic_int_t g_enqueue_pos = 0;
+static int g_dequeue_pos = 0;           /* Guarded by g_flush_lock */
+static bool g_ring_ready = false;       /* Guarded by g_flush_lock */
+static mds_mutex_t g_flush_lock = MDS_MUTEX_INITIALIZER;
+
+/* ============================================================================
+ * Delivery
+ * ========================================================================== */
+
+static void default_handler(mds_log_level_t level, mds_log_subsystem_t subsystem,
+                            const char *message, void *user_data) {
+    (void)user_data;
+    fprintf(stderr, "[MDS %s] %s: %s\n",
+            mds_log_subsystem_name(subsystem), mds_log_level_name(level), message);
+}
+
+static void call_handler(mds_log_level_t level, mds_log_subsystem_t subsystem,
+                         const char *message) {
+    mds_mutex_lock(&g_handler_lock);
+    mds_log_handler_t handler = g_handler ? g_handler : default_handler;
+    void *user_data = g_handler_user_data;
+    mds_mutex_unlock(&g_handler_lock);
+
+    handler(level, subsystem, message, user_data);
+}
+
+/* Positions wrap; compare them as signed distances */
+static int ring_distance(int a, int b) {
+    return (int)((unsigned int)a - (unsigned int)b);
+}
+
+static int ring_next(int pos, int delta) {
+    return (int)((unsigned int)pos + (unsigned int)delta);
+}
+
+/* Queue a message; returns false if the ring is full */
+static bool ring_push(mds_log_level_t level, mds_log_subsystem_t subsystem,
+                      const char *message) {
+    int pos = mds_atomic_load(&g_enqueue_pos);
+
+    for (;;) {
+        log_slot_t *slot = &g_ring[(unsigned int)pos & (LOG_RING_SIZE - 1)];
+        int diff = ring_distance(mds_atomic_load(&slot->sequence), pos);
+
+        if (diff == 0) {
+            /* Slot is free for this position - try to claim it */
+            if (mds_atomic_cas(&g_enqueue_pos, pos, ring_next(pos, 1))) {
+                slot->level = level;
+                slot->subsystem = subsystem;
+                memcpy(slot->message, message, strlen(message) + 1);
+                mds_atomic_store(&slot->sequence, ring_next(pos, 1));
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;  /* Consumer has not freed the slot yet */
+        }
+
+        pos = mds_atomic_load(&g_enqueue_pos);
+    }
+}
+
+/* Take the oldest message (caller holds g_flush_lock) */
+static bool ring_pop(mds_log_level_t *level, mds_log_subsystem_t *subsystem,
+                     char *message) {
+    log_slot_t *slot = &g_ring[(unsigned int)g_dequeue_pos & (LOG_RING_SIZE - 1)];
+
+    if (ring_distance(mds_atomic_load(&slot->sequence), ring_next(g_dequeue_pos, 1)) != 0) {
+        return false;  /* Empty, or the producer is still writing */
+    }
+
+    *level = slot->level;
+    *subsystem = slot->subsystem;
+    memcpy(message, slot->message, MDS_LOG_MAX_MESSAGE_LEN);
+
+    mds_atomic_store(&slot->sequence, ring_next(g_dequeue_pos, LOG_RING_SIZE));
+    g_dequeue_pos = ring_next(g_dequeue_pos, 1);
+    return true;
+}
+
+static void deliver(mds_log_level_t level, mds_log_subsystem_t subsystem,
+                    const char *message) {
+    if (!mds_atomic_load(&g_deferred)) {
+        call_handler(level, subsystem, message);
+        return;
+    }
+
+    if (!ring_push(level, subsystem, message)) {
+        mds_atomic_add(&g_total_dropped, 1);
+    }
+}
+
+/* ============================================================================
+ * Rate Limiting
+ * ========================================================================== */
+
+static bool rate_limit_allow(mds_log_subsystem_t subsystem) {
+    int limit = mds_atomic_load(&g_rate_limit);
+    if (limit <= 0) {
+        return true;
+    }
+
+    rate_limit_t *rate = &g_rate[subsystem];
+    int now = (int)(mds_time_monotonic_ms() / 1000);
+    int window = mds_atomic_load(&rate->window);
+
+    if (window != now && mds_atomic_cas(&rate->window, window, now)) {
+        mds_atomic_store(&rate->count, 0);
+
+        int missed = mds_atomic_exchange(&rate->suppressed, 0);
+        if (missed > 0) {
+            char message[MDS_LOG_MAX_MESSAGE_LEN];
+            snprintf(message, sizeof(message), "%d messages suppressed by rate limit", missed);
+            deliver(MDS_LOG_WARN, subsystem, message);
+        }
+    }
+
+    if (mds_atomic_add(&rate->count, 1) > limit) {
+        mds_atomic_add(&rate->suppressed, 1);
+        mds_atomic_add(&g_total_suppressed, 1);
+        return false;
+    }
+
+    return true;
+}
+
+/* ============================================================================
+ * Public API
+ * ========================================================================== */
+
+void mds_log(mds_log_level_t level, mds_log_subsystem_t subsystem,
+             const char *fmt, ...) {
+    if (level == MDS_LOG_OFF || (int)level > mds_atomic_load(&g_level) ||
+        (unsigned int)subsystem >= MDS_LOG_SUBSYSTEM_COUNT) {
+        return;
+    }
+
+    if (!rate_limit_allow(subsystem)) {
+        return;
+    }
+
+    char message[MDS_LOG_MAX_MESSAGE_LEN];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(message, sizeof(message), fmt, args);
+    va_end(args);
+
+    deliver(level, subsystem, message);
+}
+
+void mds_log_set_handler(mds_log_handler_t handler, void *user_data) {
+    mds_mutex_lock(&g_handler_lock);
+    g_handler = handler;
+    g_handler_user_data = user_data;
+    mds_mutex_unlock(&g_handler_lock);
+}
+
+void mds_log_set_level(mds_log_level_t level) {
+    mds_atomic_store(&g_level, (int)level);
+}
+
+mds_log_level_t mds_log_get_level(void) {
+    return (mds_log_level_t)mds_atomic_load(&g_level);
+}
+
+void mds_log_set_rate_limit(unsigned int max_per_second) {
+    mds_atomic_store(&g_rate_limit, (int)max_per_second);
+
+    /* The new limit applies from now on, not to messages already counted */
+    for (int i = 0; i < MDS_LOG_SUBSYSTEM_COUNT; i++) {
+        mds_atomic_store(&g_rate[i].count, 0);
+    }
+}
+
+void mds_log_set_deferred(bool deferred) {
+    if (!deferred) {
+        mds_atomic_store(&g_deferred, 0);
+        mds_log_flush();
+        return;
+    }
+
+    mds_mutex_lock(&g_flush_lock);
+    if (!g_ring_ready) {
+        for (int i = 0; i < LOG_RING_SIZE; i++) {
+            mds_atomic_store(&g_ring[i].sequence, i);
+        }
+        mds_atomic_store(&g_enqueue_pos, 0);
+        g_dequeue_pos = 0;
+        g_ring_ready = true;
+    }
+    mds_mutex_unlock(&g_flush_lock);
+
+    mds_atomic_store(&g_deferred, 1);
+}
+
+size_t mds_log_flush(void) {
+    size_t delivered = 0;
+    mds_log_level_t level;
+    mds_log_subsystem_t subsystem;
+    char message[MDS_LOG_MAX_MESSAGE_LEN];
+
+    mds_mutex_lock(&g_flush_lock);
+    if (g_ring_ready) {
+        while (ring_pop(&level, &subsystem, message)) {
+            call_handler(level, subsystem, message);
+            delivered++;
+        }
+    }
+    mds_mutex_unlock(&g_flush_lock);
+
+    return delivered;
+}
+
+void mds_log_get_stats(mds_log_stats_t *stats) {
+    if (stats == NULL) {
+        return;
+    }
+
+    stats->suppressed = (uint64_t)(unsigned int)mds_atomic_load(&g_total_suppressed);
+    stats->dropped = (uint64_t)(unsigned int)mds_atomic_load(&g_total_dropped);
+}
+
+const char *mds_log_level_name(mds_log_level_t level) {
+    switch (level) {
+        case MDS_LOG_ERROR: return "error";
+        case MDS_LOG_WARN:  return "warn";
+        case MDS_LOG_INFO:  return "info";
+        case MDS_LOG_DEBUG: return "debug";
+        default:            return "off";
+    }
+}
+
+const char *mds_log_subsystem_name(mds_log_subsystem_t subsystem) {
+    switch (subsystem) {
+        case MDS_LOG_PROTOCOL: return "protocol";
+        case MDS_LOG_HID:      return "hid";
+        case MDS_LOG_UPLOAD:   return "upload";
+        default:               return "unknown";
+    }
+}
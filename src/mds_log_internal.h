@@ -0,0 +1,41 @@
+/**
+ * @file mds_log_internal.h
+ * @brief Internal logging entry point used by the library modules
+ *
+ * This header is for internal use only and should not be installed as a public API.
+ */
+
+#ifndef MDS_LOG_INTERNAL_H
+#define MDS_LOG_INTERNAL_H
+
+#include "mds_bridge/mds_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define MDS_LOG_PRINTF_FORMAT(fmt_index, args_index) \
+    __attribute__((format(printf, fmt_index, args_index)))
+#else
+#define MDS_LOG_PRINTF_FORMAT(fmt_index, args_index)
+#endif
+
+/**
+ * Log a message
+ *
+ * Cheap when the level is filtered out or the subsystem is rate limited:
+ * the message is only formatted once it is going to be delivered or queued.
+ *
+ * @param level Message level
+ * @param subsystem Producing subsystem
+ * @param fmt printf-style format string
+ */
+void mds_log(mds_log_level_t level, mds_log_subsystem_t subsystem,
+             const char *fmt, ...) MDS_LOG_PRINTF_FORMAT(3, 4);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MDS_LOG_INTERNAL_H */
@@ -5,21 +5,72 @@
 
 #include "mds_bridge/mds_protocol.h"
 #include "mds_bridge/mds_backend.h"
+#include "mds_bridge/mds_arena.h"
 #include "mds_backend_hid_internal.h"
+#include "mds_sink_internal.h"
+#include "mds_log_internal.h"
+#include "mds_time.h"
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
-#include <stdio.h>
+
+/* Packet held back for reordering; data points into the session's held slab */
+typedef struct {
+    mds_chunk_info_t info;
+    size_t len;
+    uint8_t *data;
+} mds_held_packet_t;
 
 /* MDS Session structure */
 struct mds_session {
+    mds_arena_t *arena;               /* Holds the session and its tables */
     mds_backend_t *backend;
-    uint8_t last_sequence;
     bool streaming_enabled;
 
+    /* Sequence accounting */
+    bool have_sequence;               /* last_sequence is valid */
+    uint8_t last_sequence;            /* Newest sequence seen */
+    mds_session_stats_t stats;
+    mds_sequence_callback_t sequence_callback;
+    void *sequence_user_data;
+
+    /* Loss recovery (MDS_FEATURE_STREAM_RETRANSMIT) */
+    bool retransmit_enabled;
+    int retransmit_timeout_ms;
+    bool deliver_started;             /* deliver_next is valid */
+    uint8_t deliver_next;             /* Next sequence to upload */
+    uint32_t held_mask;               /* Bit n set = held[n] waits for a missing packet */
+    uint32_t done_mask;               /* Bit n set = sequence n (behind deliver_next) uploaded or given up on */
+    int64_t hold_deadline_ms;         /* Give up on missing packets after this */
+    mds_held_packet_t *held;          /* One slot per sequence number */
+    size_t held_capacity;             /* Data bytes per held slot */
+
+    /* Credit-based flow control (MDS_FEATURE_STREAM_CREDITS) */
+    uint8_t credit_window;            /* 0 = flow control off */
+    uint8_t credit_granted;           /* Credit sent with the last grant */
+    uint8_t credit_used;              /* Packets received since the last grant */
+    int64_t credit_granted_ms;        /* Time of the last grant */
+
+    /* Large-report mode (MDS_FEATURE_STREAM_LARGE_REPORTS) */
+    bool large_reports;
+
+    /* Chunk classification, in arrival order */
+    mds_chunk_classifier_t classifier;
+
+    /* Stream resume (MDS_FEATURE_STREAM_RESUME) */
+    bool resume_enabled;
+    bool resume_stalled;              /* Acknowledged offset no longer trustworthy */
+    uint32_t resume_offset;           /* Acknowledged chunk data bytes */
+
     /* Chunk upload */
+    mds_sink_set_t sinks;
+    mds_sink_t *upload_sink;          /* Sink of the upload callback */
     mds_chunk_upload_callback_t upload_callback;
+    mds_chunk_upload_callback_ex_t upload_callback_ex;
     void *upload_user_data;
+    uint32_t uploads_ok;              /* Packets accepted by the required sinks */
+    uint32_t uploads_failed;          /* Packets rejected by a required sink */
+    uint64_t upload_bytes_failed;
 };
 
 
@@ -31,49 +82,170 @@ static uint8_t mds_extract_sequence(uint8_t byte0) {
     return byte0 & MDS_SEQUENCE_MASK;
 }
 
-static bool mds_validate_sequence(uint8_t prev_seq, uint8_t new_seq) {
-    /* Expected next sequence */
-    uint8_t expected = (prev_seq + 1) & MDS_SEQUENCE_MASK;
+/*
+ * With retransmit ordering: true if a sequence that looks like it is behind
+ * deliver_next was neither uploaded, given up on nor held, so the stream
+ * jumped ahead by more than half the sequence space.
+ */
+static bool mds_deliver_is_jump(const mds_session_t *session, uint8_t sequence) {
+    if (!session->retransmit_enabled || !session->deliver_started) {
+        return false;
+    }
+
+    uint8_t ahead = (sequence - session->deliver_next) & MDS_SEQUENCE_MASK;
+    uint32_t bit = 1u << sequence;
+    return ahead > MDS_SEQUENCE_MAX / 2 &&
+           !(session->done_mask & bit) && !(session->held_mask & bit);
+}
+
+/*
+ * Size the held slots for the payload limit of normal or large reports,
+ * keeping packets already held. The slots come from the session arena; a
+ * slab outgrown by switching to large reports stays there until the session
+ * is destroyed.
+ */
+static int mds_held_reserve(mds_session_t *session, bool large_reports) {
+    size_t capacity = large_reports ? MDS_MAX_STREAM_DATA_LEN : MDS_MAX_CHUNK_DATA_LEN;
+    if (session->held != NULL && session->held_capacity >= capacity) {
+        return 0;
+    }
+
+    mds_held_packet_t *held = mds_arena_calloc(session->arena, MDS_SEQUENCE_MAX + 1,
+                                               sizeof(mds_held_packet_t));
+    uint8_t *slab = mds_arena_alloc(session->arena, (MDS_SEQUENCE_MAX + 1) * capacity);
+    if (held == NULL || slab == NULL) {
+        return -ENOMEM;
+    }
+
+    for (unsigned int i = 0; i <= MDS_SEQUENCE_MAX; i++) {
+        held[i].data = slab + i * capacity;
+        if (session->held_mask & (1u << i)) {
+            held[i].info = session->held[i].info;
+            held[i].len = session->held[i].len;
+            memcpy(held[i].data, session->held[i].data, held[i].len);
+        }
+    }
 
-    return (new_seq == expected);
+    session->held = held;
+    session->held_capacity = capacity;
+    return 0;
 }
 
+/*
+ * Classify a received sequence number and update the session counters.
+ * Returns true (and fills event) if the packet was not the expected one.
+ */
+static bool mds_track_sequence(mds_session_t *session, uint8_t sequence,
+                               mds_sequence_event_t *event) {
+    session->stats.packets_received++;
+
+    if (!session->have_sequence) {
+        session->have_sequence = true;
+        session->last_sequence = sequence;
+        return false;
+    }
+
+    uint8_t expected = (session->last_sequence + 1) & MDS_SEQUENCE_MASK;
+    uint8_t ahead = (sequence - expected) & MDS_SEQUENCE_MASK;
+    if (ahead == 0) {
+        session->last_sequence = sequence;
+        return false;
+    }
+
+    event->expected = expected;
+    event->received = sequence;
+    event->missing = 0;
+
+    if (sequence == session->last_sequence) {
+        event->type = MDS_SEQUENCE_EVENT_DUPLICATE;
+        session->stats.duplicates++;
+    } else if (ahead <= MDS_SEQUENCE_MAX / 2 || mds_deliver_is_jump(session, sequence)) {
+        /* Skipped ahead - the packets in between count as lost */
+        event->type = MDS_SEQUENCE_EVENT_GAP;
+        event->missing = ahead;
+        session->stats.gaps++;
+        session->stats.lost_packets += ahead;
+        session->last_sequence = sequence;
+    } else {
+        /* Behind the newest packet - a late arrival of one counted as lost */
+        event->type = MDS_SEQUENCE_EVENT_REORDER;
+        session->stats.reorders++;
+        if (session->stats.lost_packets > 0) {
+            session->stats.lost_packets--;
+        }
+    }
+
+    mds_log(MDS_LOG_WARN, MDS_LOG_PROTOCOL, "Sequence error: expected %u, got %u",
+            expected, sequence);
+
+    if (session->sequence_callback) {
+        session->sequence_callback(session, event, session->sequence_user_data);
+    }
+    return true;
+}
+
+/* Stop advancing the resume offset until the stream is re-enabled */
+static void mds_stall_resume(mds_session_t *session, const char *reason) {
+    if (session->resume_enabled && !session->resume_stalled) {
+        session->resume_stalled = true;
+        mds_log(MDS_LOG_WARN, MDS_LOG_PROTOCOL, "Resume offset held at %u after %s",
+                (unsigned int)session->resume_offset, reason);
+    }
+}
+
+static void mds_advance_resume(mds_session_t *session, size_t length) {
+    if (session->resume_enabled && !session->resume_stalled) {
+        session->resume_offset += (uint32_t)length;
+    }
+}
+
+/*
+ * Parse a stream packet. Standard packets carry an 8-bit length (byte 1),
+ * large-report packets a 16-bit little-endian length (bytes 1-2).
+ */
 static int mds_parse_stream_packet(const uint8_t *buffer, size_t buffer_len,
-                                    mds_stream_packet_t *packet) {
+                                    bool large, mds_stream_packet_t *packet) {
     if (buffer == NULL || packet == NULL) {
         return -EINVAL;
     }
 
-    /* Need at least sequence byte + length byte */
-    if (buffer_len < 2) {
+    size_t header_len = large ? 3 : 2;
+    unsigned int max_len = large ? MDS_MAX_STREAM_DATA_LEN : MDS_MAX_CHUNK_DATA_LEN;
+
+    /* Need at least sequence byte + length field */
+    if (buffer_len < header_len) {
         return -EINVAL;
     }
 
     /* Extract sequence number from byte 0 */
     packet->sequence = mds_extract_sequence(buffer[0]);
 
-    /* Extract payload length from byte 1 */
-    uint8_t payload_len = buffer[1];
+    /* Extract payload length */
+    unsigned int payload_len = buffer[1];
+    if (large) {
+        payload_len |= (unsigned int)buffer[2] << 8;
+    }
 
     /* Validate payload length */
-    if (payload_len > MDS_MAX_CHUNK_DATA_LEN) {
-        fprintf(stderr, "[MDS] Invalid payload length: %u (max %d)\n",
-                payload_len, MDS_MAX_CHUNK_DATA_LEN);
+    if (payload_len > max_len) {
+        mds_log(MDS_LOG_WARN, MDS_LOG_PROTOCOL, "Invalid payload length: %u (max %u)",
+                payload_len, max_len);
         return -EINVAL;
     }
 
     /* Verify buffer has enough data */
-    if (buffer_len < (size_t)(2 + payload_len)) {
-        fprintf(stderr, "[MDS] Buffer too short: %zu bytes, need %u\n",
-                buffer_len, 2 + payload_len);
+    if (buffer_len < header_len + payload_len) {
+        mds_log(MDS_LOG_WARN, MDS_LOG_PROTOCOL, "Buffer too short: %zu bytes, need %zu",
+                buffer_len, header_len + payload_len);
         return -EINVAL;
     }
 
     packet->data_len = payload_len;
+    packet->chunk_class = MDS_CHUNK_CLASS_UNKNOWN;
 
-    /* Copy only the valid payload bytes (starting at byte 2) */
+    /* Copy only the valid payload bytes (after the header) */
     if (packet->data_len > 0) {
-        memcpy(packet->data, &buffer[2], packet->data_len);
+        memcpy(packet->data, &buffer[header_len], packet->data_len);
     }
 
     return 0;
@@ -91,14 +263,19 @@ int mds_session_create(mds_backend_t *backend, mds_session_t **session) {
 
     // Note: backend can be NULL for external I/O (e.g., event-driven with mds_process_stream_from_bytes)
 
-    mds_session_t *s = calloc(1, sizeof(mds_session_t));
+    /* Session-lifetime memory comes from one arena, released in one go */
+    mds_arena_t *arena = mds_arena_create(sizeof(mds_session_t));
+    mds_session_t *s = mds_arena_calloc(arena, 1, sizeof(mds_session_t));
     if (s == NULL) {
+        mds_arena_destroy(arena);
         return -ENOMEM;
     }
 
+    s->arena = arena;
     s->backend = backend;
-    s->last_sequence = MDS_SEQUENCE_MAX;  /* Initialize to max so first packet (0) is valid */
+    s->have_sequence = false;  /* First packet starts the stream, whatever its sequence */
     s->streaming_enabled = false;
+    s->sinks.max_chunk_len = MDS_MAX_CHUNK_DATA_LEN;
 
     *session = s;
     return 0;
@@ -160,12 +337,46 @@ void mds_session_destroy(mds_session_t *session) {
         mds_stream_disable(session);
     }
 
+    /* Write what async sinks have queued */
+    mds_sink_set_clear(&session->sinks);
+
     /* Destroy backend (closes HID device and frees resources) */
     if (session->backend) {
         mds_backend_destroy(session->backend);
     }
 
-    free(session);
+    mds_arena_destroy(session->arena);  /* Frees the session */
+}
+
+int mds_session_push_decorator(mds_session_t *session,
+                                const mds_backend_decorator_ops_t *ops,
+                                void *ctx) {
+    if (session == NULL || ops == NULL || session->backend == NULL) {
+        return -EINVAL;
+    }
+
+    mds_backend_t *decorated = NULL;
+    int ret = mds_backend_decorate(session->backend, ops, ctx, &decorated);
+    if (ret < 0) {
+        return ret;
+    }
+
+    session->backend = decorated;
+    return 0;
+}
+
+int mds_session_pop_decorator(mds_session_t *session) {
+    if (session == NULL) {
+        return -EINVAL;
+    }
+
+    mds_backend_t *inner = mds_backend_undecorate(session->backend);
+    if (inner == NULL) {
+        return -ENOENT;
+    }
+
+    session->backend = inner;
+    return 0;
 }
 
 /* ============================================================================
@@ -302,27 +513,251 @@ int mds_get_authorization(mds_session_t *session, char *auth, size_t max_len) {
  * Stream Control
  * ========================================================================== */
 
+/* Packets the session can absorb right now (window minus packets held for reordering) */
+static uint8_t mds_credit_available(mds_session_t *session) {
+    int held = 0;
+    for (uint32_t mask = session->held_mask; mask != 0; mask &= mask - 1) {
+        held++;
+    }
+    return (held >= session->credit_window) ? 0 : (uint8_t)(session->credit_window - held);
+}
+
+/* Send a credit grant (Stream Control with a credit byte) */
+static int mds_grant_credit(mds_session_t *session, uint8_t credit) {
+    uint8_t buffer[2] = { MDS_STREAM_MODE_ENABLED, credit };
+    if (session->large_reports) {
+        buffer[0] |= MDS_STREAM_MODE_LARGE_REPORTS;
+    }
+
+    int ret = mds_backend_write(session->backend, MDS_REPORT_ID_STREAM_CONTROL,
+                                buffer, sizeof(buffer));
+    if (ret < 0) {
+        mds_log(MDS_LOG_WARN, MDS_LOG_PROTOCOL, "Credit grant failed: %d", ret);
+        return ret;
+    }
+
+    session->credit_granted = credit;
+    session->credit_used = 0;
+    session->credit_granted_ms = mds_time_monotonic_ms();
+    session->stats.credit_grants++;
+    return 0;
+}
+
+/*
+ * Top up the device's credit after a packet was consumed (or re-send the
+ * grant after an idle period, in case it was lost).
+ */
+static void mds_replenish_credit(mds_session_t *session, bool consumed) {
+    if (session->credit_window == 0 || !session->streaming_enabled ||
+        session->backend == NULL) {
+        return;
+    }
+
+    if (consumed) {
+        if (session->credit_used < UINT8_MAX) {
+            session->credit_used++;
+        }
+        if (session->credit_used < (session->credit_granted + 1) / 2) {
+            return;
+        }
+    } else if (mds_time_monotonic_ms() - session->credit_granted_ms <
+               MDS_CREDIT_REGRANT_INTERVAL_MS) {
+        return;
+    }
+
+    uint8_t credit = mds_credit_available(session);
+    if (credit > 0) {
+        mds_grant_credit(session, credit);
+    }
+}
+
+/* Tell the device where to resume and adopt the offset it actually uses */
+static int mds_send_resume_offset(mds_session_t *session) {
+    uint8_t buffer[4];
+    uint32_t offset = session->resume_offset;
+
+    for (int i = 0; i < 4; i++) {
+        buffer[i] = (uint8_t)(offset >> (8 * i));
+    }
+
+    int ret = mds_backend_write(session->backend, MDS_REPORT_ID_STREAM_RESUME,
+                                buffer, sizeof(buffer));
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = mds_backend_read(session->backend, MDS_REPORT_ID_STREAM_RESUME,
+                           buffer, sizeof(buffer), 1000);
+    if (ret < 0) {
+        return ret;
+    }
+    if (ret < 4) {
+        return -EIO;
+    }
+
+    uint32_t actual = (uint32_t)buffer[0] | ((uint32_t)buffer[1] << 8) |
+                      ((uint32_t)buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+    if (actual != offset) {
+        mds_log(MDS_LOG_WARN, MDS_LOG_PROTOCOL, "Device resumes at offset %u, requested %u",
+                (unsigned int)actual, (unsigned int)offset);
+    }
+
+    session->resume_offset = actual;
+    session->resume_stalled = false;
+    return 0;
+}
+
 int mds_stream_enable(mds_session_t *session) {
     if (session == NULL) {
         return -EINVAL;
     }
 
-    /* Build stream control buffer */
-    uint8_t buffer[1];
+    if (session->resume_enabled) {
+        int ret = mds_send_resume_offset(session);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    /* Build stream control buffer (with the initial credit under flow control) */
+    uint8_t buffer[2];
+    size_t length = 1;
     buffer[0] = MDS_STREAM_MODE_ENABLED;
+    if (session->large_reports) {
+        buffer[0] |= MDS_STREAM_MODE_LARGE_REPORTS;
+    }
+    if (session->credit_window > 0) {
+        buffer[length++] = mds_credit_available(session);
+    }
 
     /* Stream Control is a FEATURE report */
     int ret = mds_backend_write(session->backend,
                                  MDS_REPORT_ID_STREAM_CONTROL,
-                                 buffer, sizeof(buffer));
+                                 buffer, length);
     if (ret < 0) {
         return ret;
     }
 
+    if (session->credit_window > 0) {
+        session->credit_granted = buffer[1];
+        session->credit_used = 0;
+        session->credit_granted_ms = mds_time_monotonic_ms();
+        session->stats.credit_grants++;
+    }
+
+    /* The stream may pick up mid-message */
+    mds_chunk_classifier_reset(&session->classifier);
     session->streaming_enabled = true;
     return 0;
 }
 
+int mds_stream_set_flow_control(mds_session_t *session, unsigned int window) {
+    if (session == NULL || window > UINT8_MAX) {
+        return -EINVAL;
+    }
+
+    if (window > 0) {
+        if (session->backend == NULL) {
+            return -ENOTSUP;  /* No way to send a grant */
+        }
+
+        uint32_t features = 0;
+        int ret = mds_get_supported_features(session, &features);
+        if (ret < 0) {
+            return ret;
+        }
+        if (!(features & MDS_FEATURE_STREAM_CREDITS)) {
+            return -ENOTSUP;
+        }
+    }
+
+    session->credit_window = (uint8_t)window;
+    return 0;
+}
+
+int mds_stream_set_large_reports(mds_session_t *session, bool enable) {
+    if (session == NULL) {
+        return -EINVAL;
+    }
+
+    if (enable) {
+        if (session->backend == NULL) {
+            return -ENOTSUP;  /* Mode cannot be negotiated */
+        }
+
+        uint32_t features = 0;
+        int ret = mds_get_supported_features(session, &features);
+        if (ret < 0) {
+            return ret;
+        }
+        if (!(features & MDS_FEATURE_STREAM_LARGE_REPORTS)) {
+            return -ENOTSUP;
+        }
+    }
+
+    /* Held packets may now be larger */
+    if (session->retransmit_enabled) {
+        int ret = mds_held_reserve(session, enable);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    session->large_reports = enable;
+    session->sinks.max_chunk_len = enable ? MDS_MAX_STREAM_DATA_LEN : MDS_MAX_CHUNK_DATA_LEN;
+    return 0;
+}
+
+int mds_stream_set_resume_offset(mds_session_t *session, uint32_t offset) {
+    if (session == NULL) {
+        return -EINVAL;
+    }
+
+    if (session->backend == NULL) {
+        return -ENOTSUP;  /* Offset cannot be sent */
+    }
+
+    uint32_t features = 0;
+    int ret = mds_get_supported_features(session, &features);
+    if (ret < 0) {
+        return ret;
+    }
+    if (!(features & MDS_FEATURE_STREAM_RESUME)) {
+        return -ENOTSUP;
+    }
+
+    session->resume_enabled = true;
+    session->resume_stalled = false;
+    session->resume_offset = offset;
+    return 0;
+}
+
+int mds_stream_get_resume_offset(mds_session_t *session, uint32_t *offset) {
+    if (session == NULL || offset == NULL) {
+        return -EINVAL;
+    }
+
+    if (!session->resume_enabled) {
+        return -ENOTSUP;
+    }
+
+    *offset = session->resume_offset;
+    return 0;
+}
+
+int mds_stream_ack(mds_session_t *session, size_t length) {
+    if (session == NULL) {
+        return -EINVAL;
+    }
+
+    if (!session->resume_enabled) {
+        return -ENOTSUP;
+    }
+
+    mds_advance_resume(session, length);
+    return 0;
+}
+
 int mds_stream_disable(mds_session_t *session) {
     if (session == NULL) {
         return -EINVAL;
@@ -348,37 +783,120 @@ int mds_stream_disable(mds_session_t *session) {
  * Stream Data Reception
  * ========================================================================== */
 
-int mds_stream_read_packet(mds_session_t *session, mds_stream_packet_t *packet,
-                           int timeout_ms) {
-    if (session == NULL || packet == NULL) {
-        return -EINVAL;
-    }
-
-    uint8_t data[MDS_MAX_CHUNK_DATA_LEN + 2];  /* +2 for sequence and length bytes */
+/* Tag a packet with the class of the message it belongs to */
+static void mds_classify_packet(mds_session_t *session, mds_stream_packet_t *packet) {
+    packet->chunk_class = mds_chunk_classify(&session->classifier, packet->data, packet->data_len);
+    session->stats.class_packets[packet->chunk_class]++;
+    session->stats.class_bytes[packet->chunk_class] += packet->data_len;
+}
 
-    int ret = mds_backend_read(session->backend,
-                                MDS_REPORT_ID_STREAM_DATA,
-                                data, sizeof(data), timeout_ms);
+/* Read and parse one stream packet without sequence accounting */
+static int mds_read_stream_packet(mds_session_t *session, mds_stream_packet_t *packet,
+                                  int timeout_ms) {
+    uint8_t buffer[MDS_MAX_STREAM_DATA_LEN + 3];  /* +3 for sequence and 16-bit length */
+    const uint8_t *data = NULL;
+
+    /* Parse the report where the transport put it, if it can hand it out */
+    int ret = mds_backend_read_direct(session->backend, MDS_REPORT_ID_STREAM_DATA,
+                                      &data, timeout_ms);
+    if (ret == -ENOTSUP) {
+        data = buffer;
+        ret = mds_backend_read(session->backend,
+                               MDS_REPORT_ID_STREAM_DATA,
+                               buffer, sizeof(buffer), timeout_ms);
+    }
     if (ret < 0) {
         return ret;
     }
 
+    /* Prefer the transport's timestamps, taken right at the read syscall */
+    mds_rx_timestamp_t ts;
+    if (mds_backend_get_rx_timestamp(session->backend, &ts) < 0) {
+        ts.monotonic_ns = mds_time_monotonic_ns();
+        ts.realtime_ns = mds_time_realtime_ns();
+    }
+
     /* Use the buffer-based parser */
-    ret = mds_parse_stream_packet(data, ret, packet);
+    ret = mds_parse_stream_packet(data, ret, session->large_reports, packet);
     if (ret < 0) {
         return ret;
     }
 
-    /* Update last sequence */
-    session->last_sequence = packet->sequence;
+    packet->rx_monotonic_ns = ts.monotonic_ns;
+    packet->rx_realtime_ns = ts.realtime_ns;
+    mds_classify_packet(session, packet);
 
     return 0;
 }
 
+int mds_stream_read_packet(mds_session_t *session, mds_stream_packet_t *packet,
+                           int timeout_ms) {
+    if (session == NULL || packet == NULL) {
+        return -EINVAL;
+    }
+
+    int ret = mds_read_stream_packet(session, packet, timeout_ms);
+    if (ret < 0) {
+        mds_replenish_credit(session, false);
+        return ret;
+    }
+
+    mds_sequence_event_t event;
+    if (mds_track_sequence(session, packet->sequence, &event)) {
+        mds_stall_resume(session, "a sequence error");
+    }
+    mds_replenish_credit(session, true);
+    return 0;
+}
+
 /* ============================================================================
  * Chunk Upload
  * ========================================================================== */
 
+/* Sink adapter for the upload callbacks */
+static int mds_upload_callback_write(const mds_sink_chunk_t *chunks, size_t count,
+                                     void *user_data) {
+    mds_session_t *session = (mds_session_t *)user_data;
+    (void)count;  /* Inline sinks get one chunk at a time */
+
+    if (session->upload_callback_ex != NULL) {
+        return session->upload_callback_ex(chunks->uri, chunks->auth_header,
+                                           chunks->data, chunks->len,
+                                           &chunks->info, session->upload_user_data);
+    }
+    return session->upload_callback(chunks->uri, chunks->auth_header,
+                                    chunks->data, chunks->len,
+                                    session->upload_user_data);
+}
+
+static int mds_set_upload_sink(mds_session_t *session,
+                               mds_chunk_upload_callback_t callback,
+                               mds_chunk_upload_callback_ex_t callback_ex,
+                               void *user_data) {
+    if (callback == NULL && callback_ex == NULL) {
+        if (session->upload_sink != NULL) {
+            mds_sink_set_remove(&session->sinks, session->upload_sink);
+            session->upload_sink = NULL;
+        }
+    } else if (session->upload_sink == NULL) {
+        mds_sink_config_t config;
+        mds_sink_default_config(&config);
+        config.name = "upload";
+        config.write = mds_upload_callback_write;
+        config.user_data = session;
+
+        int ret = mds_sink_set_add(&session->sinks, &config, &session->upload_sink);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    session->upload_callback = callback;
+    session->upload_callback_ex = callback_ex;
+    session->upload_user_data = user_data;
+    return 0;
+}
+
 int mds_set_upload_callback(mds_session_t *session,
                              mds_chunk_upload_callback_t callback,
                              void *user_data) {
@@ -386,47 +904,279 @@ int mds_set_upload_callback(mds_session_t *session,
         return -EINVAL;
     }
 
-    session->upload_callback = callback;
-    session->upload_user_data = user_data;
+    return mds_set_upload_sink(session, callback, NULL, user_data);
+}
+
+int mds_set_upload_callback_ex(mds_session_t *session,
+                                mds_chunk_upload_callback_ex_t callback,
+                                void *user_data) {
+    if (session == NULL) {
+        return -EINVAL;
+    }
+
+    return mds_set_upload_sink(session, NULL, callback, user_data);
+}
+
+int mds_session_add_sink(mds_session_t *session,
+                         const mds_sink_config_t *config,
+                         mds_sink_t **sink) {
+    if (session == NULL || config == NULL) {
+        return -EINVAL;
+    }
+
+    return mds_sink_set_add(&session->sinks, config, sink);
+}
+
+int mds_session_remove_sink(mds_session_t *session, mds_sink_t *sink) {
+    if (session == NULL || sink == NULL) {
+        return -EINVAL;
+    }
+
+    if (sink == session->upload_sink) {
+        return mds_set_upload_sink(session, NULL, NULL, NULL);
+    }
+    return mds_sink_set_remove(&session->sinks, sink);
+}
+
+/* Hand a chunk to the sinks, if any (acknowledging it once the required ones have it) */
+static int mds_upload_chunk(mds_session_t *session,
+                            const mds_device_config_t *config,
+                            const uint8_t *data, size_t len,
+                            const mds_chunk_info_t *info) {
+    if (session->sinks.count == 0) {
+        return 0;  /* Caller forwards the packet (and acknowledges it) */
+    }
+
+    int ret = mds_sink_set_deliver(&session->sinks, config->data_uri, config->authorization,
+                                   data, len, info);
+    if (ret < 0) {
+        session->uploads_failed++;
+        session->upload_bytes_failed += len;
+        mds_stall_resume(session, "an upload failure");
+        return ret;
+    }
+
+    session->uploads_ok++;
+    mds_advance_resume(session, len);
+    return 0;
+}
+
+static int mds_upload_packet(mds_session_t *session,
+                             const mds_device_config_t *config,
+                             const mds_stream_packet_t *pkt) {
+    mds_chunk_info_t info = {
+        .sequence = pkt->sequence,
+        .rx_monotonic_ns = pkt->rx_monotonic_ns,
+        .rx_realtime_ns = pkt->rx_realtime_ns,
+        .chunk_class = pkt->chunk_class,
+    };
+    return mds_upload_chunk(session, config, pkt->data, pkt->data_len, &info);
+}
+
+/* ============================================================================
+ * Loss Recovery
+ * ========================================================================== */
+
+static int mds_send_nack(mds_session_t *session, uint8_t first, uint8_t count) {
+    uint8_t buffer[2] = { first, count };
+
+    int ret = mds_backend_write(session->backend, MDS_REPORT_ID_STREAM_NACK,
+                                buffer, sizeof(buffer));
+    if (ret < 0) {
+        mds_log(MDS_LOG_WARN, MDS_LOG_PROTOCOL, "Retransmit request failed: %d", ret);
+        return ret;
+    }
 
+    session->stats.nacks_sent++;
     return 0;
 }
 
-/* Common packet processing logic (validate, update sequence, upload) */
+/* Mark deliver_next as uploaded or given up on, and move on to the next sequence */
+static void mds_deliver_advance(mds_session_t *session) {
+    uint8_t sequence = session->deliver_next;
+
+    session->done_mask |= 1u << sequence;
+    /* Half the sequence space later, the number belongs to a packet not yet sent */
+    session->done_mask &= ~(1u << ((sequence + MDS_SEQUENCE_MAX / 2 + 1) & MDS_SEQUENCE_MASK));
+    session->deliver_next = (sequence + 1) & MDS_SEQUENCE_MASK;
+}
+
+/* Upload held packets that are now in order */
+static int mds_release_held(mds_session_t *session, const mds_device_config_t *config) {
+    int result = 0;
+
+    while (session->held_mask & (1u << session->deliver_next)) {
+        uint8_t sequence = session->deliver_next;
+        session->held_mask &= ~(1u << sequence);
+        mds_deliver_advance(session);
+
+        mds_held_packet_t *held = &session->held[sequence];
+        int ret = mds_upload_chunk(session, config, held->data, held->len, &held->info);
+        if (ret < 0 && result == 0) {
+            result = ret;
+        }
+    }
+
+    return result;
+}
+
+/* Give up on the missing packets and upload everything held (if expired or forced) */
+static int mds_expire_held(mds_session_t *session, const mds_device_config_t *config,
+                           bool force) {
+    if (session->held_mask == 0 ||
+        (!force && mds_time_monotonic_ms() < session->hold_deadline_ms)) {
+        return 0;
+    }
+
+    int result = 0;
+    while (session->held_mask != 0) {
+        uint8_t missing_from = session->deliver_next;
+        while (!(session->held_mask & (1u << session->deliver_next))) {
+            mds_deliver_advance(session);
+        }
+        mds_log(MDS_LOG_WARN, MDS_LOG_PROTOCOL, "Retransmit timed out, skipping sequence %u-%u",
+                missing_from, (session->deliver_next - 1) & MDS_SEQUENCE_MASK);
+        mds_stall_resume(session, "unrecovered packet loss");
+
+        int ret = mds_release_held(session, config);
+        if (ret < 0 && result == 0) {
+            result = ret;
+        }
+    }
+
+    return result;
+}
+
+/* Upload a packet in sequence order, holding it back while earlier packets are missing */
+static int mds_deliver_packet(mds_session_t *session, const mds_device_config_t *config,
+                              const mds_stream_packet_t *pkt, bool late) {
+    if (!session->retransmit_enabled) {
+        return mds_upload_packet(session, config, pkt);
+    }
+
+    if (!session->deliver_started) {
+        session->deliver_started = true;
+        session->deliver_next = pkt->sequence;
+        session->done_mask = 0;
+    }
+
+    uint32_t bit = 1u << pkt->sequence;
+    if (session->held_mask & bit) {
+        return 0;  /* Already held */
+    }
+
+    /*
+     * Behind deliver_next is either a packet already uploaded or given up on,
+     * or (not marked done) a jump past a loss of more than half the sequence
+     * space, which mds_track_sequence() counted as a gap.
+     */
+    uint8_t ahead = (pkt->sequence - session->deliver_next) & MDS_SEQUENCE_MASK;
+    bool jump = false;
+    if (ahead > MDS_SEQUENCE_MAX / 2) {
+        if (session->done_mask & bit) {
+            return 0;
+        }
+        jump = true;
+    }
+
+    if (late) {
+        session->stats.recovered++;
+    }
+
+    if (ahead == 0) {
+        mds_deliver_advance(session);
+        int ret = mds_upload_packet(session, config, pkt);
+        int released = mds_release_held(session, config);
+        return ret < 0 ? ret : released;
+    }
+
+    if (jump || ahead > MDS_RETRANSMIT_WINDOW) {
+        /* Too far ahead to be recovered - accept the loss and resync */
+        int ret = mds_expire_held(session, config, true);
+        if (session->deliver_next != pkt->sequence) {
+            mds_log(MDS_LOG_WARN, MDS_LOG_PROTOCOL, "Packets lost, skipping sequence %u-%u",
+                    session->deliver_next, (pkt->sequence - 1) & MDS_SEQUENCE_MASK);
+            mds_stall_resume(session, "unrecovered packet loss");
+        }
+        while (session->deliver_next != pkt->sequence) {
+            mds_deliver_advance(session);
+        }
+        mds_deliver_advance(session);
+        int uploaded = mds_upload_packet(session, config, pkt);
+        return ret < 0 ? ret : uploaded;
+    }
+
+    if (session->held_mask == 0) {
+        session->hold_deadline_ms = mds_time_monotonic_ms() + session->retransmit_timeout_ms;
+    }
+    mds_held_packet_t *held = &session->held[pkt->sequence];
+    held->info.sequence = pkt->sequence;
+    held->info.rx_monotonic_ns = pkt->rx_monotonic_ns;
+    held->info.rx_realtime_ns = pkt->rx_realtime_ns;
+    held->info.chunk_class = pkt->chunk_class;
+    held->len = pkt->data_len;
+    memcpy(held->data, pkt->data, pkt->data_len);
+    session->held_mask |= 1u << pkt->sequence;
+    return 0;
+}
+
+/* Common packet processing logic (account sequence, request retransmits, upload) */
 static int mds_process_packet_common(mds_session_t *session,
                                       const mds_device_config_t *config,
                                       const mds_stream_packet_t *pkt,
                                       mds_stream_packet_t *packet_out) {
-    /* Validate sequence if we have a previous sequence */
-    if (session->last_sequence != MDS_SEQUENCE_MAX) {
-        if (!mds_validate_sequence(session->last_sequence, pkt->sequence)) {
-            /* Log warning but continue - sequence validation is not critical */
-            uint8_t expected = (session->last_sequence + 1) & MDS_SEQUENCE_MASK;
-            fprintf(stderr, "[MDS] Sequence error: expected %u, got %u\n",
-                    expected, pkt->sequence);
-        }
+    /* Account for gaps/duplicates but continue - sequence errors are not fatal */
+    mds_sequence_event_t event;
+    bool anomaly = mds_track_sequence(session, pkt->sequence, &event);
+
+    if (anomaly && session->retransmit_enabled &&
+        event.type == MDS_SEQUENCE_EVENT_GAP && event.missing <= MDS_RETRANSMIT_WINDOW) {
+        mds_send_nack(session, event.expected, event.missing);
+    } else if (anomaly && (!session->retransmit_enabled ||
+                           event.type == MDS_SEQUENCE_EVENT_GAP)) {
+        /* Loss, or a duplicate that will be uploaded again, without retransmit ordering */
+        mds_stall_resume(session, "a sequence error");
     }
 
-    /* Update sequence */
-    session->last_sequence = pkt->sequence;
-
     /* Copy packet to output if requested */
     if (packet_out) {
         *packet_out = *pkt;
     }
 
-    /* Upload chunk if callback is configured */
-    if (session->upload_callback != NULL) {
-        int ret = session->upload_callback(config->data_uri,
-                                            config->authorization,
-                                            pkt->data,
-                                            pkt->data_len,
-                                            session->upload_user_data);
+    return mds_deliver_packet(session, config, pkt,
+                              anomaly && event.type == MDS_SEQUENCE_EVENT_REORDER);
+}
+
+int mds_stream_set_retransmit(mds_session_t *session, bool enable, int timeout_ms) {
+    if (session == NULL) {
+        return -EINVAL;
+    }
+
+    if (enable) {
+        if (session->backend == NULL) {
+            return -ENOTSUP;  /* No way to send a NACK */
+        }
+
+        uint32_t features = 0;
+        int ret = mds_get_supported_features(session, &features);
+        if (ret < 0) {
+            return ret;
+        }
+        if (!(features & MDS_FEATURE_STREAM_RETRANSMIT)) {
+            return -ENOTSUP;
+        }
+
+        ret = mds_held_reserve(session, session->large_reports);
         if (ret < 0) {
             return ret;
         }
     }
 
+    session->retransmit_enabled = enable;
+    session->retransmit_timeout_ms = (timeout_ms > 0) ? timeout_ms : MDS_RETRANSMIT_DEFAULT_TIMEOUT_MS;
+    session->deliver_started = false;
+    session->held_mask = 0;
+    session->done_mask = 0;
     return 0;
 }
 
@@ -438,13 +1188,22 @@ int mds_process_stream(mds_session_t *session,
         return -EINVAL;
     }
 
+    /* Release packets whose missing predecessors did not arrive in time */
+    int ret = mds_expire_held(session, config, false);
+    if (ret < 0) {
+        return ret;
+    }
+
     mds_stream_packet_t pkt;
-    int ret = mds_stream_read_packet(session, &pkt, timeout_ms);
+    ret = mds_read_stream_packet(session, &pkt, timeout_ms);
     if (ret < 0) {
+        mds_replenish_credit(session, false);
         return ret;
     }
 
-    return mds_process_packet_common(session, config, &pkt, packet);
+    ret = mds_process_packet_common(session, config, &pkt, packet);
+    mds_replenish_credit(session, true);
+    return ret;
 }
 
 int mds_process_stream_from_bytes(mds_session_t *session,
@@ -457,10 +1216,155 @@ int mds_process_stream_from_bytes(mds_session_t *session,
     }
 
     mds_stream_packet_t pkt;
-    int ret = mds_parse_stream_packet(buffer, buffer_len, &pkt);
+    pkt.rx_monotonic_ns = mds_time_monotonic_ns();
+    pkt.rx_realtime_ns = mds_time_realtime_ns();
+
+    int ret = mds_expire_held(session, config, false);
     if (ret < 0) {
         return ret;
     }
 
-    return mds_process_packet_common(session, config, &pkt, packet);
+    ret = mds_parse_stream_packet(buffer, buffer_len, session->large_reports, &pkt);
+    if (ret < 0) {
+        return ret;
+    }
+    mds_classify_packet(session, &pkt);
+
+    ret = mds_process_packet_common(session, config, &pkt, packet);
+    mds_replenish_credit(session, true);
+    return ret;
+}
+
+/* ============================================================================
+ * Sequence Accounting
+ * ========================================================================== */
+
+int mds_get_session_stats(mds_session_t *session, mds_session_stats_t *stats) {
+    if (session == NULL || stats == NULL) {
+        return -EINVAL;
+    }
+
+    *stats = session->stats;
+    return 0;
+}
+
+int mds_reset_session_stats(mds_session_t *session) {
+    if (session == NULL) {
+        return -EINVAL;
+    }
+
+    memset(&session->stats, 0, sizeof(session->stats));
+    session->have_sequence = false;
+    return 0;
+}
+
+int mds_set_sequence_callback(mds_session_t *session,
+                              mds_sequence_callback_t callback,
+                              void *user_data) {
+    if (session == NULL) {
+        return -EINVAL;
+    }
+
+    session->sequence_callback = callback;
+    session->sequence_user_data = user_data;
+    return 0;
+}
+
+/* ============================================================================
+ * Shutdown
+ * ========================================================================== */
+
+/* A device that has sent nothing for this long has been drained */
+#define MDS_SHUTDOWN_QUIET_MS 50
+
+int mds_session_shutdown(mds_session_t *session,
+                         const mds_device_config_t *config,
+                         int deadline_ms,
+                         mds_shutdown_report_t *report) {
+    if (session == NULL || config == NULL) {
+        return -EINVAL;
+    }
+
+    mds_shutdown_report_t result = {0};
+    int64_t deadline = mds_time_monotonic_ms() + (deadline_ms > 0 ? deadline_ms : 0);
+    bool have_sinks = session->sinks.count > 0;
+    uint32_t ok_before = session->uploads_ok;
+    uint32_t failed_before = session->uploads_failed;
+    uint64_t failed_bytes_before = session->upload_bytes_failed;
+
+    /* Stop new data first; a failure here usually means the device is gone */
+    int ret = 0;
+    if (session->backend != NULL) {
+        ret = mds_stream_disable(session);
+        if (ret < 0) {
+            mds_log(MDS_LOG_WARN, MDS_LOG_PROTOCOL, "Disabling stream for shutdown failed: %d", ret);
+        }
+    }
+
+    /*
+     * The device will not answer retransmit requests any more: flush what is
+     * held, then upload the drained packets in arrival order.
+     */
+    mds_expire_held(session, config, true);
+    session->retransmit_enabled = false;
+    session->credit_window = 0;
+
+    while (ret >= 0 && session->backend != NULL) {
+        int64_t remaining = deadline - mds_time_monotonic_ms();
+        if (remaining <= 0) {
+            result.deadline_expired = deadline_ms > 0;
+            break;
+        }
+
+        mds_stream_packet_t pkt;
+        int read_ret = mds_read_stream_packet(session, &pkt,
+                                              remaining < MDS_SHUTDOWN_QUIET_MS ?
+                                              (int)remaining : MDS_SHUTDOWN_QUIET_MS);
+        if (read_ret == -EINVAL) {
+            continue;  /* Malformed report, keep draining */
+        }
+        if (read_ret < 0) {
+            break;  /* Quiet (timeout) - drained, or the device is gone */
+        }
+
+        result.packets_drained++;
+        if (!have_sinks) {
+            mds_sequence_event_t event;
+            mds_track_sequence(session, pkt.sequence, &event);
+            result.packets_dropped++;
+            result.bytes_dropped += pkt.data_len;
+            continue;
+        }
+
+        mds_process_packet_common(session, config, &pkt, NULL);
+    }
+
+    /* Let async sinks write what they have queued within the deadline */
+    if (have_sinks && deadline_ms > 0) {
+        int64_t remaining = deadline - mds_time_monotonic_ms();
+        if (mds_sink_set_flush(&session->sinks, remaining > 0 ? (int)remaining : 0) < 0) {
+            result.deadline_expired = true;
+        }
+    }
+
+    result.packets_uploaded = session->uploads_ok - ok_before;
+    result.packets_dropped += session->uploads_failed - failed_before;
+    result.bytes_dropped += session->upload_bytes_failed - failed_bytes_before;
+
+    if (result.packets_dropped > 0 || result.deadline_expired) {
+        mds_log(MDS_LOG_WARN, MDS_LOG_PROTOCOL,
+                "Shutdown dropped %u packets (%llu bytes)%s",
+                (unsigned int)result.packets_dropped,
+                (unsigned long long)result.bytes_dropped,
+                result.deadline_expired ? ", deadline expired" : "");
+    }
+
+    if (report != NULL) {
+        *report = result;
+    }
+
+    if (result.deadline_expired) {
+        return -ETIMEDOUT;
+    }
+    return result.packets_dropped > 0 ? -EIO : 0;
 }
@@ -0,0 +1,581 @@
+/**
+ * @file mds_sink.c
+ * @brief Chunk sinks attached to a session
+ *
+ * Data structures:
+ * - Inline sinks are plain callbacks; the chunk they see points into the
+ *   session's parsed packet.
+ * - A packet taken by at least one async sink is copied once into a
+ *   sink_packet_t, which every async sink that takes it references from its
+ *   queue. The last reference returns it to the set's pool. Packets have
+ *   independent lifetimes on several threads, so they are recycled through
+ *   a free list (up to POOL_MAX_FREE) rather than taken from an arena; in
+ *   steady state no packet is allocated. Buffers hold the session's payload
+ *   limit (max_chunk_len), so normal 61-byte reports do not pay for
+ *   large-report capacity; a recycled buffer too small for a chunk is
+ *   replaced.
+ * - The URI and authorization of queued packets live in a shared, reference
+ *   counted mds_sink_dest_t. The set keeps the last one and hands it to new
+ *   packets for as long as the device configuration does not change, so they
+ *   are not copied per packet.
+ * - An async sink's queue is a ring of queue_depth entries guarded by the
+ *   sink's mutex. Its thread takes up to one batch at a time, releases the
+ *   lock and calls the write callback.
+ */
+
+#include "mds_sink_internal.h"
+#include "mds_log_internal.h"
+#include "mds_thread.h"
+#include "mds_time.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define DEFAULT_QUEUE_DEPTH     256
+#define DEFAULT_MAX_BATCH       16
+
+/* Free packet buffers kept for reuse */
+#define POOL_MAX_FREE           64
+
+struct mds_sink_dest {
+    mds_atomic_int_t refs;
+    char uri[MDS_MAX_URI_LEN];
+    char auth[MDS_MAX_AUTH_LEN];
+};
+
+/* Packet shared by the queues of the async sinks */
+typedef struct sink_packet {
+    mds_atomic_int_t refs;
+    struct sink_packet *next_free;
+    mds_sink_pool_t *pool;
+    mds_sink_dest_t *dest;
+    mds_chunk_info_t info;
+    size_t len;
+    size_t capacity;
+    uint8_t data[];
+} sink_packet_t;
+
+struct mds_sink_pool {
+    mds_mutex_t lock;
+    sink_packet_t *free;
+    size_t free_count;
+};
+
+/* Queue entry */
+typedef struct {
+    sink_packet_t *packet;
+    int64_t queued_ms;
+} sink_entry_t;
+
+struct mds_sink {
+    mds_sink_config_t config;
+    char name[32];
+
+    mds_mutex_t lock;
+    mds_sink_stats_t stats;
+
+    /* Async mode */
+    mds_thread_t thread;
+    mds_cond_t ready;                   /* Chunks queued, flush or stop requested */
+    mds_cond_t space;                   /* Chunks taken or written */
+    sink_entry_t *queue;                /* Ring of config.queue_depth entries */
+    size_t head;
+    size_t queued_bytes;
+    bool busy;                          /* Write callback running */
+    bool stopping;
+    bool overflowing;                   /* Dropping chunks (logged once per episode) */
+    int flushing;                       /* Threads in mds_sink_flush() */
+    sink_packet_t **taken;              /* Batch being written */
+    mds_sink_chunk_t *batch;
+};
+
+/* ============================================================================
+ * Shared Packets
+ * ========================================================================== */
+
+static void dest_release(mds_sink_dest_t *dest) {
+    if (dest != NULL && mds_atomic_add(&dest->refs, -1) == 0) {
+        free(dest);
+    }
+}
+
+/* The set's destination for uri/auth, replaced when they change. Returns a new reference */
+static mds_sink_dest_t *dest_get(mds_sink_set_t *set, const char *uri, const char *auth_header) {
+    mds_sink_dest_t *dest = set->dest;
+    if (dest == NULL || strcmp(dest->uri, uri) != 0 || strcmp(dest->auth, auth_header) != 0) {
+        dest = malloc(sizeof(*dest));
+        if (dest == NULL) {
+            return NULL;
+        }
+        mds_atomic_store(&dest->refs, 1);
+        snprintf(dest->uri, sizeof(dest->uri), "%s", uri);
+        snprintf(dest->auth, sizeof(dest->auth), "%s", auth_header);
+        dest_release(set->dest);
+        set->dest = dest;
+    }
+    mds_atomic_add(&dest->refs, 1);
+    return dest;
+}
+
+static void pool_put(mds_sink_pool_t *pool, sink_packet_t *packet) {
+    mds_mutex_lock(&pool->lock);
+    if (pool->free_count < POOL_MAX_FREE) {
+        packet->next_free = pool->free;
+        pool->free = packet;
+        pool->free_count++;
+        packet = NULL;
+    }
+    mds_mutex_unlock(&pool->lock);
+    free(packet);
+}
+
+static void pool_destroy(mds_sink_pool_t *pool) {
+    if (pool == NULL) {
+        return;
+    }
+    while (pool->free != NULL) {
+        sink_packet_t *next = pool->free->next_free;
+        free(pool->free);
+        pool->free = next;
+    }
+    mds_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+static sink_packet_t *packet_create(mds_sink_set_t *set, const mds_sink_chunk_t *chunk) {
+    if (chunk->len > MDS_MAX_STREAM_DATA_LEN) {
+        return NULL;
+    }
+    if (set->pool == NULL) {
+        set->pool = calloc(1, sizeof(*set->pool));
+        if (set->pool == NULL) {
+            return NULL;
+        }
+        mds_mutex_init(&set->pool->lock);
+    }
+
+    mds_sink_pool_t *pool = set->pool;
+    mds_mutex_lock(&pool->lock);
+    sink_packet_t *packet = pool->free;
+    if (packet != NULL) {
+        pool->free = packet->next_free;
+        pool->free_count--;
+    }
+    mds_mutex_unlock(&pool->lock);
+
+    if (packet != NULL && packet->capacity < chunk->len) {
+        free(packet);  /* Sized before the payload limit grew */
+        packet = NULL;
+    }
+    if (packet == NULL) {
+        size_t capacity = (set->max_chunk_len > chunk->len) ? set->max_chunk_len : chunk->len;
+        packet = malloc(sizeof(*packet) + capacity);
+        if (packet == NULL) {
+            return NULL;
+        }
+        packet->capacity = capacity;
+    }
+    packet->pool = pool;
+    packet->dest = dest_get(set, chunk->uri, chunk->auth_header);
+    if (packet->dest == NULL) {
+        pool_put(pool, packet);
+        return NULL;
+    }
+    mds_atomic_store(&packet->refs, 1);
+    packet->info = chunk->info;
+    packet->len = chunk->len;
+    memcpy(packet->data, chunk->data, chunk->len);
+    return packet;
+}
+
+static void packet_release(sink_packet_t *packet) {
+    if (mds_atomic_add(&packet->refs, -1) == 0) {
+        dest_release(packet->dest);
+        pool_put(packet->pool, packet);
+    }
+}
+
+/* ============================================================================
+ * Async Sinks
+ * ========================================================================== */
+
+static bool sink_batch_full(const mds_sink_t *sink) {
+    return sink->stats.queued >= sink->config.max_batch ||
+           (sink->config.max_batch_bytes > 0 &&
+            sink->queued_bytes >= sink->config.max_batch_bytes);
+}
+
+/* Move the next batch out of the queue. Called with the lock held */
+static size_t sink_take(mds_sink_t *sink) {
+    size_t depth = sink->config.queue_depth;
+    size_t count = 0;
+    size_t bytes = 0;
+
+    while (count < sink->stats.queued && count < sink->config.max_batch) {
+        sink_packet_t *packet = sink->queue[(sink->head + count) % depth].packet;
+        if (count > 0 && sink->config.max_batch_bytes > 0 &&
+            bytes + packet->len > sink->config.max_batch_bytes) {
+            break;
+        }
+        sink->taken[count++] = packet;
+        bytes += packet->len;
+    }
+
+    sink->head = (sink->head + count) % depth;
+    sink->stats.queued -= count;
+    sink->queued_bytes -= bytes;
+    sink->busy = true;
+    return count;
+}
+
+static mds_thread_result_t MDS_THREAD_CALL sink_main(void *arg) {
+    mds_sink_t *sink = (mds_sink_t *)arg;
+
+    mds_mutex_lock(&sink->lock);
+    for (;;) {
+        if (sink->stats.queued == 0) {
+            if (sink->stopping) {
+                break;
+            }
+            mds_cond_wait(&sink->ready, &sink->lock);
+            continue;
+        }
+
+        /* Give a partial batch time to fill */
+        if (sink->config.max_delay_ms > 0 && !sink->stopping && sink->flushing == 0 &&
+            !sink_batch_full(sink)) {
+            int64_t wait_ms = sink->queue[sink->head].queued_ms + sink->config.max_delay_ms -
+                              mds_time_monotonic_ms();
+            if (wait_ms > 0) {
+                mds_cond_timedwait(&sink->ready, &sink->lock, (int)wait_ms);
+                continue;
+            }
+        }
+
+        size_t count = sink_take(sink);
+        mds_cond_broadcast(&sink->space);
+        mds_mutex_unlock(&sink->lock);
+
+        for (size_t i = 0; i < count; i++) {
+            sink_packet_t *packet = sink->taken[i];
+            sink->batch[i].uri = packet->dest->uri;
+            sink->batch[i].auth_header = packet->dest->auth;
+            sink->batch[i].data = packet->data;
+            sink->batch[i].len = packet->len;
+            sink->batch[i].info = packet->info;
+        }
+        int ret = sink->config.write(sink->batch, count, sink->config.user_data);
+        for (size_t i = 0; i < count; i++) {
+            packet_release(sink->taken[i]);
+        }
+        if (ret < 0) {
+            mds_log(MDS_LOG_WARN, MDS_LOG_UPLOAD, "Sink '%s' failed to write %zu chunks: %d",
+                    sink->name, count, ret);
+        }
+
+        mds_mutex_lock(&sink->lock);
+        sink->busy = false;
+        sink->stats.writes++;
+        if (ret < 0) {
+            sink->stats.chunks_failed += count;
+        } else {
+            sink->stats.chunks_written += count;
+        }
+        mds_cond_broadcast(&sink->space);
+    }
+    mds_mutex_unlock(&sink->lock);
+    return 0;
+}
+
+static void sink_enqueue(mds_sink_t *sink, sink_packet_t *packet) {
+    size_t depth = sink->config.queue_depth;
+
+    mds_mutex_lock(&sink->lock);
+    while (sink->stats.queued == depth && !sink->config.drop_when_full) {
+        mds_cond_wait(&sink->space, &sink->lock);
+    }
+
+    if (sink->stats.queued == depth) {
+        sink->stats.chunks_dropped++;
+        bool first = !sink->overflowing;
+        sink->overflowing = true;
+        mds_mutex_unlock(&sink->lock);
+        if (first) {
+            mds_log(MDS_LOG_WARN, MDS_LOG_UPLOAD, "Sink '%s' queue full, dropping chunks",
+                    sink->name);
+        }
+        return;
+    }
+
+    mds_atomic_add(&packet->refs, 1);
+    sink_entry_t *entry = &sink->queue[(sink->head + sink->stats.queued) % depth];
+    entry->packet = packet;
+    entry->queued_ms = mds_time_monotonic_ms();
+    sink->stats.queued++;
+    sink->queued_bytes += packet->len;
+    sink->stats.chunks_accepted++;
+    sink->overflowing = false;
+    if (sink->stats.queued > sink->stats.max_queued) {
+        sink->stats.max_queued = sink->stats.queued;
+    }
+    mds_cond_signal(&sink->ready);
+    mds_mutex_unlock(&sink->lock);
+}
+
+/* ============================================================================
+ * Sink Lifecycle
+ * ========================================================================== */
+
+static void sink_free(mds_sink_t *sink) {
+    mds_mutex_destroy(&sink->lock);
+    if (sink->config.mode == MDS_SINK_ASYNC) {
+        mds_cond_destroy(&sink->ready);
+        mds_cond_destroy(&sink->space);
+    }
+    free(sink->queue);
+    free(sink->taken);
+    free(sink->batch);
+    free(sink);
+}
+
+static int sink_create(const mds_sink_config_t *config, mds_sink_t **out) {
+    if (config->write == NULL ||
+        (config->mode != MDS_SINK_INLINE && config->mode != MDS_SINK_ASYNC)) {
+        return -EINVAL;
+    }
+    if (config->mode == MDS_SINK_ASYNC && (config->queue_depth == 0 || config->max_batch == 0)) {
+        return -EINVAL;
+    }
+
+    mds_sink_t *sink = calloc(1, sizeof(*sink));
+    if (sink == NULL) {
+        return -ENOMEM;
+    }
+    sink->config = *config;
+    snprintf(sink->name, sizeof(sink->name), "%s", config->name ? config->name : "sink");
+    sink->config.name = sink->name;
+    mds_mutex_init(&sink->lock);
+
+    if (config->mode == MDS_SINK_ASYNC) {
+        mds_cond_init(&sink->ready);
+        mds_cond_init(&sink->space);
+        sink->queue = calloc(config->queue_depth, sizeof(sink_entry_t));
+        sink->taken = calloc(config->max_batch, sizeof(sink_packet_t *));
+        sink->batch = calloc(config->max_batch, sizeof(mds_sink_chunk_t));
+        if (sink->queue == NULL || sink->taken == NULL || sink->batch == NULL) {
+            sink_free(sink);
+            return -ENOMEM;
+        }
+
+        int ret = mds_thread_create(&sink->thread, sink_main, sink);
+        if (ret < 0) {
+            sink_free(sink);
+            return ret;
+        }
+    }
+
+    *out = sink;
+    return 0;
+}
+
+static void sink_destroy(mds_sink_t *sink) {
+    if (sink->config.mode == MDS_SINK_ASYNC) {
+        mds_mutex_lock(&sink->lock);
+        sink->stopping = true;
+        mds_cond_signal(&sink->ready);
+        mds_mutex_unlock(&sink->lock);
+        mds_thread_join(sink->thread);  /* Writes what is queued first */
+    }
+    sink_free(sink);
+}
+
+static bool sink_takes(mds_sink_t *sink, const mds_sink_chunk_t *chunk) {
+    if (!(sink->config.class_mask & MDS_SINK_CLASS(chunk->info.chunk_class))) {
+        return false;
+    }
+    return sink->config.filter == NULL || sink->config.filter(chunk, sink->config.user_data);
+}
+
+/* ============================================================================
+ * Public API
+ * ========================================================================== */
+
+void mds_sink_default_config(mds_sink_config_t *config) {
+    if (config == NULL) {
+        return;
+    }
+
+    memset(config, 0, sizeof(*config));
+    config->mode = MDS_SINK_INLINE;
+    config->class_mask = MDS_SINK_CLASS_ALL;
+    config->required = true;
+    config->queue_depth = DEFAULT_QUEUE_DEPTH;
+    config->max_batch = DEFAULT_MAX_BATCH;
+}
+
+int mds_sink_flush(mds_sink_t *sink, int timeout_ms) {
+    if (sink == NULL) {
+        return -EINVAL;
+    }
+    if (sink->config.mode != MDS_SINK_ASYNC) {
+        return 0;
+    }
+
+    int64_t deadline = mds_time_monotonic_ms() + timeout_ms;
+    int result = 0;
+
+    mds_mutex_lock(&sink->lock);
+    sink->flushing++;
+    mds_cond_signal(&sink->ready);
+    while (sink->stats.queued > 0 || sink->busy) {
+        if (timeout_ms < 0) {
+            mds_cond_wait(&sink->space, &sink->lock);
+            continue;
+        }
+        int64_t remaining = deadline - mds_time_monotonic_ms();
+        if (remaining <= 0) {
+            result = -ETIMEDOUT;
+            break;
+        }
+        mds_cond_timedwait(&sink->space, &sink->lock, (int)remaining);
+    }
+    sink->flushing--;
+    mds_mutex_unlock(&sink->lock);
+    return result;
+}
+
+int mds_sink_get_stats(mds_sink_t *sink, mds_sink_stats_t *stats) {
+    if (sink == NULL || stats == NULL) {
+        return -EINVAL;
+    }
+
+    mds_mutex_lock(&sink->lock);
+    *stats = sink->stats;
+    mds_mutex_unlock(&sink->lock);
+    return 0;
+}
+
+/* ============================================================================
+ * Sink Set (used by the session)
+ * ========================================================================== */
+
+int mds_sink_set_add(mds_sink_set_t *set, const mds_sink_config_t *config, mds_sink_t **sink) {
+    if (set->count == MDS_MAX_SINKS) {
+        return -ENOSPC;
+    }
+
+    mds_sink_t *created;
+    int ret = sink_create(config, &created);
+    if (ret < 0) {
+        return ret;
+    }
+
+    set->sinks[set->count++] = created;
+    if (sink != NULL) {
+        *sink = created;
+    }
+    return 0;
+}
+
+int mds_sink_set_remove(mds_sink_set_t *set, mds_sink_t *sink) {
+    for (size_t i = 0; i < set->count; i++) {
+        if (set->sinks[i] == sink) {
+            memmove(&set->sinks[i], &set->sinks[i + 1],
+                    (set->count - i - 1) * sizeof(set->sinks[0]));
+            set->count--;
+            sink_destroy(sink);
+            return 0;
+        }
+    }
+    return -ENOENT;
+}
+
+void mds_sink_set_clear(mds_sink_set_t *set) {
+    for (size_t i = 0; i < set->count; i++) {
+        sink_destroy(set->sinks[i]);
+    }
+    set->count = 0;
+    dest_release(set->dest);
+    set->dest = NULL;
+    pool_destroy(set->pool);  /* All packets are back: the sink threads have stopped */
+    set->pool = NULL;
+}
+
+int mds_sink_set_deliver(mds_sink_set_t *set, const char *uri, const char *auth_header,
+                         const uint8_t *data, size_t len, const mds_chunk_info_t *info) {
+    mds_sink_chunk_t chunk = {
+        .uri = uri,
+        .auth_header = auth_header,
+        .data = data,
+        .len = len,
+        .info = *info,
+    };
+    sink_packet_t *shared = NULL;
+    int result = 0;
+
+    for (size_t i = 0; i < set->count; i++) {
+        mds_sink_t *sink = set->sinks[i];
+
+        if (!sink_takes(sink, &chunk)) {
+            mds_mutex_lock(&sink->lock);
+            sink->stats.chunks_filtered++;
+            mds_mutex_unlock(&sink->lock);
+            continue;
+        }
+
+        if (sink->config.mode == MDS_SINK_INLINE) {
+            int ret = sink->config.write(&chunk, 1, sink->config.user_data);
+            mds_mutex_lock(&sink->lock);
+            sink->stats.chunks_accepted++;
+            sink->stats.writes++;
+            if (ret < 0) {
+                sink->stats.chunks_failed++;
+            } else {
+                sink->stats.chunks_written++;
+            }
+            mds_mutex_unlock(&sink->lock);
+
+            if (ret < 0 && sink->config.required && result == 0) {
+                result = ret;
+            }
+            continue;
+        }
+
+        /* One copy for all async sinks */
+        if (shared == NULL) {
+            shared = packet_create(set, &chunk);
+            if (shared == NULL) {
+                mds_log(MDS_LOG_WARN, MDS_LOG_UPLOAD, "Out of memory queuing chunk for sink '%s'",
+                        sink->name);
+                mds_mutex_lock(&sink->lock);
+                sink->stats.chunks_dropped++;
+                mds_mutex_unlock(&sink->lock);
+                continue;
+            }
+        }
+        sink_enqueue(sink, shared);
+    }
+
+    if (shared != NULL) {
+        packet_release(shared);
+    }
+    return result;
+}
+
+int mds_sink_set_flush(mds_sink_set_t *set, int timeout_ms) {
+    int64_t deadline = mds_time_monotonic_ms() + timeout_ms;
+
+    for (size_t i = 0; i < set->count; i++) {
+        int remaining = timeout_ms;
+        if (timeout_ms >= 0) {
+            int64_t left = deadline - mds_time_monotonic_ms();
+            remaining = left > 0 ? (int)left : 0;
+        }
+        int ret = mds_sink_flush(set->sinks[i], remaining);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
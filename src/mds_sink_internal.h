@@ -0,0 +1,55 @@
+/**
+ * @file mds_sink_internal.h
+ * @brief Sink set owned by a session (see mds_sink.h)
+ *
+ * This header is for internal use only and should not be installed as a public API.
+ */
+
+#ifndef MDS_SINK_INTERNAL_H
+#define MDS_SINK_INTERNAL_H
+
+#include "mds_bridge/mds_sink.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Reference-counted copy of a data URI and authorization */
+typedef struct mds_sink_dest mds_sink_dest_t;
+
+/* Recycled packet buffers of the async sinks */
+typedef struct mds_sink_pool mds_sink_pool_t;
+
+/* The sinks of a session, in delivery order */
+typedef struct {
+    mds_sink_t *sinks[MDS_MAX_SINKS];
+    size_t count;
+    mds_sink_dest_t *dest;            /* Destination of the last chunk queued */
+    mds_sink_pool_t *pool;            /* Created with the first async chunk */
+    size_t max_chunk_len;             /* Payload limit; sizes the queued copies */
+} mds_sink_set_t;
+
+/* Create a sink and append it to the set */
+int mds_sink_set_add(mds_sink_set_t *set, const mds_sink_config_t *config, mds_sink_t **sink);
+
+/* Remove a sink from the set and destroy it (writing queued chunks). -ENOENT if not in the set */
+int mds_sink_set_remove(mds_sink_set_t *set, mds_sink_t *sink);
+
+/* Remove and destroy all sinks */
+void mds_sink_set_clear(mds_sink_set_t *set);
+
+/*
+ * Hand a packet to every sink that takes it. Returns 0, or the first error
+ * of a required inline sink (the other sinks still get the packet).
+ */
+int mds_sink_set_deliver(mds_sink_set_t *set, const char *uri, const char *auth_header,
+                         const uint8_t *data, size_t len, const mds_chunk_info_t *info);
+
+/* Wait until all async sinks have written their queues. 0 or -ETIMEDOUT */
+int mds_sink_set_flush(mds_sink_set_t *set, int timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MDS_SINK_INTERNAL_H */
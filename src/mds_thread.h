@@ -0,0 +1,220 @@
+/**
+ * @file mds_thread.h
+ * @brief Internal threading primitives (threads, mutexes, condition variables and atomics)
+ *
+ * Thin wrappers over pthreads on POSIX and CRT threads / SRW locks / condition
+ * variables / Interlocked functions on Windows. Mutexes support static initialization with MDS_MUTEX_INITIALIZER
+ * so library-global state needs no separate once-initialization.
+ */
+
+#ifndef MDS_THREAD_H
+#define MDS_THREAD_H
+
+#include <stdbool.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <process.h>
+#include <errno.h>
+#else
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include "mds_time.h"
+#endif
+
+/* ============================================================================
+ * Mutex
+ * ========================================================================== */
+
+#ifdef _WIN32
+typedef SRWLOCK mds_mutex_t;
+#define MDS_MUTEX_INITIALIZER SRWLOCK_INIT
+
+static inline void mds_mutex_init(mds_mutex_t *mutex) { InitializeSRWLock(mutex); }
+static inline void mds_mutex_destroy(mds_mutex_t *mutex) { (void)mutex; }
+static inline void mds_mutex_lock(mds_mutex_t *mutex) { AcquireSRWLockExclusive(mutex); }
+static inline void mds_mutex_unlock(mds_mutex_t *mutex) { ReleaseSRWLockExclusive(mutex); }
+#else
+typedef pthread_mutex_t mds_mutex_t;
+#define MDS_MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+
+static inline void mds_mutex_init(mds_mutex_t *mutex) { pthread_mutex_init(mutex, NULL); }
+static inline void mds_mutex_destroy(mds_mutex_t *mutex) { pthread_mutex_destroy(mutex); }
+static inline void mds_mutex_lock(mds_mutex_t *mutex) { pthread_mutex_lock(mutex); }
+static inline void mds_mutex_unlock(mds_mutex_t *mutex) { pthread_mutex_unlock(mutex); }
+#endif
+
+/* ============================================================================
+ * Condition Variable
+ * ========================================================================== */
+
+#ifdef _WIN32
+typedef CONDITION_VARIABLE mds_cond_t;
+
+static inline void mds_cond_init(mds_cond_t *cond) { InitializeConditionVariable(cond); }
+static inline void mds_cond_destroy(mds_cond_t *cond) { (void)cond; }
+static inline void mds_cond_wait(mds_cond_t *cond, mds_mutex_t *mutex) {
+    SleepConditionVariableSRW(cond, mutex, INFINITE, 0);
+}
+/* Returns false on timeout */
+static inline bool mds_cond_timedwait(mds_cond_t *cond, mds_mutex_t *mutex, int timeout_ms) {
+    return SleepConditionVariableSRW(cond, mutex, timeout_ms > 0 ? (DWORD)timeout_ms : 0, 0) != 0;
+}
+static inline void mds_cond_signal(mds_cond_t *cond) { WakeConditionVariable(cond); }
+static inline void mds_cond_broadcast(mds_cond_t *cond) { WakeAllConditionVariable(cond); }
+#else
+typedef pthread_cond_t mds_cond_t;
+
+/* Timed waits run on CLOCK_MONOTONIC, so wall clock steps do not stretch or
+ * cut them short. macOS has no pthread_condattr_setclock() but waits
+ * relative to the call instead. */
+static inline void mds_cond_init(mds_cond_t *cond) {
+#ifdef __APPLE__
+    pthread_cond_init(cond, NULL);
+#else
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+#endif
+}
+static inline void mds_cond_destroy(mds_cond_t *cond) { pthread_cond_destroy(cond); }
+static inline void mds_cond_wait(mds_cond_t *cond, mds_mutex_t *mutex) {
+    pthread_cond_wait(cond, mutex);
+}
+/* Returns false on timeout */
+static inline bool mds_cond_timedwait(mds_cond_t *cond, mds_mutex_t *mutex, int timeout_ms) {
+    uint64_t wait_ns = timeout_ms > 0 ? (uint64_t)timeout_ms * 1000000ull : 0;
+#ifdef __APPLE__
+    struct timespec ts = {
+        .tv_sec = (time_t)(wait_ns / 1000000000ull),
+        .tv_nsec = (long)(wait_ns % 1000000000ull),
+    };
+    return pthread_cond_timedwait_relative_np(cond, mutex, &ts) == 0;
+#else
+    uint64_t deadline_ns = mds_time_monotonic_ns() + wait_ns;
+    struct timespec ts = {
+        .tv_sec = (time_t)(deadline_ns / 1000000000ull),
+        .tv_nsec = (long)(deadline_ns % 1000000000ull),
+    };
+    return pthread_cond_timedwait(cond, mutex, &ts) == 0;
+#endif
+}
+static inline void mds_cond_signal(mds_cond_t *cond) { pthread_cond_signal(cond); }
+static inline void mds_cond_broadcast(mds_cond_t *cond) { pthread_cond_broadcast(cond); }
+#endif
+
+/* ============================================================================
+ * Thread
+ * ========================================================================== */
+
+/**
+ * Thread entry point. Declare as
+ * "static mds_thread_result_t MDS_THREAD_CALL fn(void *arg)" and return 0.
+ */
+#ifdef _WIN32
+typedef HANDLE mds_thread_t;
+typedef unsigned mds_thread_result_t;
+#define MDS_THREAD_CALL __stdcall
+#else
+typedef pthread_t mds_thread_t;
+typedef void *mds_thread_result_t;
+#define MDS_THREAD_CALL
+#endif
+typedef mds_thread_result_t (MDS_THREAD_CALL *mds_thread_fn_t)(void *arg);
+
+/**
+ * Start a thread. On POSIX the thread starts with all signals blocked, so
+ * the application's handlers keep running on its own threads.
+ * Returns 0 or a negative errno.
+ */
+static inline int mds_thread_create(mds_thread_t *thread, mds_thread_fn_t fn, void *arg) {
+#ifdef _WIN32
+    uintptr_t handle = _beginthreadex(NULL, 0, fn, arg, 0, NULL);
+    if (handle == 0) {
+        return -errno;
+    }
+    *thread = (HANDLE)handle;
+    return 0;
+#else
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int ret = pthread_create(thread, NULL, fn, arg);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return -ret;
+#endif
+}
+
+static inline void mds_thread_join(mds_thread_t thread) {
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+/* ============================================================================
+ * Atomics
+ * ========================================================================== */
+
+/**
+ * Atomic integer. Always access through the helpers below.
+ */
+#ifdef _WIN32
+typedef volatile LONG mds_atomic_int_t;
+#else
+typedef volatile int mds_atomic_int_t;
+#endif
+
+static inline int mds_atomic_load(mds_atomic_int_t *value) {
+#ifdef _WIN32
+    return (int)InterlockedCompareExchange(value, 0, 0);
+#else
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline void mds_atomic_store(mds_atomic_int_t *value, int desired) {
+#ifdef _WIN32
+    InterlockedExchange(value, (LONG)desired);
+#else
+    __atomic_store_n(value, desired, __ATOMIC_RELEASE);
+#endif
+}
+
+/** Set *value to desired if it equals expected. Returns true on success. */
+static inline bool mds_atomic_cas(mds_atomic_int_t *value, int expected, int desired) {
+#ifdef _WIN32
+    return InterlockedCompareExchange(value, (LONG)desired, (LONG)expected) == (LONG)expected;
+#else
+    return __atomic_compare_exchange_n(value, &expected, desired, false,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/** Set *value to desired and return the previous value. */
+static inline int mds_atomic_exchange(mds_atomic_int_t *value, int desired) {
+#ifdef _WIN32
+    return (int)InterlockedExchange(value, (LONG)desired);
+#else
+    return __atomic_exchange_n(value, desired, __ATOMIC_ACQ_REL);
+#endif
+}
+
+/** Add delta to *value and return the new value. */
+static inline int mds_atomic_add(mds_atomic_int_t *value, int delta) {
+#ifdef _WIN32
+    return (int)InterlockedAdd(value, (LONG)delta);
+#else
+    return __atomic_add_fetch(value, delta, __ATOMIC_ACQ_REL);
+#endif
+}
+
+#endif /* MDS_THREAD_H */
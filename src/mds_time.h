@@ -0,0 +1,38 @@
+/**
+ * @file mds_time.h
+ * @brief Internal clock helpers
+ */
+
+#ifndef MDS_TIME_H
+#define MDS_TIME_H
+
+#include <stdint.h>
+#include <time.h>
+#include "mds_bridge/platform_compat.h"
+
+/**
+ * CLOCK_MONOTONIC in nanoseconds
+ */
+static inline uint64_t mds_time_monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * CLOCK_REALTIME in nanoseconds since the Unix epoch
+ */
+static inline uint64_t mds_time_realtime_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * CLOCK_MONOTONIC in milliseconds
+ */
+static inline int64_t mds_time_monotonic_ms(void) {
+    return (int64_t)(mds_time_monotonic_ns() / 1000000ull);
+}
+
+#endif /* MDS_TIME_H */
@@ -1,124 +1,291 @@
 /**
  * @file memfault_hid.c
  * @brief Main implementation of the memfault HID library
+ *
+ * Concurrency model:
+ * - memfault_hid_init()/memfault_hid_exit() are reference counted and may be
+ *   called from any thread; hidapi is shut down when the last user exits.
+ * - Different devices may be used from different threads without any
+ *   coordination.
+ * - On a single device, feature and output report I/O is serialized by a
+ *   per-device mutex, so a control thread can exchange feature reports while
+ *   another thread reads input reports.
+ * - The input read path takes no lock. Only one reader per device is allowed
+ *   at a time; a concurrent read returns MEMFAULT_HID_ERROR_BUSY. Report
+ *   filter updates take the reader slot too, so they never race a read.
+ * - memfault_hid_close() must not race any other call on the same device.
  */
 
 #include "memfault_hid_internal.h"
+#include "mds_thread.h"
+#include "mds_time.h"
+#include "mds_log_internal.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <hidapi.h>
 
+/* Input report route for a filtered Report ID */
+typedef struct {
+    memfault_hid_report_handler_t handler;
+    void *user_data;
+} report_route_t;
+
+/* Queued input report */
+typedef struct {
+    uint32_t seq;                                 /* Arrival order across all queues */
+    uint16_t length;                              /* Data length (excluding Report ID) */
+    uint64_t rx_monotonic_ns;                     /* Receive timestamps */
+    uint64_t rx_realtime_ns;
+    uint8_t data[MEMFAULT_HID_MAX_REPORT_SIZE];
+} queued_report_t;
+
+/* Per-Report-ID ring buffer of input reports */
+typedef struct {
+    queued_report_t *slots;
+    size_t depth;
+    size_t head;
+    size_t count;
+    uint32_t dropped;                             /* Oldest reports overwritten */
+} report_queue_t;
+
 /* Device structure */
 struct memfault_hid_device {
     hid_device *handle;
     memfault_hid_device_info_t info;
     memfault_hid_report_filter_t filter;
+    report_route_t *routes;           /* 256 entries, allocated on first route */
+    report_queue_t *queues[256];      /* Input report queues, created on demand */
+    size_t queue_depth[256];          /* Configured depth (0 = default) */
+    uint32_t pending[8];              /* Bit n set = queue n is non-empty */
+    uint32_t next_seq;                /* Arrival counter for queued reports */
+    uint64_t rx_monotonic_ns;         /* Receive time of the last report returned */
+    uint64_t rx_realtime_ns;
     bool nonblocking;
+    mds_mutex_t lock;                 /* Serializes feature/output I/O and config */
+    mds_atomic_int_t reader_active;   /* Input reader slot (see concurrency model) */
 };
 
 /* Library initialization state */
-static bool g_initialized = false;
+static mds_mutex_t g_init_lock = MDS_MUTEX_INITIALIZER;
+static int g_init_count = 0;                  /* Guarded by g_init_lock */
+static mds_atomic_int_t g_initialized = 0;    /* Lock-free view of g_init_count > 0 */
+
+static bool is_initialized(void) {
+    return mds_atomic_load(&g_initialized) != 0;
+}
 
 /* ============================================================================
  * Library Initialization
  * ========================================================================== */
 
 int memfault_hid_init(void) {
-    if (g_initialized) {
-        return MEMFAULT_HID_SUCCESS;
+    int result = MEMFAULT_HID_SUCCESS;
+
+    mds_mutex_lock(&g_init_lock);
+
+    if (g_init_count == 0) {
+        if (hid_init() != 0) {
+            result = MEMFAULT_HID_ERROR_UNKNOWN;
+        } else {
+            mds_atomic_store(&g_initialized, 1);
+        }
     }
 
-    if (hid_init() != 0) {
-        return MEMFAULT_HID_ERROR_UNKNOWN;
+    if (result == MEMFAULT_HID_SUCCESS) {
+        g_init_count++;
     }
 
-    g_initialized = true;
-    return MEMFAULT_HID_SUCCESS;
+    mds_mutex_unlock(&g_init_lock);
+    return result;
 }
 
 int memfault_hid_exit(void) {
-    if (!g_initialized) {
-        return MEMFAULT_HID_SUCCESS;
+    int result = MEMFAULT_HID_SUCCESS;
+
+    mds_mutex_lock(&g_init_lock);
+
+    if (g_init_count == 1) {
+        mds_atomic_store(&g_initialized, 0);
+        if (hid_exit() != 0) {
+            result = MEMFAULT_HID_ERROR_UNKNOWN;
+        }
     }
 
-    if (hid_exit() != 0) {
-        return MEMFAULT_HID_ERROR_UNKNOWN;
+    if (g_init_count > 0) {
+        g_init_count--;
     }
 
-    g_initialized = false;
-    return MEMFAULT_HID_SUCCESS;
+    mds_mutex_unlock(&g_init_lock);
+    return result;
 }
 
 /* ============================================================================
  * Device Enumeration
  * ========================================================================== */
 
-int memfault_hid_enumerate(uint16_t vendor_id,
-                           uint16_t product_id,
-                           memfault_hid_device_info_t **devices,
-                           size_t *num_devices) {
-    if (!g_initialized) {
-        return MEMFAULT_HID_ERROR_INVALID_PARAM;
+static bool filter_matches(const memfault_hid_enum_filter_t *filter,
+                           const struct hid_device_info *info) {
+    if (filter == NULL) {
+        return true;
     }
 
-    if (devices == NULL || num_devices == NULL) {
-        return MEMFAULT_HID_ERROR_INVALID_PARAM;
+    if (filter->vendor_id != 0 && info->vendor_id != filter->vendor_id) {
+        return false;
+    }
+    if (filter->product_id != 0 && info->product_id != filter->product_id) {
+        return false;
+    }
+    if (filter->usage_page != 0 && info->usage_page != filter->usage_page) {
+        return false;
+    }
+    if (filter->interface_number >= 0 && info->interface_number != filter->interface_number) {
+        return false;
+    }
+    if (filter->serial_prefix != NULL) {
+        size_t prefix_len = wcslen(filter->serial_prefix);
+        if (info->serial_number == NULL ||
+            wcsncmp(info->serial_number, filter->serial_prefix, prefix_len) != 0) {
+            return false;
+        }
     }
 
-    struct hid_device_info *dev_list = hid_enumerate(vendor_id, product_id);
-    if (dev_list == NULL) {
-        *devices = NULL;
-        *num_devices = 0;
-        return MEMFAULT_HID_SUCCESS;
+    return true;
+}
+
+int memfault_hid_enumerate_visit(const memfault_hid_enum_filter_t *filter,
+                                 memfault_hid_enum_visitor_t visitor,
+                                 void *user_data) {
+    if (!is_initialized() || visitor == NULL) {
+        return MEMFAULT_HID_ERROR_INVALID_PARAM;
     }
 
-    /* Count devices */
-    size_t count = 0;
-    struct hid_device_info *cur = dev_list;
-    while (cur) {
-        count++;
-        cur = cur->next;
+    /* Let hidapi narrow by VID/PID; the remaining predicates are checked here */
+    struct hid_device_info *dev_list = hid_enumerate(filter ? filter->vendor_id : 0,
+                                                     filter ? filter->product_id : 0);
+
+    int visited = 0;
+    for (struct hid_device_info *cur = dev_list; cur; cur = cur->next) {
+        if (!filter_matches(filter, cur)) {
+            continue;
+        }
+
+        memfault_hid_device_ref_t ref = {
+            .path = cur->path ? cur->path : "",
+            .vendor_id = cur->vendor_id,
+            .product_id = cur->product_id,
+            .release_number = cur->release_number,
+            .usage_page = cur->usage_page,
+            .usage = cur->usage,
+            .interface_number = cur->interface_number,
+            .handle = cur,
+        };
+
+        visited++;
+        if (!visitor(&ref, user_data)) {
+            break;
+        }
     }
 
-    /* Allocate device info array */
-    memfault_hid_device_info_t *dev_array = calloc(count, sizeof(memfault_hid_device_info_t));
-    if (dev_array == NULL) {
+    if (dev_list) {
         hid_free_enumeration(dev_list);
-        return MEMFAULT_HID_ERROR_NO_MEM;
     }
 
-    /* Fill device info */
-    cur = dev_list;
-    for (size_t i = 0; i < count; i++) {
-        strncpy(dev_array[i].path, cur->path, sizeof(dev_array[i].path) - 1);
-        dev_array[i].vendor_id = cur->vendor_id;
-        dev_array[i].product_id = cur->product_id;
+    return visited;
+}
 
-        if (cur->serial_number) {
-            wcsncpy(dev_array[i].serial_number, cur->serial_number, 127);
-        }
+static const wchar_t *ref_string(const wchar_t *str) {
+    return str ? str : L"";
+}
 
-        dev_array[i].release_number = cur->release_number;
+const wchar_t *memfault_hid_device_ref_serial(const memfault_hid_device_ref_t *device) {
+    if (device == NULL || device->handle == NULL) {
+        return L"";
+    }
+    return ref_string(((const struct hid_device_info *)device->handle)->serial_number);
+}
 
-        if (cur->manufacturer_string) {
-            wcsncpy(dev_array[i].manufacturer, cur->manufacturer_string, 127);
-        }
+const wchar_t *memfault_hid_device_ref_manufacturer(const memfault_hid_device_ref_t *device) {
+    if (device == NULL || device->handle == NULL) {
+        return L"";
+    }
+    return ref_string(((const struct hid_device_info *)device->handle)->manufacturer_string);
+}
+
+const wchar_t *memfault_hid_device_ref_product(const memfault_hid_device_ref_t *device) {
+    if (device == NULL || device->handle == NULL) {
+        return L"";
+    }
+    return ref_string(((const struct hid_device_info *)device->handle)->product_string);
+}
 
-        if (cur->product_string) {
-            wcsncpy(dev_array[i].product, cur->product_string, 127);
+/* Accumulator for memfault_hid_enumerate() */
+typedef struct {
+    memfault_hid_device_info_t *devices;
+    size_t count;
+    size_t capacity;
+    bool out_of_memory;
+} enum_collect_t;
+
+static bool collect_device(const memfault_hid_device_ref_t *device, void *user_data) {
+    enum_collect_t *collect = (enum_collect_t *)user_data;
+
+    if (collect->count == collect->capacity) {
+        size_t new_capacity = collect->capacity ? collect->capacity * 2 : 4;
+        memfault_hid_device_info_t *devices =
+            realloc(collect->devices, new_capacity * sizeof(memfault_hid_device_info_t));
+        if (devices == NULL) {
+            collect->out_of_memory = true;
+            return false;
         }
+        collect->devices = devices;
+        collect->capacity = new_capacity;
+    }
 
-        dev_array[i].usage_page = cur->usage_page;
-        dev_array[i].usage = cur->usage;
-        dev_array[i].interface_number = cur->interface_number;
+    memfault_hid_device_info_t *info = &collect->devices[collect->count++];
+    memset(info, 0, sizeof(*info));
+
+    strncpy(info->path, device->path, sizeof(info->path) - 1);
+    info->vendor_id = device->vendor_id;
+    info->product_id = device->product_id;
+    wcsncpy(info->serial_number, memfault_hid_device_ref_serial(device), 127);
+    info->release_number = device->release_number;
+    wcsncpy(info->manufacturer, memfault_hid_device_ref_manufacturer(device), 127);
+    wcsncpy(info->product, memfault_hid_device_ref_product(device), 127);
+    info->usage_page = device->usage_page;
+    info->usage = device->usage;
+    info->interface_number = device->interface_number;
+
+    return true;
+}
+
+int memfault_hid_enumerate(uint16_t vendor_id,
+                           uint16_t product_id,
+                           memfault_hid_device_info_t **devices,
+                           size_t *num_devices) {
+    if (!is_initialized()) {
+        return MEMFAULT_HID_ERROR_INVALID_PARAM;
+    }
 
-        cur = cur->next;
+    if (devices == NULL || num_devices == NULL) {
+        return MEMFAULT_HID_ERROR_INVALID_PARAM;
     }
 
-    hid_free_enumeration(dev_list);
+    memfault_hid_enum_filter_t filter = {
+        .vendor_id = vendor_id,
+        .product_id = product_id,
+        .interface_number = -1,
+    };
+    enum_collect_t collect = {0};
+
+    int ret = memfault_hid_enumerate_visit(&filter, collect_device, &collect);
+    if (ret < 0 || collect.out_of_memory) {
+        free(collect.devices);
+        return ret < 0 ? ret : MEMFAULT_HID_ERROR_NO_MEM;
+    }
 
-    *devices = dev_array;
-    *num_devices = count;
+    *devices = collect.devices;
+    *num_devices = collect.count;
     return MEMFAULT_HID_SUCCESS;
 }
 
@@ -131,7 +298,7 @@ void memfault_hid_free_device_list(memfault_hid_device_info_t *devices) {
  * ========================================================================== */
 
 int memfault_hid_open_path(const char *path, memfault_hid_device_t **device) {
-    if (!g_initialized || path == NULL || device == NULL) {
+    if (!is_initialized() || path == NULL || device == NULL) {
         return MEMFAULT_HID_ERROR_INVALID_PARAM;
     }
 
@@ -151,6 +318,7 @@ int memfault_hid_open_path(const char *path, memfault_hid_device_t **device) {
 
     dev->nonblocking = false;
     dev->filter.filter_enabled = false;
+    mds_mutex_init(&dev->lock);
 
     *device = dev;
     return MEMFAULT_HID_SUCCESS;
@@ -160,7 +328,7 @@ int memfault_hid_open(uint16_t vendor_id,
                       uint16_t product_id,
                       const wchar_t *serial_number,
                       memfault_hid_device_t **device) {
-    if (!g_initialized || device == NULL) {
+    if (!is_initialized() || device == NULL) {
         return MEMFAULT_HID_ERROR_INVALID_PARAM;
     }
 
@@ -184,6 +352,7 @@ int memfault_hid_open(uint16_t vendor_id,
 
     dev->nonblocking = false;
     dev->filter.filter_enabled = false;
+    mds_mutex_init(&dev->lock);
 
     *device = dev;
     return MEMFAULT_HID_SUCCESS;
@@ -198,10 +367,16 @@ void memfault_hid_close(memfault_hid_device_t *device) {
         hid_close(device->handle);
     }
 
-    if (device->filter.report_ids) {
-        free(device->filter.report_ids);
+    free(device->routes);
+
+    for (size_t i = 0; i < 256; i++) {
+        if (device->queues[i]) {
+            free(device->queues[i]->slots);
+            free(device->queues[i]);
+        }
     }
 
+    mds_mutex_destroy(&device->lock);
     free(device);
 }
 
@@ -225,23 +400,16 @@ int memfault_hid_set_report_filter(memfault_hid_device_t *device,
         return MEMFAULT_HID_ERROR_INVALID_PARAM;
     }
 
-    /* Free existing filter */
-    if (device->filter.report_ids) {
-        free(device->filter.report_ids);
-        device->filter.report_ids = NULL;
+    /* The lock-free read path consults the filter, so take the reader slot */
+    if (!mds_atomic_cas(&device->reader_active, 0, 1)) {
+        return MEMFAULT_HID_ERROR_BUSY;
     }
+    mds_mutex_lock(&device->lock);
 
-    /* Copy new filter */
-    if (filter->num_report_ids > 0 && filter->report_ids != NULL) {
-        device->filter.report_ids = malloc(filter->num_report_ids);
-        if (device->filter.report_ids == NULL) {
-            return MEMFAULT_HID_ERROR_NO_MEM;
-        }
-        memcpy(device->filter.report_ids, filter->report_ids, filter->num_report_ids);
-    }
+    device->filter = *filter;
 
-    device->filter.num_report_ids = filter->num_report_ids;
-    device->filter.filter_enabled = filter->filter_enabled;
+    mds_mutex_unlock(&device->lock);
+    mds_atomic_store(&device->reader_active, 0);
 
     return MEMFAULT_HID_SUCCESS;
 }
@@ -252,10 +420,42 @@ int memfault_hid_get_report_filter(memfault_hid_device_t *device,
         return MEMFAULT_HID_ERROR_INVALID_PARAM;
     }
 
-    filter->report_ids = device->filter.report_ids;
-    filter->num_report_ids = device->filter.num_report_ids;
-    filter->filter_enabled = device->filter.filter_enabled;
+    mds_mutex_lock(&device->lock);
+    *filter = device->filter;
+    mds_mutex_unlock(&device->lock);
+
+    return MEMFAULT_HID_SUCCESS;
+}
+
+int memfault_hid_set_report_handler(memfault_hid_device_t *device,
+                                     uint8_t report_id,
+                                     memfault_hid_report_handler_t handler,
+                                     void *user_data) {
+    if (device == NULL) {
+        return MEMFAULT_HID_ERROR_INVALID_PARAM;
+    }
+
+    /* The lock-free read path consults the routes, so take the reader slot */
+    if (!mds_atomic_cas(&device->reader_active, 0, 1)) {
+        return MEMFAULT_HID_ERROR_BUSY;
+    }
+
+    if (device->routes == NULL) {
+        if (handler == NULL) {
+            mds_atomic_store(&device->reader_active, 0);
+            return MEMFAULT_HID_SUCCESS;
+        }
+        device->routes = calloc(256, sizeof(report_route_t));
+        if (device->routes == NULL) {
+            mds_atomic_store(&device->reader_active, 0);
+            return MEMFAULT_HID_ERROR_NO_MEM;
+        }
+    }
+
+    device->routes[report_id].handler = handler;
+    device->routes[report_id].user_data = user_data;
 
+    mds_atomic_store(&device->reader_active, 0);
     return MEMFAULT_HID_SUCCESS;
 }
 
@@ -264,17 +464,76 @@ int memfault_hid_get_report_filter(memfault_hid_device_t *device,
  * ========================================================================== */
 
 static bool is_report_filtered(memfault_hid_device_t *device, uint8_t report_id) {
-    if (!device->filter.filter_enabled) {
+    return device->filter.filter_enabled &&
+           !memfault_hid_report_filter_contains(&device->filter, report_id);
+}
+
+/* Route a filtered input report to its handler. Returns false if unrouted. */
+static bool dispatch_filtered_report(memfault_hid_device_t *device,
+                                     const uint8_t *buffer, int length) {
+    if (device->routes == NULL) {
         return false;
     }
 
-    for (size_t i = 0; i < device->filter.num_report_ids; i++) {
-        if (device->filter.report_ids[i] == report_id) {
-            return false;  /* Report ID is in filter list, don't filter it */
-        }
+    const report_route_t *route = &device->routes[buffer[0]];
+    if (route->handler == NULL) {
+        return false;
+    }
+
+    route->handler(buffer[0], buffer + 1, (size_t)(length - 1), route->user_data);
+    return true;
+}
+
+/* Send a report whose buffer already starts with the Report ID */
+static int write_raw(memfault_hid_device_t *device, const uint8_t *raw, size_t size,
+                     bool feature) {
+    mds_mutex_lock(&device->lock);
+
+    if (is_report_filtered(device, raw[0])) {
+        mds_mutex_unlock(&device->lock);
+        return MEMFAULT_HID_ERROR_INVALID_REPORT_TYPE;
+    }
+
+    /* Output reports go through hid_write() for compatibility with older
+     * HIDAPI versions (pre-0.14.0); it behaves the same for our use case */
+    int result = feature ? hid_send_feature_report(device->handle, raw, size)
+                         : hid_write(device->handle, raw, size);
+
+    mds_mutex_unlock(&device->lock);
+
+    if (result < 0) {
+        return MEMFAULT_HID_ERROR_IO;
+    }
+
+    return result - 1;  /* Don't count the Report ID byte */
+}
+
+/* GET_FEATURE into raw (Report ID first). Returns bytes excluding the Report ID. */
+static int get_feature_raw(memfault_hid_device_t *device, uint8_t report_id,
+                           uint8_t *raw, size_t size) {
+    raw[0] = report_id;
+
+    mds_mutex_lock(&device->lock);
+
+    if (is_report_filtered(device, report_id)) {
+        mds_mutex_unlock(&device->lock);
+        return MEMFAULT_HID_ERROR_INVALID_REPORT_TYPE;
+    }
+
+    int result = hid_get_feature_report(device->handle, raw, size);
+
+    mds_mutex_unlock(&device->lock);
+
+    if (result < 0) {
+        return MEMFAULT_HID_ERROR_IO;
+    }
+
+    /* Verify Report ID in response matches what we requested */
+    if (raw[0] != report_id) {
+        return MEMFAULT_HID_ERROR_IO;
     }
 
-    return true;  /* Report ID not in filter list, filter it out */
+    return result - 1;
 }
 
 int memfault_hid_write_report(memfault_hid_device_t *device,
@@ -282,14 +541,10 @@ int memfault_hid_write_report(memfault_hid_device_t *device,
                                const uint8_t *data,
                                size_t length,
                                int timeout_ms) {
-    if (device == NULL || data == NULL) {
+    if (device == NULL || data == NULL || length > MEMFAULT_HID_MAX_REPORT_SIZE) {
         return MEMFAULT_HID_ERROR_INVALID_PARAM;
     }
 
-    if (is_report_filtered(device, report_id)) {
-        return MEMFAULT_HID_ERROR_INVALID_REPORT_TYPE;
-    }
-
     (void)timeout_ms;  /* hidapi doesn't support write timeout */
 
     /* Prepare buffer with Report ID */
@@ -297,12 +552,242 @@ int memfault_hid_write_report(memfault_hid_device_t *device,
     buffer[0] = report_id;
     memcpy(buffer + 1, data, length);
 
-    int result = hid_write(device->handle, buffer, length + 1);
+    return write_raw(device, buffer, length + 1, false);
+}
+/* ============================================================================
+ * Input Report Demultiplexing
+ *
+ * Everything below runs with the reader slot held, so the queues need no lock.
+ * ========================================================================== */
+
+static bool is_pending(const memfault_hid_device_t *device, uint8_t report_id) {
+    return (device->pending[report_id >> 5] >> (report_id & 31)) & 1u;
+}
+
+static void set_pending(memfault_hid_device_t *device, uint8_t report_id, bool pending) {
+    if (pending) {
+        device->pending[report_id >> 5] |= (uint32_t)1 << (report_id & 31);
+    } else {
+        device->pending[report_id >> 5] &= ~((uint32_t)1 << (report_id & 31));
+    }
+}
+
+static report_queue_t *get_queue(memfault_hid_device_t *device, uint8_t report_id) {
+    if (device->queues[report_id]) {
+        return device->queues[report_id];
+    }
+
+    size_t depth = device->queue_depth[report_id];
+    if (depth == 0) {
+        depth = MEMFAULT_HID_REPORT_QUEUE_DEPTH;
+    }
+
+    report_queue_t *queue = calloc(1, sizeof(report_queue_t));
+    if (queue == NULL) {
+        return NULL;
+    }
+    queue->slots = calloc(depth, sizeof(queued_report_t));
+    if (queue->slots == NULL) {
+        free(queue);
+        return NULL;
+    }
+    queue->depth = depth;
+
+    device->queues[report_id] = queue;
+    return queue;
+}
+
+/* Park a report read while waiting for another Report ID (drops oldest when full) */
+static void enqueue_report(memfault_hid_device_t *device, const uint8_t *buffer, int length,
+                           uint64_t rx_monotonic_ns, uint64_t rx_realtime_ns) {
+    uint8_t rid = buffer[0];
+    report_queue_t *queue = get_queue(device, rid);
+    if (queue == NULL) {
+        return;
+    }
+
+    if (queue->count == queue->depth) {
+        queue->head = (queue->head + 1) % queue->depth;
+        queue->count--;
+        queue->dropped++;
+        mds_log(MDS_LOG_WARN, MDS_LOG_HID, "Report 0x%02X queue full, dropped oldest (%lu total)",
+                rid, (unsigned long)queue->dropped);
+    }
+
+    queued_report_t *slot = &queue->slots[(queue->head + queue->count) % queue->depth];
+    slot->seq = device->next_seq++;
+    slot->length = (uint16_t)(length - 1);
+    slot->rx_monotonic_ns = rx_monotonic_ns;
+    slot->rx_realtime_ns = rx_realtime_ns;
+    memcpy(slot->data, buffer + 1, slot->length);
+    queue->count++;
+
+    set_pending(device, rid, true);
+}
+
+/* Pop the oldest queued report for report_id into buffer (Report ID first) */
+static int dequeue_report(memfault_hid_device_t *device, uint8_t report_id,
+                          uint8_t *buffer, size_t size) {
+    report_queue_t *queue = device->queues[report_id];
+    queued_report_t *slot = &queue->slots[queue->head];
+
+    size_t data_len = slot->length;
+    if (data_len > size - 1) {
+        data_len = size - 1;
+    }
+    buffer[0] = report_id;
+    memcpy(buffer + 1, slot->data, data_len);
+    int result = (int)data_len + 1;
+
+    device->rx_monotonic_ns = slot->rx_monotonic_ns;
+    device->rx_realtime_ns = slot->rx_realtime_ns;
+
+    queue->head = (queue->head + 1) % queue->depth;
+    if (--queue->count == 0) {
+        set_pending(device, report_id, false);
+    }
+    return result;
+}
+
+/* Report ID of the oldest queued report (pending bitmap keeps this cheap) */
+static int oldest_pending(const memfault_hid_device_t *device) {
+    int oldest = -1;
+    uint32_t oldest_seq = 0;
+
+    for (size_t word = 0; word < 8; word++) {
+        if (device->pending[word] == 0) {
+            continue;
+        }
+
+        for (size_t bit = 0; bit < 32; bit++) {
+            if (!((device->pending[word] >> bit) & 1u)) {
+                continue;
+            }
+
+            uint8_t rid = (uint8_t)(word * 32 + bit);
+            const report_queue_t *queue = device->queues[rid];
+            uint32_t seq = queue->slots[queue->head].seq;
+            if (oldest < 0 || (int32_t)(seq - oldest_seq) < 0) {
+                oldest = rid;
+                oldest_seq = seq;
+            }
+        }
+    }
+
+    return oldest;
+}
+
+/*
+ * Read the next report from the device into buffer (Report ID first).
+ *
+ * want_id < 0 accepts any report that is not routed to a handler. Otherwise
+ * only want_id is returned: filtered reports go to their handler (or are
+ * discarded), and other Report IDs are parked in their queue.
+ * Returns the hidapi result (bytes incl. Report ID, 0 on timeout, < 0 on error).
+ */
+static int read_next_report(memfault_hid_device_t *device, int want_id,
+                            uint8_t *buffer, size_t size, int timeout_ms) {
+    int64_t deadline = (timeout_ms > 0) ? mds_time_monotonic_ms() + timeout_ms : 0;
+    /* 0 polls once whatever the device's blocking mode; negative waits forever */
+    int wait_ms = (timeout_ms < 0) ? -1 : timeout_ms;
+    int result;
+
+    for (;;) {
+        result = hid_read_timeout(device->handle, buffer, size, wait_ms);
+
+        if (result <= 0) {
+            return result;
+        }
+
+        /* Timestamp right after the read returns, before any bookkeeping */
+        uint64_t rx_monotonic_ns = mds_time_monotonic_ns();
+        uint64_t rx_realtime_ns = mds_time_realtime_ns();
+
+        uint8_t rid = buffer[0];
+        if (want_id >= 0 && rid == want_id) {
+            device->rx_monotonic_ns = rx_monotonic_ns;
+            device->rx_realtime_ns = rx_realtime_ns;
+            return result;
+        }
+
+        if (is_report_filtered(device, rid)) {
+            if (!dispatch_filtered_report(device, buffer, result) && want_id < 0) {
+                device->rx_monotonic_ns = rx_monotonic_ns;
+                device->rx_realtime_ns = rx_realtime_ns;
+                return result;  /* Unrouted - caller reports it as filtered */
+            }
+        } else if (want_id < 0) {
+            device->rx_monotonic_ns = rx_monotonic_ns;
+            device->rx_realtime_ns = rx_realtime_ns;
+            return result;
+        } else {
+            enqueue_report(device, buffer, result, rx_monotonic_ns, rx_realtime_ns);
+        }
+
+        /* Routed or parked - keep waiting until the deadline */
+        if (timeout_ms > 0) {
+            int64_t remaining = deadline - mds_time_monotonic_ms();
+            if (remaining <= 0) {
+                return 0;
+            }
+            wait_ms = (int)remaining;
+        }
+    }
+}
+
+static int copy_report_data(const uint8_t *buffer, int result, uint8_t *data, size_t length) {
+    size_t data_len = (size_t)(result - 1);
+    if (data_len > length) {
+        data_len = length;
+    }
+    memcpy(data, buffer + 1, data_len);
+    return (int)data_len;
+}
+
+/*
+ * Read one input report into raw (Report ID first, at least
+ * MEMFAULT_HID_MAX_REPORT_SIZE + 1 bytes). want_id < 0 accepts any Report ID.
+ * Returns bytes including the Report ID, or an error code.
+ */
+static int read_input_raw(memfault_hid_device_t *device, int want_id,
+                          uint8_t *raw, size_t size, int timeout_ms) {
+    /* Lock-free single-reader path: claim the reader slot for this call */
+    if (!mds_atomic_cas(&device->reader_active, 0, 1)) {
+        return MEMFAULT_HID_ERROR_BUSY;
+    }
+
+    if (want_id >= 0 && is_report_filtered(device, (uint8_t)want_id)) {
+        mds_atomic_store(&device->reader_active, 0);
+        return MEMFAULT_HID_ERROR_INVALID_REPORT_TYPE;
+    }
+
+    /* Reports parked by memfault_hid_read_report_id() come first, oldest first */
+    int queued = (want_id >= 0) ? (is_pending(device, (uint8_t)want_id) ? want_id : -1)
+                                : oldest_pending(device);
+    int result;
+    if (queued >= 0) {
+        result = dequeue_report(device, (uint8_t)queued, raw, size);
+    } else {
+        result = read_next_report(device, want_id, raw, size, timeout_ms);
+    }
+
+    bool filtered = (result > 0) && is_report_filtered(device, raw[0]);
+
+    mds_atomic_store(&device->reader_active, 0);
+
     if (result < 0) {
         return MEMFAULT_HID_ERROR_IO;
     }
 
-    return result - 1;  /* Don't count the Report ID byte */
+    if (result == 0) {
+        return MEMFAULT_HID_ERROR_TIMEOUT;
+    }
+
+    if (filtered) {
+        return MEMFAULT_HID_ERROR_INVALID_REPORT_TYPE;
+    }
+
+    return result;
 }
 
 int memfault_hid_read_report(memfault_hid_device_t *device,
@@ -315,132 +800,221 @@ int memfault_hid_read_report(memfault_hid_device_t *device,
     }
 
     uint8_t buffer[MEMFAULT_HID_MAX_REPORT_SIZE + 1];
-    int result;
+    int result = read_input_raw(device, -1, buffer, sizeof(buffer), timeout_ms);
+    if (result < 0) {
+        return result;
+    }
 
-    if (timeout_ms == 0) {
-        result = hid_read(device->handle, buffer, sizeof(buffer));
-    } else {
-        result = hid_read_timeout(device->handle, buffer, sizeof(buffer), timeout_ms);
+    /* First byte is Report ID */
+    if (report_id) {
+        *report_id = buffer[0];
+    }
+
+    return copy_report_data(buffer, result, data, length);
+}
+int memfault_hid_read_report_id(memfault_hid_device_t *device,
+                                 uint8_t report_id,
+                                 uint8_t *data,
+                                 size_t length,
+                                 int timeout_ms) {
+    if (device == NULL || data == NULL) {
+        return MEMFAULT_HID_ERROR_INVALID_PARAM;
     }
 
+    uint8_t buffer[MEMFAULT_HID_MAX_REPORT_SIZE + 1];
+    int result = read_input_raw(device, report_id, buffer, sizeof(buffer), timeout_ms);
     if (result < 0) {
-        return MEMFAULT_HID_ERROR_IO;
+        return result;
     }
 
-    if (result == 0) {
-        return MEMFAULT_HID_ERROR_TIMEOUT;
+    return copy_report_data(buffer, result, data, length);
+}
+
+int memfault_hid_get_rx_timestamp(memfault_hid_device_t *device,
+                                   uint64_t *monotonic_ns,
+                                   uint64_t *realtime_ns) {
+    if (device == NULL) {
+        return MEMFAULT_HID_ERROR_INVALID_PARAM;
     }
 
-    /* First byte is Report ID */
-    uint8_t rid = buffer[0];
+    if (device->rx_monotonic_ns == 0) {
+        return MEMFAULT_HID_ERROR_NOT_FOUND;
+    }
 
-    if (is_report_filtered(device, rid)) {
-        return MEMFAULT_HID_ERROR_INVALID_REPORT_TYPE;
+    if (monotonic_ns) {
+        *monotonic_ns = device->rx_monotonic_ns;
     }
+    if (realtime_ns) {
+        *realtime_ns = device->rx_realtime_ns;
+    }
+    return MEMFAULT_HID_SUCCESS;
+}
 
-    if (report_id) {
-        *report_id = rid;
+int memfault_hid_set_report_queue_depth(memfault_hid_device_t *device,
+                                         uint8_t report_id,
+                                         size_t depth) {
+    if (device == NULL) {
+        return MEMFAULT_HID_ERROR_INVALID_PARAM;
     }
 
-    /* Copy data (excluding Report ID) */
-    size_t data_len = (size_t)(result - 1);
-    if (data_len > length) {
-        data_len = length;
+    if (!mds_atomic_cas(&device->reader_active, 0, 1)) {
+        return MEMFAULT_HID_ERROR_BUSY;
     }
-    memcpy(data, buffer + 1, data_len);
 
-    return (int)data_len;
+    /* Drop the existing queue (and anything in it); it is recreated on demand */
+    report_queue_t *queue = device->queues[report_id];
+    if (queue) {
+        free(queue->slots);
+        free(queue);
+        device->queues[report_id] = NULL;
+        set_pending(device, report_id, false);
+    }
+    device->queue_depth[report_id] = depth;
+
+    mds_atomic_store(&device->reader_active, 0);
+    return MEMFAULT_HID_SUCCESS;
 }
 
 int memfault_hid_get_feature_report(memfault_hid_device_t *device,
                                      uint8_t report_id,
                                      uint8_t *data,
                                      size_t length) {
-    if (device == NULL || data == NULL) {
+    if (device == NULL || data == NULL || length > MEMFAULT_HID_MAX_REPORT_SIZE) {
         return MEMFAULT_HID_ERROR_INVALID_PARAM;
     }
 
-    if (is_report_filtered(device, report_id)) {
-        return MEMFAULT_HID_ERROR_INVALID_REPORT_TYPE;
-    }
-
     uint8_t buffer[MEMFAULT_HID_MAX_REPORT_SIZE + 1];
-    buffer[0] = report_id;
-
-    int result = hid_get_feature_report(device->handle, buffer, length + 1);
+    int result = get_feature_raw(device, report_id, buffer, length + 1);
     if (result < 0) {
-        return MEMFAULT_HID_ERROR_IO;
-    }
-
-    /* Verify Report ID in response matches what we requested */
-    if (buffer[0] != report_id) {
-        return MEMFAULT_HID_ERROR_IO;
+        return result;
     }
 
     /* Copy data (excluding Report ID) */
-    memcpy(data, buffer + 1, result - 1);
-    return result - 1;
+    memcpy(data, buffer + 1, result);
+    return result;
 }
-
 int memfault_hid_send_output_report(memfault_hid_device_t *device,
                                      uint8_t report_id,
                                      const uint8_t *data,
                                      size_t length) {
-    if (device == NULL || data == NULL) {
+    if (device == NULL || data == NULL || length > MEMFAULT_HID_MAX_REPORT_SIZE) {
         return MEMFAULT_HID_ERROR_INVALID_PARAM;
     }
 
-    if (is_report_filtered(device, report_id)) {
-        return MEMFAULT_HID_ERROR_INVALID_REPORT_TYPE;
-    }
-
     uint8_t buffer[MEMFAULT_HID_MAX_REPORT_SIZE + 1];
     buffer[0] = report_id;
     memcpy(buffer + 1, data, length);
 
     /* Debug: Print what we're sending */
     #ifdef DEBUG_HID_REPORTS
-    printf("[DEBUG] Sending output report: ID=0x%02X, len=%zu, data=[", report_id, length);
-    for (size_t i = 0; i < length + 1; i++) {
-        printf("%02X%s", buffer[i], i < length ? " " : "");
+    char hex[3 * 16 + 1] = "";
+    for (size_t i = 0; i < length + 1 && i < 16; i++) {
+        snprintf(hex + 3 * i, 4, "%02X ", buffer[i]);
     }
-    printf("]\n");
+    mds_log(MDS_LOG_DEBUG, MDS_LOG_HID, "Sending output report: ID=0x%02X, len=%zu, data=[%s%s]",
+            report_id, length, hex, length + 1 > 16 ? "..." : "");
     #endif
 
-    // Use hid_write() for compatibility with older HIDAPI versions (pre-0.14.0)
-    // hid_write() sends output reports and works the same way for our use case
-    int result = hid_write(device->handle, buffer, length + 1);
-    if (result < 0) {
-        return MEMFAULT_HID_ERROR_IO;
-    }
-
-    return result - 1;
+    return write_raw(device, buffer, length + 1, false);
 }
-
 int memfault_hid_set_feature_report(memfault_hid_device_t *device,
                                      uint8_t report_id,
                                      const uint8_t *data,
                                      size_t length) {
-    if (device == NULL || data == NULL) {
+    if (device == NULL || data == NULL || length > MEMFAULT_HID_MAX_REPORT_SIZE) {
         return MEMFAULT_HID_ERROR_INVALID_PARAM;
     }
 
-    if (is_report_filtered(device, report_id)) {
-        return MEMFAULT_HID_ERROR_INVALID_REPORT_TYPE;
-    }
-
     uint8_t buffer[MEMFAULT_HID_MAX_REPORT_SIZE + 1];
     buffer[0] = report_id;
     memcpy(buffer + 1, data, length);
 
-    int result = hid_send_feature_report(device->handle, buffer, length + 1);
+    return write_raw(device, buffer, length + 1, true);
+}
+
+/* ============================================================================
+ * Buffer-based Report Communication
+ *
+ * The Report ID lives in the byte before buf->data, so the buffer is handed
+ * to hidapi as-is with no intermediate copy.
+ * ========================================================================== */
+
+int memfault_hid_read_report_buf(memfault_hid_device_t *device,
+                                  memfault_hid_report_buf_t *buf,
+                                  int timeout_ms) {
+    if (device == NULL || buf == NULL || buf->data == NULL) {
+        return MEMFAULT_HID_ERROR_INVALID_PARAM;
+    }
+
+    uint8_t *raw = buf->data - 1;
+    int result = read_input_raw(device, -1, raw, buf->capacity + 1, timeout_ms);
     if (result < 0) {
-        return MEMFAULT_HID_ERROR_IO;
+        return result;
     }
 
-    return result - 1;
+    buf->report_id = raw[0];
+    buf->length = (size_t)(result - 1);
+    return (int)buf->length;
 }
 
+int memfault_hid_read_report_id_buf(memfault_hid_device_t *device,
+                                     uint8_t report_id,
+                                     memfault_hid_report_buf_t *buf,
+                                     int timeout_ms) {
+    if (device == NULL || buf == NULL || buf->data == NULL) {
+        return MEMFAULT_HID_ERROR_INVALID_PARAM;
+    }
+
+    uint8_t *raw = buf->data - 1;
+    int result = read_input_raw(device, report_id, raw, buf->capacity + 1, timeout_ms);
+    if (result < 0) {
+        return result;
+    }
+
+    buf->report_id = raw[0];
+    buf->length = (size_t)(result - 1);
+    return (int)buf->length;
+}
+
+int memfault_hid_write_report_buf(memfault_hid_device_t *device,
+                                   memfault_hid_report_buf_t *buf) {
+    if (device == NULL || buf == NULL || buf->data == NULL || buf->length > buf->capacity) {
+        return MEMFAULT_HID_ERROR_INVALID_PARAM;
+    }
+
+    uint8_t *raw = buf->data - 1;
+    raw[0] = buf->report_id;
+    return write_raw(device, raw, buf->length + 1, false);
+}
+
+int memfault_hid_set_feature_report_buf(memfault_hid_device_t *device,
+                                         memfault_hid_report_buf_t *buf) {
+    if (device == NULL || buf == NULL || buf->data == NULL || buf->length > buf->capacity) {
+        return MEMFAULT_HID_ERROR_INVALID_PARAM;
+    }
+
+    uint8_t *raw = buf->data - 1;
+    raw[0] = buf->report_id;
+    return write_raw(device, raw, buf->length + 1, true);
+}
+
+int memfault_hid_get_feature_report_buf(memfault_hid_device_t *device,
+                                         uint8_t report_id,
+                                         memfault_hid_report_buf_t *buf) {
+    if (device == NULL || buf == NULL || buf->data == NULL) {
+        return MEMFAULT_HID_ERROR_INVALID_PARAM;
+    }
+
+    size_t want = (buf->length > 0 && buf->length <= buf->capacity) ? buf->length : buf->capacity;
+    int result = get_feature_raw(device, report_id, buf->data - 1, want + 1);
+    if (result < 0) {
+        return result;
+    }
+
+    buf->report_id = report_id;
+    buf->length = (size_t)result;
+    return result;
+}
 /* ============================================================================
  * Utility Functions
  * ========================================================================== */
@@ -485,10 +1059,15 @@ int memfault_hid_set_nonblocking(memfault_hid_device_t *device, bool nonblock) {
         return MEMFAULT_HID_ERROR_INVALID_PARAM;
     }
 
+    mds_mutex_lock(&device->lock);
     int result = hid_set_nonblocking(device->handle, nonblock ? 1 : 0);
+    if (result == 0) {
+        device->nonblocking = nonblock;
+    }
+    mds_mutex_unlock(&device->lock);
+
     if (result < 0) {
         return MEMFAULT_HID_ERROR_IO;
     }
-    device->nonblocking = nonblock;
     return MEMFAULT_HID_SUCCESS;
 }
@@ -0,0 +1,126 @@
+/**
+ * @file memfault_hid_buf.c
+ * @brief Pooled, cache-aligned report buffers
+ *
+ * All slabs live in one allocation. Each slab starts on a
+ * MEMFAULT_HID_BUF_ALIGN boundary with the Report ID byte, followed by up to
+ * MEMFAULT_HID_MAX_REPORT_SIZE bytes of report data, so a slab can be passed
+ * to hidapi exactly as it expects a report buffer.
+ */
+
+#include "memfault_hid_internal.h"
+#include "mds_thread.h"
+#include <stdlib.h>
+#include <stdint.h>
+
+/* Slab size: Report ID + max report, rounded up to whole cache lines */
+#define SLAB_SIZE \
+    (((MEMFAULT_HID_MAX_REPORT_SIZE + 1) + MEMFAULT_HID_BUF_ALIGN - 1) & \
+     ~(size_t)(MEMFAULT_HID_BUF_ALIGN - 1))
+
+/* Pool structure */
+struct memfault_hid_buf_pool {
+    mds_mutex_t lock;
+    void *memory;                           /* Unaligned slab allocation */
+    memfault_hid_report_buf_t *bufs;        /* Descriptors, one per slab */
+    memfault_hid_report_buf_t *free_list;   /* Guarded by lock */
+    size_t count;
+    size_t available;                       /* Guarded by lock */
+};
+
+int memfault_hid_buf_pool_create(size_t count, memfault_hid_buf_pool_t **pool) {
+    if (count == 0 || pool == NULL || count > SIZE_MAX / SLAB_SIZE - 1) {
+        return MEMFAULT_HID_ERROR_INVALID_PARAM;
+    }
+
+    memfault_hid_buf_pool_t *p = calloc(1, sizeof(memfault_hid_buf_pool_t));
+    if (p == NULL) {
+        return MEMFAULT_HID_ERROR_NO_MEM;
+    }
+
+    /* Over-allocate by one slab so the first slab can be aligned (C99 has no aligned_alloc) */
+    p->memory = malloc((count + 1) * SLAB_SIZE);
+    p->bufs = calloc(count, sizeof(memfault_hid_report_buf_t));
+    if (p->memory == NULL || p->bufs == NULL) {
+        free(p->memory);
+        free(p->bufs);
+        free(p);
+        return MEMFAULT_HID_ERROR_NO_MEM;
+    }
+
+    uintptr_t base = ((uintptr_t)p->memory + MEMFAULT_HID_BUF_ALIGN - 1) &
+                     ~(uintptr_t)(MEMFAULT_HID_BUF_ALIGN - 1);
+
+    for (size_t i = 0; i < count; i++) {
+        memfault_hid_report_buf_t *buf = &p->bufs[i];
+        buf->data = (uint8_t *)(base + i * SLAB_SIZE) + 1;   /* Headroom for Report ID */
+        buf->capacity = MEMFAULT_HID_MAX_REPORT_SIZE;
+        buf->pool = p;
+        buf->next = p->free_list;
+        p->free_list = buf;
+    }
+
+    p->count = count;
+    p->available = count;
+    mds_mutex_init(&p->lock);
+
+    *pool = p;
+    return MEMFAULT_HID_SUCCESS;
+}
+
+void memfault_hid_buf_pool_destroy(memfault_hid_buf_pool_t *pool) {
+    if (pool == NULL) {
+        return;
+    }
+
+    mds_mutex_destroy(&pool->lock);
+    free(pool->memory);
+    free(pool->bufs);
+    free(pool);
+}
+
+memfault_hid_report_buf_t *memfault_hid_buf_alloc(memfault_hid_buf_pool_t *pool) {
+    if (pool == NULL) {
+        return NULL;
+    }
+
+    mds_mutex_lock(&pool->lock);
+    memfault_hid_report_buf_t *buf = pool->free_list;
+    if (buf) {
+        pool->free_list = buf->next;
+        pool->available--;
+    }
+    mds_mutex_unlock(&pool->lock);
+
+    if (buf) {
+        buf->next = NULL;
+        buf->length = 0;
+        buf->report_id = 0;
+    }
+    return buf;
+}
+
+void memfault_hid_buf_free(memfault_hid_report_buf_t *buf) {
+    if (buf == NULL || buf->pool == NULL) {
+        return;
+    }
+
+    memfault_hid_buf_pool_t *pool = buf->pool;
+
+    mds_mutex_lock(&pool->lock);
+    buf->next = pool->free_list;
+    pool->free_list = buf;
+    pool->available++;
+    mds_mutex_unlock(&pool->lock);
+}
+
+size_t memfault_hid_buf_pool_available(memfault_hid_buf_pool_t *pool) {
+    if (pool == NULL) {
+        return 0;
+    }
+
+    mds_mutex_lock(&pool->lock);
+    size_t available = pool->available;
+    mds_mutex_unlock(&pool->lock);
+    return available;
+}
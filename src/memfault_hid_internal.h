@@ -10,6 +10,12 @@
  *
  * Applications should generally use the public API in memfault_hid.h or
  * the high-level MDS API in mds_protocol.h instead.
+ *
+ * Thread safety: separate devices are independent. On one device, feature
+ * and output reports are serialized by a per-device lock, while input reads
+ * are lock-free and limited to one reader at a time (a second concurrent
+ * reader gets MEMFAULT_HID_ERROR_BUSY). memfault_hid_close() must not race
+ * other calls on the same device.
  */
 
 #ifndef MEMFAULT_HID_INTERNAL_H
@@ -27,8 +33,11 @@ extern "C" {
 #define MEMFAULT_HID_VERSION_MINOR 0
 #define MEMFAULT_HID_VERSION_PATCH 0
 
-/* Maximum report size (increased to support MDS feature reports up to 128 bytes) */
-#define MEMFAULT_HID_MAX_REPORT_SIZE 256
+/* Maximum report size (high-speed interrupt reports, MDS large-report mode) */
+#define MEMFAULT_HID_MAX_REPORT_SIZE 1024
+
+/* Default depth of the per-Report-ID input queues */
+#define MEMFAULT_HID_REPORT_QUEUE_DEPTH 8
 
 /**
  * @brief Report types (HID report types)
@@ -52,13 +61,87 @@ typedef struct memfault_hid_device memfault_hid_device_t;
  *
  * This structure allows the library to filter reports by Report ID,
  * enabling coexistence with other HID functionality in the application.
+ * Allowed Report IDs are stored as a 256-bit bitmap, so lookups are O(1)
+ * and setting up a filter needs no allocation. Use the helpers below to
+ * build it.
  */
 typedef struct {
-    uint8_t *report_ids;             /* Array of Report IDs to filter */
-    size_t num_report_ids;           /* Number of Report IDs in the array */
+    uint32_t bitmap[8];              /* Bit n set = Report ID n allowed */
     bool filter_enabled;             /* Enable/disable filtering */
 } memfault_hid_report_filter_t;
 
+/**
+ * @brief Remove all Report IDs from a filter (does not change filter_enabled)
+ */
+static inline void memfault_hid_report_filter_clear(memfault_hid_report_filter_t *filter) {
+    for (size_t i = 0; i < sizeof(filter->bitmap) / sizeof(filter->bitmap[0]); i++) {
+        filter->bitmap[i] = 0;
+    }
+}
+
+/**
+ * @brief Allow a Report ID through the filter
+ */
+static inline void memfault_hid_report_filter_add(memfault_hid_report_filter_t *filter,
+                                                  uint8_t report_id) {
+    filter->bitmap[report_id >> 5] |= (uint32_t)1 << (report_id & 31);
+}
+
+/**
+ * @brief Stop allowing a Report ID through the filter
+ */
+static inline void memfault_hid_report_filter_remove(memfault_hid_report_filter_t *filter,
+                                                     uint8_t report_id) {
+    filter->bitmap[report_id >> 5] &= ~((uint32_t)1 << (report_id & 31));
+}
+
+/**
+ * @brief Check whether a Report ID is in the filter
+ */
+static inline bool memfault_hid_report_filter_contains(const memfault_hid_report_filter_t *filter,
+                                                       uint8_t report_id) {
+    return (filter->bitmap[report_id >> 5] >> (report_id & 31)) & 1u;
+}
+
+/**
+ * @brief Handler for input reports rejected by the report filter
+ *
+ * Invoked from the thread calling memfault_hid_read_report().
+ *
+ * @param report_id Report ID of the received report
+ * @param data Report data (excluding Report ID), valid only during the call
+ * @param length Length of data
+ * @param user_data User-provided context pointer
+ */
+typedef void (*memfault_hid_report_handler_t)(uint8_t report_id,
+                                              const uint8_t *data,
+                                              size_t length,
+                                              void *user_data);
+
+/**
+ * @brief Opaque handle to a report buffer pool
+ */
+typedef struct memfault_hid_buf_pool memfault_hid_buf_pool_t;
+
+/**
+ * @brief Pooled report buffer
+ *
+ * The byte before data is reserved as headroom for the Report ID, so the
+ * buffer-based I/O functions hand the same memory to hidapi without an
+ * intermediate copy. Obtain buffers from memfault_hid_buf_alloc().
+ */
+typedef struct memfault_hid_report_buf {
+    uint8_t *data;                           /* Report data (excluding Report ID) */
+    size_t length;                           /* Valid bytes in data */
+    size_t capacity;                         /* Size of data */
+    uint8_t report_id;                       /* Report ID */
+    struct memfault_hid_report_buf *next;    /* Internal - pool free list */
+    memfault_hid_buf_pool_t *pool;           /* Internal - owning pool */
+} memfault_hid_report_buf_t;
+
+/* Alignment of pooled buffers (Report ID byte starts a cache line) */
+#define MEMFAULT_HID_BUF_ALIGN 64
+
 /* ============================================================================
  * Device Management
  * ========================================================================== */
@@ -122,6 +205,7 @@ int memfault_hid_get_device_info(memfault_hid_device_t *device,
  * @param filter Filter configuration
  *
  * @return MEMFAULT_HID_SUCCESS on success, error code otherwise
+ *         MEMFAULT_HID_ERROR_BUSY if an input read is in progress
  */
 int memfault_hid_set_report_filter(memfault_hid_device_t *device,
                                     const memfault_hid_report_filter_t *filter);
@@ -137,6 +221,28 @@ int memfault_hid_set_report_filter(memfault_hid_device_t *device,
 int memfault_hid_get_report_filter(memfault_hid_device_t *device,
                                     memfault_hid_report_filter_t *filter);
 
+/**
+ * @brief Route input reports that the filter rejects to a handler
+ *
+ * When the report filter is enabled and an input report with this Report
+ * ID arrives, memfault_hid_read_report() passes it to the handler and keeps
+ * waiting (within its timeout) for a report that passes the filter, instead
+ * of failing with MEMFAULT_HID_ERROR_INVALID_REPORT_TYPE. This lets MDS
+ * share an interface with other HID traffic without losing those reports.
+ *
+ * @param device Device handle
+ * @param report_id Report ID to route
+ * @param handler Handler to invoke (NULL removes the route)
+ * @param user_data User context pointer passed to the handler
+ *
+ * @return MEMFAULT_HID_SUCCESS on success, error code otherwise
+ *         MEMFAULT_HID_ERROR_BUSY if an input read is in progress
+ */
+int memfault_hid_set_report_handler(memfault_hid_device_t *device,
+                                     uint8_t report_id,
+                                     memfault_hid_report_handler_t handler,
+                                     void *user_data);
+
 /* ============================================================================
  * Report Communication
  * ========================================================================== */
@@ -168,6 +274,10 @@ int memfault_hid_write_report(memfault_hid_device_t *device,
  * @param timeout_ms Timeout in milliseconds (0 for non-blocking, -1 for infinite)
  *
  * @return Number of bytes read on success, negative error code otherwise
+ *         MEMFAULT_HID_ERROR_BUSY if another thread is reading this device
+ *
+ * @note Reports parked by memfault_hid_read_report_id() are returned first,
+ *       oldest first, before reading from the device.
  */
 int memfault_hid_read_report(memfault_hid_device_t *device,
                               uint8_t *report_id,
@@ -175,6 +285,65 @@ int memfault_hid_read_report(memfault_hid_device_t *device,
                               size_t length,
                               int timeout_ms);
 
+/**
+ * @brief Read the next input report with a specific Report ID
+ *
+ * Input reports with other Report IDs that arrive while waiting are not
+ * discarded: they are parked in small per-Report-ID ring buffers and handed
+ * out by later calls for their ID (or by memfault_hid_read_report()).
+ * Filtered reports go to their handler, if any. When a ring buffer is full
+ * its oldest report is overwritten.
+ *
+ * @param device Device handle
+ * @param report_id Report ID to wait for
+ * @param data Buffer to receive report data (excluding Report ID)
+ * @param length Length of buffer
+ * @param timeout_ms Timeout in milliseconds (0 for non-blocking, -1 for infinite)
+ *
+ * @return Number of bytes read on success, negative error code otherwise
+ *         MEMFAULT_HID_ERROR_TIMEOUT if no such report arrived in time
+ *         MEMFAULT_HID_ERROR_BUSY if another thread is reading this device
+ */
+int memfault_hid_read_report_id(memfault_hid_device_t *device,
+                                 uint8_t report_id,
+                                 uint8_t *data,
+                                 size_t length,
+                                 int timeout_ms);
+
+/**
+ * @brief Get the receive timestamps of the last input report returned
+ *
+ * The timestamps are taken immediately after the underlying read returns
+ * (for queued reports, when they were originally read from the device).
+ * Call from the reading thread after a successful read.
+ *
+ * @param device Device handle
+ * @param monotonic_ns Pointer to receive CLOCK_MONOTONIC time in ns (may be NULL)
+ * @param realtime_ns Pointer to receive CLOCK_REALTIME time in ns (may be NULL)
+ *
+ * @return MEMFAULT_HID_SUCCESS on success,
+ *         MEMFAULT_HID_ERROR_NOT_FOUND if no report has been read yet
+ */
+int memfault_hid_get_rx_timestamp(memfault_hid_device_t *device,
+                                   uint64_t *monotonic_ns,
+                                   uint64_t *realtime_ns);
+
+/**
+ * @brief Set the ring buffer depth for a Report ID
+ *
+ * Discards any reports currently queued for the Report ID.
+ *
+ * @param device Device handle
+ * @param report_id Report ID
+ * @param depth Number of reports to buffer (0 = MEMFAULT_HID_REPORT_QUEUE_DEPTH)
+ *
+ * @return MEMFAULT_HID_SUCCESS on success, error code otherwise
+ *         MEMFAULT_HID_ERROR_BUSY if an input read is in progress
+ */
+int memfault_hid_set_report_queue_depth(memfault_hid_device_t *device,
+                                         uint8_t report_id,
+                                         size_t depth);
+
 /**
  * @brief Get a feature report from the device
  *
@@ -224,6 +393,134 @@ int memfault_hid_set_feature_report(memfault_hid_device_t *device,
                                      const uint8_t *data,
                                      size_t length);
 
+/* ============================================================================
+ * Report Buffer Pool
+ * ========================================================================== */
+
+/**
+ * @brief Create a pool of report buffers
+ *
+ * Allocates count fixed-size, cache-aligned slabs of
+ * MEMFAULT_HID_MAX_REPORT_SIZE bytes plus Report ID headroom in one block.
+ * The pool is thread-safe.
+ *
+ * @param count Number of buffers
+ * @param pool Pointer to receive pool handle
+ *
+ * @return MEMFAULT_HID_SUCCESS on success, error code otherwise
+ */
+int memfault_hid_buf_pool_create(size_t count, memfault_hid_buf_pool_t **pool);
+
+/**
+ * @brief Destroy a report buffer pool
+ *
+ * All buffers must have been returned with memfault_hid_buf_free().
+ *
+ * @param pool Pool handle
+ */
+void memfault_hid_buf_pool_destroy(memfault_hid_buf_pool_t *pool);
+
+/**
+ * @brief Take a buffer from the pool
+ *
+ * @param pool Pool handle
+ *
+ * @return Buffer with length 0 and full capacity, or NULL if the pool is empty
+ */
+memfault_hid_report_buf_t *memfault_hid_buf_alloc(memfault_hid_buf_pool_t *pool);
+
+/**
+ * @brief Return a buffer to its pool
+ *
+ * @param buf Buffer from memfault_hid_buf_alloc() (NULL is ignored)
+ */
+void memfault_hid_buf_free(memfault_hid_report_buf_t *buf);
+
+/**
+ * @brief Get the number of free buffers in a pool
+ *
+ * @param pool Pool handle
+ *
+ * @return Number of buffers available
+ */
+size_t memfault_hid_buf_pool_available(memfault_hid_buf_pool_t *pool);
+
+/* ============================================================================
+ * Buffer-based Report Communication
+ * ========================================================================== */
+
+/**
+ * @brief Read an input report into a pooled buffer
+ *
+ * Same semantics as memfault_hid_read_report(), but hidapi reads directly
+ * into the buffer. Sets buf->report_id and buf->length.
+ *
+ * @param device Device handle
+ * @param buf Buffer to fill
+ * @param timeout_ms Timeout in milliseconds (0 for non-blocking, -1 for infinite)
+ *
+ * @return Number of bytes read on success, negative error code otherwise
+ */
+int memfault_hid_read_report_buf(memfault_hid_device_t *device,
+                                  memfault_hid_report_buf_t *buf,
+                                  int timeout_ms);
+
+/**
+ * @brief Read an input report with a specific Report ID into a pooled buffer
+ *
+ * Same semantics as memfault_hid_read_report_id(). Sets buf->report_id and
+ * buf->length.
+ *
+ * @param device Device handle
+ * @param report_id Report ID to wait for
+ * @param buf Buffer to fill
+ * @param timeout_ms Timeout in milliseconds (0 for non-blocking, -1 for infinite)
+ *
+ * @return Number of bytes read on success, negative error code otherwise
+ */
+int memfault_hid_read_report_id_buf(memfault_hid_device_t *device,
+                                     uint8_t report_id,
+                                     memfault_hid_report_buf_t *buf,
+                                     int timeout_ms);
+
+/**
+ * @brief Send buf->length bytes of buf as an output report with buf->report_id
+ *
+ * @param device Device handle
+ * @param buf Buffer to send
+ *
+ * @return Number of bytes written on success, negative error code otherwise
+ */
+int memfault_hid_write_report_buf(memfault_hid_device_t *device,
+                                   memfault_hid_report_buf_t *buf);
+
+/**
+ * @brief Send buf->length bytes of buf as a feature report with buf->report_id
+ *
+ * @param device Device handle
+ * @param buf Buffer to send
+ *
+ * @return Number of bytes written on success, negative error code otherwise
+ */
+int memfault_hid_set_feature_report_buf(memfault_hid_device_t *device,
+                                         memfault_hid_report_buf_t *buf);
+
+/**
+ * @brief Get a feature report into a pooled buffer
+ *
+ * Requests buf->length bytes (or the full capacity if buf->length is 0).
+ * Sets buf->report_id and buf->length to the received size.
+ *
+ * @param device Device handle
+ * @param report_id Report ID
+ * @param buf Buffer to fill
+ *
+ * @return Number of bytes read on success, negative error code otherwise
+ */
+int memfault_hid_get_feature_report_buf(memfault_hid_device_t *device,
+                                         uint8_t report_id,
+                                         memfault_hid_report_buf_t *buf);
+
 /* ============================================================================
  * Utility Functions
  * ========================================================================== */
@@ -336,9 +336,13 @@ int HID_API_EXPORT hid_read(hid_device *dev, unsigned char *data, size_t length)
         return 0;
     }
 
-    /* Blocking mode - return 0 to simulate no data available */
+    /*
+     * Blocking mode - a real device would wait for the next report. Nothing
+     * can arrive while the caller is blocked here, so fail instead of hanging.
+     */
     if (g_mock_device.input_queue_count == 0) {
-        return 0;
+        printf("[MOCK] hid_read() would block forever on an empty queue\n");
+        return -1;
     }
 
     /* Return queued input report */
@@ -368,6 +372,10 @@ int HID_API_EXPORT hid_read_timeout(hid_device *dev, unsigned char *data,
 
     /* Check if data available */
     if (g_mock_device.input_queue_count == 0) {
+        if (milliseconds < 0) {
+            printf("[MOCK] hid_read_timeout() would block forever on an empty queue\n");
+            return -1;
+        }
         /* Simulate timeout */
         return 0;
     }
@@ -24,7 +24,8 @@
 typedef struct {
     char last_url[512];
     char last_headers[1024];
-    uint8_t last_data[512];
+    const void *post_data;
+    uint8_t last_data[4096];
     size_t last_data_len;
     long response_code;
     CURLcode error_code;
@@ -61,6 +62,10 @@ const uint8_t* mock_curl_get_last_data(size_t *len) {
     return mock_state.last_data;
 }
 
+const char* mock_curl_get_last_headers(void) {
+    return mock_state.last_headers;
+}
+
 /* ============================================================================
  * Mock libcurl API Implementation
  * ========================================================================== */
@@ -115,6 +120,7 @@ CURLcode curl_easy_setopt(CURL *curl, CURLoption option, ...) {
                 printf("[MOCK CURL] curl_easy_setopt(CURLOPT_POSTFIELDS, %p)\n", data);
             }
             /* Store pointer but don't copy yet - wait for POSTFIELDSIZE */
+            mock_state.post_data = data;
             break;
         }
         case CURLOPT_POSTFIELDSIZE: {
@@ -123,7 +129,14 @@ CURLcode curl_easy_setopt(CURL *curl, CURLoption option, ...) {
                 printf("[MOCK CURL] curl_easy_setopt(CURLOPT_POSTFIELDSIZE, %ld)\n", size);
             }
             /* Note: In real usage, POSTFIELDS is set before POSTFIELDSIZE */
-            /* We'll capture the data in curl_easy_perform */
+            size_t len = size > 0 ? (size_t)size : 0;
+            if (len > sizeof(mock_state.last_data)) {
+                len = sizeof(mock_state.last_data);
+            }
+            if (mock_state.post_data != NULL) {
+                memcpy(mock_state.last_data, mock_state.post_data, len);
+            }
+            mock_state.last_data_len = len;
             break;
         }
         case CURLOPT_HTTPHEADER: {
@@ -49,6 +49,13 @@ const char* mock_curl_get_last_url(void);
  */
 const uint8_t* mock_curl_get_last_data(size_t *len);
 
+/**
+ * @brief Get the headers of the last request ("Header: value;" each)
+ *
+ * @return Last headers string
+ */
+const char* mock_curl_get_last_headers(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -39,6 +39,33 @@ int memfault_hid_read_report(memfault_hid_device_t *device, uint8_t *report_id,
     return -ENOSYS;  /* Not implemented */
 }
 
+int memfault_hid_read_report_id(memfault_hid_device_t *device, uint8_t report_id,
+                                 uint8_t *data, size_t max_length, int timeout_ms) {
+    (void)device;
+    (void)report_id;
+    (void)data;
+    (void)max_length;
+    (void)timeout_ms;
+    return -ENOSYS;  /* Not implemented */
+}
+
+int memfault_hid_read_report_id_buf(memfault_hid_device_t *device, uint8_t report_id,
+                                     memfault_hid_report_buf_t *buf, int timeout_ms) {
+    (void)device;
+    (void)report_id;
+    (void)buf;
+    (void)timeout_ms;
+    return -ENOSYS;  /* Not implemented */
+}
+
+int memfault_hid_get_rx_timestamp(memfault_hid_device_t *device, uint64_t *monotonic_ns,
+                                   uint64_t *realtime_ns) {
+    (void)device;
+    (void)monotonic_ns;
+    (void)realtime_ns;
+    return -ENOSYS;  /* Not implemented */
+}
+
 int memfault_hid_get_feature_report(memfault_hid_device_t *device, uint8_t report_id,
                                      uint8_t *data, size_t max_length) {
     (void)device;
@@ -66,6 +93,21 @@ int memfault_hid_set_feature_report(memfault_hid_device_t *device, uint8_t repor
     return -ENOSYS;  /* Not implemented */
 }
 
+int memfault_hid_get_feature_report_buf(memfault_hid_device_t *device, uint8_t report_id,
+                                         memfault_hid_report_buf_t *buf) {
+    (void)device;
+    (void)report_id;
+    (void)buf;
+    return -ENOSYS;  /* Not implemented */
+}
+
+int memfault_hid_set_feature_report_buf(memfault_hid_device_t *device,
+                                         memfault_hid_report_buf_t *buf) {
+    (void)device;
+    (void)buf;
+    return -ENOSYS;  /* Not implemented */
+}
+
 int memfault_hid_open(uint16_t vendor_id, uint16_t product_id,
                        const wchar_t *serial_number,
                        memfault_hid_device_t **device) {
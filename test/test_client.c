@@ -6,11 +6,19 @@
  */
 
 #include "../src/memfault_hid_internal.h"
+#include "../src/mds_thread.h"
+#include "../src/mds_time.h"
 #include "mds_bridge/mds_protocol.h"
+#include "mds_bridge/mds_device_manager.h"
+#include "mds_bridge/mds_log.h"
 #include "mds_bridge/platform_compat.h"
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <wchar.h>
+#include <pthread.h>
 
 #define TEST_VID 0x1234
 #define TEST_PID 0x5678
@@ -21,6 +29,496 @@ static bool validate_sequence(uint8_t prev_seq, uint8_t new_seq) {
     return (new_seq == expected);
 }
 
+/* Enumeration visitor that records the last match */
+typedef struct {
+    int visits;
+    char path[256];
+    wchar_t serial[64];
+} visit_record_t;
+
+static bool record_visit(const memfault_hid_device_ref_t *device, void *user_data) {
+    visit_record_t *record = (visit_record_t *)user_data;
+    record->visits++;
+    snprintf(record->path, sizeof(record->path), "%s", device->path);
+    wcsncpy(record->serial, memfault_hid_device_ref_serial(device), 63);
+    return true;
+}
+
+/* Worker hammering feature reads on a shared device */
+#define FEATURE_THREADS     4
+#define FEATURE_ITERATIONS  200
+
+typedef struct {
+    memfault_hid_device_t *device;
+    int failures;
+} feature_worker_t;
+
+static void *feature_worker(void *arg) {
+    feature_worker_t *worker = (feature_worker_t *)arg;
+    uint8_t data[8];
+
+    for (int i = 0; i < FEATURE_ITERATIONS; i++) {
+        int ret = memfault_hid_get_feature_report(worker->device, MDS_REPORT_ID_SUPPORTED_FEATURES,
+                                                  data, 4);
+        if (ret != 4) {
+            worker->failures++;
+        }
+    }
+    return NULL;
+}
+
+/* Handler recording reports routed away from the filtered read path */
+typedef struct {
+    int count;
+    uint8_t report_id;
+    uint8_t data[64];
+    size_t length;
+} routed_report_t;
+
+static void record_routed_report(uint8_t report_id, const uint8_t *data, size_t length,
+                                 void *user_data) {
+    routed_report_t *routed = (routed_report_t *)user_data;
+    routed->count++;
+    routed->report_id = report_id;
+    routed->length = length < sizeof(routed->data) ? length : sizeof(routed->data);
+    memcpy(routed->data, data, routed->length);
+}
+
+/* Device manager event counters */
+typedef struct {
+    int attached;
+    int detached;
+    char last_path[256];
+} device_events_t;
+
+static void count_device_events(mds_device_manager_t *manager, mds_device_event_t event,
+                                const char *path, mds_session_t *session, void *user_data) {
+    device_events_t *events = (device_events_t *)user_data;
+    (void)manager;
+    (void)session;
+
+    if (event == MDS_DEVICE_EVENT_ATTACHED) {
+        events->attached++;
+    } else {
+        events->detached++;
+    }
+    snprintf(events->last_path, sizeof(events->last_path), "%s", path);
+}
+
+/* Waits in mds_device_manager_process() until the manager is destroyed */
+typedef struct {
+    mds_device_manager_t *manager;
+    int result;
+} device_process_t;
+
+static void *device_process_worker(void *arg) {
+    device_process_t *process = (device_process_t *)arg;
+    process->result = mds_device_manager_process(process->manager, -1);
+    return NULL;
+}
+
+/* Decorator that counts calls and forwards to the inner backend */
+typedef struct {
+    int reads;
+    int writes;
+    bool destroyed;
+} decorator_counts_t;
+
+static int counting_read(void *ctx, mds_backend_t *inner, uint8_t report_id,
+                         uint8_t *buffer, size_t length, int timeout_ms) {
+    ((decorator_counts_t *)ctx)->reads++;
+    return mds_backend_read(inner, report_id, buffer, length, timeout_ms);
+}
+
+static int counting_write(void *ctx, mds_backend_t *inner, uint8_t report_id,
+                          const uint8_t *buffer, size_t length) {
+    ((decorator_counts_t *)ctx)->writes++;
+    return mds_backend_write(inner, report_id, buffer, length);
+}
+
+static void counting_destroy(void *ctx) {
+    ((decorator_counts_t *)ctx)->destroyed = true;
+}
+
+static const mds_backend_decorator_ops_t counting_decorator_ops = {
+    .read = counting_read,
+    .write = counting_write,
+    .destroy = counting_destroy,
+};
+
+typedef struct {
+    int calls;
+    size_t chunk_len;
+    mds_chunk_info_t info;
+} upload_capture_t;
+
+static int capture_upload_ex(const char *uri, const char *auth_header,
+                             const uint8_t *chunk_data, size_t chunk_len,
+                             const mds_chunk_info_t *info, void *user_data) {
+    (void)uri;
+    (void)auth_header;
+    (void)chunk_data;
+    upload_capture_t *capture = (upload_capture_t *)user_data;
+    capture->calls++;
+    capture->chunk_len = chunk_len;
+    capture->info = *info;
+    return 0;
+}
+
+typedef struct {
+    int events;
+    mds_sequence_event_t last;
+} sequence_capture_t;
+
+static void capture_sequence_event(mds_session_t *session,
+                                   const mds_sequence_event_t *event, void *user_data) {
+    (void)session;
+    sequence_capture_t *capture = (sequence_capture_t *)user_data;
+    capture->events++;
+    capture->last = *event;
+}
+
+static int feed_sequence(mds_session_t *session, const mds_device_config_t *config,
+                         uint8_t sequence) {
+    const uint8_t raw[] = {sequence, 0x01, 0x00};
+    return mds_process_stream_from_bytes(session, config, raw, sizeof(raw), NULL);
+}
+
+typedef struct {
+    int messages;             /* "Invalid payload length" warnings delivered */
+    int other;                /* Any other message (e.g. suppression summaries) */
+} log_capture_t;
+
+static void capture_log(mds_log_level_t level, mds_log_subsystem_t subsystem,
+                        const char *message, void *user_data) {
+    log_capture_t *capture = (log_capture_t *)user_data;
+    if (level == MDS_LOG_WARN && subsystem == MDS_LOG_PROTOCOL &&
+        strncmp(message, "Invalid payload length", 22) == 0) {
+        capture->messages++;
+    } else {
+        capture->other++;
+    }
+}
+
+/* Handlers swapped while another thread logs; each must get its own context */
+typedef struct {
+    char owner;
+    mds_atomic_int_t messages;
+    mds_atomic_int_t mismatched;
+} log_swap_t;
+
+static void swap_log(log_swap_t *swap, char owner) {
+    mds_atomic_add(&swap->messages, 1);
+    if (swap->owner != owner) {
+        mds_atomic_add(&swap->mismatched, 1);
+    }
+}
+
+static void swap_log_a(mds_log_level_t level, mds_log_subsystem_t subsystem,
+                       const char *message, void *user_data) {
+    (void)level;
+    (void)subsystem;
+    (void)message;
+    swap_log((log_swap_t *)user_data, 'a');
+}
+
+static void swap_log_b(mds_log_level_t level, mds_log_subsystem_t subsystem,
+                       const char *message, void *user_data) {
+    (void)level;
+    (void)subsystem;
+    (void)message;
+    swap_log((log_swap_t *)user_data, 'b');
+}
+
+static void *log_swap_worker(void *arg) {
+    log_swap_t *swaps = (log_swap_t *)arg;
+    for (int i = 0; i < 2000; i++) {
+        if (i % 2) {
+            mds_log_set_handler(swap_log_a, &swaps[0]);
+        } else {
+            mds_log_set_handler(swap_log_b, &swaps[1]);
+        }
+    }
+    return NULL;
+}
+
+/* Scripted retransmit-capable device: sends a fixed sequence, resends on NACK */
+typedef struct {
+    uint8_t script[16];       /* Sequence numbers to send, in order */
+    size_t script_len;
+    size_t next;
+    uint8_t resend[8];        /* Sequences queued by a NACK (sent first) */
+    size_t resend_len;
+    int nacks;
+    bool window_lost;         /* Packets are no longer in the retransmit window */
+} retransmit_device_t;
+
+static int retransmit_read(void *impl_data, uint8_t report_id, uint8_t *buffer,
+                           size_t length, int timeout_ms) {
+    retransmit_device_t *dev = (retransmit_device_t *)impl_data;
+    (void)timeout_ms;
+
+    if (report_id == MDS_REPORT_ID_SUPPORTED_FEATURES && length >= 4) {
+        memset(buffer, 0, 4);
+        buffer[0] = MDS_FEATURE_STREAM_RETRANSMIT | MDS_FEATURE_STREAM_RESUME;
+        return 4;
+    }
+
+    uint8_t sequence;
+    if (dev->resend_len > 0) {
+        sequence = dev->resend[0];
+        memmove(dev->resend, dev->resend + 1, --dev->resend_len);
+    } else if (dev->next < dev->script_len) {
+        sequence = dev->script[dev->next++];
+    } else {
+        return -ETIMEDOUT;
+    }
+
+    buffer[0] = sequence;
+    buffer[1] = 1;
+    buffer[2] = sequence;  /* Payload identifies the packet */
+    return 3;
+}
+
+static int retransmit_write(void *impl_data, uint8_t report_id, const uint8_t *buffer,
+                            size_t length) {
+    retransmit_device_t *dev = (retransmit_device_t *)impl_data;
+
+    if (report_id == MDS_REPORT_ID_STREAM_NACK && length == 2) {
+        dev->nacks++;
+        for (uint8_t i = 0; !dev->window_lost && i < buffer[1] && dev->resend_len < sizeof(dev->resend); i++) {
+            dev->resend[dev->resend_len++] = (buffer[0] + i) & MDS_SEQUENCE_MASK;
+        }
+    }
+    return (int)length;
+}
+
+static void retransmit_destroy(void *impl_data) {
+    (void)impl_data;
+}
+
+static const mds_backend_ops_t retransmit_backend_ops = {
+    .read = retransmit_read,
+    .write = retransmit_write,
+    .destroy = retransmit_destroy,
+};
+
+/* Scripted flow-controlled device: streams endlessly while it has credit */
+typedef struct {
+    int credit;
+    int grants;
+    int sent;
+    int overruns;             /* Packets the device would have sent without credit */
+    uint8_t sequence;
+} credit_device_t;
+
+static int credit_read(void *impl_data, uint8_t report_id, uint8_t *buffer,
+                       size_t length, int timeout_ms) {
+    credit_device_t *dev = (credit_device_t *)impl_data;
+    (void)timeout_ms;
+
+    if (report_id == MDS_REPORT_ID_SUPPORTED_FEATURES && length >= 4) {
+        memset(buffer, 0, 4);
+        buffer[0] = MDS_FEATURE_STREAM_CREDITS;
+        return 4;
+    }
+
+    if (dev->credit == 0) {
+        dev->overruns++;
+        return -ETIMEDOUT;
+    }
+
+    dev->credit--;
+    dev->sent++;
+    buffer[0] = dev->sequence;
+    buffer[1] = 1;
+    buffer[2] = dev->sequence;
+    dev->sequence = (dev->sequence + 1) & MDS_SEQUENCE_MASK;
+    return 3;
+}
+
+static int credit_write(void *impl_data, uint8_t report_id, const uint8_t *buffer,
+                        size_t length) {
+    credit_device_t *dev = (credit_device_t *)impl_data;
+
+    if (report_id == MDS_REPORT_ID_STREAM_CONTROL && length == 2 &&
+        buffer[0] == MDS_STREAM_MODE_ENABLED) {
+        dev->credit = buffer[1];
+        dev->grants++;
+    }
+    return (int)length;
+}
+
+static const mds_backend_ops_t credit_backend_ops = {
+    .read = credit_read,
+    .write = credit_write,
+    .destroy = retransmit_destroy,
+};
+
+/* Scripted large-report device: sends one 600-byte packet once asked to */
+#define LARGE_TEST_PAYLOAD 600
+
+typedef struct {
+    uint8_t mode;
+    bool sent;
+} large_device_t;
+
+static int large_read(void *impl_data, uint8_t report_id, uint8_t *buffer,
+                      size_t length, int timeout_ms) {
+    large_device_t *dev = (large_device_t *)impl_data;
+    (void)timeout_ms;
+
+    if (report_id == MDS_REPORT_ID_SUPPORTED_FEATURES && length >= 4) {
+        memset(buffer, 0, 4);
+        buffer[0] = MDS_FEATURE_STREAM_LARGE_REPORTS | MDS_FEATURE_STREAM_RETRANSMIT;
+        return 4;
+    }
+
+    if (dev->sent || !(dev->mode & MDS_STREAM_MODE_LARGE_REPORTS) ||
+        length < 3 + LARGE_TEST_PAYLOAD) {
+        return -ETIMEDOUT;
+    }
+
+    dev->sent = true;
+    buffer[0] = 0;
+    buffer[1] = LARGE_TEST_PAYLOAD & 0xFF;
+    buffer[2] = LARGE_TEST_PAYLOAD >> 8;
+    for (int i = 0; i < LARGE_TEST_PAYLOAD; i++) {
+        buffer[3 + i] = (uint8_t)i;
+    }
+    return 3 + LARGE_TEST_PAYLOAD;
+}
+
+static int large_write(void *impl_data, uint8_t report_id, const uint8_t *buffer,
+                       size_t length) {
+    large_device_t *dev = (large_device_t *)impl_data;
+
+    if (report_id == MDS_REPORT_ID_STREAM_CONTROL && length >= 1) {
+        dev->mode = buffer[0];
+    }
+    return (int)length;
+}
+
+static const mds_backend_ops_t large_backend_ops = {
+    .read = large_read,
+    .write = large_write,
+    .destroy = retransmit_destroy,
+};
+
+/* Scripted resumable device: streams bytes 0..RESUME_TEST_TOTAL-1 in 10-byte packets */
+#define RESUME_TEST_TOTAL 60
+
+typedef struct {
+    uint32_t floor;           /* Oldest offset the device still has */
+    uint32_t pos;             /* Next offset to send */
+    uint8_t sequence;
+} resume_device_t;
+
+static int resume_read(void *impl_data, uint8_t report_id, uint8_t *buffer,
+                       size_t length, int timeout_ms) {
+    resume_device_t *dev = (resume_device_t *)impl_data;
+    (void)timeout_ms;
+
+    if (report_id == MDS_REPORT_ID_SUPPORTED_FEATURES && length >= 4) {
+        memset(buffer, 0, 4);
+        buffer[0] = MDS_FEATURE_STREAM_RESUME;
+        return 4;
+    }
+
+    if (report_id == MDS_REPORT_ID_STREAM_RESUME && length >= 4) {
+        for (int i = 0; i < 4; i++) {
+            buffer[i] = (uint8_t)(dev->pos >> (8 * i));
+        }
+        return 4;
+    }
+
+    if (dev->pos >= RESUME_TEST_TOTAL) {
+        return -ETIMEDOUT;
+    }
+
+    buffer[0] = dev->sequence;
+    buffer[1] = 10;
+    for (int i = 0; i < 10; i++) {
+        buffer[2 + i] = (uint8_t)(dev->pos + i);
+    }
+    dev->pos += 10;
+    dev->sequence = (dev->sequence + 1) & MDS_SEQUENCE_MASK;
+    return 12;
+}
+
+static int resume_write(void *impl_data, uint8_t report_id, const uint8_t *buffer,
+                        size_t length) {
+    resume_device_t *dev = (resume_device_t *)impl_data;
+
+    if (report_id == MDS_REPORT_ID_STREAM_RESUME && length == 4) {
+        uint32_t offset = (uint32_t)buffer[0] | ((uint32_t)buffer[1] << 8) |
+                          ((uint32_t)buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+        dev->pos = offset > dev->floor ? offset : dev->floor;
+    }
+    return (int)length;
+}
+
+static const mds_backend_ops_t resume_backend_ops = {
+    .read = resume_read,
+    .write = resume_write,
+    .destroy = retransmit_destroy,
+};
+
+/* Upload callback recording the first byte of each chunk, optionally failing */
+typedef struct {
+    uint8_t first[8];
+    size_t count;
+    bool fail;
+} resume_uploads_t;
+
+static int record_resume_upload(const char *uri, const char *auth_header,
+                                const uint8_t *chunk_data, size_t chunk_len, void *user_data) {
+    (void)uri;
+    (void)auth_header;
+    resume_uploads_t *uploads = (resume_uploads_t *)user_data;
+    if (chunk_len > 0 && uploads->count < sizeof(uploads->first)) {
+        uploads->first[uploads->count++] = chunk_data[0];
+    }
+    return uploads->fail ? -EIO : 0;
+}
+
+/* Upload callback recording the order of uploaded packets */
+typedef struct {
+    uint8_t order[32];
+    size_t count;
+} upload_order_t;
+
+static int record_upload_order(const char *uri, const char *auth_header,
+                               const uint8_t *chunk_data, size_t chunk_len, void *user_data) {
+    (void)uri;
+    (void)auth_header;
+    upload_order_t *uploads = (upload_order_t *)user_data;
+    if (chunk_len == 1 && uploads->count < sizeof(uploads->order)) {
+        uploads->order[uploads->count++] = chunk_data[0];
+    }
+    return 0;
+}
+
+/* Upload callback recording the last uploaded chunk */
+typedef struct {
+    size_t count;
+    size_t len;
+    uint8_t first;
+    uint8_t last;
+} last_upload_t;
+
+static int record_last_upload(const char *uri, const char *auth_header,
+                              const uint8_t *chunk_data, size_t chunk_len, void *user_data) {
+    (void)uri;
+    (void)auth_header;
+    last_upload_t *upload = (last_upload_t *)user_data;
+    upload->count++;
+    upload->len = chunk_len;
+    upload->first = chunk_len > 0 ? chunk_data[0] : 0;
+    upload->last = chunk_len > 0 ? chunk_data[chunk_len - 1] : 0;
+    return 0;
+}
+
 #define REPORT_ID_INPUT_1     0x01
 #define REPORT_ID_OUTPUT_1    0x02
 #define REPORT_ID_FEATURE_1   0x03
@@ -59,6 +557,11 @@ int main(void) {
     ret = memfault_hid_init();
     TEST_ASSERT(ret == MEMFAULT_HID_SUCCESS, "Library initialized successfully");
 
+    ret = memfault_hid_init();
+    TEST_ASSERT(ret == MEMFAULT_HID_SUCCESS, "Nested initialization succeeds");
+    ret = memfault_hid_exit();
+    TEST_ASSERT(ret == MEMFAULT_HID_SUCCESS, "Nested exit succeeds");
+
     /* Test 2: Device enumeration */
     TEST_START("Device Enumeration");
     memfault_hid_device_info_t *devices = NULL;
@@ -79,6 +582,36 @@ int main(void) {
 
     memfault_hid_free_device_list(devices);
 
+    /* Test 2b: Filtered enumeration visitor */
+    TEST_START("Device Enumeration Visitor");
+    visit_record_t record = {0};
+    memfault_hid_enum_filter_t enum_filter = {
+        .vendor_id = TEST_VID,
+        .product_id = TEST_PID,
+        .usage_page = 0xFF00,
+        .interface_number = 0,
+        .serial_prefix = L"TEST-",
+    };
+    ret = memfault_hid_enumerate_visit(&enum_filter, record_visit, &record);
+    TEST_ASSERT(ret == 1 && record.visits == 1, "Visitor called for matching device");
+    TEST_ASSERT(strcmp(record.path, "mock://device/1") == 0, "Visitor received device path");
+    TEST_ASSERT(wcscmp(record.serial, L"TEST-001") == 0, "Serial fetched lazily");
+
+    memset(&record, 0, sizeof(record));
+    enum_filter.serial_prefix = L"PROD-";
+    ret = memfault_hid_enumerate_visit(&enum_filter, record_visit, &record);
+    TEST_ASSERT(ret == 0 && record.visits == 0, "Serial prefix filter excludes device");
+
+    enum_filter.serial_prefix = NULL;
+    enum_filter.interface_number = 1;
+    ret = memfault_hid_enumerate_visit(&enum_filter, record_visit, &record);
+    TEST_ASSERT(ret == 0 && record.visits == 0, "Interface filter excludes device");
+
+    enum_filter.interface_number = -1;
+    enum_filter.usage_page = 0xFF01;
+    ret = memfault_hid_enumerate_visit(&enum_filter, record_visit, &record);
+    TEST_ASSERT(ret == 0 && record.visits == 0, "Usage page filter excludes device");
+
     /* Test 3: Open device */
     TEST_START("Device Open");
     ret = memfault_hid_open(TEST_VID, TEST_PID, NULL, &device);
@@ -95,6 +628,30 @@ int main(void) {
     ret = memfault_hid_set_nonblocking(device, true);
     TEST_ASSERT(ret == MEMFAULT_HID_SUCCESS, "Set non-blocking mode");
 
+    /* Test 4a: A zero timeout polls even when the device is in blocking mode */
+    TEST_START("Zero-timeout Read in Blocking Mode");
+    memfault_hid_set_nonblocking(device, false);
+    uint8_t poll_data[64];
+    ret = memfault_hid_read_report(device, NULL, poll_data, sizeof(poll_data), 0);
+    TEST_ASSERT(ret == MEMFAULT_HID_ERROR_TIMEOUT, "Zero timeout returns without blocking");
+    memfault_hid_set_nonblocking(device, true);
+
+    /* Test 4b: Concurrent feature report access */
+    TEST_START("Concurrent Feature Reports");
+    pthread_t threads[FEATURE_THREADS];
+    feature_worker_t workers[FEATURE_THREADS];
+    for (int i = 0; i < FEATURE_THREADS; i++) {
+        workers[i].device = device;
+        workers[i].failures = 0;
+        pthread_create(&threads[i], NULL, feature_worker, &workers[i]);
+    }
+    int feature_failures = 0;
+    for (int i = 0; i < FEATURE_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        feature_failures += workers[i].failures;
+    }
+    TEST_ASSERT(feature_failures == 0, "Parallel feature reads all succeed");
+
     /* Test 5: Configure report filter */
     TEST_START("Report Filtering");
     uint8_t allowed_reports[] = {
@@ -105,11 +662,13 @@ int main(void) {
         REPORT_ID_OUTPUT_2
     };
 
-    memfault_hid_report_filter_t filter = {
-        .report_ids = allowed_reports,
-        .num_report_ids = sizeof(allowed_reports),
-        .filter_enabled = true
-    };
+    memfault_hid_report_filter_t filter = { .filter_enabled = true };
+    for (size_t i = 0; i < sizeof(allowed_reports); i++) {
+        memfault_hid_report_filter_add(&filter, allowed_reports[i]);
+    }
+    TEST_ASSERT(memfault_hid_report_filter_contains(&filter, REPORT_ID_INPUT_2) &&
+                !memfault_hid_report_filter_contains(&filter, 0xFF),
+                "Filter bitmap membership");
 
     ret = memfault_hid_set_report_filter(device, &filter);
     TEST_ASSERT(ret == MEMFAULT_HID_SUCCESS, "Report filter configured");
@@ -240,6 +799,119 @@ int main(void) {
         TEST_ASSERT(true, "Filter bypass successful (no filter rejection)");
     }
 
+    /* Test 12: Route filtered input reports to a handler */
+    TEST_START("Filtered Report Routing");
+
+    /* Drain echoes left over from the previous tests */
+    uint8_t drain[64];
+    while (memfault_hid_read_report(device, NULL, drain, sizeof(drain), 0) > 0) {
+    }
+
+    uint8_t routed_data[8] = "routed";
+    uint8_t mds_data[8] = "mds";
+    memfault_hid_write_report(device, REPORT_ID_OUTPUT_2, routed_data, sizeof(routed_data), 1000);
+    memfault_hid_write_report(device, REPORT_ID_OUTPUT_1, mds_data, sizeof(mds_data), 1000);
+
+    memfault_hid_report_filter_clear(&filter);
+    memfault_hid_report_filter_add(&filter, REPORT_ID_OUTPUT_1);
+    filter.filter_enabled = true;
+    memfault_hid_set_report_filter(device, &filter);
+
+    routed_report_t routed = {0};
+    ret = memfault_hid_set_report_handler(device, REPORT_ID_OUTPUT_2, record_routed_report, &routed);
+    TEST_ASSERT(ret == MEMFAULT_HID_SUCCESS, "Report handler registered");
+
+    uint8_t routed_read[64];
+    uint8_t routed_rid = 0;
+    ret = memfault_hid_read_report(device, &routed_rid, routed_read, sizeof(routed_read), 100);
+    TEST_ASSERT(routed.count == 1 && routed.report_id == REPORT_ID_OUTPUT_2,
+                "Filtered report delivered to handler");
+    TEST_ASSERT(routed.length == sizeof(routed_data) &&
+                memcmp(routed.data, routed_data, sizeof(routed_data)) == 0,
+                "Handler received report data");
+    TEST_ASSERT(ret == (int)sizeof(mds_data) && routed_rid == REPORT_ID_OUTPUT_1,
+                "Read continued to the next allowed report");
+
+    memfault_hid_set_report_handler(device, REPORT_ID_OUTPUT_2, NULL, NULL);
+
+    /* Test 12b: Per-Report-ID input queues */
+    TEST_START("Input Report Demultiplexing");
+    filter.filter_enabled = false;
+    memfault_hid_set_report_filter(device, &filter);
+
+    uint8_t telemetry_1[4] = "t-1";
+    uint8_t telemetry_2[4] = "t-2";
+    uint8_t stream_1[4] = "s-1";
+    memfault_hid_write_report(device, REPORT_ID_OUTPUT_2, telemetry_1, sizeof(telemetry_1), 1000);
+    memfault_hid_write_report(device, REPORT_ID_OUTPUT_1, stream_1, sizeof(stream_1), 1000);
+    memfault_hid_write_report(device, REPORT_ID_OUTPUT_2, telemetry_2, sizeof(telemetry_2), 1000);
+
+    uint8_t demux_read[64];
+    ret = memfault_hid_read_report_id(device, REPORT_ID_OUTPUT_1, demux_read, sizeof(demux_read), 100);
+    TEST_ASSERT(ret == (int)sizeof(stream_1) && memcmp(demux_read, stream_1, ret) == 0,
+                "Requested Report ID read past other reports");
+
+    ret = memfault_hid_read_report_id(device, REPORT_ID_OUTPUT_2, demux_read, sizeof(demux_read), 100);
+    TEST_ASSERT(ret == (int)sizeof(telemetry_1) && memcmp(demux_read, telemetry_1, ret) == 0,
+                "Skipped report delivered from its queue");
+
+    uint8_t demux_rid = 0;
+    ret = memfault_hid_read_report(device, &demux_rid, demux_read, sizeof(demux_read), 100);
+    TEST_ASSERT(ret == (int)sizeof(telemetry_2) && demux_rid == REPORT_ID_OUTPUT_2,
+                "Generic read continues with the device stream");
+
+    /* A full queue overwrites its oldest report */
+    ret = memfault_hid_set_report_queue_depth(device, REPORT_ID_OUTPUT_2, 2);
+    TEST_ASSERT(ret == MEMFAULT_HID_SUCCESS, "Queue depth configured");
+    for (uint8_t i = 0; i < 3; i++) {
+        uint8_t telemetry[1] = { i };
+        memfault_hid_write_report(device, REPORT_ID_OUTPUT_2, telemetry, sizeof(telemetry), 1000);
+    }
+    memfault_hid_write_report(device, REPORT_ID_OUTPUT_1, stream_1, sizeof(stream_1), 1000);
+    memfault_hid_read_report_id(device, REPORT_ID_OUTPUT_1, demux_read, sizeof(demux_read), 100);
+
+    ret = memfault_hid_read_report(device, &demux_rid, demux_read, sizeof(demux_read), 0);
+    TEST_ASSERT(ret == 1 && demux_rid == REPORT_ID_OUTPUT_2 && demux_read[0] == 1,
+                "Oldest queued report dropped on overflow");
+    ret = memfault_hid_read_report(device, &demux_rid, demux_read, sizeof(demux_read), 0);
+    TEST_ASSERT(ret == 1 && demux_read[0] == 2, "Queued reports kept in order");
+
+    /* Test 12c: Pooled report buffers */
+    TEST_START("Pooled Report Buffers");
+    memfault_hid_buf_pool_t *pool = NULL;
+    ret = memfault_hid_buf_pool_create(2, &pool);
+    TEST_ASSERT(ret == MEMFAULT_HID_SUCCESS, "Buffer pool created");
+
+    memfault_hid_report_buf_t *tx = memfault_hid_buf_alloc(pool);
+    memfault_hid_report_buf_t *rx = memfault_hid_buf_alloc(pool);
+    TEST_ASSERT(tx != NULL && rx != NULL && memfault_hid_buf_alloc(pool) == NULL,
+                "Pool hands out exactly its buffers");
+    TEST_ASSERT(((uintptr_t)(tx->data - 1) % MEMFAULT_HID_BUF_ALIGN) == 0 &&
+                ((uintptr_t)(rx->data - 1) % MEMFAULT_HID_BUF_ALIGN) == 0,
+                "Report ID headroom is cache-aligned");
+
+    tx->report_id = REPORT_ID_OUTPUT_1;
+    memcpy(tx->data, "pooled", 6);
+    tx->length = 6;
+    ret = memfault_hid_write_report_buf(device, tx);
+    TEST_ASSERT(ret == 6, "Output report sent from pooled buffer");
+
+    ret = memfault_hid_read_report_buf(device, rx, 100);
+    TEST_ASSERT(ret == 6 && rx->report_id == REPORT_ID_OUTPUT_1 &&
+                memcmp(rx->data, "pooled", 6) == 0,
+                "Input report read into pooled buffer");
+
+    rx->length = sizeof(feature_data);
+    ret = memfault_hid_get_feature_report_buf(device, REPORT_ID_FEATURE_1, rx);
+    TEST_ASSERT(ret > 0 && rx->report_id == REPORT_ID_FEATURE_1 &&
+                memcmp(rx->data, feature_data, (size_t)ret) == 0,
+                "Feature report read into pooled buffer");
+
+    memfault_hid_buf_free(tx);
+    memfault_hid_buf_free(rx);
+    TEST_ASSERT(memfault_hid_buf_pool_available(pool) == 2, "Buffers returned to pool");
+    memfault_hid_buf_pool_destroy(pool);
+
     /* Close device before MDS tests (MDS will open its own device) */
     memfault_hid_close(device);
     device = NULL;
@@ -293,6 +965,38 @@ int main(void) {
     TEST_ASSERT(ret == 0, "Get authorization");
     TEST_ASSERT(strcmp(auth, config.authorization) == 0, "Auth matches config read");
 
+    /* Test: MDS Backend Decorators */
+    TEST_START("MDS Backend Decorators");
+
+    decorator_counts_t outer_counts = {0};
+    decorator_counts_t inner_counts = {0};
+
+    ret = mds_session_push_decorator(mds_session, &counting_decorator_ops, &inner_counts);
+    TEST_ASSERT(ret == 0, "First decorator installed");
+    ret = mds_session_push_decorator(mds_session, &counting_decorator_ops, &outer_counts);
+    TEST_ASSERT(ret == 0, "Second decorator installed");
+
+    features = 0xFFFFFFFF;
+    ret = mds_get_supported_features(mds_session, &features);
+    TEST_ASSERT(ret == 0, "Read through decorator chain");
+    TEST_ASSERT(features == config.supported_features, "Decorated read returns device data");
+    TEST_ASSERT(outer_counts.reads == 1 && inner_counts.reads == 1,
+                "Both decorators saw the read");
+
+    ret = mds_session_pop_decorator(mds_session);
+    TEST_ASSERT(ret == 0, "Outer decorator removed");
+    TEST_ASSERT(outer_counts.destroyed, "Outer decorator destroyed on pop");
+
+    ret = mds_get_supported_features(mds_session, &features);
+    TEST_ASSERT(ret == 0 && outer_counts.reads == 1 && inner_counts.reads == 2,
+                "Remaining decorator still in chain");
+
+    ret = mds_session_pop_decorator(mds_session);
+    TEST_ASSERT(ret == 0 && inner_counts.destroyed, "Inner decorator removed");
+
+    ret = mds_session_pop_decorator(mds_session);
+    TEST_ASSERT(ret == -ENOENT, "Pop without decorators reports -ENOENT");
+
     /* Test 16: MDS Stream Enable */
     TEST_START("MDS Stream Enable");
 
@@ -340,6 +1044,8 @@ int main(void) {
             // Verify we have data
             TEST_ASSERT(packet.data_len > 0, "Packet contains data");
             TEST_ASSERT(packet.data_len <= MDS_MAX_CHUNK_DATA_LEN, "Data length is within bounds");
+            TEST_ASSERT(packet.rx_monotonic_ns != 0 && packet.rx_realtime_ns != 0,
+                        "Packet carries receive timestamps");
 
             if (packet.data_len > 0) {
                 printf("    Data: ");
@@ -380,6 +1086,519 @@ int main(void) {
     valid = validate_sequence(10, 10);
     TEST_ASSERT(!valid, "Sequence 10->10 detects duplicate");
 
+    TEST_START("MDS Upload Callback Metadata");
+    {
+        upload_capture_t capture = {0};
+        mds_device_config_t upload_config = {0};
+        strcpy(upload_config.data_uri, "https://chunks.example.com/api/v0/chunks/TEST");
+        const uint8_t raw[] = {0x07, 0x03, 0xAA, 0xBB, 0xCC};
+
+        ret = mds_set_upload_callback_ex(mds_session, capture_upload_ex, &capture);
+        TEST_ASSERT(ret == 0, "Extended upload callback registered");
+
+        uint64_t before = mds_time_monotonic_ns();
+        ret = mds_process_stream_from_bytes(mds_session, &upload_config, raw, sizeof(raw), NULL);
+        TEST_ASSERT(ret == 0, "Packet processed from bytes");
+        TEST_ASSERT(capture.calls == 1 && capture.chunk_len == 3,
+                    "Extended callback received the chunk");
+        TEST_ASSERT(capture.info.sequence == 0x07, "Chunk info carries the sequence");
+        TEST_ASSERT(capture.info.rx_monotonic_ns >= before &&
+                    capture.info.rx_monotonic_ns <= mds_time_monotonic_ns(),
+                    "Chunk info carries the receive timestamp");
+
+        mds_set_upload_callback(mds_session, NULL, NULL);
+        ret = mds_process_stream_from_bytes(mds_session, &upload_config, raw, sizeof(raw), NULL);
+        TEST_ASSERT(ret == 0 && capture.calls == 1,
+                    "Setting the basic callback clears the extended one");
+    }
+
+    TEST_START("MDS Sequence Accounting");
+    {
+        mds_session_t *seq_session = NULL;
+        mds_device_config_t seq_config = {0};
+        mds_session_stats_t stats;
+        sequence_capture_t capture = {0};
+
+        ret = mds_session_create(NULL, &seq_session);
+        TEST_ASSERT(ret == 0, "Session without backend created");
+        mds_set_sequence_callback(seq_session, capture_sequence_event, &capture);
+
+        /* 5 (start), 6, 9 (gap of 2), 9 (duplicate), 7 (late), 10 */
+        const uint8_t sequence[] = {5, 6, 9, 9, 7, 10};
+        for (size_t i = 0; i < sizeof(sequence); i++) {
+            feed_sequence(seq_session, &seq_config, sequence[i]);
+            if (i == 2) {
+                TEST_ASSERT(capture.last.type == MDS_SEQUENCE_EVENT_GAP &&
+                            capture.last.expected == 7 && capture.last.missing == 2,
+                            "Gap event reports expected sequence and missing count");
+            }
+        }
+
+        mds_get_session_stats(seq_session, &stats);
+        TEST_ASSERT(stats.packets_received == 6, "All packets counted");
+        TEST_ASSERT(stats.gaps == 1 && stats.duplicates == 1 && stats.reorders == 1,
+                    "Gap, duplicate and reorder each counted once");
+        TEST_ASSERT(stats.lost_packets == 1, "Late packet no longer counted as lost");
+        TEST_ASSERT(capture.events == 3, "Callback fired for each anomaly");
+
+        /* Wrap-around: 30, 31, 0, 1 is in order; 1 -> 4 skips 2 and 3 */
+        mds_reset_session_stats(seq_session);
+        const uint8_t wrapped[] = {30, 31, 0, 1, 4};
+        for (size_t i = 0; i < sizeof(wrapped); i++) {
+            feed_sequence(seq_session, &seq_config, wrapped[i]);
+        }
+        mds_get_session_stats(seq_session, &stats);
+        TEST_ASSERT(stats.packets_received == 5 && stats.gaps == 1 &&
+                    stats.lost_packets == 2 && stats.reorders == 0,
+                    "Counter wrap is not a gap; skip after wrap is");
+
+        mds_session_destroy(seq_session);
+    }
+
+    TEST_START("Rate-limited Deferred Logging");
+    {
+        mds_session_t *log_session = NULL;
+        mds_device_config_t log_config = {0};
+        log_capture_t capture = {0};
+        mds_log_stats_t before, after;
+        const uint8_t bad_length[] = {0x01, 0xFF};  /* Payload length beyond maximum */
+
+        mds_session_create(NULL, &log_session);
+        mds_log_set_handler(capture_log, &capture);
+
+        /* Rate limit: at most 5 per window, the rest are counted */
+        mds_log_set_rate_limit(5);
+        mds_log_get_stats(&before);
+        for (int i = 0; i < 50; i++) {
+            mds_process_stream_from_bytes(log_session, &log_config, bad_length,
+                                          sizeof(bad_length), NULL);
+        }
+        mds_log_get_stats(&after);
+        TEST_ASSERT(capture.messages > 0 && capture.messages <= 10,
+                    "Rate limiter caps delivered messages");
+        TEST_ASSERT(capture.messages + (int)(after.suppressed - before.suppressed) == 50,
+                    "Suppressed messages are counted");
+
+        /* Level threshold: warnings are discarded below MDS_LOG_WARN */
+        mds_log_set_rate_limit(0);
+        mds_log_set_level(MDS_LOG_ERROR);
+        capture.messages = 0;
+        mds_process_stream_from_bytes(log_session, &log_config, bad_length,
+                                      sizeof(bad_length), NULL);
+        TEST_ASSERT(capture.messages == 0, "Messages above the level threshold are discarded");
+        mds_log_set_level(MDS_LOG_WARN);
+
+        /* Deferred: nothing reaches the handler until flushed */
+        mds_log_set_deferred(true);
+        for (int i = 0; i < 3; i++) {
+            mds_process_stream_from_bytes(log_session, &log_config, bad_length,
+                                          sizeof(bad_length), NULL);
+        }
+        TEST_ASSERT(capture.messages == 0, "Deferred messages are queued, not delivered");
+        size_t flushed = mds_log_flush();
+        TEST_ASSERT(flushed == 3 && capture.messages == 3, "Flush delivers queued messages");
+        mds_log_set_deferred(false);
+
+        /* Replacing the handler while another thread logs */
+        log_swap_t swaps[2] = { { .owner = 'a' }, { .owner = 'b' } };
+        pthread_t swap_thread;
+        pthread_create(&swap_thread, NULL, log_swap_worker, swaps);
+        for (int i = 0; i < 2000; i++) {
+            mds_process_stream_from_bytes(log_session, &log_config, bad_length,
+                                          sizeof(bad_length), NULL);
+        }
+        pthread_join(swap_thread, NULL);
+        TEST_ASSERT(mds_atomic_load(&swaps[0].mismatched) == 0 &&
+                    mds_atomic_load(&swaps[1].mismatched) == 0,
+                    "Handler swap never pairs a handler with another's context");
+
+        mds_log_set_handler(NULL, NULL);
+        mds_log_set_rate_limit(20);
+        mds_session_destroy(log_session);
+    }
+
+    TEST_START("Stream Retransmit on Sequence Gap");
+    {
+        retransmit_device_t dev = { .script = {0, 1, 4, 5}, .script_len = 4 };
+        mds_backend_t rt_backend = { .ops = &retransmit_backend_ops, .impl_data = &dev };
+        mds_session_t *rt_session = NULL;
+        mds_device_config_t rt_config = {0};
+        upload_order_t uploads = {0};
+        mds_session_stats_t stats;
+
+        mds_session_create(&rt_backend, &rt_session);
+        mds_set_upload_callback(rt_session, record_upload_order, &uploads);
+
+        ret = mds_stream_set_retransmit(mds_session, true, 0);
+        TEST_ASSERT(ret == -ENOTSUP, "Retransmit rejected when device lacks the feature");
+
+        ret = mds_stream_set_retransmit(rt_session, true, 1000);
+        TEST_ASSERT(ret == 0, "Retransmit enabled on capable device");
+
+        while (mds_process_stream(rt_session, &rt_config, 0, NULL) == 0) {
+        }
+
+        /* 0, 1, [4 held, NACK 2-3], 5 held, 2, 3 resent -> 2, 3, 4, 5 released */
+        TEST_ASSERT(dev.nacks == 1, "One NACK sent for the gap");
+        TEST_ASSERT(uploads.count == 6, "All packets uploaded");
+        bool in_order = true;
+        for (size_t i = 0; i < uploads.count; i++) {
+            in_order = in_order && uploads.order[i] == i;
+        }
+        TEST_ASSERT(in_order, "Packets uploaded in sequence order");
+
+        mds_get_session_stats(rt_session, &stats);
+        TEST_ASSERT(stats.nacks_sent == 1 && stats.recovered == 2 && stats.lost_packets == 0,
+                    "Recovered packets are not counted as lost");
+
+        /* Packet 7 never comes back: 6, [8 held, NACK 7], expires -> 8 uploaded */
+        dev.script[0] = 6;
+        dev.script[1] = 8;
+        dev.script_len = 2;
+        dev.next = 0;
+        dev.window_lost = true;
+        mds_stream_set_retransmit(rt_session, true, 20);
+        while (mds_process_stream(rt_session, &rt_config, 0, NULL) == 0) {
+        }
+        TEST_ASSERT(uploads.count == 7, "Packet after an unrecovered gap is held");
+        usleep(30000);
+        mds_process_stream(rt_session, &rt_config, 0, NULL);
+        TEST_ASSERT(uploads.count == 8 && uploads.order[7] == 8,
+                    "Held packet released after the retransmit timeout");
+
+        mds_session_destroy(rt_session);
+
+        /* Loss of more than half the sequence space: 1-19 never arrive */
+        const uint8_t burst[] = { 0, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 0, 1, 2 };
+        retransmit_device_t burst_dev = { .script_len = sizeof(burst), .window_lost = true };
+        memcpy(burst_dev.script, burst, sizeof(burst));
+        rt_backend.impl_data = &burst_dev;
+        upload_order_t burst_uploads = {0};
+        uint32_t resume_offset = 0;
+
+        mds_session_create(&rt_backend, &rt_session);
+        mds_set_upload_callback(rt_session, record_upload_order, &burst_uploads);
+        mds_stream_set_retransmit(rt_session, true, 1000);
+        mds_stream_set_resume_offset(rt_session, 0);
+        while (mds_process_stream(rt_session, &rt_config, 0, NULL) == 0) {
+        }
+
+        bool all_uploaded = burst_uploads.count == sizeof(burst);
+        for (size_t i = 0; all_uploaded && i < burst_uploads.count; i++) {
+            all_uploaded = burst_uploads.order[i] == burst[i];
+        }
+        TEST_ASSERT(all_uploaded, "Packets after a long loss burst are uploaded");
+
+        mds_get_session_stats(rt_session, &stats);
+        mds_stream_get_resume_offset(rt_session, &resume_offset);
+        TEST_ASSERT(stats.gaps == 1 && stats.lost_packets == 19 && stats.reorders == 0,
+                    "Long loss burst counted as lost");
+        TEST_ASSERT(resume_offset == 1, "Resume offset held at the loss");
+
+        mds_session_destroy(rt_session);
+    }
+
+    TEST_START("Credit-based Flow Control");
+    {
+        credit_device_t dev = {0};
+        mds_backend_t fc_backend = { .ops = &credit_backend_ops, .impl_data = &dev };
+        mds_session_t *fc_session = NULL;
+        mds_stream_packet_t fc_packet;
+        mds_session_stats_t stats;
+
+        mds_session_create(&fc_backend, &fc_session);
+
+        ret = mds_stream_set_flow_control(mds_session, 4);
+        TEST_ASSERT(ret == -ENOTSUP, "Flow control rejected when device lacks the feature");
+
+        ret = mds_stream_set_flow_control(fc_session, 4);
+        TEST_ASSERT(ret == 0, "Flow control enabled on capable device");
+
+        mds_stream_enable(fc_session);
+        TEST_ASSERT(dev.grants == 1 && dev.credit == 4, "Enable grants the initial window");
+
+        /* Consuming packets keeps the device supplied */
+        int received = 0;
+        for (int i = 0; i < 20; i++) {
+            if (mds_stream_read_packet(fc_session, &fc_packet, 0) == 0) {
+                received++;
+            }
+        }
+        TEST_ASSERT(received == 20 && dev.overruns == 0,
+                    "Credits replenished as packets are consumed");
+        TEST_ASSERT(dev.grants > 1 && dev.credit <= 4, "Device never holds more than the window");
+
+        mds_get_session_stats(fc_session, &stats);
+        TEST_ASSERT(stats.credit_grants == (uint64_t)dev.grants, "Grants counted in stats");
+
+        /* A lost grant is not re-sent before the regrant interval */
+        dev.credit = 0;
+        int grants_before = dev.grants;
+        ret = mds_stream_read_packet(fc_session, &fc_packet, 0);
+        TEST_ASSERT(ret == -ETIMEDOUT && dev.grants == grants_before,
+                    "Idle reads do not flood the device with grants");
+
+        mds_stream_disable(fc_session);
+        mds_session_destroy(fc_session);
+    }
+
+    TEST_START("Stream Resume After Reconnect");
+    {
+        resume_device_t dev = {0};
+        mds_backend_t rs_backend = { .ops = &resume_backend_ops, .impl_data = &dev };
+        mds_device_config_t rs_config = {0};
+        resume_uploads_t uploads = {0};
+        mds_session_t *rs_session = NULL;
+        uint32_t offset = 0;
+
+        ret = mds_stream_set_resume_offset(mds_session, 0);
+        TEST_ASSERT(ret == -ENOTSUP, "Resume rejected when device lacks the feature");
+        TEST_ASSERT(mds_stream_get_resume_offset(mds_session, &offset) == -ENOTSUP,
+                    "No resume offset without resume");
+
+        /* First connection forwards two packets */
+        mds_session_create(&rs_backend, &rs_session);
+        mds_set_upload_callback(rs_session, record_resume_upload, &uploads);
+        ret = mds_stream_set_resume_offset(rs_session, 0);
+        TEST_ASSERT(ret == 0, "Resume enabled on capable device");
+        mds_stream_enable(rs_session);
+        mds_process_stream(rs_session, &rs_config, 0, NULL);
+        mds_process_stream(rs_session, &rs_config, 0, NULL);
+        mds_stream_get_resume_offset(rs_session, &offset);
+        TEST_ASSERT(offset == 20, "Offset advances with uploaded data");
+        mds_session_destroy(rs_session);
+
+        /* Reconnect (device rebooted, sequence restarts) with the saved offset */
+        dev.sequence = 7;
+        dev.pos = 0;
+        uploads.count = 0;
+        mds_session_create(&rs_backend, &rs_session);
+        mds_set_upload_callback(rs_session, record_resume_upload, &uploads);
+        mds_stream_set_resume_offset(rs_session, offset);
+        mds_stream_enable(rs_session);
+        mds_process_stream(rs_session, &rs_config, 0, NULL);
+        TEST_ASSERT(uploads.count == 1 && uploads.first[0] == 20,
+                    "Device resumes after the acknowledged data");
+
+        /* A failed upload holds the offset; re-enabling resends from there */
+        uploads.fail = true;
+        mds_process_stream(rs_session, &rs_config, 0, NULL);
+        uploads.fail = false;
+        mds_process_stream(rs_session, &rs_config, 0, NULL);
+        mds_stream_get_resume_offset(rs_session, &offset);
+        TEST_ASSERT(offset == 30, "Offset held after an upload failure");
+        mds_stream_enable(rs_session);
+        uploads.count = 0;
+        mds_process_stream(rs_session, &rs_config, 0, NULL);
+        TEST_ASSERT(uploads.count == 1 && uploads.first[0] == 30,
+                    "Unacknowledged data resent after re-enable");
+
+        /* Applications uploading themselves acknowledge explicitly */
+        mds_set_upload_callback(rs_session, NULL, NULL);
+        mds_stream_packet_t rs_packet;
+        mds_stream_read_packet(rs_session, &rs_packet, 0);
+        mds_stream_ack(rs_session, rs_packet.data_len);
+        mds_stream_get_resume_offset(rs_session, &offset);
+        TEST_ASSERT(offset == 50, "Explicit acknowledgement advances the offset");
+
+        /* The device may no longer have the requested data */
+        dev.floor = 55;
+        mds_stream_set_resume_offset(rs_session, 10);
+        mds_stream_enable(rs_session);
+        mds_stream_get_resume_offset(rs_session, &offset);
+        TEST_ASSERT(offset == 55, "Offset the device resumes from is adopted");
+
+        mds_session_destroy(rs_session);
+    }
+
+    TEST_START("Session Drain-and-Flush Shutdown");
+    {
+        resume_device_t dev = { .pos = 30 };  /* Three packets still in flight */
+        mds_backend_t sd_backend = { .ops = &resume_backend_ops, .impl_data = &dev };
+        mds_device_config_t sd_config = {0};
+        resume_uploads_t uploads = {0};
+        mds_shutdown_report_t report;
+        mds_session_t *sd_session = NULL;
+
+        mds_session_create(&sd_backend, &sd_session);
+        mds_set_upload_callback(sd_session, record_resume_upload, &uploads);
+        ret = mds_session_shutdown(sd_session, &sd_config, 1000, &report);
+        TEST_ASSERT(ret == 0 && report.packets_drained == 3 && report.packets_uploaded == 3,
+                    "In-flight packets drained and uploaded");
+        TEST_ASSERT(uploads.count == 3 && uploads.first[0] == 30 && uploads.first[2] == 50,
+                    "Drained packets uploaded in order");
+
+        dev.pos = 40;
+        uploads.fail = true;
+        ret = mds_session_shutdown(sd_session, &sd_config, 1000, &report);
+        TEST_ASSERT(ret == -EIO && report.packets_dropped == 2 && report.bytes_dropped == 20,
+                    "Failed uploads reported as dropped");
+        mds_session_destroy(sd_session);
+
+        /* A device that keeps sending is cut off at the deadline */
+        credit_device_t busy = { .credit = 1000000 };
+        mds_backend_t busy_backend = { .ops = &credit_backend_ops, .impl_data = &busy };
+        mds_session_create(&busy_backend, &sd_session);
+        ret = mds_session_shutdown(sd_session, &sd_config, 20, &report);
+        TEST_ASSERT(ret == -ETIMEDOUT && report.deadline_expired,
+                    "Deadline bounds the drain");
+        TEST_ASSERT(report.packets_drained > 0 && report.packets_dropped == report.packets_drained,
+                    "Packets without an upload callback reported as dropped");
+        mds_session_destroy(sd_session);
+    }
+
+    TEST_START("Large-report Stream Mode");
+    {
+        large_device_t dev = {0};
+        mds_backend_t lr_backend = { .ops = &large_backend_ops, .impl_data = &dev };
+        mds_session_t *lr_session = NULL;
+        mds_stream_packet_t lr_packet;
+
+        mds_session_create(&lr_backend, &lr_session);
+
+        ret = mds_stream_set_large_reports(mds_session, true);
+        TEST_ASSERT(ret == -ENOTSUP, "Large reports rejected when device lacks the feature");
+
+        ret = mds_stream_set_large_reports(lr_session, true);
+        TEST_ASSERT(ret == 0, "Large reports enabled on capable device");
+
+        mds_stream_enable(lr_session);
+        TEST_ASSERT(dev.mode == (MDS_STREAM_MODE_ENABLED | MDS_STREAM_MODE_LARGE_REPORTS),
+                    "Enable requests large-report mode");
+
+        ret = mds_stream_read_packet(lr_session, &lr_packet, 0);
+        TEST_ASSERT(ret == 0 && lr_packet.data_len == LARGE_TEST_PAYLOAD,
+                    "Packet with 16-bit length parsed");
+        TEST_ASSERT(lr_packet.data[0] == 0 && lr_packet.data[255] == 255 &&
+                    lr_packet.data[LARGE_TEST_PAYLOAD - 1] == (uint8_t)(LARGE_TEST_PAYLOAD - 1),
+                    "Large payload copied intact");
+
+        /* An oversized length field is rejected */
+        mds_device_config_t lr_config = {0};
+        uint8_t bad[8] = { 0x01, 0xFD, 0x03, 0 };  /* 0x3FD = 1021 bytes */
+        ret = mds_process_stream_from_bytes(lr_session, &lr_config, bad, sizeof(bad), NULL);
+        TEST_ASSERT(ret == -EINVAL, "Payload length above the maximum rejected");
+
+        mds_stream_disable(lr_session);
+        mds_session_destroy(lr_session);
+
+        /* Held packets survive switching to large reports, and large ones fit */
+        static uint8_t report[3 + LARGE_TEST_PAYLOAD];
+        last_upload_t upload = {0};
+        mds_session_create(&lr_backend, &lr_session);
+        mds_set_upload_callback(lr_session, record_last_upload, &upload);
+        mds_stream_set_retransmit(lr_session, true, 1000);
+
+        const uint8_t small_0[] = { 0x00, 1, 0xA0 };
+        const uint8_t small_2[] = { 0x02, 3, 0xB0, 0xB1, 0xB2 };
+        mds_process_stream_from_bytes(lr_session, &lr_config, small_0, sizeof(small_0), NULL);
+        mds_process_stream_from_bytes(lr_session, &lr_config, small_2, sizeof(small_2), NULL);
+        TEST_ASSERT(upload.count == 1, "Packet after a gap held");
+
+        ret = mds_stream_set_large_reports(lr_session, true);
+        report[0] = 0x01;
+        report[1] = LARGE_TEST_PAYLOAD & 0xFF;
+        report[2] = LARGE_TEST_PAYLOAD >> 8;
+        for (int i = 0; i < LARGE_TEST_PAYLOAD; i++) {
+            report[3 + i] = (uint8_t)i;
+        }
+        mds_process_stream_from_bytes(lr_session, &lr_config, report, sizeof(report), NULL);
+        TEST_ASSERT(ret == 0 && upload.count == 3 && upload.len == 3 &&
+                    upload.first == 0xB0 && upload.last == 0xB2,
+                    "Held packet kept across the switch to large reports");
+
+        report[0] = 0x04;
+        mds_process_stream_from_bytes(lr_session, &lr_config, report, sizeof(report), NULL);
+        report[0] = 0x03;
+        report[3] = 0x33;
+        mds_process_stream_from_bytes(lr_session, &lr_config, report, sizeof(report), NULL);
+        TEST_ASSERT(upload.count == 5 && upload.len == LARGE_TEST_PAYLOAD &&
+                    upload.first == 0 && upload.last == (uint8_t)(LARGE_TEST_PAYLOAD - 1),
+                    "Large packet held and released intact");
+
+        mds_session_destroy(lr_session);
+    }
+
+    TEST_START("Chunk Classification");
+    {
+        mds_chunk_classifier_t classifier;
+        mds_chunk_classifier_reset(&classifier);
+
+        /* Single-chunk events: header, message type, CBOR event, CRC */
+        const uint8_t heartbeat[] = { 0x00, 0x02, 0xA2, 0x01, 0x1A, 0x65, 0x00, 0x00, 0x00,
+                                      0x02, 0x01, 0xAB, 0xCD };
+        const uint8_t reboot[] = { 0x00, 0x02, 0xA3, 0x01, 0x1A, 0x65, 0x00, 0x00, 0x00,
+                                   0x02, 0x02, 0x04, 0xA1, 0x01, 0x19, 0x80, 0x08, 0xAB, 0xCD };
+        const uint8_t trace[] = { 0x00, 0x02, 0xA3, 0x01, 0x1A, 0x65, 0x00, 0x00, 0x00,
+                                  0x02, 0x02, 0x04, 0xA1, 0x06, 0x05, 0xAB, 0xCD };
+        TEST_ASSERT(mds_chunk_classify(&classifier, heartbeat, sizeof(heartbeat)) ==
+                    MDS_CHUNK_CLASS_HEARTBEAT, "Heartbeat event classified");
+        TEST_ASSERT(mds_chunk_classify(&classifier, reboot, sizeof(reboot)) ==
+                    MDS_CHUNK_CLASS_REBOOT, "Trace with a reboot reason classified as reboot");
+        TEST_ASSERT(mds_chunk_classify(&classifier, trace, sizeof(trace)) ==
+                    MDS_CHUNK_CLASS_TRACE, "Trace with a user reason classified as trace");
+
+        /* Multi-chunk coredump: continuations inherit the class */
+        const uint8_t core_first[] = { 0x40, 0x90, 0x03, 0x01, 0x43, 0x44, 0x41, 0x50 };
+        const uint8_t core_next[] = { 0xC0, 0x05, 0x00, 0x00, 0x00, 0x00 };
+        const uint8_t core_last[] = { 0x80, 0x09, 0x00, 0xAB, 0xCD };
+        const uint8_t log_msg[] = { 0x00, 0x03, 0x81, 0x00, 0xAB, 0xCD };
+        TEST_ASSERT(mds_chunk_classify(&classifier, core_first, sizeof(core_first)) ==
+                    MDS_CHUNK_CLASS_COREDUMP, "Coredump start classified");
+        TEST_ASSERT(mds_chunk_classify(&classifier, core_next, sizeof(core_next)) ==
+                    MDS_CHUNK_CLASS_COREDUMP &&
+                    mds_chunk_classify(&classifier, core_last, sizeof(core_last)) ==
+                    MDS_CHUNK_CLASS_COREDUMP, "Coredump continuations inherit the class");
+        TEST_ASSERT(mds_chunk_classify(&classifier, log_msg, sizeof(log_msg)) ==
+                    MDS_CHUNK_CLASS_LOG, "Next message classified on its own");
+
+        /* Event type only arrives in the second chunk */
+        const uint8_t split_first[] = { 0x40, 0x0C, 0x02, 0xA2, 0x01, 0x1A, 0x65 };
+        const uint8_t split_next[] = { 0x80, 0x05, 0x00, 0x00, 0x00, 0x02, 0x01, 0xAB, 0xCD };
+        TEST_ASSERT(mds_chunk_classify(&classifier, split_first, sizeof(split_first)) ==
+                    MDS_CHUNK_CLASS_UNKNOWN, "Undecided until the event type arrives");
+        TEST_ASSERT(mds_chunk_classify(&classifier, split_next, sizeof(split_next)) ==
+                    MDS_CHUNK_CLASS_HEARTBEAT, "Decided once the event type arrives");
+
+        /* Picking up a stream mid-message */
+        mds_chunk_classifier_reset(&classifier);
+        TEST_ASSERT(mds_chunk_classify(&classifier, core_next, sizeof(core_next)) ==
+                    MDS_CHUNK_CLASS_UNKNOWN, "Continuation without a start is unknown");
+
+        /* Sessions tag packets and count them per class */
+        mds_session_t *cls_session = NULL;
+        mds_device_config_t cls_config = {0};
+        upload_capture_t capture = {0};
+        mds_session_create(NULL, &cls_session);
+        mds_set_upload_callback_ex(cls_session, capture_upload_ex, &capture);
+
+        uint8_t raw[2 + sizeof(reboot)];
+        raw[0] = 0x00;
+        raw[1] = (uint8_t)sizeof(reboot);
+        memcpy(&raw[2], reboot, sizeof(reboot));
+        mds_stream_packet_t cls_packet;
+        ret = mds_process_stream_from_bytes(cls_session, &cls_config, raw, sizeof(raw), &cls_packet);
+        TEST_ASSERT(ret == 0 && capture.info.chunk_class == MDS_CHUNK_CLASS_REBOOT,
+                    "Upload callback receives the chunk class");
+        TEST_ASSERT(cls_packet.chunk_class == MDS_CHUNK_CLASS_REBOOT, "Packet carries the chunk class");
+
+        raw[0] = 0x01;
+        raw[1] = (uint8_t)sizeof(core_first);
+        memcpy(&raw[2], core_first, sizeof(core_first));
+        mds_process_stream_from_bytes(cls_session, &cls_config, raw, 2 + sizeof(core_first), NULL);
+
+        mds_session_stats_t cls_stats;
+        mds_get_session_stats(cls_session, &cls_stats);
+        TEST_ASSERT(cls_stats.class_packets[MDS_CHUNK_CLASS_REBOOT] == 1 &&
+                    cls_stats.class_packets[MDS_CHUNK_CLASS_COREDUMP] == 1,
+                    "Packets counted per class");
+        TEST_ASSERT(cls_stats.class_bytes[MDS_CHUNK_CLASS_COREDUMP] == sizeof(core_first),
+                    "Bytes counted per class");
+        TEST_ASSERT(strcmp(mds_chunk_class_name(MDS_CHUNK_CLASS_COREDUMP), "coredump") == 0,
+                    "Class names");
+        mds_session_destroy(cls_session);
+    }
+
     /* Test 19: MDS Stream Disable */
     TEST_START("MDS Stream Disable");
     ret = mds_stream_disable(mds_session);
@@ -390,6 +1609,56 @@ int main(void) {
     mds_session_destroy(mds_session);  /* Also closes HID device */
     TEST_ASSERT(true, "MDS session destroyed (HID device closed)");
 
+    /* Test 21: Device Manager Discovery */
+    TEST_START("Device Manager Discovery");
+    device_events_t events = {0};
+    mds_device_manager_config_t dm_config = {
+        .vendor_id = TEST_VID,
+        .product_id = TEST_PID,
+        .usage_page = 0xFF00,
+        .callback = count_device_events,
+        .user_data = &events,
+    };
+    mds_device_manager_t *manager = NULL;
+    ret = mds_device_manager_create(&dm_config, &manager);
+    TEST_ASSERT(ret == 0 && manager != NULL, "Device manager created");
+    TEST_ASSERT(events.attached == 1, "Matching device attached on creation");
+    TEST_ASSERT(mds_device_manager_count(manager) == 1, "One device managed");
+
+    const char *dm_path = NULL;
+    mds_session_t *dm_session = NULL;
+    ret = mds_device_manager_get(manager, 0, &dm_path, &dm_session);
+    TEST_ASSERT(ret == 0 && dm_session != NULL, "Managed session available");
+    TEST_ASSERT(dm_path != NULL && strcmp(dm_path, events.last_path) == 0,
+                "Managed path matches attach event");
+    TEST_ASSERT(mds_device_manager_get(manager, 1, NULL, NULL) == -ENOENT,
+                "Out-of-range index rejected");
+
+    ret = mds_device_manager_scan(manager);
+    TEST_ASSERT(ret == 0 && events.attached == 1, "Rescan does not re-attach");
+
+    /* Destroy wakes a process() call blocked on another thread */
+    device_process_t process = { .manager = manager, .result = -1 };
+    pthread_t process_thread;
+    pthread_create(&process_thread, NULL, device_process_worker, &process);
+    usleep(50 * 1000);
+    uint64_t destroy_start = mds_time_monotonic_ns();
+    mds_device_manager_destroy(manager);
+    uint64_t destroy_ms = (mds_time_monotonic_ns() - destroy_start) / 1000000;
+    pthread_join(process_thread, NULL);
+    TEST_ASSERT(events.detached == 1, "Device detached on manager destroy");
+    TEST_ASSERT(process.result == 0 && destroy_ms < 500,
+                "Destroy wakes a waiting process call");
+
+    /* Usage page filter excludes non-MDS interfaces */
+    memset(&events, 0, sizeof(events));
+    dm_config.usage_page = 0xFF01;
+    ret = mds_device_manager_create(&dm_config, &manager);
+    TEST_ASSERT(ret == 0, "Device manager created with other usage page");
+    TEST_ASSERT(events.attached == 0 && mds_device_manager_count(manager) == 0,
+                "Non-matching usage page not attached");
+    mds_device_manager_destroy(manager);
+
     ret = memfault_hid_exit();
     TEST_ASSERT(ret == MEMFAULT_HID_SUCCESS, "Library shutdown");
 
@@ -7,10 +7,23 @@
 
 #include "mds_bridge/mds_protocol.h"
 #include "mds_bridge/chunks_uploader.h"
+#include "mds_bridge/chunks_scheduler.h"
+#include "mds_bridge/chunks_dedup.h"
+#include "mds_bridge/mds_sink.h"
+#include "mds_bridge/mds_arena.h"
 #include "mock_libcurl.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#include "mds_bridge/chunks_file_sink.h"
+#include "mds_bridge/mds_io.h"
+#include "mds_io_internal.h"
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 static int test_count = 0;
 static int test_passed = 0;
@@ -54,6 +67,200 @@ static int test_upload_callback(const char *uri, const char *auth_header,
     return data->last_result; /* Return configured result */
 }
 
+/* Chunks passed on by the deduplicator */
+typedef struct {
+    int count;
+    size_t bytes;
+    uint8_t headers[16];
+} dedup_test_data_t;
+
+static void test_dedup_forward(const char *device_id, const uint8_t *chunk, size_t len,
+                               void *user_data) {
+    dedup_test_data_t *data = (dedup_test_data_t *)user_data;
+    if (data->count < (int)sizeof(data->headers)) {
+        data->headers[data->count] = chunk[0];
+    }
+    data->count++;
+    data->bytes += len;
+    (void)device_id;
+}
+
+/* Split a message into Memfault chunks of up to payload_len bytes and feed
+ * them to the deduplicator; returns the number of chunks (max_chunks caps it) */
+static int test_dedup_send(chunks_dedup_t *dedup, const char *device_id,
+                           const uint8_t *msg, size_t msg_len, size_t payload_len,
+                           int max_chunks, dedup_test_data_t *data) {
+    int chunks = 0;
+    for (size_t offset = 0; offset < msg_len && chunks < max_chunks; offset += payload_len) {
+        uint8_t chunk[256];
+        size_t pos = 1;
+        size_t take = msg_len - offset < payload_len ? msg_len - offset : payload_len;
+        bool more = offset + take < msg_len;
+
+        chunk[0] = (uint8_t)((offset ? 0x80 : 0) | (more ? 0x40 : 0));
+        if (offset || more) {
+            size_t varint = offset ? offset : msg_len;
+            do {
+                chunk[pos++] = (uint8_t)((varint & 0x7F) | (varint > 0x7F ? 0x80 : 0));
+                varint >>= 7;
+            } while (varint);
+        }
+        memcpy(&chunk[pos], &msg[offset], take);
+        chunks_dedup_process(dedup, device_id, chunk, pos + take, test_dedup_forward, data);
+        chunks++;
+    }
+    return chunks;
+}
+
+#ifndef _WIN32
+/* Chunks read back from a segment file */
+typedef struct {
+    int count;
+    size_t bytes;
+    uint8_t first[16];
+    char uri[MDS_MAX_URI_LEN];
+    char auth[MDS_MAX_AUTH_LEN];
+} segment_test_data_t;
+
+static int test_segment_record(const chunks_file_segment_info_t *segment, const uint8_t *chunk,
+                               size_t len, mds_chunk_class_t chunk_class, void *user_data) {
+    segment_test_data_t *data = (segment_test_data_t *)user_data;
+    if (data->count < (int)sizeof(data->first)) {
+        data->first[data->count] = chunk[0];
+    }
+    data->count++;
+    data->bytes += len;
+    snprintf(data->uri, sizeof(data->uri), "%s", segment->uri);
+    snprintf(data->auth, sizeof(data->auth), "%s", segment->auth);
+    (void)chunk_class;
+    return 0;
+}
+
+/* Read a segment of a test device into data; returns the chunk count */
+static int test_segment_read(const char *dir, const char *name, segment_test_data_t *data) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/dev1/%s", dir, name);
+    memset(data, 0, sizeof(*data));
+    return chunks_file_segment_read(path, test_segment_record, data);
+}
+
+/* Read the index of a test device into buf */
+static size_t test_index_read(const char *dir, char *buf, size_t size) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/dev1/index", dir);
+    buf[0] = '\0';
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return 0;
+    }
+    size_t n = fread(buf, 1, size - 1, f);
+    buf[n] = '\0';
+    fclose(f);
+    return n;
+}
+
+/* Completions seen by the I/O engine test */
+typedef struct {
+    int completed;
+    int out_of_order;
+    int last_index;
+    int last_error;
+    size_t bytes;
+} io_test_data_t;
+
+static io_test_data_t io_test_data;
+static int io_test_index[64];
+
+static void test_io_done(int result, void *user_data) {
+    int index = user_data ? *(int *)user_data : -1;
+    if (index >= 0 && index <= io_test_data.last_index) {
+        io_test_data.out_of_order++;
+    }
+    if (index >= 0) {
+        io_test_data.last_index = index;
+    }
+    if (result < 0) {
+        io_test_data.last_error = result;
+    } else {
+        io_test_data.bytes += (size_t)result;
+    }
+    io_test_data.completed++;
+}
+
+/* Remove a test sink directory with one device */
+static void test_sink_remove(const char *dir) {
+    const char *names[] = { "index", "00000001.seg", "00000002.seg", "00000003.seg",
+                            "00000010.seg", "00000011.seg.gz" };
+    char path[512];
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        snprintf(path, sizeof(path), "%s/dev1/%s", dir, names[i]);
+        remove(path);
+    }
+    snprintf(path, sizeof(path), "%s/dev1", dir);
+    rmdir(path);
+    rmdir(dir);
+}
+
+/* Chunks written to a test sink (the first data byte numbers the chunk) */
+typedef struct {
+    int chunks;
+    int writes;
+    size_t max_batch;
+    int out_of_order;
+    int last_index;
+    size_t bytes;
+    bool uri_ok;
+    int result;
+    volatile int hold;  /* Write blocks while set */
+} sink_test_data_t;
+
+static int test_sink_write(const mds_sink_chunk_t *chunks, size_t count, void *user_data) {
+    sink_test_data_t *data = (sink_test_data_t *)user_data;
+    while (__atomic_load_n(&data->hold, __ATOMIC_ACQUIRE)) {
+        usleep(1000);
+    }
+    data->writes++;
+    data->max_batch = count > data->max_batch ? count : data->max_batch;
+    for (size_t i = 0; i < count; i++) {
+        if (data->chunks > 0 && chunks[i].data[0] <= data->last_index) {
+            data->out_of_order++;
+        }
+        data->last_index = chunks[i].data[0];
+        data->bytes += chunks[i].len;
+        data->uri_ok = strcmp(chunks[i].uri, "https://chunks.memfault.com/api/v0/chunks/test") == 0;
+        data->chunks++;
+    }
+    return data->result;
+}
+
+static bool test_sink_even(const mds_sink_chunk_t *chunk, void *user_data) {
+    (void)user_data;
+    return (chunk->data[0] & 1) == 0;
+}
+
+/* Feed count stream packets of 40 bytes, numbered from first, through a session */
+static int test_sink_feed(mds_session_t *session, const mds_device_config_t *config,
+                          int first, int count, int *coredumps) {
+    int failures = 0;
+    for (int i = first; i < first + count; i++) {
+        uint8_t report[2 + 40];
+        report[0] = (uint8_t)(i & MDS_SEQUENCE_MASK);
+        report[1] = 40;
+        memset(&report[2], 0x5A, 40);
+        report[2] = (uint8_t)i;
+
+        mds_stream_packet_t pkt;
+        if (mds_process_stream_from_bytes(session, config, report, sizeof(report), &pkt) != 0) {
+            failures++;
+        }
+        if (coredumps != NULL && pkt.chunk_class == MDS_CHUNK_CLASS_COREDUMP) {
+            (*coredumps)++;
+        }
+    }
+    return failures;
+}
+#endif
+
 int main(void) {
     int ret;
 
@@ -213,6 +420,577 @@ int main(void) {
     printf("  Total bytes: %zu\n", stats.bytes_uploaded);
     printf("  HTTP requests: %d\n", mock_curl_get_request_count());
 
+    /* Test 12: Fair Scheduling Across Devices */
+    TEST_START("Upload Scheduler Fairness");
+
+    chunks_scheduler_t *scheduler = chunks_scheduler_create(NULL);
+    TEST_ASSERT(scheduler != NULL, "Scheduler created");
+
+    /* A device with a coredump backlog, then one with time-sensitive events */
+    int bulk_chunks[20], high_chunks[20];
+    for (int i = 0; i < 20; i++) {
+        chunks_scheduler_enqueue(scheduler, "bulk-device", CHUNKS_PRIORITY_BULK, 1000, &bulk_chunks[i]);
+    }
+    for (int i = 0; i < 20; i++) {
+        chunks_scheduler_enqueue(scheduler, "high-device", CHUNKS_PRIORITY_HIGH, 1000, &high_chunks[i]);
+    }
+
+    void *chunk = NULL;
+    int wait_ms = 0;
+    int bulk_sent = 0, high_sent = 0;
+    bool in_order = true;
+    for (int i = 0; i < 10; i++) {
+        ret = chunks_scheduler_dequeue(scheduler, &chunk, &wait_ms);
+        if (ret != 0) {
+            break;
+        }
+        if (chunk == &bulk_chunks[bulk_sent]) {
+            bulk_sent++;
+        } else if (chunk == &high_chunks[high_sent]) {
+            high_sent++;
+        } else {
+            in_order = false;
+        }
+        chunks_scheduler_complete(scheduler, chunk, false);
+    }
+    TEST_ASSERT(ret == 0, "Ten chunks dispatched");
+    TEST_ASSERT(in_order, "Chunks of each device leave in order");
+    TEST_ASSERT(bulk_sent >= 1, "Bulk device is not starved");
+    TEST_ASSERT(high_sent >= 7, "High-priority device gets the weighted share");
+
+    /* One chunk per device in flight */
+    ret = chunks_scheduler_dequeue(scheduler, &chunk, &wait_ms);
+    void *second = NULL;
+    int ret2 = chunks_scheduler_dequeue(scheduler, &second, &wait_ms);
+    int ret3 = chunks_scheduler_dequeue(scheduler, &second, &wait_ms);
+    TEST_ASSERT(ret == 0 && ret2 == 0, "Both devices have a chunk in flight");
+    TEST_ASSERT(ret3 == -ENOENT, "No second chunk of a busy device");
+
+    /* A failed upload goes back to the front of its device queue */
+    chunks_scheduler_complete(scheduler, second, false);
+    TEST_ASSERT(chunks_scheduler_complete(scheduler, chunk, true) == 0, "Failed chunk requeued");
+    TEST_ASSERT(chunks_scheduler_complete(scheduler, chunk, false) == -EINVAL,
+                "Completing a chunk not in flight is rejected");
+
+    chunks_scheduler_stats_t sched_stats;
+    chunks_scheduler_get_stats(scheduler, &sched_stats);
+    TEST_ASSERT(sched_stats.active_devices == 2, "Both devices still active");
+    TEST_ASSERT(sched_stats.queued == 40 - 11 && sched_stats.in_flight == 0, "Queue accounting");
+    TEST_ASSERT(sched_stats.dispatched[CHUNKS_PRIORITY_HIGH] +
+                sched_stats.dispatched[CHUNKS_PRIORITY_BULK] == 12, "Dispatch counters");
+    TEST_ASSERT(chunks_scheduler_priority(MDS_CHUNK_CLASS_REBOOT) == CHUNKS_PRIORITY_HIGH &&
+                chunks_scheduler_priority(MDS_CHUNK_CLASS_HEARTBEAT) == CHUNKS_PRIORITY_HIGH,
+                "Reboots and heartbeats map to high priority");
+    TEST_ASSERT(chunks_scheduler_priority(MDS_CHUNK_CLASS_COREDUMP) == CHUNKS_PRIORITY_BULK &&
+                chunks_scheduler_priority(MDS_CHUNK_CLASS_UNKNOWN) == CHUNKS_PRIORITY_NORMAL,
+                "Coredumps map to bulk, unknown data to normal");
+    chunks_scheduler_destroy(scheduler, NULL);
+
+    /* Test 13: Per-device and Global Rate Limits */
+    TEST_START("Upload Scheduler Rate Limits");
+
+    chunks_scheduler_config_t sched_config;
+    chunks_scheduler_default_config(&sched_config);
+    sched_config.device_limit.rate_bytes_per_sec = 1000;
+    scheduler = chunks_scheduler_create(&sched_config);
+
+    int limited[3], unlimited[1];
+    for (int i = 0; i < 3; i++) {
+        chunks_scheduler_enqueue(scheduler, "chatty", CHUNKS_PRIORITY_NORMAL, 600, &limited[i]);
+    }
+
+    ret = chunks_scheduler_dequeue(scheduler, &chunk, &wait_ms);
+    chunks_scheduler_complete(scheduler, chunk, false);
+    ret2 = chunks_scheduler_dequeue(scheduler, &chunk, &wait_ms);
+    chunks_scheduler_complete(scheduler, chunk, false);
+    TEST_ASSERT(ret == 0 && ret2 == 0, "Burst allows the first chunks");
+
+    wait_ms = 0;
+    ret = chunks_scheduler_dequeue(scheduler, &chunk, &wait_ms);
+    TEST_ASSERT(ret == -EAGAIN, "Device over its rate is held back");
+    TEST_ASSERT(wait_ms > 0 && wait_ms <= 200, "Wait time reflects the token debt");
+
+    chunks_scheduler_enqueue(scheduler, "quiet", CHUNKS_PRIORITY_NORMAL, 600, &unlimited[0]);
+    ret = chunks_scheduler_dequeue(scheduler, &chunk, &wait_ms);
+    TEST_ASSERT(ret == 0 && chunk == &unlimited[0], "Other devices are not held back");
+    chunks_scheduler_complete(scheduler, chunk, false);
+
+    /* Global cap: 600 + 1500 bytes put the shared 1000-byte bucket into debt */
+    sched_config.device_limit.rate_bytes_per_sec = 0;
+    sched_config.global_limit.rate_bytes_per_sec = 1000;
+    TEST_ASSERT(chunks_scheduler_set_config(scheduler, &sched_config) == 0, "Config updated");
+    ret = chunks_scheduler_dequeue(scheduler, &chunk, &wait_ms);
+    TEST_ASSERT(ret == 0 && chunk == &limited[2], "Device limit lifted");
+    chunks_scheduler_complete(scheduler, chunk, false);
+
+    chunks_scheduler_enqueue(scheduler, "a", CHUNKS_PRIORITY_HIGH, 1500, &unlimited[0]);
+    chunks_scheduler_enqueue(scheduler, "b", CHUNKS_PRIORITY_HIGH, 1500, &limited[0]);
+
+    ret = chunks_scheduler_dequeue(scheduler, &chunk, &wait_ms);
+    TEST_ASSERT(ret == 0, "Chunk larger than the burst is not stuck");
+    void *held = chunk;
+    ret = chunks_scheduler_dequeue(scheduler, &chunk, &wait_ms);
+    TEST_ASSERT(ret == -EAGAIN && wait_ms > 0 && wait_ms <= 1100, "Global cap holds back all devices");
+
+    /* Requeueing refunds the tokens */
+    chunks_scheduler_complete(scheduler, held, true);
+    ret = chunks_scheduler_dequeue(scheduler, &chunk, &wait_ms);
+    TEST_ASSERT(ret == 0, "Refunded tokens allow a retry");
+
+    chunks_scheduler_get_stats(scheduler, &sched_stats);
+    TEST_ASSERT(sched_stats.throttled == 2, "Throttled attempts counted");
+    chunks_scheduler_complete(scheduler, chunk, false);
+    chunks_scheduler_destroy(scheduler, NULL);
+
+    /* Test 14: Deduplication of Re-sent Messages */
+    TEST_START("Chunk Deduplication");
+
+    uint8_t msg_a[100], msg_b[100];
+    for (size_t i = 0; i < sizeof(msg_a); i++) {
+        msg_a[i] = (uint8_t)i;
+        msg_b[i] = (uint8_t)(i < 80 ? i : 0xEE);  /* Same prefix, different tail */
+    }
+    dedup_test_data_t fwd;
+    chunks_dedup_stats_t dedup_stats;
+    chunks_dedup_t *dedup = chunks_dedup_create(NULL);
+    TEST_ASSERT(dedup != NULL, "Deduplicator created");
+
+    memset(&fwd, 0, sizeof(fwd));
+    test_dedup_send(dedup, "dev1", msg_a, sizeof(msg_a), 40, 99, &fwd);
+    TEST_ASSERT(fwd.count == 3 && fwd.headers[0] == 0x40 && fwd.headers[2] == 0x80,
+                "New message forwarded in order");
+
+    memset(&fwd, 0, sizeof(fwd));
+    test_dedup_send(dedup, "dev1", msg_a, sizeof(msg_a), 30, 99, &fwd);
+    TEST_ASSERT(fwd.count == 0, "Re-sent message dropped despite different chunking");
+    test_dedup_send(dedup, "dev2", msg_a, sizeof(msg_a), 30, 99, &fwd);
+    TEST_ASSERT(fwd.count == 4, "Same message from another device forwarded");
+
+    memset(&fwd, 0, sizeof(fwd));
+    test_dedup_send(dedup, "dev1", msg_b, sizeof(msg_b), 30, 99, &fwd);
+    TEST_ASSERT(fwd.count == 4 && fwd.headers[0] == 0x40 && fwd.headers[1] == 0xC0 &&
+                fwd.headers[3] == 0x80, "Held chunks released in order when content differs");
+
+    memset(&fwd, 0, sizeof(fwd));
+    test_dedup_send(dedup, "dev1", msg_a, sizeof(msg_a), 30, 2, &fwd);
+    test_dedup_send(dedup, "dev1", msg_a, 10, 30, 99, &fwd);
+    chunks_dedup_get_stats(dedup, &dedup_stats);
+    TEST_ASSERT(fwd.count == 1 && fwd.bytes == 11 && dedup_stats.abandoned_chunks == 2,
+                "Interrupted duplicate dropped, next message forwarded");
+
+    memset(&fwd, 0, sizeof(fwd));
+    size_t held_bytes = 0;
+    test_dedup_send(dedup, "dev1", msg_a, sizeof(msg_a), 30, 2, &fwd);
+    chunks_dedup_get_held_bytes(dedup, "dev1", &held_bytes);
+    TEST_ASSERT(fwd.count == 0 && held_bytes == 64, "Held bytes reported per device");
+    ret = chunks_dedup_flush(dedup, "dev1", test_dedup_forward, &fwd);
+    TEST_ASSERT(ret == 2 && fwd.count == 2, "Flush forwards held chunks");
+    chunks_dedup_get_held_bytes(dedup, "dev1", &held_bytes);
+    TEST_ASSERT(held_bytes == 0 && fwd.bytes == 64, "Flushed bytes no longer held");
+    ret = chunks_dedup_get_held_bytes(dedup, "dev9", &held_bytes);
+    TEST_ASSERT(ret == 0 && held_bytes == 0, "Unknown device holds nothing");
+
+    chunks_dedup_get_stats(dedup, &dedup_stats);
+    TEST_ASSERT(dedup_stats.devices == 2 && dedup_stats.duplicate_messages == 1 &&
+                dedup_stats.duplicate_chunks == 4 && dedup_stats.held_bytes == 0,
+                "Deduplication statistics");
+
+    /* Remembered messages survive a restart */
+    const char *dedup_path = "test_dedup.db";
+    TEST_ASSERT(chunks_dedup_save(dedup, dedup_path) == 0, "Hashes saved");
+    chunks_dedup_destroy(dedup);
+
+    chunks_dedup_config_t dedup_config;
+    chunks_dedup_default_config(&dedup_config);
+    dedup_config.max_messages = 2;
+    dedup = chunks_dedup_create(&dedup_config);
+    ret = chunks_dedup_load(dedup, dedup_path);
+    TEST_ASSERT(ret == 3, "Hashes loaded up to the per-device limit");
+    memset(&fwd, 0, sizeof(fwd));
+    test_dedup_send(dedup, "dev2", msg_a, sizeof(msg_a), 50, 99, &fwd);
+    TEST_ASSERT(fwd.count == 0, "Duplicate detected after reload");
+    TEST_ASSERT(chunks_dedup_load(dedup, "missing_dedup.db") == -ENOENT, "Missing file reported");
+    chunks_dedup_destroy(dedup);
+    remove(dedup_path);
+
+    /* Every tracked device holds chunks: further devices pass through */
+    chunks_dedup_default_config(&dedup_config);
+    dedup_config.max_devices = 1;
+    dedup = chunks_dedup_create(&dedup_config);
+    test_dedup_send(dedup, "dev1", msg_a, sizeof(msg_a), 30, 99, &fwd);
+    test_dedup_send(dedup, "dev1", msg_a, sizeof(msg_a), 30, 2, &fwd);
+    memset(&fwd, 0, sizeof(fwd));
+    test_dedup_send(dedup, "dev2", msg_a, sizeof(msg_a), 30, 99, &fwd);
+    test_dedup_send(dedup, "dev2", msg_a, sizeof(msg_a), 30, 99, &fwd);
+    chunks_dedup_get_stats(dedup, &dedup_stats);
+    TEST_ASSERT(fwd.count == 8 && dedup_stats.devices == 1 && dedup_stats.held_bytes > 0,
+                "Devices beyond max_devices pass through while all hold chunks");
+    chunks_dedup_destroy(dedup);
+
+#ifndef _WIN32
+    /* Test 15: Batched Uploads and Offline Storage */
+    TEST_START("Chunk File Sink and Batch Upload");
+
+    mock_curl_reset();
+    mock_curl_set_response(200, CURLE_OK);
+    const uint8_t batch_a[] = { 0x01, 0x02 }, batch_b[] = { 0x03 }, batch_c[] = { 0x04, 0x05 };
+    const uint8_t *const batch[] = { batch_a, batch_b, batch_c };
+    const size_t batch_lens[] = { sizeof(batch_a), sizeof(batch_b), sizeof(batch_c) };
+    size_t body_len;
+    chunks_uploader_get_stats(uploader, &stats);
+    size_t chunks_before = stats.chunks_uploaded;
+    ret = chunks_uploader_upload_batch(uploader, test_uri, test_auth, batch, batch_lens, 3);
+    const uint8_t *body = mock_curl_get_last_data(&body_len);
+    chunks_uploader_get_stats(uploader, &stats);
+    TEST_ASSERT(ret == 0 && mock_curl_get_request_count() == 1 &&
+                stats.chunks_uploaded == chunks_before + 3, "Three chunks sent in one request");
+    TEST_ASSERT(strstr(mock_curl_get_last_headers(), "multipart/mixed; boundary=") != NULL &&
+                body_len > 4 && memcmp(&body[body_len - 4], "--\r\n", 4) == 0,
+                "Batch sent as multipart body");
+
+    char sink_dir[] = "/tmp/mds_sink_XXXXXX";
+    TEST_ASSERT(mkdtemp(sink_dir) != NULL, "Sink directory created");
+
+    chunks_file_sink_config_t sink_config;
+    chunks_file_sink_default_config(&sink_config);
+    sink_config.flush_interval_ms = 0;
+    chunks_file_sink_t *sink = chunks_file_sink_create(sink_dir, &sink_config);
+    uint8_t sink_chunk[100];
+    memset(sink_chunk, 0x5A, sizeof(sink_chunk));
+    for (int i = 0; i < 20; i++) {
+        sink_chunk[0] = (uint8_t)i;
+        chunks_file_sink_write(sink, "dev1", test_uri, test_auth, sink_chunk,
+                               sizeof(sink_chunk), MDS_CHUNK_CLASS_TRACE);
+    }
+
+    chunks_file_sink_stats_t sink_stats;
+    char index[512];
+    chunks_file_sink_get_stats(sink, &sink_stats);
+    TEST_ASSERT(sink_stats.chunks_written == 20 && sink_stats.writes == 0 &&
+                test_index_read(sink_dir, index, sizeof(index)) == 0,
+                "Chunks buffered, open segment not indexed");
+
+    chunks_file_sink_rotate(sink);
+    chunks_file_sink_get_stats(sink, &sink_stats);
+    test_index_read(sink_dir, index, sizeof(index));
+    TEST_ASSERT(sink_stats.writes == 1 && sink_stats.segments_closed == 1 &&
+                strcmp(index, "00000001.seg 20 2000\n") == 0, "Rotation writes and indexes segment");
+
+    segment_test_data_t seg;
+    ret = test_segment_read(sink_dir, "00000001.seg", &seg);
+    TEST_ASSERT(ret == 20 && seg.bytes == 2000 && seg.first[0] == 0 && seg.first[15] == 15 &&
+                strcmp(seg.uri, test_uri) == 0 && strcmp(seg.auth, test_auth) == 0,
+                "Segment read back in order");
+
+    chunks_file_sink_write(sink, "dev1", test_uri, test_auth, sink_chunk, 10, MDS_CHUNK_CLASS_LOG);
+    chunks_file_sink_write(sink, "dev1", "https://example.com/other", test_auth, sink_chunk, 10,
+                           MDS_CHUNK_CLASS_LOG);
+    chunks_file_sink_destroy(sink);
+    TEST_ASSERT(test_segment_read(sink_dir, "00000002.seg", &seg) == 1 &&
+                test_segment_read(sink_dir, "00000003.seg", &seg) == 1 &&
+                strcmp(seg.uri, "https://example.com/other") == 0, "New URI starts a new segment");
+
+    /* A segment missing from the index (crash) is indexed on the next start */
+    char old_path[512], new_path[512];
+    snprintf(old_path, sizeof(old_path), "%s/dev1/00000003.seg", sink_dir);
+    snprintf(new_path, sizeof(new_path), "%s/dev1/00000010.seg", sink_dir);
+    rename(old_path, new_path);
+    sink_config.compress = chunks_file_sink_compression_supported();
+    sink = chunks_file_sink_create(sink_dir, &sink_config);
+    chunks_file_sink_write(sink, "dev1", test_uri, test_auth, sink_chunk, 50, MDS_CHUNK_CLASS_LOG);
+    chunks_file_sink_destroy(sink);
+    test_index_read(sink_dir, index, sizeof(index));
+    TEST_ASSERT(strstr(index, "00000010.seg 1 10\n") != NULL &&
+                strstr(index, "00000003.seg") == NULL, "Unindexed segment recovered");
+
+    const char *next_segment = sink_config.compress ? "00000011.seg.gz" : "00000011.seg";
+    TEST_ASSERT(test_segment_read(sink_dir, next_segment, &seg) == 1 && seg.bytes == 50,
+                "Numbering continues after recovered segment");
+    printf("  Compression: %s\n", sink_config.compress ? "gzip" : "not available");
+    test_sink_remove(sink_dir);
+
+    /* Test 16: Asynchronous writes through the I/O engine */
+    TEST_START("I/O Engine");
+
+    const mds_io_backend_t io_backends[] = { MDS_IO_BACKEND_AUTO, MDS_IO_BACKEND_THREADS };
+    for (size_t b = 0; b < sizeof(io_backends) / sizeof(io_backends[0]); b++) {
+        mds_io_config_t io_config;
+        mds_io_default_config(&io_config);
+        io_config.backend = io_backends[b];
+        mds_io_t *io = mds_io_create(&io_config);
+        printf("  Backend: %s\n", mds_io_backend_name(mds_io_get_backend(io)));
+
+        char io_path[] = "/tmp/mds_io_XXXXXX";
+        int io_fd = mkstemp(io_path);
+        fcntl(io_fd, F_SETFL, O_APPEND);
+        uint8_t blocks[40][64];
+        memset(&io_test_data, 0, sizeof(io_test_data));
+        io_test_data.last_index = -1;
+        for (int i = 0; i < 40; i++) {
+            memset(blocks[i], i, sizeof(blocks[i]));
+            io_test_index[i] = i;
+            mds_io_write(io, io_fd, blocks[i], sizeof(blocks[i]), -1, test_io_done, &io_test_index[i]);
+        }
+        io_test_index[40] = 40;
+        mds_io_fsync(io, io_fd, true, test_io_done, &io_test_index[40]);
+        mds_io_drain(io);
+
+        mds_io_stats_t io_stats;
+        mds_io_get_stats(io, &io_stats);
+        uint8_t readback[40 * 64];
+        ssize_t read_len = pread(io_fd, readback, sizeof(readback), 0);
+        TEST_ASSERT(io_test_data.completed == 41 && io_test_data.out_of_order == 0 &&
+                    io_test_data.bytes == sizeof(readback) && read_len == (ssize_t)sizeof(readback) &&
+                    readback[64] == 1 && readback[sizeof(readback) - 1] == 39,
+                    "Writes and fsync on one file complete in order");
+        TEST_ASSERT(io_stats.requests == 41 && io_stats.failures == 0 && io_stats.pending == 0 &&
+                    io_stats.submissions < 41, "Requests submitted in batches");
+
+        close(io_fd);
+        remove(io_path);
+        mds_io_write(io, io_fd, blocks[0], sizeof(blocks[0]), 0, test_io_done, NULL);
+        mds_io_drain(io);
+        TEST_ASSERT(io_test_data.last_error == -EBADF, "Failed write reported to its callback");
+        mds_io_destroy(io);
+    }
+
+#ifdef MDS_IO_FAULT_INJECTION
+    /* A short write at the head of a linked batch: the kernel cancels the
+     * rest of the batch, which must be rerun rather than reported */
+    mds_io_t *short_io = mds_io_create(NULL);
+    if (mds_io_get_backend(short_io) == MDS_IO_BACKEND_IO_URING) {
+        char io_path[] = "/tmp/mds_io_XXXXXX";
+        int io_fd = mkstemp(io_path);
+        fcntl(io_fd, F_SETFL, O_APPEND);
+        uint8_t blocks[4][64];
+        memset(&io_test_data, 0, sizeof(io_test_data));
+        io_test_data.last_index = -1;
+        mds_io_fault_short_writes = 1;
+        for (int i = 0; i < 4; i++) {
+            memset(blocks[i], i, sizeof(blocks[i]));
+            io_test_index[i] = i;
+            mds_io_write(short_io, io_fd, blocks[i], sizeof(blocks[i]), -1, test_io_done,
+                         &io_test_index[i]);
+        }
+        io_test_index[4] = 4;
+        mds_io_fsync(short_io, io_fd, true, test_io_done, &io_test_index[4]);
+        mds_io_drain(short_io);
+
+        mds_io_stats_t io_stats;
+        mds_io_get_stats(short_io, &io_stats);
+        uint8_t readback[4 * 64 + 1];
+        ssize_t read_len = pread(io_fd, readback, sizeof(readback), 0);
+        TEST_ASSERT(mds_io_fault_short_writes == 0 && io_test_data.completed == 5 &&
+                    io_test_data.out_of_order == 0 && io_test_data.last_error == 0 &&
+                    io_stats.failures == 0, "Requests linked behind a short write rerun");
+        TEST_ASSERT(read_len == 4 * 64 && readback[0] == 0 && readback[63] == 0 &&
+                    readback[64] == 1 && readback[255] == 3, "Short write completed before the rest");
+        close(io_fd);
+        remove(io_path);
+    }
+    mds_io_destroy(short_io);
+#endif
+
+    /* The file sink writes through the engine */
+    TEST_ASSERT(mkdtemp(strcpy(sink_dir, "/tmp/mds_sink_XXXXXX")) != NULL, "Sink directory created");
+    mds_io_t *sink_io = mds_io_create(NULL);
+    chunks_file_sink_default_config(&sink_config);
+    sink_config.buffer_bytes = 4096;
+    sink_config.sync = true;
+    sink_config.io = sink_io;
+    sink = chunks_file_sink_create(sink_dir, &sink_config);
+    for (int i = 0; i < 100; i++) {
+        sink_chunk[0] = (uint8_t)i;
+        chunks_file_sink_write(sink, "dev1", test_uri, test_auth, sink_chunk,
+                               sizeof(sink_chunk), MDS_CHUNK_CLASS_TRACE);
+    }
+    chunks_file_sink_destroy(sink);
+    mds_io_destroy(sink_io);
+    ret = test_segment_read(sink_dir, "00000001.seg", &seg);
+    TEST_ASSERT(ret == 100 && seg.bytes == 10000 && seg.first[0] == 0 && seg.first[15] == 15,
+                "Segment written through the engine reads back in order");
+    test_sink_remove(sink_dir);
+
+    /* Test 17: Several sinks fed by one session */
+    TEST_START("Session Sinks");
+
+    mds_session_t *sink_session = NULL;
+    mds_session_create(NULL, &sink_session);
+    mds_device_config_t sink_device;
+    memset(&sink_device, 0, sizeof(sink_device));
+    snprintf(sink_device.data_uri, sizeof(sink_device.data_uri), "%s", test_uri);
+    snprintf(sink_device.authorization, sizeof(sink_device.authorization), "%s", test_auth);
+
+    memset(&upload_data, 0, sizeof(upload_data));
+    mds_set_upload_callback(sink_session, test_upload_callback, &upload_data);
+
+    sink_test_data_t inline_data = {0}, async_data = {0}, class_data = {0};
+    mds_sink_t *inline_sink = NULL, *async_sink = NULL, *class_sink = NULL;
+    mds_sink_config_t sink_cfg;
+    mds_sink_default_config(&sink_cfg);
+    sink_cfg.name = "analytics";
+    sink_cfg.required = false;
+    sink_cfg.filter = test_sink_even;
+    sink_cfg.write = test_sink_write;
+    sink_cfg.user_data = &inline_data;
+    inline_data.result = -EIO;
+    ret = mds_session_add_sink(sink_session, &sink_cfg, &inline_sink);
+
+    mds_sink_default_config(&sink_cfg);
+    sink_cfg.name = "archive";
+    sink_cfg.mode = MDS_SINK_ASYNC;
+    sink_cfg.max_batch = 8;
+    sink_cfg.max_delay_ms = 20;
+    sink_cfg.write = test_sink_write;
+    sink_cfg.user_data = &async_data;
+    ret |= mds_session_add_sink(sink_session, &sink_cfg, &async_sink);
+
+    sink_cfg.name = "coredumps";
+    sink_cfg.class_mask = MDS_SINK_CLASS(MDS_CHUNK_CLASS_COREDUMP);
+    sink_cfg.user_data = &class_data;
+    ret |= mds_session_add_sink(sink_session, &sink_cfg, &class_sink);
+    TEST_ASSERT(ret == 0, "Inline and async sinks attached next to the upload callback");
+
+    int coredumps = 0;
+    int failures = test_sink_feed(sink_session, &sink_device, 0, 64, &coredumps);
+    TEST_ASSERT(failures == 0 && upload_data.upload_count == 64,
+                "Upload callback sees every chunk");
+
+    mds_sink_stats_t sink_stat;
+    mds_sink_get_stats(inline_sink, &sink_stat);
+    TEST_ASSERT(inline_data.chunks == 32 && sink_stat.chunks_filtered == 32 &&
+                sink_stat.chunks_failed == 32, "Filter applied, optional sink failures ignored");
+
+    TEST_ASSERT(mds_sink_flush(async_sink, 1000) == 0, "Async sink flushed");
+    mds_sink_get_stats(async_sink, &sink_stat);
+    TEST_ASSERT(async_data.chunks == 64 && async_data.out_of_order == 0 &&
+                async_data.bytes == 64 * 40 && async_data.uri_ok && sink_stat.queued == 0,
+                "Async sink receives every chunk in order");
+    TEST_ASSERT(sink_stat.writes < 64 && async_data.max_batch > 1 && async_data.max_batch <= 8,
+                "Async chunks written in batches");
+
+    mds_sink_flush(class_sink, 1000);
+    mds_sink_get_stats(class_sink, &sink_stat);
+    TEST_ASSERT(class_data.chunks == coredumps && sink_stat.chunks_filtered == (uint64_t)(64 - coredumps),
+                "Sink takes only its chunk classes");
+
+    /* A failing upload callback fails the packet; without it nothing does */
+    upload_data.last_result = -5;
+    TEST_ASSERT(test_sink_feed(sink_session, &sink_device, 64, 1, NULL) == 1,
+                "Required sink failure fails the packet");
+    mds_set_upload_callback(sink_session, NULL, NULL);
+    TEST_ASSERT(test_sink_feed(sink_session, &sink_device, 65, 1, NULL) == 0 &&
+                upload_data.upload_count == 65, "Upload callback removed");
+    TEST_ASSERT(mds_session_remove_sink(sink_session, inline_sink) == 0 &&
+                mds_session_remove_sink(sink_session, inline_sink) == -ENOENT, "Sink removed");
+
+    /* A full queue drops chunks for that sink only */
+    sink_test_data_t slow_data = {0};
+    slow_data.hold = 1;
+    mds_sink_t *slow_sink = NULL;
+    mds_sink_default_config(&sink_cfg);
+    sink_cfg.mode = MDS_SINK_ASYNC;
+    sink_cfg.queue_depth = 2;
+    sink_cfg.max_batch = 1;
+    sink_cfg.drop_when_full = true;
+    sink_cfg.write = test_sink_write;
+    sink_cfg.user_data = &slow_data;
+    mds_session_add_sink(sink_session, &sink_cfg, &slow_sink);
+    test_sink_feed(sink_session, &sink_device, 100, 5, NULL);
+    mds_sink_stats_t slow_stat;
+    mds_sink_get_stats(slow_sink, &slow_stat);
+    __atomic_store_n(&slow_data.hold, 0, __ATOMIC_RELEASE);
+    mds_sink_flush(slow_sink, 1000);
+    mds_sink_flush(async_sink, 1000);
+    mds_session_remove_sink(sink_session, slow_sink);
+    TEST_ASSERT(slow_stat.chunks_dropped >= 2 && slow_stat.chunks_accepted + slow_stat.chunks_dropped == 5 &&
+                slow_data.chunks == (int)slow_stat.chunks_accepted && async_data.chunks == 71,
+                "Full queue drops chunks without holding up other sinks");
+
+    /* Uploads batched into multipart requests by an async sink */
+    mock_curl_reset();
+    mock_curl_set_response(200, CURLE_OK);
+    chunks_uploader_get_stats(uploader, &stats);
+    chunks_before = stats.chunks_uploaded;
+    mds_sink_t *upload_sink = NULL;
+    mds_sink_default_config(&sink_cfg);
+    sink_cfg.mode = MDS_SINK_ASYNC;
+    sink_cfg.max_delay_ms = 20;
+    sink_cfg.write = chunks_uploader_batch_callback;
+    sink_cfg.user_data = uploader;
+    mds_session_add_sink(sink_session, &sink_cfg, &upload_sink);
+    test_sink_feed(sink_session, &sink_device, 110, 16, NULL);
+    mds_sink_flush(upload_sink, 1000);
+    chunks_uploader_get_stats(uploader, &stats);
+    TEST_ASSERT(stats.chunks_uploaded == chunks_before + 16 && mock_curl_get_request_count() < 16,
+                "Uploader batch callback shares requests");
+
+    mds_session_destroy(sink_session);  /* Writes what async sinks have queued */
+    TEST_ASSERT(class_data.chunks + async_data.chunks > 0, "Session destroyed with sinks attached");
+#endif
+
+    /* Test 18: Arena allocator */
+    TEST_START("Arena Allocator");
+
+    mds_arena_t *arena = mds_arena_create(256);
+    mds_arena_stats_t arena_stats;
+    uint8_t *a1 = mds_arena_alloc(arena, 3);
+    uint8_t *a2 = mds_arena_alloc(arena, 5);
+    TEST_ASSERT(a1 != NULL && a2 != NULL && ((uintptr_t)a1 % 16) == 0 &&
+                ((uintptr_t)a2 % 16) == 0 && a2 != a1, "Allocations aligned");
+
+    mds_arena_mark_t mark = mds_arena_mark(arena);
+    uint8_t *a3 = mds_arena_alloc(arena, 32);
+    mds_arena_rewind(arena, mark);
+    TEST_ASSERT(mds_arena_alloc(arena, 32) == a3, "Rewind releases allocations after mark");
+
+    char *str = mds_arena_printf(arena, "%s-%d", "chunk", 42);
+    uint8_t *zeros = mds_arena_calloc(arena, 4, 8);
+    TEST_ASSERT(str != NULL && strcmp(str, "chunk-42") == 0 && zeros != NULL &&
+                zeros[0] == 0 && zeros[31] == 0, "printf and calloc");
+
+    for (int i = 0; i < 8; i++) {
+        mds_arena_alloc(arena, 100);
+    }
+    TEST_ASSERT(mds_arena_alloc(arena, 2000) != NULL, "Allocation larger than a block");
+    mds_arena_get_stats(arena, &arena_stats);
+    uint64_t grows = arena_stats.grows;
+    TEST_ASSERT(grows > 0 && arena_stats.blocks == grows + 1 &&
+                arena_stats.used == arena_stats.high_water, "Arena grows when full");
+
+    mds_arena_reset(arena);
+    TEST_ASSERT(mds_arena_alloc(arena, 3) == a1, "Reset starts over at the first block");
+    for (int i = 0; i < 8; i++) {
+        mds_arena_alloc(arena, 100);
+    }
+    mds_arena_alloc(arena, 2000);
+    mds_arena_get_stats(arena, &arena_stats);
+    TEST_ASSERT(arena_stats.grows == grows && arena_stats.resets == 1,
+                "Blocks reused after reset");
+
+    mds_arena_trim(arena);
+    mds_arena_get_stats(arena, &arena_stats);
+    TEST_ASSERT(arena_stats.blocks == 1 && arena_stats.used == 0 &&
+                arena_stats.capacity == 256, "Trim keeps the first block only");
+    TEST_ASSERT(mds_arena_get_stats(NULL, &arena_stats) == -EINVAL &&
+                mds_arena_alloc(NULL, 1) == NULL, "Invalid parameters rejected");
+    mds_arena_destroy(arena);
+
+    /* Uploader request headers and boundary are reused across batches */
+    mock_curl_reset();
+    mock_curl_set_response(200, CURLE_OK);
+    const uint8_t part_a[] = { 0x10, 0x11 }, part_b[] = { 0x12 };
+    const uint8_t *const parts[] = { part_a, part_b };
+    const size_t part_lens[] = { sizeof(part_a), sizeof(part_b) };
+    char first_headers[512];
+    chunks_uploader_upload_batch(uploader, test_uri, test_auth, parts, part_lens, 2);
+    snprintf(first_headers, sizeof(first_headers), "%s", mock_curl_get_last_headers());
+    chunks_uploader_upload_batch(uploader, test_uri, test_auth, parts, part_lens, 2);
+    TEST_ASSERT(mock_curl_get_request_count() == 2 &&
+                strcmp(first_headers, mock_curl_get_last_headers()) == 0 &&
+                strstr(first_headers, "Memfault-Project-Key: ") != NULL,
+                "Batches share headers");
+
     /* Cleanup */
     TEST_START("Cleanup");
     chunks_uploader_destroy(uploader);